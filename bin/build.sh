@@ -1,7 +1,26 @@
 #!/bin/sh
-#../src/objanalyze.cc
+../src/objanalyze.cc
 ../src/objcompress.cc
+../src/objgen.cc
 ../src/testing/all_codepoints.cc
+../src/testing/bvh_benchmark.cc
+../src/testing/bvh_test.cc
+../src/testing/cache_test.cc
+../src/testing/cleanup_test.cc
+../src/testing/cluster_test.cc
 ../src/testing/good_codepoints.cc
 ../src/testing/hex_sanity.cc
+../src/testing/normals_test.cc
+../src/testing/overdraw_test.cc
+../src/testing/pipeline_benchmark.cc
+../src/testing/progressive_test.cc
+../src/testing/quantize_test.cc
+../src/testing/reorder_test.cc
+../src/testing/simplify_test.cc
+../src/testing/stream_benchmark.cc
+../src/testing/tangents_test.cc
+../src/testing/texcoord_test.cc
+../src/testing/triangulate_test.cc
+../src/testing/utf8_test.cc
 ../src/testing/wavefront_obj_file_test.cc
+../src/testing/weld_test.cc
@@ -1,7 +1,26 @@
 #!/bin/sh
-# rm -f objanalyze
+rm -f objanalyze
 rm -f objcompress
+rm -f objgen
 rm -f all_codepoints
+rm -f bvh_benchmark
+rm -f bvh_test
+rm -f cache_test
+rm -f cleanup_test
+rm -f cluster_test
 rm -f good_codepoints
 rm -f hex_sanity
+rm -f normals_test
+rm -f overdraw_test
+rm -f pipeline_benchmark
+rm -f progressive_test
+rm -f quantize_test
+rm -f reorder_test
+rm -f simplify_test
+rm -f stream_benchmark
+rm -f tangents_test
+rm -f texcoord_test
+rm -f triangulate_test
+rm -f utf8_test
 rm -f wavefront_obj_file_test
+rm -f weld_test
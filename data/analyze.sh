@@ -1,4 +1,8 @@
 #!/bin/sh
-../bin/objanalyze ben_00.obj
-../bin/objanalyze hand_00.obj
-../bin/objanalyze happy.obj
+# Fails if vertex cache efficiency or compressed size regress past the
+# stored baselines. Regenerate a baseline with --write-baseline=FILE.
+status=0
+for model in ben_00 hand_00 happy; do
+  ../bin/objanalyze --baseline=$model.baseline $model.obj || status=1
+done
+exit $status
@@ -4,16 +4,29 @@
 // name: {
 //   materials: { 'material_name': { ... } ... },
 //   decodeParams: {
-//     decodeOffsets: [ ... ],
-//     decodeScales: [ ... ],
+//     decodeOffsets: [ ... ],  // 8 columns, 10 with tangents (see
+//     decodeScales: [ ... ],   // tangentFromAngle), then 3 of RGB in
+//                              // [0, 1] for models with colors.
 //   },
 //   urls: {
 //     'url': [
 //       { material: 'material_name',
 //         attribRange: [#, #],
 //         indexRange: [#, #],
+//         indexFormat: 'varint32', 'zigzag' or 'levels',  // Optional.
+//         indexCodes: #,  // With indexFormat, the encoded length.
+//         levels: [[#, #, #, #, #], ...],  // See decompressLevel_.
+//         levelLengths: [[#, # ...], ...],  // With levels, the lengths
+//                                           // of each level, for names.
+//         lod: #,  // Optional; coarser levels of detail count up from 1.
+//         bboxes: #,  // Or, with bvh, see decompressBVH_.
+//         bvh: [#, #],  // Optional; shared by every mesh of the url.
 //         names: [ 'object names' ... ],
-//         lengths: [#, #, # ... ]
+//         lengths: [#, #, # ... ],
+//         groups: [#, #, # ... ],  // With bvh, the BVH group of each name.
+//         clusters: [#, #],  // Optional; see decompressClusters_.
+//         decodeParams: { ... }  // Optional; with --uv-bounds, the
+//                                // params of this mesh's material.
 //       }
 //     ],
 //     ...
@@ -64,6 +77,150 @@ function decompressIndices_(str, inputStart, numIndices,
   }
 }
 
+// Each high water mark delta is split into 14-bit groups, least
+// significant first. Codes in [0x8000, 0xC000) carry a group and say
+// that more follow; a code below 0x8000 carries the last one.
+function decompressVarintIndices_(str, inputStart, numIndices,
+                                  output, outputStart) {
+  var highest = 0;
+  for (var i = 0; i < numIndices; i++) {
+    var delta = 0;
+    var scale = 1;
+    var code = str.charCodeAt(inputStart++);
+    while (code >= 0x8000) {
+      delta += scale * (code - 0x8000);
+      scale *= 0x4000;
+      code = str.charCodeAt(inputStart++);
+    }
+    delta += scale * code;
+    output[outputStart++] = highest - delta;
+    if (delta == 0) {
+      highest++;
+    }
+  }
+}
+
+// Indices of meshes whose vertices are not in first-use order: each
+// is ZigZag(next - index) in the same variable-length codes, where
+// next is one past the largest index so far.
+function decompressZigZagIndices_(str, inputStart, numIndices,
+                                  output, outputStart) {
+  var next = 0;
+  for (var i = 0; i < numIndices; i++) {
+    var zigzag = 0;
+    var scale = 1;
+    var code = str.charCodeAt(inputStart++);
+    while (code >= 0x8000) {
+      zigzag += scale * (code - 0x8000);
+      scale *= 0x4000;
+      code = str.charCodeAt(inputStart++);
+    }
+    zigzag += scale * code;
+    var index = next - (zigzag % 2 ? -(zigzag + 1) / 2 : zigzag / 2);
+    output[outputStart++] = index;
+    if (index >= next) {
+      next = index + 1;
+    }
+  }
+}
+
+// Indices of a level of a progressive mesh, whose coarser levels
+// brought numKnown vertices. Code 0 is the first use of the next new
+// vertex; code 1 the first use of a known vertex, followed by its
+// ZigZag delta from one past the last known vertex used; a code c >= 2
+// repeats the vertex first used c - 1 first uses ago.
+function decompressLevelIndices_(str, inputStart, numIndices, numKnown,
+                                 output, outputStart) {
+  var input = inputStart;
+  function readVarint() {
+    var value = 0;
+    var scale = 1;
+    var code = str.charCodeAt(input++);
+    while (code >= 0x8000) {
+      value += scale * (code - 0x8000);
+      scale *= 0x4000;
+      code = str.charCodeAt(input++);
+    }
+    return value + scale * code;
+  }
+  var vertices = [];
+  var nextNew = numKnown;
+  var nextKnown = 0;
+  for (var i = 0; i < numIndices; i++) {
+    var code = readVarint();
+    var index;
+    if (code == 0) {
+      index = nextNew++;
+      vertices.push(index);
+    } else if (code == 1) {
+      var zigzag = readVarint();
+      nextKnown += zigzag % 2 ? -(zigzag + 1) / 2 : zigzag / 2;
+      index = nextKnown++;
+      vertices.push(index);
+    } else {
+      index = vertices[vertices.length - (code - 1)];
+    }
+    output[outputStart++] = index;
+  }
+}
+
+// objcompress --tangents writes two more columns per vertex: the
+// angle of the tangent around the (decoded, normalized) normal, and
+// the handedness, +1 or -1. This writes the tangent as x, y, z, w to
+// out; the bitangent is w * cross(normal, tangent). The basis must
+// match TangentBasis in src/tangents.h.
+function tangentFromAngle(normal, angle, handedness, out) {
+  var sign = normal[2] >= 0 ? 1 : -1;
+  var a = -1 / (sign + normal[2]);
+  var b = normal[0] * normal[1] * a;
+  var c = Math.cos(angle);
+  var s = Math.sin(angle);
+  out[0] = c * (1 + sign * normal[0] * normal[0] * a) + s * b;
+  out[1] = c * sign * b + s * (sign + normal[1] * normal[1] * a);
+  out[2] = -c * sign * normal[0] - s * normal[1];
+  out[3] = handedness;
+  return out;
+}
+
+// For attributes decoded with tangents, 10 or 13 columns of
+// decodeParams: a copy with each vertex's angle and handedness
+// replaced by its tangent from tangentFromAngle, x, y, z and w, to
+// bind as a vec4. vertexFormatFromDecodeParams describes the result.
+// Other attributes are returned as they are.
+function expandTangents(attribs, decodeParams) {
+  var stride = decodeParams.decodeScales.length;
+  if (stride !== 10 && stride !== 13) return attribs;
+  var outStride = stride + 2;
+  var numVerts = attribs.length / stride;
+  var out = new Float32Array(outStride * numVerts);
+  var normal = new Float32Array(3);
+  var tangent = new Float32Array(4);
+  for (var v = 0; v < numVerts; v++) {
+    var i = stride * v;
+    var o = outStride * v;
+    for (var j = 0; j < 8; j++) {
+      out[o + j] = attribs[i + j];
+    }
+    var x = attribs[i + 5];
+    var y = attribs[i + 6];
+    var z = attribs[i + 7];
+    var length = Math.sqrt(x*x + y*y + z*z);
+    var n = length > 0 ? 1 / length : 0;
+    normal[0] = n * x;
+    normal[1] = n * y;
+    normal[2] = n * z;
+    tangentFromAngle(normal, attribs[i + 8], attribs[i + 9], tangent);
+    for (var j = 0; j < 4; j++) {
+      out[o + 8 + j] = tangent[j];
+    }
+    // Colors, if any.
+    for (var j = 10; j < stride; j++) {
+      out[o + j + 2] = attribs[i + j];
+    }
+  }
+  return out;
+}
+
 function decompressAABBs_(str, inputStart, numBBoxen,
                           decodeOffsets, decodeScales) {
   var numFloats = 6 * numBBoxen;
@@ -87,55 +244,341 @@ function decompressAABBs_(str, inputStart, numBBoxen,
   return bboxen;
 }
 
-function decompressMesh(str, meshParams, decodeParams, callback) {
+// A BVH over the groups of a file, depth first: the left child of a
+// node comes right after it, and a node over g groups spans 2g - 1
+// nodes, so a culled subtree is skipped without a stack. Each node is
+// a variable-length group count, then its box: the root as in
+// decompressAABBs_, and the rest in 1/127ths of their parent's box,
+// rounded outward. Boxes are returned as center and radius, like
+// bboxen, along with the node of each group (leaves, in order).
+function decompressBVH_(str, inputStart, numNodes,
+                        decodeOffsets, decodeScales) {
+  var kGrid = 127;
+  var groupCounts = new Uint32Array(numNodes);
+  var mins = new Uint16Array(3 * numNodes);
+  var maxes = new Uint16Array(3 * numNodes);
+  var boxes = new Float32Array(6 * numNodes);
+  var leaves = [];
+  var parents = [];
+  var input = inputStart;
+  for (var i = 0; i < numNodes; i++) {
+    while (parents.length) {
+      var top = parents[parents.length - 1];
+      if (i < top + 2*groupCounts[top] - 1) break;
+      parents.pop();
+    }
+    var count = 0;
+    var scale = 1;
+    var code = str.charCodeAt(input++);
+    while (code >= 0x8000) {
+      count += scale * (code - 0x8000);
+      scale *= 0x4000;
+      code = str.charCodeAt(input++);
+    }
+    groupCounts[i] = count + scale * code;
+    for (var k = 0; k < 3; k++) {
+      var minCode = str.charCodeAt(input + k);
+      var maxCode = str.charCodeAt(input + 3 + k);
+      if (parents.length) {
+        var parent = parents[parents.length - 1];
+        var parentMin = mins[3*parent + k];
+        var extent = maxes[3*parent + k] - parentMin;
+        mins[3*i + k] = parentMin + Math.floor(minCode * extent / kGrid);
+        maxes[3*i + k] = parentMin + Math.ceil(maxCode * extent / kGrid);
+      } else {
+        mins[3*i + k] = minCode;
+        maxes[3*i + k] = minCode + maxCode;
+      }
+      // Unlike bboxen, radii are not rounded up, so children stay
+      // inside their parents.
+      var radius = 0.5 * (maxes[3*i + k] - mins[3*i + k]);
+      boxes[6*i + k] =
+          decodeScales[k] * (mins[3*i + k] + decodeOffsets[k] + radius);
+      boxes[6*i + 3 + k] = decodeScales[k] * radius;
+    }
+    input += 6;
+    if (groupCounts[i] > 1) {
+      parents.push(i);
+    } else {
+      leaves.push(i);
+    }
+  }
+  return { groupCounts: groupCounts, boxes: boxes, leaves: leaves };
+}
+
+// Returns a flag per group of bvh: 1 unless its box is entirely
+// outside one of planes, given as [a, b, c, d, ...] with the inside
+// where ax + by + cz + d >= 0. Subtrees inside every plane are taken
+// whole.
+function cullBVH(bvh, planes) {
+  var groupCounts = bvh.groupCounts;
+  var boxes = bvh.boxes;
+  var visible = new Uint8Array(bvh.leaves.length);
+  var group = 0;
+  var i = 0;
+  while (i < groupCounts.length) {
+    var count = groupCounts[i];
+    var inside = true;
+    var outside = false;
+    for (var p = 0; p < planes.length && !outside; p += 4) {
+      var dist = planes[p + 3];
+      var spread = 0;
+      for (var k = 0; k < 3; k++) {
+        dist += planes[p + k] * boxes[6*i + k];
+        spread += Math.abs(planes[p + k]) * boxes[6*i + 3 + k];
+      }
+      outside = dist + spread < 0;
+      inside = inside && dist - spread >= 0;
+    }
+    if (outside || inside || count === 1) {
+      if (!outside) {
+        for (var g = 0; g < count; g++) {
+          visible[group + g] = 1;
+        }
+      }
+      group += count;
+      i += 2*count - 1;
+    } else {
+      i++;
+    }
+  }
+  return visible;
+}
+
+// Cluster tables have 9 codes per cluster: triangle count, bounding
+// sphere center and radius (in the quantized position frame, like the
+// bboxes), normal cone axis and cutoff (biased by 127). Every face
+// normal n of a cluster has dot(n, axis) >= cutoff. Clusters are
+// consecutive triangle ranges, starting at triangle 0.
+function decompressClusters_(str, inputStart, numClusters,
+                             decodeOffsets, decodeScales) {
+  var triangleCounts = new Uint16Array(numClusters);
+  var spheres = new Float32Array(4 * numClusters);
+  var cones = new Float32Array(4 * numClusters);
+  var input = inputStart;
+  for (var i = 0; i < numClusters; i++) {
+    triangleCounts[i] = str.charCodeAt(input++);
+    for (var j = 0; j < 3; j++) {
+      spheres[4*i + j] =
+          decodeScales[j] * (str.charCodeAt(input++) + decodeOffsets[j]);
+    }
+    spheres[4*i + 3] = decodeScales[0] * str.charCodeAt(input++);
+    var length2 = 0;
+    for (var j = 0; j < 3; j++) {
+      var axis = (str.charCodeAt(input++) - 127) / 127;
+      cones[4*i + j] = axis;
+      length2 += axis * axis;
+    }
+    var invLength = length2 > 0 ? 1 / Math.sqrt(length2) : 0;
+    for (var j = 0; j < 3; j++) {
+      cones[4*i + j] *= invLength;
+    }
+    cones[4*i + 3] = (str.charCodeAt(input++) - 127) / 127;
+  }
+  return { triangleCounts: triangleCounts, spheres: spheres, cones: cones };
+}
+
+// A progressive mesh comes in levels of detail, coarsest first and
+// interleaved with the levels of other meshes. Each level is
+// [attribStart, numNewVerts, indexStart, numTris, indexCodes]: the
+// attributes of the vertices it adds, and all of its indices, into
+// the vertices of it and every coarser level. The last level is the
+// whole mesh. Returns the attributes and indices of the given level.
+// opt_coarser is what this returned for a coarser level of the mesh,
+// if any: its vertices are kept, and only the levels since are
+// decoded, so decoding every level in turn decodes each vertex once.
+// The attributes of every level share one buffer.
+function decompressLevel_(str, meshParams, level, decodeParams,
+                          opt_coarser) {
+  decodeParams = meshParams.decodeParams || decodeParams;
+  var stride = decodeParams.decodeScales.length;
+  var decodeOffsets = decodeParams.decodeOffsets;
+  var decodeScales = decodeParams.decodeScales;
+  var levels = meshParams.levels;
+  var allAttribs;
+  var numKnown = 0;
+  var l = 0;
+  if (opt_coarser) {
+    allAttribs = opt_coarser.allAttribs;
+    numKnown = opt_coarser.numVerts;
+    l = opt_coarser.level + 1;
+  } else {
+    var numAllVerts = 0;
+    for (var k = 0; k < levels.length; k++) {
+      numAllVerts += levels[k][1];
+    }
+    allAttribs = new Float32Array(stride * numAllVerts);
+  }
+  for (; l <= level; l++) {
+    var inputOffset = levels[l][0];
+    var numNewVerts = levels[l][1];
+    for (var j = 0; j < stride; j++) {
+      var end = inputOffset + numNewVerts;
+      var decodeScale = decodeScales[j];
+      if (decodeScale) {
+        decompressAttribsInner_(str, inputOffset, end,
+                                allAttribs, stride * numKnown + j, stride,
+                                decodeOffsets[j], decodeScale);
+      }
+      inputOffset = end;
+    }
+    numKnown += numNewVerts;
+  }
+  var numVerts = numKnown;
+  var numIndices = 3*levels[level][3];
+  var indicesOut = numVerts > 0x10000 ? new Uint32Array(numIndices)
+                                      : new Uint16Array(numIndices);
+  decompressLevelIndices_(str, levels[level][2], numIndices,
+                          numVerts - levels[level][1], indicesOut, 0);
+  return { attribs: allAttribs.subarray(0, stride * numVerts),
+           indices: indicesOut, level: level, numVerts: numVerts,
+           allAttribs: allAttribs };
+}
+
+// meshParams as the callback gets it for a level: lengths are the
+// level's, from levelLengths.
+function levelParams_(meshParams, level) {
+  var levelLengths = meshParams.levelLengths;
+  if (!levelLengths) return meshParams;
+  var params = Object.create(meshParams);
+  params.lengths = levelLengths[level];
+  return params;
+}
+
+// opt_bvh is the decompressBVH_ of the file, if meshParams has one and
+// it was decoded already. opt_coarser is, for a progressive mesh, the
+// decompressLevel_ of a coarser level, to continue from.
+function decompressMesh(str, meshParams, decodeParams, callback, opt_bvh,
+                        opt_coarser) {
   // Extract conversion parameters from attribArrays.
+  decodeParams = meshParams.decodeParams || decodeParams;
   var stride = decodeParams.decodeScales.length;
   var decodeOffsets = decodeParams.decodeOffsets;
   var decodeScales = decodeParams.decodeScales;
-  var attribStart = meshParams.attribRange[0];
-  var numVerts = meshParams.attribRange[1];
-
-  // Decode attributes.
-  var inputOffset = attribStart;
-  var attribsOut = new Float32Array(stride * numVerts);
-  for (var j = 0; j < stride; j++) {
-    var end = inputOffset + numVerts;
-    var decodeScale = decodeScales[j];
-    if (decodeScale) {
-      // Assume if decodeScale is never set, simply ignore the
-      // attribute.
-      decompressAttribsInner_(str, inputOffset, end,
-                              attribsOut, j, stride,
-                              decodeOffsets[j], decodeScale);
-    }
-    inputOffset = end;
-  }
-
-  var indexStart = meshParams.indexRange[0];
-  var numIndices = 3*meshParams.indexRange[1];
-  var indicesOut = new Uint16Array(numIndices);
-  decompressIndices_(str, inputOffset, numIndices, indicesOut, 0);
+  var attribsOut;
+  var indicesOut;
+  if (meshParams.levels) {
+    var decoded = decompressLevel_(str, meshParams,
+                                   meshParams.levels.length - 1,
+                                   decodeParams, opt_coarser);
+    attribsOut = decoded.attribs;
+    indicesOut = decoded.indices;
+  } else {
+    var attribStart = meshParams.attribRange[0];
+    var numVerts = meshParams.attribRange[1];
+
+    // Decode attributes.
+    var inputOffset = attribStart;
+    attribsOut = new Float32Array(stride * numVerts);
+    for (var j = 0; j < stride; j++) {
+      var end = inputOffset + numVerts;
+      var decodeScale = decodeScales[j];
+      if (decodeScale) {
+        // Assume if decodeScale is never set, simply ignore the
+        // attribute.
+        decompressAttribsInner_(str, inputOffset, end,
+                                attribsOut, j, stride,
+                                decodeOffsets[j], decodeScale);
+      }
+      inputOffset = end;
+    }
+
+    var indexStart = meshParams.indexRange[0];
+    var numIndices = 3*meshParams.indexRange[1];
+    if (meshParams.indexFormat === 'varint32') {
+      // More than 64K vertices; needs UNSIGNED_INT indices (WebGL 2 or
+      // OES_element_index_uint).
+      indicesOut = new Uint32Array(numIndices);
+      decompressVarintIndices_(str, inputOffset, numIndices, indicesOut, 0);
+    } else if (meshParams.indexFormat === 'zigzag') {
+      indicesOut = numVerts > 0x10000 ? new Uint32Array(numIndices)
+                                      : new Uint16Array(numIndices);
+      decompressZigZagIndices_(str, inputOffset, numIndices, indicesOut, 0);
+    } else {
+      indicesOut = new Uint16Array(numIndices);
+      decompressIndices_(str, inputOffset, numIndices, indicesOut, 0);
+    }
+  }
 
   // Decode bboxen.
   var bboxen = undefined;
   var bboxOffset = meshParams.bboxes;
+  var bvh = opt_bvh;
   if (bboxOffset) {
     bboxen = decompressAABBs_(str, bboxOffset, meshParams.names.length,
                               decodeOffsets, decodeScales);
+  } else if (meshParams.bvh) {
+    // One box per group, shared with other meshes; copy them per name.
+    bvh = bvh || decompressBVH_(str, meshParams.bvh[0], meshParams.bvh[1],
+                                decodeOffsets, decodeScales);
+    var groups = meshParams.groups;
+    bboxen = new Float32Array(6 * groups.length);
+    for (var i = 0; i < groups.length; i++) {
+      var node = bvh.leaves[groups[i]];
+      bboxen.set(bvh.boxes.subarray(6*node, 6*node + 6), 6*i);
+    }
   }
-  callback(attribsOut, indicesOut, bboxen, meshParams);
+
+  // Decode clusters.
+  var clusters = undefined;
+  if (meshParams.clusters) {
+    clusters = decompressClusters_(str, meshParams.clusters[0],
+                                   meshParams.clusters[1],
+                                   decodeOffsets, decodeScales);
+  }
+  var levels = meshParams.levels;
+  callback(attribsOut, indicesOut, bboxen, meshParams, clusters,
+           levels ? levels.length - 1 : undefined, bvh, decodeParams);
 }
 
 function downloadMesh(path, meshEntry, decodeParams, callback) {
   var idx = 0;
+  // The finest coarse level decoded, per progressive mesh.
+  var levelsDone = [];
+  var bvh = undefined;  // Ends where the first mesh starts.
   function onprogress(req, e) {
+    var bvhRange = meshEntry[0].bvh;
+    if (bvhRange && !bvh &&
+        req.responseText.length >= meshEntry[0].attribRange[0]) {
+      bvh = decompressBVH_(req.responseText, bvhRange[0], bvhRange[1],
+                           decodeParams.decodeOffsets,
+                           decodeParams.decodeScales);
+    }
+    // Coarse levels of progressive meshes arrive ahead of whole meshes.
+    // The callback gets the level as a sixth argument, and should
+    // replace what it drew for coarser levels of the mesh. Whole
+    // meshes of a file with a bvh get it as a seventh, for cullBVH.
+    // Every call gets the decodeParams its attributes were decoded
+    // with as an eighth, for vertexFormatFromDecodeParams.
+    for (var i = idx; i < meshEntry.length; i++) {
+      var levels = meshEntry[i].levels;
+      if (!levels) continue;
+      var decoded = levelsDone[i];
+      var level = decoded ? decoded.level + 1 : 0;
+      while (level < levels.length - 1 &&
+             req.responseText.length >= levels[level][2] + levels[level][4]) {
+        decoded = decompressLevel_(req.responseText, meshEntry[i], level,
+                                   decodeParams, decoded);
+        callback(decoded.attribs, decoded.indices, undefined,
+                 levelParams_(meshEntry[i], level), undefined, level,
+                 undefined, meshEntry[i].decodeParams || decodeParams);
+        ++level;
+      }
+      levelsDone[i] = decoded;
+    }
     while (idx < meshEntry.length) {
       var meshParams = meshEntry[idx];
       var indexRange = meshParams.indexRange;
-      var meshEnd = indexRange[0] + 3*indexRange[1];
+      var meshEnd = indexRange[0] +
+          (meshParams.indexCodes || 3*indexRange[1]);
+      var clusters = meshParams.clusters;
+      if (clusters) {
+        meshEnd = Math.max(meshEnd, clusters[0] + 9*clusters[1]);
+      }
       if (req.responseText.length < meshEnd) break;
 
-      decompressMesh(req.responseText, meshParams, decodeParams, callback);
+      decompressMesh(req.responseText, meshParams, decodeParams, callback,
+                     bvh, levelsDone[idx]);
       ++idx;
     }
   };
@@ -59,13 +59,22 @@ addWheelHandler(window, function(dx, dy, evt) {
   return false;
 });
 
+// Textures by URL, shared by every mesh of every model that uses
+// them. objcompress --merge-materials writes URLs in a canonical form,
+// so models that spell a path differently still share it.
+var TEXTURES = {};
+
 function textureFromMaterial(gl, material, callback) {
   try {
     var url = MATERIALS[material].map_Kd;  // throw-y.
     if (url === undefined) {
       throw url;
     }
-    return textureFromUrl(gl, url, callback);
+    // The first load's callback redraws for every mesh that shares it.
+    if (!TEXTURES.hasOwnProperty(url)) {
+      TEXTURES[url] = textureFromUrl(gl, url, callback);
+    }
+    return TEXTURES[url];
   } catch (e) {
     var color;
     try {
@@ -79,11 +88,19 @@ function textureFromMaterial(gl, material, callback) {
   }
 }
 
-function onLoad(attribArray, indexArray, bboxen, meshEntry) {
+// decodeParams, if given, are those loader.js decoded attribArray
+// with, which may have tangents or colors past the usual 8 columns.
+function onLoad(attribArray, indexArray, bboxen, meshEntry, clusters, level,
+                bvh, decodeParams) {
   var texture = textureFromMaterial(gl, meshEntry.material, function() {
     renderer.postRedisplay();
   });
-  var mesh = new Mesh(gl, attribArray, indexArray, DEFAULT_VERTEX_FORMAT,
+  var vertexFormat = DEFAULT_VERTEX_FORMAT;
+  if (decodeParams) {
+    attribArray = expandTangents(attribArray, decodeParams);
+    vertexFormat = vertexFormatFromDecodeParams(decodeParams);
+  }
+  var mesh = new Mesh(gl, attribArray, indexArray, vertexFormat,
                       texture, meshEntry.names, meshEntry.lengths, bboxen);
   renderer.meshes_.push(mesh);
 }
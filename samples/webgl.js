@@ -31,6 +31,51 @@ var NO_TEXCOORD_VERTEX_FORMAT = [
   }
 ];
 
+// The vertex format of attributes decoded with decodeParams (see
+// loader.js), after expandTangents: positions, texcoords and normals
+// in the first 8 columns, then for models with tangents, the 4 of
+// the tangent, and for models with colors, RGB in the last 3.
+function vertexFormatFromDecodeParams(decodeParams) {
+  var numColumns = decodeParams.decodeScales.length;
+  var hasTangents = numColumns === 10 || numColumns === 13;
+  var hasColors = numColumns === 11 || numColumns === 13;
+  var stride = hasTangents ? numColumns + 2 : numColumns;
+  var vertexFormat = [
+    { name: "a_position",
+      size: 3,
+      stride: stride,
+      offset: 0
+    },
+    { name: "a_texcoord",
+      size: 2,
+      stride: stride,
+      offset: 3
+    },
+    { name: "a_normal",
+      size: 3,
+      stride: stride,
+      offset: 5
+    }
+  ];
+  if (hasTangents) {
+    vertexFormat.push(
+      { name: "a_tangent",
+        size: 4,
+        stride: stride,
+        offset: 8
+      });
+  }
+  if (hasColors) {
+    vertexFormat.push(
+      { name: "a_color",
+        size: 3,
+        stride: stride,
+        offset: stride - 3
+      });
+  }
+  return vertexFormat;
+}
+
 var BBOX_VERTEX_FORMAT = [
   { name: "a_position",
     size: 3,
@@ -149,6 +194,7 @@ Program.prototype.vertexAttribPointers = function(vertexFormat) {
   for (var i = 0; i < numAttribs; ++i) {
     var attrib = vertexFormat[i];
     var loc = this.set_attrib[attrib.name];
+    if (loc === undefined) continue;  // Not used by this program.
     var typeBytes = 4;  // TODO: 4 assumes gl.FLOAT, use params.type
     this.gl_.vertexAttribPointer(loc, attrib.size, this.gl_.FLOAT,
                                  !!attrib.normalized, typeBytes*attrib.stride,
@@ -226,6 +272,16 @@ function Mesh(gl, attribArray, indexArray, attribArrays, texture,
   this.gl_ = gl;
   this.attribArrays_ = attribArrays;  // TODO: rename to vertex format!
   this.numIndices_ = indexArray.length;
+  if (indexArray instanceof Uint32Array) {
+    if (!gl.getExtension('OES_element_index_uint')) {
+      throw 'OES_element_index_uint is needed to draw meshes of more ' +
+          'than 65536 vertices (indexFormat varint32 or zigzag)';
+    }
+    this.indexType_ = gl.UNSIGNED_INT;
+  } else {
+    this.indexType_ = gl.UNSIGNED_SHORT;
+  }
+  this.indexSize_ = indexArray.BYTES_PER_ELEMENT;
   this.texture_ = texture || null;
 
   if (opt_bboxen) {
@@ -256,13 +312,14 @@ Mesh.prototype.bind = function(program) {
 
 Mesh.prototype.draw = function() {
   var gl = this.gl_;
-  gl.drawElements(gl.TRIANGLES, this.numIndices_, gl.UNSIGNED_SHORT, 0);
+  gl.drawElements(gl.TRIANGLES, this.numIndices_, this.indexType_, 0);
 };
 
 Mesh.prototype.drawRange = function(length, opt_offset) {
   opt_offset = opt_offset || 0;
   var gl = this.gl_;
-  gl.drawElements(gl.TRIANGLES, length, gl.UNSIGNED_SHORT, 2*opt_offset);
+  gl.drawElements(gl.TRIANGLES, length, this.indexType_,
+                  this.indexSize_*opt_offset);
 };
 
 Mesh.prototype.drawList = function(displayList) {
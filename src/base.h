@@ -19,31 +19,114 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <algorithm>
 #include <string>
 #include <vector>
 
 typedef unsigned short uint16;
 typedef short int16;
 typedef unsigned int uint32;
+typedef int int32;
+typedef unsigned long long uint64;
+typedef long long int64;
 
 typedef std::vector<float> AttribList;
 typedef std::vector<int> IndexList;
 typedef std::vector<uint16> QuantizedAttribList;
-typedef std::vector<uint16> OptimizedIndexList;
+typedef std::vector<uint32> OptimizedIndexList;
+
+// The attributes a vertex can have, in the order they are
+// interleaved.
+enum VertexAttrib {
+  kPositionAttrib,  // 3-D.
+  kTexcoordAttrib,  // 2-D.
+  kNormalAttrib,  // 3-D.
+  kTangentAttrib,  // Angle and handedness; see tangents.h.
+  kColorAttrib,  // RGB in [0, 1], from "v x y z r g b".
+  kNumVertexAttribs
+};
+
+// The columns of an interleaved vertex, the same for the floats of a
+// DrawMesh and the quantized words of a WebGLMesh: the attributes it
+// has, in VertexAttrib order. Stages that move whole vertices only
+// need the stride; those that look inside find attributes by offset.
+class VertexLayout {
+ public:
+  static const uint32 kDefaultAttribs =
+      (1 << kPositionAttrib) | (1 << kTexcoordAttrib) | (1 << kNormalAttrib);
+  static const size_t kMaxStride = 16;
+
+  explicit VertexLayout(uint32 attribs = kDefaultAttribs)
+      : attribs_(attribs),
+        stride_(0) {
+    for (size_t i = 0; i < kNumVertexAttribs; ++i) {
+      const VertexAttrib attrib = static_cast<VertexAttrib>(i);
+      offsets_[i] = stride_;
+      if (has(attrib)) stride_ += size(attrib);
+    }
+  }
+
+  static size_t size(VertexAttrib attrib) {
+    static const size_t kSizes[kNumVertexAttribs] = { 3, 2, 3, 2, 3 };
+    return kSizes[attrib];
+  }
+
+  VertexLayout With(VertexAttrib attrib) const {
+    return VertexLayout(attribs_ | (1 << attrib));
+  }
+
+  bool has(VertexAttrib attrib) const {
+    return (attribs_ >> attrib) & 1;
+  }
+
+  size_t offset(VertexAttrib attrib) const {
+    return offsets_[attrib];
+  }
+
+  size_t stride() const {
+    return stride_;
+  }
+
+  bool operator==(const VertexLayout& that) const {
+    return attribs_ == that.attribs_;
+  }
+
+ private:
+  uint32 attribs_;  // Bits by VertexAttrib.
+  size_t offsets_[kNumVertexAttribs];
+  size_t stride_;
+};
+
+template <size_t kStride, typename T>
+inline T* CopyColumns(const T* from, T* to) {
+  for (size_t i = 0; i < kStride; ++i) {
+    to[i] = from[i];
+  }
+  return to + kStride;
+}
+
+// Copies the stride columns of a vertex, and returns the end of the
+// copy. The strides of the usual layouts are unrolled at compile time.
+template <typename T>
+inline T* CopyVertex(const T* from, size_t stride, T* to) {
+  switch (stride) {
+    case 8: return CopyColumns<8>(from, to);
+    case 10: return CopyColumns<10>(from, to);
+    default: return std::copy(from, from + stride, to);
+  }
+}
 
 // TODO: these data structures ought to go elsewhere.
 struct DrawMesh {
-  // Interleaved vertex format:
-  //  3-D Position
-  //  3-D Normal
-  //  2-D TexCoord
-  // Note that these
+  VertexLayout layout;
+  // Interleaved vertex attributes, as layout says.
   AttribList attribs;
   // Indices are 0-indexed.
   IndexList indices;
 };
 
 struct WebGLMesh {
+  VertexLayout layout;
   QuantizedAttribList attribs;
   OptimizedIndexList indices;
 };
@@ -81,6 +164,38 @@ static inline const char* StripLeadingDir(const char* const str) {
   return last_slash ? (last_slash + 1) : str;
 }
 
+// path with '\\' separators made '/', and empty, "." and "dir/.."
+// components dropped, so that different spellings of a file compare
+// equal. Leading ".." components stay.
+static inline std::string CanonicalPath(const std::string& path) {
+  std::vector<std::string> parts;
+  std::string part;
+  for (size_t i = 0; i <= path.size(); ++i) {
+    const char ch = i < path.size() ? path[i] : '/';
+    if (ch != '/' && ch != '\\') {
+      part.push_back(ch);
+      continue;
+    }
+    if (part == "..") {
+      if (!parts.empty() && parts.back() != "..") {
+        parts.pop_back();
+      } else {
+        parts.push_back(part);
+      }
+    } else if (!part.empty() && part != ".") {
+      parts.push_back(part);
+    }
+    part.clear();
+  }
+  const bool absolute = !path.empty() && (path[0] == '/' || path[0] == '\\');
+  std::string canonical = absolute ? "/" : "";
+  for (size_t i = 0; i < parts.size(); ++i) {
+    if (i) canonical.push_back('/');
+    canonical += parts[i];
+  }
+  return canonical;
+}
+
 static inline void TerminateAtNewlineOrComment(char* str) {
   char* newline = strpbrk(str, "#\r\n");
   if (newline) {
@@ -145,8 +260,14 @@ void ToHex(uint32 w, char out[9]) {
   }
 }
 
-uint16 Quantize(float f, float in_min, float in_scale, uint16 out_max) {
-  return static_cast<uint16>(out_max * ((f-in_min) / in_scale));
+// Values outside [in_min, in_min + in_scale] are clamped, rather than
+// wrapped (or worse) by the cast; so is NaN, to 0. Rounds down, after
+// adding bias steps: 0.5 rounds to nearest.
+uint16 Quantize(float f, float in_min, float in_scale, uint16 out_max,
+                float bias = 0) {
+  const float quantized = out_max * ((f-in_min) / in_scale) + bias;
+  return static_cast<uint16>(
+      std::min(std::max(0.0f, quantized), static_cast<float>(out_max)));
 }
 
 // TODO: Visual Studio calls this someting different.
@@ -162,4 +283,28 @@ uint16 Quantize(float f, float in_min, float in_scale, uint16 out_max) {
     exit(-1); } else
 #endif  // CHECK
 
+// A copy of mesh with attrib added to its layout, from values, which
+// has VertexLayout::size(attrib) floats per vertex.
+void AddAttribColumns(const DrawMesh& mesh, VertexAttrib attrib,
+                      const AttribList& values, DrawMesh* with_attrib) {
+  const VertexLayout& layout = mesh.layout;
+  const size_t num_vertices = mesh.attribs.size() / layout.stride();
+  const size_t size = VertexLayout::size(attrib);
+  CHECK(!layout.has(attrib));
+  CHECK(values.size() == size * num_vertices);
+  with_attrib->layout = layout.With(attrib);
+  with_attrib->indices = mesh.indices;
+  // The columns before and after the new ones.
+  const size_t before = with_attrib->layout.offset(attrib);
+  const size_t after = layout.stride() - before;
+  with_attrib->attribs.resize(with_attrib->layout.stride() * num_vertices);
+  float* out = with_attrib->attribs.empty() ? NULL : &with_attrib->attribs[0];
+  for (size_t v = 0; v < num_vertices; ++v) {
+    const float* in = &mesh.attribs[layout.stride() * v];
+    out = std::copy(in, in + before, out);
+    out = std::copy(&values[size * v], &values[size * v] + size, out);
+    out = std::copy(in + before, in + before + after, out);
+  }
+}
+
 #endif  // WEBGL_LOADER_BASE_H_
@@ -0,0 +1,318 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_BVH_H_
+#define WEBGL_LOADER_BVH_H_
+
+#include <float.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base.h"
+#include "decode.h"
+#include "morton.h"
+#include "stats.h"
+#include "utf8.h"
+
+// A bounding volume hierarchy over the groups of an output file, so
+// clients can cull thousands of groups without testing each box.
+//
+// Boxes are kept in the quantized position frame of CompressAABBToUtf8,
+// and queries run on the boxes DecompressBvh returns. The tree is
+// binary, with one group per leaf, and stored in depth first order:
+// the left child of a node comes right after it, and a node whose
+// subtree holds g groups spans 2g - 1 nodes. So a traversal needs no
+// stack and no child pointers; it skips a culled subtree by advancing
+// 2g - 1 nodes, and its group counter by g. Groups are numbered in
+// leaf order.
+
+struct BvhNode {
+  uint16 mins[3];
+  uint16 maxes[3];
+  size_t num_groups;  // In this subtree; 1 for a leaf.
+
+  void Enclose(const BvhNode& node) {
+    for (size_t i = 0; i < 3; ++i) {
+      mins[i] = std::min(mins[i], node.mins[i]);
+      maxes[i] = std::max(maxes[i], node.maxes[i]);
+    }
+  }
+};
+
+typedef std::vector<BvhNode> BvhNodeList;
+
+// A linear BVH (Lauterbach et al. 2009): leaves are sorted by the
+// Morton code of their centers, and each range of leaves is split
+// where the highest bit that differs within it changes, which is a
+// median split along the longest remaining axis of the Morton grid.
+class BvhBuilder {
+ public:
+  // leaves holds one box per group, with num_groups of 1.
+  explicit BvhBuilder(const BvhNodeList& leaves)
+      : leaves_(leaves) {
+  }
+
+  // leaf_order[k] is the index in leaves of the k-th leaf of nodes.
+  void Build(BvhNodeList* nodes, std::vector<size_t>* leaf_order) {
+    ScopedTimer timer(Stats::kBvh);
+    nodes->clear();
+    leaf_order->clear();
+    if (leaves_.empty()) return;
+    codes_.resize(leaves_.size());
+    order_.resize(leaves_.size());
+    for (size_t i = 0; i < leaves_.size(); ++i) {
+      const BvhNode& leaf = leaves_[i];
+      uint32 center[3];
+      for (size_t k = 0; k < 3; ++k) {
+        center[k] = (leaf.mins[k] + leaf.maxes[k]) >> 1;
+      }
+      codes_[i] = MortonCode3(center[0], center[1], center[2]);
+      order_[i] = i;
+    }
+    RadixSort(kPositionMortonBits, &codes_, &order_);
+    nodes->reserve(2 * leaves_.size() - 1);
+    BuildRange(0, leaves_.size(), nodes);
+    leaf_order->assign(order_.begin(), order_.end());
+  }
+
+ private:
+  // Appends the subtree over order_[begin, end), and returns its root.
+  size_t BuildRange(size_t begin, size_t end, BvhNodeList* nodes) {
+    const size_t root = nodes->size();
+    if (end - begin == 1) {
+      nodes->push_back(leaves_[order_[begin]]);
+      return root;
+    }
+    nodes->push_back(BvhNode());
+    const size_t split = FindSplit(begin, end);
+    const size_t left = BuildRange(begin, split, nodes);
+    const size_t right = BuildRange(split, end, nodes);
+    BvhNode& node = (*nodes)[root];
+    node = (*nodes)[left];
+    node.Enclose((*nodes)[right]);
+    node.num_groups = end - begin;
+    return root;
+  }
+
+  // The first leaf whose code has the highest differing bit of the
+  // range set, or the middle if the codes are all the same.
+  size_t FindSplit(size_t begin, size_t end) const {
+    const uint64 first = codes_[begin];
+    const uint64 last = codes_[end - 1];
+    if (first == last) return (begin + end) / 2;
+    uint64 bit = static_cast<uint64>(1) << (kPositionMortonBits - 1);
+    while (!((first ^ last) & bit)) bit >>= 1;
+    size_t lo = begin + 1;
+    size_t hi = end - 1;
+    while (lo < hi) {
+      const size_t mid = (lo + hi) / 2;
+      if (codes_[mid] & bit) {
+        hi = mid;
+      } else {
+        lo = mid + 1;
+      }
+    }
+    return lo;
+  }
+
+  const BvhNodeList& leaves_;
+  std::vector<uint64> codes_;  // Sorted, with the leaves in order_.
+  std::vector<uint32> order_;
+};
+
+// Below the root, a box is written in 1/kBvhGrid steps of its
+// parent's box, rounded outward, so each coordinate is a single UTF-8
+// byte. Boxes grow a little with depth, but always hold what they did.
+static const uint32 kBvhGrid = 127;
+
+static inline uint16 DecodeBvhMin(uint16 parent_min, uint32 extent,
+                                  uint32 code) {
+  return parent_min + code * extent / kBvhGrid;
+}
+
+static inline uint16 DecodeBvhMax(uint16 parent_min, uint32 extent,
+                                  uint32 code) {
+  return parent_min + (code * extent + kBvhGrid - 1) / kBvhGrid;
+}
+
+// The nodes that would be ancestors of node i, given its predecessors.
+static inline void PopBvhParents(const BvhNodeList& nodes, size_t i,
+                                 std::vector<size_t>* parents) {
+  while (!parents->empty() &&
+         i >= parents->back() + 2 * nodes[parents->back()].num_groups - 1) {
+    parents->pop_back();
+  }
+}
+
+// Each node is written as its group count (a Uint32ToUtf8Varint), then
+// its mins and maxes: exact for the root, as the mins and extents of
+// CompressAABBToUtf8, and in kBvhGrid steps of the decoded parent for
+// the rest. Returns the number of characters written.
+size_t CompressBvhToUtf8(const BvhNodeList& nodes, std::vector<char>* utf8) {
+  ScopedTimer timer(Stats::kEncode);
+  size_t num_codes = 0;
+  BvhNodeList decoded(nodes);
+  std::vector<size_t> parents;  // Ancestors of the next node.
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    PopBvhParents(nodes, i, &parents);
+    const BvhNode& node = nodes[i];
+    num_codes += Uint32ToUtf8Varint(node.num_groups, utf8);
+    if (parents.empty()) {
+      for (size_t k = 0; k < 3; ++k) CHECK(Uint16ToUtf8(node.mins[k], utf8));
+      for (size_t k = 0; k < 3; ++k) {
+        CHECK(Uint16ToUtf8(node.maxes[k] - node.mins[k], utf8));
+      }
+    } else {
+      const BvhNode& parent = decoded[parents.back()];
+      uint32 codes[6];
+      for (size_t k = 0; k < 3; ++k) {
+        const uint32 extent = parent.maxes[k] - parent.mins[k];
+        const uint32 min = node.mins[k] - parent.mins[k];
+        const uint32 max = node.maxes[k] - parent.mins[k];
+        codes[k] = extent ? min * kBvhGrid / extent : 0;
+        codes[3 + k] = extent ? (max * kBvhGrid + extent - 1) / extent : 0;
+        decoded[i].mins[k] = DecodeBvhMin(parent.mins[k], extent, codes[k]);
+        decoded[i].maxes[k] = DecodeBvhMax(parent.mins[k], extent,
+                                           codes[3 + k]);
+      }
+      for (size_t k = 0; k < 6; ++k) CHECK(Uint16ToUtf8(codes[k], utf8));
+    }
+    num_codes += 6;
+    if (node.num_groups > 1) parents.push_back(i);
+  }
+  return num_codes;
+}
+
+// Reads num_nodes nodes as CompressBvhToUtf8 writes them, and returns
+// the number of codes they took.
+size_t DecompressBvh(const uint32* codes, size_t num_nodes,
+                     BvhNodeList* nodes) {
+  const uint32* start = codes;
+  nodes->resize(num_nodes);
+  std::vector<size_t> parents;
+  for (size_t i = 0; i < num_nodes; ++i) {
+    PopBvhParents(*nodes, i, &parents);
+    BvhNode& node = (*nodes)[i];
+    node.num_groups = ReadVarint(&codes);
+    if (parents.empty()) {
+      for (size_t k = 0; k < 3; ++k) node.mins[k] = codes[k];
+      for (size_t k = 0; k < 3; ++k) node.maxes[k] = codes[k] + codes[3 + k];
+    } else {
+      const BvhNode& parent = (*nodes)[parents.back()];
+      for (size_t k = 0; k < 3; ++k) {
+        const uint32 extent = parent.maxes[k] - parent.mins[k];
+        node.mins[k] = DecodeBvhMin(parent.mins[k], extent, codes[k]);
+        node.maxes[k] = DecodeBvhMax(parent.mins[k], extent, codes[3 + k]);
+      }
+    }
+    codes += 6;
+    if (node.num_groups > 1) parents.push_back(i);
+  }
+  return codes - start;
+}
+
+// Which side of the plane ax + by + cz + d = 0 the box is on: -1 if it
+// is entirely behind (negative), 1 if entirely in front, else 0.
+static inline int ClassifyBox(const BvhNode& node, const float* plane) {
+  float near_dist = plane[3];
+  float far_dist = plane[3];
+  for (size_t k = 0; k < 3; ++k) {
+    const float lo = plane[k] * node.mins[k];
+    const float hi = plane[k] * node.maxes[k];
+    near_dist += std::min(lo, hi);
+    far_dist += std::max(lo, hi);
+  }
+  if (far_dist < 0) return -1;
+  return near_dist >= 0 ? 1 : 0;
+}
+
+// Whether the ray from origin along direction enters the box, by the
+// slab test. inv_direction holds 1 / direction, infinite where a
+// component is zero.
+static inline bool RayHitsBox(const BvhNode& node, const float* origin,
+                              const float* inv_direction) {
+  float t_near = 0;
+  float t_far = FLT_MAX;
+  for (size_t k = 0; k < 3; ++k) {
+    float t0 = (node.mins[k] - origin[k]) * inv_direction[k];
+    float t1 = (node.maxes[k] - origin[k]) * inv_direction[k];
+    if (t0 > t1) std::swap(t0, t1);
+    // NaN, from a zero direction along a slab face, compares false
+    // and leaves the interval alone.
+    if (t0 > t_near) t_near = t0;
+    if (t1 < t_far) t_far = t1;
+    if (t_near > t_far) return false;
+  }
+  return true;
+}
+
+// Appends the groups whose boxes may be inside all num_planes planes,
+// each (a, b, c, d) with the inside where ax + by + cz + d >= 0, in
+// the quantized position frame. Subtrees inside every plane are taken
+// whole.
+void FrustumQueryBvh(const BvhNodeList& nodes, const float* planes,
+                     size_t num_planes, std::vector<size_t>* groups) {
+  size_t group = 0;
+  size_t i = 0;
+  while (i < nodes.size()) {
+    const BvhNode& node = nodes[i];
+    bool inside = true;
+    bool outside = false;
+    for (size_t p = 0; p < num_planes && !outside; ++p) {
+      const int side = ClassifyBox(node, planes + 4 * p);
+      outside = side < 0;
+      inside &= side > 0;
+    }
+    if (!outside && (inside || node.num_groups == 1)) {
+      for (size_t g = 0; g < node.num_groups; ++g) {
+        groups->push_back(group + g);
+      }
+    }
+    if (outside || inside || node.num_groups == 1) {
+      group += node.num_groups;
+      i += 2 * node.num_groups - 1;
+    } else {
+      ++i;
+    }
+  }
+}
+
+// Appends the groups whose boxes the ray from origin along direction
+// passes through, in the quantized position frame.
+void RayQueryBvh(const BvhNodeList& nodes, const float* origin,
+                 const float* direction, std::vector<size_t>* groups) {
+  float inv_direction[3];
+  for (size_t k = 0; k < 3; ++k) {
+    inv_direction[k] = 1.0f / direction[k];
+  }
+  size_t group = 0;
+  size_t i = 0;
+  while (i < nodes.size()) {
+    const BvhNode& node = nodes[i];
+    const bool hit = RayHitsBox(node, origin, inv_direction);
+    if (hit && node.num_groups == 1) {
+      groups->push_back(group);
+    }
+    if (!hit || node.num_groups == 1) {
+      group += node.num_groups;
+      i += 2 * node.num_groups - 1;
+    } else {
+      ++i;
+    }
+  }
+}
+
+#endif  // WEBGL_LOADER_BVH_H_
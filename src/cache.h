@@ -0,0 +1,422 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_CACHE_H_
+#define WEBGL_LOADER_CACHE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "base.h"
+
+// Simulators for GPU post-transform vertex caches and the vertex fetch
+// cache, for measuring the output of VertexOptimizer. Vertex indices
+// are dense, so per-vertex state lives in plain arrays indexed by
+// vertex, which keeps every simulation O(n) regardless of cache size.
+
+struct CacheStats {
+  CacheStats()
+      : misses(0),
+        num_vertices(0),
+        num_triangles(0) {
+  }
+
+  void Add(const CacheStats& that) {
+    misses += that.misses;
+    num_vertices += that.num_vertices;
+    num_triangles += that.num_triangles;
+  }
+
+  // Average cache miss ratio: transformed vertices per triangle.
+  double acmr() const {
+    return num_triangles ? static_cast<double>(misses) / num_triangles : 0;
+  }
+
+  // Average transform to vertex ratio: 1.0 is optimal.
+  double atvr() const {
+    return num_vertices ? static_cast<double>(misses) / num_vertices : 0;
+  }
+
+  size_t misses;
+  size_t num_vertices;  // Number of distinct vertices referenced.
+  size_t num_triangles;
+};
+
+// A FIFO cache. A vertex is in the cache iff fewer than cache_size
+// misses have happened since it was inserted.
+class FifoCache {
+ public:
+  explicit FifoCache(size_t cache_size)
+      : cache_size_(cache_size),
+        misses_(0) {
+  }
+
+  // Returns true on a miss.
+  bool Access(int index) {
+    if (static_cast<size_t>(index) >= stamps_.size()) {
+      stamps_.resize(index + 1, size_t(kNotCached));
+    }
+    size_t& stamp = stamps_[index];
+    if (stamp != kNotCached && misses_ - stamp <= cache_size_) {
+      return false;
+    }
+    stamp = misses_++;
+    return true;
+  }
+
+  // Evicts everything, in O(1): every stamp becomes too old.
+  void Flush() {
+    misses_ += cache_size_ + 1;
+  }
+
+ private:
+  static const size_t kNotCached = ~size_t(0);
+
+  size_t cache_size_;
+  size_t misses_;
+  std::vector<size_t> stamps_;
+};
+
+// A least-recently-used cache, as an intrusive doubly-linked list
+// threaded through per-entry arrays.
+class LruCache {
+ public:
+  explicit LruCache(size_t cache_size)
+      : cache_size_(cache_size),
+        size_(0),
+        head_(kNil),
+        tail_(kNil) {
+  }
+
+  // Returns true on a miss.
+  bool Access(int index) {
+    if (static_cast<size_t>(index) >= nodes_.size()) {
+      nodes_.resize(index + 1);
+    }
+    Node& node = nodes_[index];
+    if (node.cached) {
+      if (head_ != index) {
+        Unlink(index);
+        PushFront(index);
+      }
+      return false;
+    }
+    if (size_ == cache_size_) {
+      const int evict = tail_;
+      Unlink(evict);
+      nodes_[evict].cached = false;
+      --size_;
+    }
+    node.cached = true;
+    PushFront(index);
+    ++size_;
+    return true;
+  }
+
+ private:
+  static const int kNil = -1;
+
+  struct Node {
+    Node()
+        : prev(kNil),
+          next(kNil),
+          cached(false) {
+    }
+
+    int prev, next;
+    bool cached;
+  };
+
+  void Unlink(int index) {
+    Node& node = nodes_[index];
+    if (node.prev != kNil) nodes_[node.prev].next = node.next;
+    else head_ = node.next;
+    if (node.next != kNil) nodes_[node.next].prev = node.prev;
+    else tail_ = node.prev;
+    node.prev = node.next = kNil;
+  }
+
+  void PushFront(int index) {
+    Node& node = nodes_[index];
+    node.prev = kNil;
+    node.next = head_;
+    if (head_ != kNil) nodes_[head_].prev = index;
+    head_ = index;
+    if (tail_ == kNil) tail_ = index;
+  }
+
+  size_t cache_size_;
+  size_t size_;
+  int head_, tail_;
+  std::vector<Node> nodes_;
+};
+
+// Which cache to simulate. Batch caches model GPUs that gather
+// triangles into batches of bounded size, transform each distinct
+// vertex of a batch once, and share nothing between batches. The
+// presets are approximations of NVIDIA and AMD hardware.
+struct CacheModel {
+  enum Kind { kFifo, kLru, kBatch };
+
+  static CacheModel Fifo(size_t size) {
+    return CacheModel(kFifo, size, 0);
+  }
+
+  static CacheModel Lru(size_t size) {
+    return CacheModel(kLru, size, 0);
+  }
+
+  static CacheModel Batch(size_t max_vertices, size_t max_triangles) {
+    return CacheModel(kBatch, max_vertices, max_triangles);
+  }
+
+  static CacheModel Nvidia() { return Batch(32, 64); }
+  static CacheModel Amd() { return Batch(128, 256); }
+
+  // Parses "fifo:N", "lru:N", "batch:V:T", "nvidia", "amd" or just "N"
+  // (a FIFO, for compatibility). Returns false on a bad spec.
+  static bool Parse(const char* spec, CacheModel* model) {
+    char* end = NULL;
+    if (0 == strcmp(spec, "nvidia")) {
+      *model = Nvidia();
+    } else if (0 == strcmp(spec, "amd")) {
+      *model = Amd();
+    } else if (0 == strncmp(spec, "fifo:", 5)) {
+      *model = Fifo(strtol(spec + 5, &end, 10));
+    } else if (0 == strncmp(spec, "lru:", 4)) {
+      *model = Lru(strtol(spec + 4, &end, 10));
+    } else if (0 == strncmp(spec, "batch:", 6)) {
+      const size_t max_vertices = strtol(spec + 6, &end, 10);
+      if (*end != ':') return false;
+      *model = Batch(max_vertices, strtol(end + 1, &end, 10));
+    } else {
+      *model = Fifo(strtol(spec, &end, 10));
+    }
+    return (end == NULL || *end == '\0') && model->size > 0 &&
+        (model->kind != kBatch || model->max_triangles > 0);
+  }
+
+  std::string Name() const {
+    char buf[64];
+    switch (kind) {
+      case kFifo:
+        snprintf(buf, sizeof(buf), "fifo%zu", size);
+        break;
+      case kLru:
+        snprintf(buf, sizeof(buf), "lru%zu", size);
+        break;
+      case kBatch:
+        snprintf(buf, sizeof(buf), "batch%zux%zu", size, max_triangles);
+        break;
+    }
+    return buf;
+  }
+
+  Kind kind;
+  size_t size;  // Entries, or vertices per batch.
+  size_t max_triangles;  // Per batch.
+
+ private:
+  CacheModel(Kind k, size_t s, size_t t)
+      : kind(k),
+        size(s),
+        max_triangles(t) {
+  }
+};
+
+// A reasonable default set of models to report.
+static inline std::vector<CacheModel> StandardCacheModels() {
+  std::vector<CacheModel> models;
+  models.push_back(CacheModel::Fifo(16));
+  models.push_back(CacheModel::Fifo(32));
+  models.push_back(CacheModel::Lru(16));
+  models.push_back(CacheModel::Lru(32));
+  models.push_back(CacheModel::Nvidia());
+  models.push_back(CacheModel::Amd());
+  return models;
+}
+
+template <typename IndexListT>
+size_t CountDistinctIndices(const IndexListT& indices) {
+  std::vector<bool> seen;
+  size_t count = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const size_t index = indices[i];
+    if (index >= seen.size()) seen.resize(index + 1, false);
+    if (!seen[index]) {
+      seen[index] = true;
+      ++count;
+    }
+  }
+  return count;
+}
+
+template <typename IndexListT, typename CacheT>
+size_t CountCacheMisses(const IndexListT& indices, CacheT* cache) {
+  size_t misses = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    misses += cache->Access(indices[i]);
+  }
+  return misses;
+}
+
+template <typename IndexListT>
+size_t CountBatchCacheMisses(const IndexListT& indices,
+                             size_t max_vertices, size_t max_triangles) {
+  // A vertex has been transformed in this batch iff its stamp matches.
+  std::vector<size_t> batch_of;
+  size_t batch = 1;
+  size_t batch_vertices = 0;
+  size_t batch_triangles = 0;
+  size_t misses = 0;
+  for (size_t i = 0; i + 3 <= indices.size(); i += 3) {
+    size_t new_vertices = 0;
+    for (size_t j = 0; j < 3; ++j) {
+      const size_t index = indices[i + j];
+      if (index >= batch_of.size()) batch_of.resize(index + 1, 0);
+      // Count repeated indices within the triangle only once.
+      const bool repeated = (j > 0 && index == size_t(indices[i])) ||
+          (j > 1 && index == size_t(indices[i + 1]));
+      if (batch_of[index] != batch && !repeated) ++new_vertices;
+    }
+    if (batch_vertices + new_vertices > max_vertices ||
+        batch_triangles == max_triangles) {
+      ++batch;
+      batch_vertices = batch_triangles = 0;
+    }
+    for (size_t j = 0; j < 3; ++j) {
+      const size_t index = indices[i + j];
+      if (batch_of[index] != batch) {
+        batch_of[index] = batch;
+        ++batch_vertices;
+        ++misses;
+      }
+    }
+    ++batch_triangles;
+  }
+  return misses;
+}
+
+template <typename IndexListT>
+CacheStats SimulateCache(const CacheModel& model, const IndexListT& indices) {
+  CacheStats stats;
+  stats.num_vertices = CountDistinctIndices(indices);
+  stats.num_triangles = indices.size() / 3;
+  switch (model.kind) {
+    case CacheModel::kFifo: {
+      FifoCache cache(model.size);
+      stats.misses = CountCacheMisses(indices, &cache);
+      break;
+    }
+    case CacheModel::kLru: {
+      LruCache cache(model.size);
+      stats.misses = CountCacheMisses(indices, &cache);
+      break;
+    }
+    case CacheModel::kBatch:
+      stats.misses = CountBatchCacheMisses(indices, model.size,
+                                           model.max_triangles);
+      break;
+  }
+  return stats;
+}
+
+// Vertex fetch locality: every index reads its vertex through an LRU
+// cache of memory lines. The interesting number is overfetch, the
+// bytes read per byte of distinct vertex data; 1.0 is optimal.
+struct FetchStats {
+  FetchStats()
+      : bytes_fetched(0),
+        num_vertices(0),
+        vertex_bytes(0) {
+  }
+
+  void Add(const FetchStats& that) {
+    bytes_fetched += that.bytes_fetched;
+    num_vertices += that.num_vertices;
+    vertex_bytes = that.vertex_bytes;
+  }
+
+  double overfetch() const {
+    const double ideal = static_cast<double>(num_vertices) * vertex_bytes;
+    return ideal ? bytes_fetched / ideal : 0;
+  }
+
+  double bytes_per_vertex() const {
+    return num_vertices ? static_cast<double>(bytes_fetched) / num_vertices
+                        : 0;
+  }
+
+  size_t bytes_fetched;
+  size_t num_vertices;
+  size_t vertex_bytes;
+};
+
+template <typename IndexListT>
+FetchStats SimulateVertexFetch(const IndexListT& indices,
+                               size_t vertex_bytes,
+                               size_t line_bytes = 64,
+                               size_t cache_bytes = 16 * 1024) {
+  FetchStats stats;
+  stats.vertex_bytes = vertex_bytes;
+  stats.num_vertices = CountDistinctIndices(indices);
+  LruCache lines(cache_bytes / line_bytes);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const size_t begin = indices[i] * vertex_bytes;
+    const size_t end = begin + vertex_bytes;
+    for (size_t line = begin / line_bytes; line * line_bytes < end; ++line) {
+      if (lines.Access(line)) {
+        stats.bytes_fetched += line_bytes;
+      }
+    }
+  }
+  return stats;
+}
+
+// Accumulates cache and fetch statistics for a set of models over
+// several index lists, such as all the meshes of a model.
+class CacheReport {
+ public:
+  explicit CacheReport(const std::vector<CacheModel>& models,
+                       size_t vertex_bytes = VertexLayout().stride() *
+                                             sizeof(uint16))
+      : models_(models),
+        stats_(models.size()),
+        vertex_bytes_(vertex_bytes) {
+  }
+
+  template <typename IndexListT>
+  void Add(const IndexListT& indices) {
+    for (size_t i = 0; i < models_.size(); ++i) {
+      stats_[i].Add(SimulateCache(models_[i], indices));
+    }
+    fetch_.Add(SimulateVertexFetch(indices, vertex_bytes_));
+  }
+
+  const std::vector<CacheModel>& models() const { return models_; }
+  const std::vector<CacheStats>& stats() const { return stats_; }
+  const FetchStats& fetch() const { return fetch_; }
+
+ private:
+  std::vector<CacheModel> models_;
+  std::vector<CacheStats> stats_;
+  FetchStats fetch_;
+  size_t vertex_bytes_;
+};
+
+#endif  // WEBGL_LOADER_CACHE_H_
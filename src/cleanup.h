@@ -0,0 +1,151 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_CLEANUP_H_
+#define WEBGL_LOADER_CLEANUP_H_
+
+#include <vector>
+
+#include "base.h"
+#include "mesh.h"
+#include "stats.h"
+
+// Drops triangles that cost bandwidth and GPU time without drawing
+// anything: those with zero area once positions are quantized, and
+// repeats of a triangle earlier in the same group.
+
+// Whether the quantized positions of a, b and c are collinear, in
+// attribs of stride columns.
+bool IsDegenerateTriangle(const QuantizedAttribList& attribs, size_t stride,
+                          int a, int b, int c) {
+  if (a == b || b == c || c == a) return true;
+  const uint16* pa = &attribs[stride * a];
+  const uint16* pb = &attribs[stride * b];
+  const uint16* pc = &attribs[stride * c];
+  int64 ab[3], ac[3];
+  for (size_t k = 0; k < 3; ++k) {
+    ab[k] = static_cast<int64>(pb[k]) - pa[k];
+    ac[k] = static_cast<int64>(pc[k]) - pa[k];
+  }
+  return ab[1] * ac[2] == ab[2] * ac[1] &&
+      ab[2] * ac[0] == ab[0] * ac[2] &&
+      ab[0] * ac[1] == ab[1] * ac[0];
+}
+
+// A hash set of triangles, by group. Triangles are rotated to start
+// at their smallest index, so that the same triangle matches however
+// it was started, but the winding is kept: a back face is not a
+// duplicate of its front face.
+class TriangleSet {
+ public:
+  explicit TriangleSet(size_t num_triangles) {
+    size_t table_size = 1;
+    while (table_size < 2 * num_triangles) table_size *= 2;
+    Triangle empty = { { -1, -1, -1 }, 0 };
+    table_.assign(table_size, empty);
+  }
+
+  // Returns false if the triangle was already in the group.
+  bool Insert(size_t group, int a, int b, int c) {
+    Triangle triangle;
+    if (a < b && a < c) {
+      triangle.Set(a, b, c, group);
+    } else if (b < c) {
+      triangle.Set(b, c, a, group);
+    } else {
+      triangle.Set(c, a, b, group);
+    }
+    const size_t mask = table_.size() - 1;
+    uint64 hash = group;
+    for (size_t k = 0; k < 3; ++k) {
+      hash = (hash ^ static_cast<uint32>(triangle.indices[k])) *
+          0x9E3779B97F4A7C15ULL;
+    }
+    for (size_t slot = (hash >> 32) & mask; ; slot = (slot + 1) & mask) {
+      Triangle& entry = table_[slot];
+      if (entry.indices[0] < 0) {
+        entry = triangle;
+        return true;
+      }
+      if (entry == triangle) return false;
+    }
+  }
+
+ private:
+  struct Triangle {
+    int indices[3];
+    size_t group;
+
+    void Set(int a, int b, int c, size_t g) {
+      indices[0] = a;
+      indices[1] = b;
+      indices[2] = c;
+      group = g;
+    }
+
+    bool operator==(const Triangle& that) const {
+      return indices[0] == that.indices[0] &&
+          indices[1] == that.indices[1] &&
+          indices[2] == that.indices[2] && group == that.group;
+    }
+  };
+
+  std::vector<Triangle> table_;
+};
+
+// Copies draw_mesh to cleaned_mesh without degenerate or duplicate
+// triangles, with group_starts to match. Groups left without
+// triangles are dropped. Vertices are untouched, so the quantized
+// attribs still apply.
+void CleanupTriangles(const DrawMesh& draw_mesh,
+                      const std::vector<GroupStart>& group_starts,
+                      const QuantizedAttribList& quantized_attribs,
+                      DrawMesh* cleaned_mesh,
+                      std::vector<GroupStart>* cleaned_group_starts) {
+  ScopedTimer timer(Stats::kCleanup);
+  cleaned_mesh->layout = draw_mesh.layout;
+  cleaned_mesh->attribs = draw_mesh.attribs;
+  cleaned_mesh->indices.clear();
+  cleaned_group_starts->clear();
+  const IndexList& indices = draw_mesh.indices;
+  TriangleSet triangles(indices.size() / 3);
+  size_t num_degenerate = 0;
+  size_t num_duplicate = 0;
+  for (size_t g = 0; g < group_starts.size(); ++g) {
+    const size_t begin = group_starts[g].offset;
+    const size_t end = (g + 1 < group_starts.size()) ?
+        group_starts[g + 1].offset : indices.size();
+    GroupStart group_start = group_starts[g];
+    group_start.offset = cleaned_mesh->indices.size();
+    for (size_t i = begin; i < end; i += 3) {
+      const int a = indices[i], b = indices[i + 1], c = indices[i + 2];
+      if (IsDegenerateTriangle(quantized_attribs, draw_mesh.layout.stride(),
+                               a, b, c)) {
+        ++num_degenerate;
+      } else if (!triangles.Insert(g, a, b, c)) {
+        ++num_duplicate;
+      } else {
+        cleaned_mesh->indices.insert(cleaned_mesh->indices.end(),
+                                     &indices[i], &indices[i] + 3);
+      }
+    }
+    if (cleaned_mesh->indices.size() > group_start.offset) {
+      cleaned_group_starts->push_back(group_start);
+    }
+  }
+  Stats::Get().Increment(Stats::kDegenerateTriangles, num_degenerate);
+  Stats::Get().Increment(Stats::kDuplicateTriangles, num_duplicate);
+}
+
+#endif  // WEBGL_LOADER_CLEANUP_H_
@@ -0,0 +1,325 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_CLUSTER_H_
+#define WEBGL_LOADER_CLUSTER_H_
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "base.h"
+#include "stats.h"
+#include "utf8.h"
+
+// Clusters (a.k.a. meshlets): runs of consecutive triangles of an
+// optimized WebGLMesh, each touching at most a few dozen vertices, with
+// a bounding sphere and a normal cone for culling. Since the runs
+// follow the optimized triangle order, a cluster is drawn as an index
+// range and the index stream itself is unchanged.
+//
+// Bounds are kept in the quantized position frame, which is the frame
+// of CompressAABBToUtf8: BoundsParams uses one uniform scale for
+// positions, so quantized distances are isotropic and decode with
+// decodeScales[0] like everything else.
+
+// Normal cone axes and cutoffs are stored as signed 8-bit fractions of
+// kConeScale, biased by kConeScale.
+static const int kConeScale = 127;
+
+struct Cluster {
+  size_t index_start;  // Into WebGLMesh::indices.
+  size_t num_triangles;
+  size_t num_vertices;
+  uint16 center[3];  // Quantized position.
+  uint16 radius;  // Quantized position units.
+  // Every face normal n in the cluster has dot(n, axis) >= cutoff,
+  // with the axis from DecodeConeAxis and the cutoff from
+  // DecodeConeValue. A cutoff of -1 means the cone is useless for
+  // culling.
+  uint16 cone_axis[3];
+  uint16 cone_cutoff;
+};
+
+typedef std::vector<Cluster> ClusterList;
+
+// The most vertices or triangles a cluster may have: its triangle
+// count is written as a single code, which must stay below 0xF800.
+static const size_t kMaxClusterSize = 0xF7FF;
+
+// Parses the value of a --clusters=V:T flag: V in [3, kMaxClusterSize]
+// vertices and T in [1, kMaxClusterSize] triangles.
+bool ParseClusters(const char* value, size_t* max_vertices,
+                   size_t* max_triangles) {
+  char* end = NULL;
+  const long v = strtol(value, &end, 10);
+  if (end == value || *end != ':') return false;
+  const char* start = end + 1;
+  const long t = strtol(start, &end, 10);
+  if (end == start || *end != '\0') return false;
+  if (v < 3 || v > static_cast<long>(kMaxClusterSize) ||
+      t < 1 || t > static_cast<long>(kMaxClusterSize)) {
+    return false;
+  }
+  *max_vertices = v;
+  *max_triangles = t;
+  return true;
+}
+
+static inline float DecodeConeValue(uint16 code) {
+  return static_cast<float>(static_cast<int>(code) - kConeScale) /
+      kConeScale;
+}
+
+// The decoded, renormalized cone axis. Encoders and decoders must
+// agree on this exactly, since the cutoff is relative to it.
+void DecodeConeAxis(const Cluster& cluster, float* axis) {
+  float length2 = 0;
+  for (size_t i = 0; i < 3; ++i) {
+    axis[i] = DecodeConeValue(cluster.cone_axis[i]);
+    length2 += axis[i] * axis[i];
+  }
+  const float inv_length = length2 > 0 ? 1.0f / sqrtf(length2) : 0;
+  for (size_t i = 0; i < 3; ++i) {
+    axis[i] *= inv_length;
+  }
+}
+
+class ClusterBuilder {
+ public:
+  ClusterBuilder(const WebGLMesh& mesh, size_t max_vertices,
+                 size_t max_triangles)
+      : mesh_(mesh),
+        max_vertices_(max_vertices),
+        max_triangles_(max_triangles),
+        stamps_(mesh.attribs.size() / mesh.layout.stride(), 0),
+        current_stamp_(0) {
+    CHECK(max_vertices >= 3 && max_vertices <= kMaxClusterSize);
+    CHECK(max_triangles >= 1 && max_triangles <= kMaxClusterSize);
+  }
+
+  // Greedily cuts the triangle order into clusters, starting a new one
+  // whenever the next triangle would exceed either limit.
+  void Build(ClusterList* clusters) {
+    ScopedTimer timer(Stats::kCluster);
+    const OptimizedIndexList& indices = mesh_.indices;
+    Cluster cluster;
+    StartCluster(0, &cluster);
+    for (size_t i = 0; i < indices.size(); i += 3) {
+      size_t new_vertices = CountNewVertices(i);
+      if (cluster.num_triangles == max_triangles_ ||
+          cluster.num_vertices + new_vertices > max_vertices_) {
+        FinishCluster(&cluster, clusters);
+        StartCluster(i, &cluster);
+        new_vertices = CountNewVertices(i);
+      }
+      for (size_t j = 0; j < 3; ++j) {
+        stamps_[indices[i + j]] = current_stamp_;
+      }
+      cluster.num_vertices += new_vertices;
+      ++cluster.num_triangles;
+    }
+    if (cluster.num_triangles) {
+      FinishCluster(&cluster, clusters);
+    }
+  }
+
+ private:
+  // Distinct vertices of triangle i that the current cluster lacks.
+  size_t CountNewVertices(size_t i) const {
+    const OptimizedIndexList& indices = mesh_.indices;
+    size_t new_vertices = 0;
+    for (size_t j = 0; j < 3; ++j) {
+      const uint32 index = indices[i + j];
+      if (stamps_[index] != current_stamp_ &&
+          (j < 1 || index != indices[i]) &&
+          (j < 2 || index != indices[i + 1])) {
+        ++new_vertices;
+      }
+    }
+    return new_vertices;
+  }
+
+  void StartCluster(size_t index_start, Cluster* cluster) {
+    ++current_stamp_;
+    cluster->index_start = index_start;
+    cluster->num_triangles = 0;
+    cluster->num_vertices = 0;
+  }
+
+  void FinishCluster(Cluster* cluster, ClusterList* clusters) {
+    ComputeSphere(cluster);
+    ComputeCone(cluster);
+    clusters->push_back(*cluster);
+    Stats::Get().Increment(Stats::kClusters);
+  }
+
+  const uint16* Position(size_t i) const {
+    return &mesh_.attribs[mesh_.layout.stride() * mesh_.indices[i]];
+  }
+
+  static float Distance2(const uint16* position, const float* center) {
+    float distance2 = 0;
+    for (size_t k = 0; k < 3; ++k) {
+      const float d = position[k] - center[k];
+      distance2 += d * d;
+    }
+    return distance2;
+  }
+
+  // Ritter's bounding sphere: start from the most separated pair of
+  // axis extremes, then grow to enclose the stragglers. The center is
+  // rounded to the quantized grid before measuring the radius, so the
+  // stored sphere still encloses every vertex exactly.
+  void ComputeSphere(Cluster* cluster) const {
+    const size_t begin = cluster->index_start;
+    const size_t end = begin + 3 * cluster->num_triangles;
+    size_t min_at[3] = { begin, begin, begin };
+    size_t max_at[3] = { begin, begin, begin };
+    for (size_t i = begin; i < end; ++i) {
+      const uint16* position = Position(i);
+      for (size_t k = 0; k < 3; ++k) {
+        if (position[k] < Position(min_at[k])[k]) min_at[k] = i;
+        if (position[k] > Position(max_at[k])[k]) max_at[k] = i;
+      }
+    }
+    size_t widest = 0;
+    float widest2 = -1;
+    for (size_t k = 0; k < 3; ++k) {
+      float from[3];
+      for (size_t c = 0; c < 3; ++c) from[c] = Position(min_at[k])[c];
+      const float span2 = Distance2(Position(max_at[k]), from);
+      if (span2 > widest2) {
+        widest2 = span2;
+        widest = k;
+      }
+    }
+    float center[3];
+    for (size_t k = 0; k < 3; ++k) {
+      center[k] = 0.5f * (Position(min_at[widest])[k] +
+                          Position(max_at[widest])[k]);
+    }
+    float radius = 0.5f * sqrtf(widest2);
+    for (size_t i = begin; i < end; ++i) {
+      const uint16* position = Position(i);
+      const float distance2 = Distance2(position, center);
+      if (distance2 > radius * radius) {
+        const float distance = sqrtf(distance2);
+        const float grown = 0.5f * (radius + distance);
+        const float shift = (grown - radius) / distance;
+        for (size_t k = 0; k < 3; ++k) {
+          center[k] += shift * (position[k] - center[k]);
+        }
+        radius = grown;
+      }
+    }
+    float max_distance2 = 0;
+    for (size_t k = 0; k < 3; ++k) {
+      cluster->center[k] = static_cast<uint16>(center[k] + 0.5f);
+      center[k] = cluster->center[k];
+    }
+    for (size_t i = begin; i < end; ++i) {
+      const float distance2 = Distance2(Position(i), center);
+      if (distance2 > max_distance2) max_distance2 = distance2;
+    }
+    cluster->radius = static_cast<uint16>(ceilf(sqrtf(max_distance2)));
+  }
+
+  // Face normals, from quantized positions; false for zero-area faces.
+  bool FaceNormal(size_t i, float* normal) const {
+    const uint16* p0 = Position(i);
+    const uint16* p1 = Position(i + 1);
+    const uint16* p2 = Position(i + 2);
+    float e1[3], e2[3];
+    for (size_t k = 0; k < 3; ++k) {
+      e1[k] = static_cast<float>(p1[k]) - p0[k];
+      e2[k] = static_cast<float>(p2[k]) - p0[k];
+    }
+    normal[0] = e1[1] * e2[2] - e1[2] * e2[1];
+    normal[1] = e1[2] * e2[0] - e1[0] * e2[2];
+    normal[2] = e1[0] * e2[1] - e1[1] * e2[0];
+    const float length2 =
+        normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2];
+    if (length2 == 0) return false;
+    const float inv_length = 1.0f / sqrtf(length2);
+    for (size_t k = 0; k < 3; ++k) {
+      normal[k] *= inv_length;
+    }
+    return true;
+  }
+
+  // The axis is the mean face normal. The cutoff is measured against
+  // the axis as it will be decoded, and rounded down, so that the
+  // stored cone is conservative.
+  void ComputeCone(Cluster* cluster) const {
+    const size_t begin = cluster->index_start;
+    const size_t end = begin + 3 * cluster->num_triangles;
+    float sum[3] = { 0, 0, 0 };
+    for (size_t i = begin; i < end; i += 3) {
+      float normal[3];
+      if (!FaceNormal(i, normal)) continue;
+      for (size_t k = 0; k < 3; ++k) sum[k] += normal[k];
+    }
+    const float length = sqrtf(sum[0] * sum[0] + sum[1] * sum[1] +
+                               sum[2] * sum[2]);
+    for (size_t k = 0; k < 3; ++k) {
+      const float unit = length > 0 ? sum[k] / length : 0;
+      cluster->cone_axis[k] =
+          static_cast<uint16>(lrintf(unit * kConeScale) + kConeScale);
+    }
+    float axis[3];
+    DecodeConeAxis(*cluster, axis);
+    float cutoff = (length > 0) ? 1.0f : -1.0f;
+    for (size_t i = begin; i < end && cutoff > -1.0f; i += 3) {
+      float normal[3];
+      if (!FaceNormal(i, normal)) continue;
+      const float dot =
+          normal[0] * axis[0] + normal[1] * axis[1] + normal[2] * axis[2];
+      if (dot < cutoff) cutoff = dot;
+    }
+    int code = static_cast<int>(floorf(cutoff * kConeScale));
+    if (code < -kConeScale) code = -kConeScale;
+    cluster->cone_cutoff = static_cast<uint16>(code + kConeScale);
+  }
+
+  const WebGLMesh& mesh_;
+  size_t max_vertices_;
+  size_t max_triangles_;
+  std::vector<size_t> stamps_;
+  size_t current_stamp_;
+};
+
+// The cluster table of a mesh: per cluster, the triangle count, the
+// sphere center and radius, the cone axis and the cone cutoff.
+static const size_t kClusterCodes = 9;
+
+void CompressClustersToUtf8(const ClusterList& clusters,
+                            std::vector<char>* utf8) {
+  ScopedTimer timer(Stats::kEncode);
+  for (size_t i = 0; i < clusters.size(); ++i) {
+    const Cluster& cluster = clusters[i];
+    CHECK(Uint16ToUtf8(cluster.num_triangles, utf8));
+    for (size_t k = 0; k < 3; ++k) {
+      CHECK(Uint16ToUtf8(cluster.center[k], utf8));
+    }
+    CHECK(Uint16ToUtf8(cluster.radius, utf8));
+    for (size_t k = 0; k < 3; ++k) {
+      CHECK(Uint16ToUtf8(cluster.cone_axis[k], utf8));
+    }
+    CHECK(Uint16ToUtf8(cluster.cone_cutoff, utf8));
+  }
+}
+
+#endif  // WEBGL_LOADER_CLUSTER_H_
@@ -0,0 +1,150 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_DECODE_H_
+#define WEBGL_LOADER_DECODE_H_
+
+#include <vector>
+
+#include "base.h"
+#include "utf8.h"
+
+// A C++ decoder for the compressed stream, mirroring
+// samples/loader.js, for tests and benchmarks that need to read back
+// what objcompress writes. As in loader.js, codes are the characters
+// of the stream, as String.charCodeAt would return them.
+
+// Decodes the whole characters at the start of utf8 onto the end of
+// codes, and returns how many bytes they took. A character cut off by
+// the end of utf8 is left for the next call, so a stream can be fed in
+// as it arrives.
+size_t Utf8ToCodes(const char* utf8, size_t length,
+                   std::vector<uint32>* codes) {
+  size_t i = 0;
+  while (i < length) {
+    const unsigned char lead = static_cast<unsigned char>(utf8[i]);
+    size_t size = 1;
+    uint32 code = lead;
+    if (lead >= 0xE0) {
+      size = 3;
+      code = lead & 0x0F;
+    } else if (lead >= 0xC0) {
+      size = 2;
+      code = lead & 0x1F;
+    }
+    if (i + size > length) break;
+    for (size_t j = 1; j < size; ++j) {
+      code = (code << 6) | (utf8[i + j] & kUtf8MoreBytesMask);
+    }
+    codes->push_back(code);
+    i += size;
+  }
+  return i;
+}
+
+// The transposed, delta-coded attributes of num_vertices vertices of
+// stride columns, as CompressQuantizedAttribsToUtf8 writes them.
+void DecompressAttribs(const uint32* codes, size_t num_vertices,
+                       size_t stride, uint16* attribs) {
+  for (size_t k = 0; k < stride; ++k) {
+    uint16 prev = 0;
+    for (size_t v = 0; v < num_vertices; ++v) {
+      const uint32 code = *codes++;
+      prev += static_cast<uint16>((code >> 1) ^ (-(code & 1)));
+      attribs[stride * v + k] = prev;
+    }
+  }
+}
+
+// Reads one Uint32ToUtf8Varint value, and advances codes past it.
+static inline uint32 ReadVarint(const uint32** codes) {
+  uint32 value = 0;
+  uint32 shift = 0;
+  uint32 code = *(*codes)++;
+  while (code >= kVarintMoreCodes) {
+    value |= (code - kVarintMoreCodes) << shift;
+    shift += kVarintGroupBits;
+    code = *(*codes)++;
+  }
+  return value | (code << shift);
+}
+
+// Each of these decodes num_indices indices and returns the number of
+// codes they took.
+
+// CompressIndicesToUtf8.
+size_t DecompressIndices(const uint32* codes, size_t num_indices,
+                         uint32* indices) {
+  uint32 highest = 0;
+  for (size_t i = 0; i < num_indices; ++i) {
+    const uint32 code = codes[i];
+    indices[i] = highest - code;
+    if (code == 0) ++highest;
+  }
+  return num_indices;
+}
+
+// CompressIndicesToUtf8Varint.
+size_t DecompressVarintIndices(const uint32* codes, size_t num_indices,
+                               uint32* indices) {
+  const uint32* start = codes;
+  uint32 highest = 0;
+  for (size_t i = 0; i < num_indices; ++i) {
+    const uint32 delta = ReadVarint(&codes);
+    indices[i] = highest - delta;
+    if (delta == 0) ++highest;
+  }
+  return codes - start;
+}
+
+// CompressIndicesToUtf8ZigZag.
+size_t DecompressZigZagIndices(const uint32* codes, size_t num_indices,
+                               uint32* indices) {
+  const uint32* start = codes;
+  uint32 next = 0;
+  for (size_t i = 0; i < num_indices; ++i) {
+    const uint32 zigzag = ReadVarint(&codes);
+    const uint32 index = next - ((zigzag >> 1) ^ (0 - (zigzag & 1)));
+    indices[i] = index;
+    if (index >= next) next = index + 1;
+  }
+  return codes - start;
+}
+
+// CompressLevelIndicesToUtf8 (see progressive.h), for a level whose
+// coarser levels brought num_known vertices.
+size_t DecompressLevelIndices(const uint32* codes, size_t num_indices,
+                              uint32 num_known, uint32* indices) {
+  const uint32* start = codes;
+  std::vector<uint32> vertices;  // In order of first use.
+  uint32 next_new = num_known;
+  uint32 next_known = 0;
+  for (size_t i = 0; i < num_indices; ++i) {
+    const uint32 code = ReadVarint(&codes);
+    if (code == 0) {
+      indices[i] = next_new++;
+      vertices.push_back(indices[i]);
+    } else if (code == 1) {
+      const uint32 zigzag = ReadVarint(&codes);
+      next_known += (zigzag >> 1) ^ (0 - (zigzag & 1));
+      indices[i] = next_known++;
+      vertices.push_back(indices[i]);
+    } else {
+      indices[i] = vertices[vertices.size() - (code - 1)];
+    }
+  }
+  return codes - start;
+}
+
+#endif  // WEBGL_LOADER_DECODE_H_
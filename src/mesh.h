@@ -21,30 +21,41 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+#include <algorithm>
 #include <map>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "base.h"
+#include "morton.h"
+#include "normals.h"
+#include "stats.h"
+#include "tangents.h"
+#include "triangulate.h"
 #include "utf8.h"
+#include "weld.h"
 
-void DumpJsonFromQuantizedAttribs(const QuantizedAttribList& attribs) {
+void DumpJsonFromQuantizedAttribs(const QuantizedAttribList& attribs,
+                                  size_t stride = 8) {
   puts("var attribs = new Uint16Array([");
-  for (size_t i = 0; i < attribs.size(); i += 8) {
-    printf("%u,%hu,%hu,%hu,%hu,%hu,%hu,%hu,\n",
-           attribs[i + 0], attribs[i + 1], attribs[i + 2], attribs[i + 3],
-           attribs[i + 4], attribs[i + 5], attribs[i + 6], attribs[i + 7]);
+  for (size_t i = 0; i < attribs.size(); i += stride) {
+    for (size_t j = 0; j < stride; ++j) {
+      printf("%hu,", attribs[i + j]);
+    }
+    putchar('\n');
   }
   puts("]);");
 }
 
-void DumpJsonFromInterleavedAttribs(const AttribList& attribs) {
+void DumpJsonFromInterleavedAttribs(const AttribList& attribs,
+                                   size_t stride = 8) {
   puts("var attribs = new Float32Array([");
-  for (size_t i = 0; i < attribs.size(); i += 8) {
-    printf("%f,%f,%f,%f,%f,%f,%f,%f,\n",
-           attribs[i + 0], attribs[i + 1], attribs[i + 2], attribs[i + 3],
-           attribs[i + 4], attribs[i + 5], attribs[i + 6], attribs[i + 7]);
+  for (size_t i = 0; i < attribs.size(); i += stride) {
+    for (size_t j = 0; j < stride; ++j) {
+      printf("%f,", attribs[i + j]);
+    }
+    putchar('\n');
   }
   puts("]);");
 }
@@ -113,11 +124,18 @@ class IndexFlattener {
  public:
   explicit IndexFlattener(size_t num_positions)
       : count_(0),
+        map_spills_(0),
+        map_lookups_(0),
         table_(num_positions) {
   }
 
   int count() const { return count_; }
 
+  // For Stats::kFlattenerMapSpills and kFlattenerMapLookups, which the
+  // owner publishes once it is done.
+  size_t map_spills() const { return map_spills_; }
+  size_t map_lookups() const { return map_lookups_; }
+
   void reserve(size_t size) {
     table_.reserve(size);
   }
@@ -154,6 +172,7 @@ class IndexFlattener {
     }
     // The other indices don't match, so we mark this table entry,
     // and insert both the old and new indices into the map.
+    ++map_spills_;
     const IndexType old_index(position_index, index.texcoord, index.normal);
     map_.insert(std::make_pair(old_index, index.position_or_flat));
     index.position_or_flat = kIndexNotInTable;
@@ -166,6 +185,7 @@ class IndexFlattener {
   std::pair<int, bool> GetFlattenedIndexFromMap(int position_index,
                                                 int texcoord_index,
                                                 int normal_index) {
+    ++map_lookups_;
     IndexType index(position_index, texcoord_index, normal_index);
     MapType::iterator iter = map_.lower_bound(index);
     if (iter == map_.end() || iter->first != index) {
@@ -226,27 +246,196 @@ class IndexFlattener {
   typedef std::map<IndexType, int> MapType;
 
   int count_;
+  size_t map_spills_;
+  size_t map_lookups_;
   std::vector<IndexType> table_;
   MapType map_;
 };
 
+// Flattens every corner at once, where IndexFlattener goes one corner
+// at a time. corners holds 3 ints per corner: 0-based position,
+// texcoord and normal indices, -1 if absent. Corners are radix sorted
+// by position, so those that share a position end up adjacent, in
+// order, and texcoords and normals are told apart within those short
+// runs. That gives each corner the first corner of its triple, and
+// first corners are numbered in order, which is IndexFlattener's
+// numbering. Every step runs in parallel over chunks.
+class BulkIndexFlattener {
+ public:
+  explicit BulkIndexFlattener(const std::vector<int>& corners)
+      : corners_(corners),
+        num_corners_(corners.size() / 3),
+        num_chunks_(std::max<size_t>(1, std::min(4 * NumThreads(),
+                                                 num_corners_ / (1 << 14)))),
+        chunk_size_((num_corners_ + num_chunks_ - 1) / num_chunks_),
+        triple_starts_(num_corners_),
+        chunk_counts_(num_chunks_, 0),
+        flat_indices_(NULL),
+        first_corners_out_(NULL),
+        step_(kLabelCorners) {
+  }
+
+  // Writes a flat index per corner and, for each flat index, the
+  // corner that introduced it. Returns the number of flat indices.
+  size_t Flatten(std::vector<int>* flat_indices,
+                 std::vector<uint32>* first_corners) {
+    std::vector<uint64> positions(num_corners_);
+    sorted_corners_.resize(num_corners_);
+    size_t position_bits = 0;
+    for (size_t c = 0; c < num_corners_; ++c) {
+      const int position = corners_[3 * c];
+      CHECK(position >= 0);
+      while (position >> position_bits) ++position_bits;
+      positions[c] = position;
+      sorted_corners_[c] = c;
+    }
+    RadixSort(position_bits, &positions, &sorted_corners_);
+    // Chunks of the sorted corners start on a new position.
+    run_starts_.assign(1, 0);
+    for (size_t i = 1; i < num_chunks_; ++i) {
+      size_t start = std::max(run_starts_.back(), i * chunk_size_);
+      while (start < num_corners_ &&
+             positions[start] == positions[start - 1]) {
+        ++start;
+      }
+      run_starts_.push_back(std::min(start, num_corners_));
+    }
+    run_starts_.push_back(num_corners_);
+    std::vector<uint64>().swap(positions);
+    step_ = kLabelCorners;
+    ParallelFor(num_chunks_, this);
+    step_ = kCountFirstCorners;
+    ParallelFor(num_chunks_, this);
+    size_t num_flat = 0;
+    for (size_t i = 0; i < num_chunks_; ++i) {
+      const size_t count = chunk_counts_[i];
+      chunk_counts_[i] = num_flat;
+      num_flat += count;
+    }
+    flat_indices->resize(num_corners_);
+    first_corners->resize(num_flat);
+    if (!num_corners_) return 0;
+    flat_indices_ = &(*flat_indices)[0];
+    first_corners_out_ = &(*first_corners)[0];
+    step_ = kNumberFirstCorners;
+    ParallelFor(num_chunks_, this);
+    step_ = kNumberCorners;
+    ParallelFor(num_chunks_, this);
+    return num_flat;
+  }
+
+  void operator()(size_t chunk) {
+    if (step_ == kLabelCorners) {
+      LabelCorners(run_starts_[chunk], run_starts_[chunk + 1]);
+      return;
+    }
+    const size_t begin = chunk * chunk_size_;
+    const size_t end = std::min(begin + chunk_size_, num_corners_);
+    if (step_ == kCountFirstCorners) {
+      size_t count = 0;
+      for (size_t c = begin; c < end; ++c) {
+        count += triple_starts_[c] == c;
+      }
+      chunk_counts_[chunk] = count;
+    } else if (step_ == kNumberFirstCorners) {
+      size_t next = chunk_counts_[chunk];
+      for (size_t c = begin; c < end; ++c) {
+        if (triple_starts_[c] == c) {
+          first_corners_out_[next] = c;
+          flat_indices_[c] = next++;
+        }
+      }
+    } else {
+      for (size_t c = begin; c < end; ++c) {
+        flat_indices_[c] = flat_indices_[triple_starts_[c]];
+      }
+    }
+  }
+
+ private:
+  enum Step {
+    kLabelCorners,
+    kCountFirstCorners,
+    kNumberFirstCorners,
+    kNumberCorners,
+  };
+
+  // Labels each corner in [begin, end) of the sorted corners with the
+  // first corner of its triple. Runs of a position are a handful of
+  // corners, so a linear search usually beats sorting them.
+  void LabelCorners(size_t begin, size_t end) {
+    static const size_t kMaxSearchedRun = 64;
+    std::vector<std::pair<uint64, uint32> > run;
+    for (size_t i = begin; i < end; ) {
+      const int position = corners_[3 * sorted_corners_[i]];
+      run.clear();
+      for (; i < end && corners_[3 * sorted_corners_[i]] == position; ++i) {
+        const uint32 corner = sorted_corners_[i];
+        const uint64 other =
+            (static_cast<uint64>(static_cast<uint32>(corners_[3 * corner + 1]))
+             << 32) | static_cast<uint32>(corners_[3 * corner + 2]);
+        run.push_back(std::make_pair(other, corner));
+      }
+      if (run.size() <= kMaxSearchedRun) {
+        for (size_t j = 0; j < run.size(); ++j) {
+          size_t k = 0;
+          while (run[k].first != run[j].first) ++k;
+          triple_starts_[run[j].second] = run[k].second;
+        }
+      } else {
+        // Ties on the texcoord and normal fall back on corner order.
+        std::sort(run.begin(), run.end());
+        for (size_t j = 0, k = 0; j < run.size(); ++j) {
+          if (run[j].first != run[k].first) k = j;
+          triple_starts_[run[j].second] = run[k].second;
+        }
+      }
+    }
+  }
+
+  const std::vector<int>& corners_;
+  size_t num_corners_;
+  size_t num_chunks_;
+  size_t chunk_size_;
+  std::vector<uint32> sorted_corners_;
+  std::vector<size_t> run_starts_;  // Chunks of sorted_corners_.
+  std::vector<uint32> triple_starts_;  // Per corner, its triple's first.
+  std::vector<size_t> chunk_counts_;  // Then flat index offsets.
+  int* flat_indices_;
+  uint32* first_corners_out_;
+  Step step_;
+};
+
+size_t FlattenIndicesBulk(const std::vector<int>& corners,
+                          std::vector<int>* flat_indices,
+                          std::vector<uint32>* first_corners) {
+  return BulkIndexFlattener(corners).Flatten(flat_indices, first_corners);
+}
+
+enum FlattenMode {
+  kFlattenIncremental,  // IndexFlattener, as faces are parsed.
+  kFlattenBulk,  // FlattenIndicesBulk, once the file is parsed.
+};
+
 static inline size_t positionDim() { return 3; }
 static inline size_t texcoordDim() { return 2; }
 static inline size_t normalDim() { return 3; }
+static inline size_t colorDim() { return 3; }
 
+// The bounds of each column of a VertexLayout.
 struct Bounds {
-  float mins[8];
-  float maxes[8];
+  float mins[VertexLayout::kMaxStride];
+  float maxes[VertexLayout::kMaxStride];
 
   void Clear() {
-    for (size_t i = 0; i < 8; ++i) {
+    for (size_t i = 0; i < VertexLayout::kMaxStride; ++i) {
       mins[i] = FLT_MAX;
       maxes[i] = -FLT_MAX;
     }
   }
 
-  void EncloseAttrib(const float* attribs) {
-    for (size_t i = 0; i < 8; ++i) {
+  void EncloseAttrib(const float* attribs, size_t stride) {
+    for (size_t i = 0; i < stride; ++i) {
       const float attrib = attribs[i];
       if (mins[i] > attrib) {
         mins[i] = attrib;
@@ -257,9 +446,9 @@ struct Bounds {
     }
   }
 
-  void Enclose(const AttribList& attribs) {
-    for (size_t i = 0; i < attribs.size(); i += 8) {
-      EncloseAttrib(&attribs[i]);
+  void Enclose(const AttribList& attribs, size_t stride) {
+    for (size_t i = 0; i < attribs.size(); i += stride) {
+      EncloseAttrib(&attribs[i], stride);
     }
   }
 
@@ -285,6 +474,8 @@ class DrawBatch {
  public:
   DrawBatch()
       : flattener_(0),
+        flatten_mode_(kFlattenIncremental),
+        deferred_(false),
         current_group_line_(0xFFFFFFFF) {
   }
 
@@ -292,88 +483,259 @@ class DrawBatch {
     return group_starts_;
   }
 
-  void Init(AttribList* positions, AttribList* texcoords, AttribList* normals) {
+  // With deferred, corners are kept by AddTriangle, for Weld and
+  // SetNormals, and flattened by Flatten; kFlattenBulk is always
+  // deferred.
+  void Init(AttribList* positions, AttribList* texcoords, AttribList* normals,
+            FlattenMode flatten_mode, bool deferred) {
     positions_ = positions;
     texcoords_ = texcoords;
     normals_ = normals;
-    flattener_.reserve(1024);
+    flatten_mode_ = flatten_mode;
+    deferred_ = deferred || flatten_mode == kFlattenBulk;
+    if (flatten_mode == kFlattenIncremental) {
+      flattener_.reserve(1024);
+    }
   }
 
-  void AddTriangle(unsigned int group_line, int* indices) {
+  void AddTriangle(unsigned int group_line, unsigned int smoothing_group,
+                   int* indices) {
     if (group_line != current_group_line_) {
       current_group_line_ = group_line;
       GroupStart group_start;
-      group_start.offset = draw_mesh_.indices.size();
+      group_start.offset = num_corners();
       group_start.group_line = group_line;
       group_start.min_index = INT_MAX;
       group_start.max_index = INT_MIN;
       group_start.bounds.Clear();
       group_starts_.push_back(group_start);
     }
-    GroupStart& group = group_starts_.back();
+    if (deferred_) {
+      smoothing_groups_.push_back(smoothing_group);
+    }
     for (size_t i = 0; i < 9; i += 3) {
       // .OBJ files use 1-based indexing.
       const int position_index = indices[i + 0] - 1;
       const int texcoord_index = indices[i + 1] - 1;
       const int normal_index = indices[i + 2] - 1;
+      if (deferred_) {
+        // Flatten() does the rest.
+        corners_.push_back(position_index);
+        corners_.push_back(texcoord_index);
+        corners_.push_back(normal_index);
+        continue;
+      }
       const std::pair<int, bool> flattened = flattener_.GetFlattenedIndex(
           position_index, texcoord_index, normal_index);
       const int flat_index = flattened.first;
       CHECK(flat_index >= 0);
       draw_mesh_.indices.push_back(flat_index);
       if (flattened.second) {
-        // This is a new index. Keep track of index ranges and vertex
-        // bounds.
-        if (flat_index > group.max_index) {
-          group.max_index = flat_index;
-        }
-        if (flat_index < group.min_index) {
-          group.min_index = flat_index;
-        }
-        const size_t new_loc = draw_mesh_.attribs.size();
-        CHECK(8*size_t(flat_index) == new_loc);
-        for (size_t i = 0; i < positionDim(); ++i) {
-          draw_mesh_.attribs.push_back(
-              positions_->at(positionDim() * position_index + i));
-        }
-        if (texcoord_index == -1) {
-          for (size_t i = 0; i < texcoordDim(); ++i) {
-            draw_mesh_.attribs.push_back(0);
-          }
-        } else {
-          for (size_t i = 0; i < texcoordDim(); ++i) {
-            draw_mesh_.attribs.push_back(
-                texcoords_->at(texcoordDim() * texcoord_index + i));
-          }
-        }
-        if (normal_index == -1) {
-          for (size_t i = 0; i < normalDim(); ++i) {
-            draw_mesh_.attribs.push_back(0);
-          }
-        } else {
-          for (size_t i = 0; i < normalDim(); ++i) {
-            draw_mesh_.attribs.push_back(
-                normals_->at(normalDim() * normal_index + i));
-          }
-        }
-        // TODO: is the covariance body useful for anything?
-        group.bounds.EncloseAttrib(&draw_mesh_.attribs[new_loc]);
+        AddVertex(flat_index, position_index, texcoord_index, normal_index);
       }
     }
   }
 
+  // Replaces the indices of the corners kept by a deferred AddTriangle
+  // by their welded ones, before Flatten.
+  void Weld(const WeldMaps& maps) {
+    CHECK(deferred_);
+    const std::vector<int>* remaps[3] = {
+      &maps.positions, &maps.texcoords, &maps.normals
+    };
+    for (size_t i = 0; i < corners_.size(); ++i) {
+      const std::vector<int>& remap = *remaps[i % 3];
+      // Out of range indices are left for Flatten to fail on.
+      if (corners_[i] >= 0 && corners_[i] < static_cast<int>(remap.size())) {
+        corners_[i] = remap[corners_[i]];
+      }
+    }
+  }
+
+  // Appends the position and normal index of each corner kept by a
+  // deferred AddTriangle, and the smoothing group of each triangle.
+  void GetCorners(std::vector<int>* positions, std::vector<int>* normals,
+                  std::vector<unsigned int>* smoothing_groups) const {
+    CHECK(deferred_);
+    for (size_t i = 0; i < corners_.size(); i += 3) {
+      positions->push_back(corners_[i]);
+      normals->push_back(corners_[i + 2]);
+    }
+    smoothing_groups->insert(smoothing_groups->end(),
+                             smoothing_groups_.begin(),
+                             smoothing_groups_.end());
+  }
+
+  size_t num_corners() const {
+    return deferred_ ? corners_.size() / 3 : draw_mesh_.indices.size();
+  }
+
+  // Replaces the normal index of each corner by normals[offset + i],
+  // for the i-th corner GetCorners appended.
+  void SetNormals(const std::vector<int>& normals, size_t offset) {
+    CHECK(deferred_);
+    for (size_t i = 2; i < corners_.size(); i += 3) {
+      corners_[i] = normals[offset++];
+    }
+  }
+
+  // When deferred, flattens the corners kept by AddTriangle, in bulk
+  // or one by one. The result is the same as flattening while parsing.
+  // Either way, sets the bounds of each group and publishes the
+  // batch's triangle, vertex and flattener counts, once the file is
+  // parsed.
+  void Flatten() {
+    Stats& stats = Stats::Get();
+    stats.Increment(Stats::kTriangles, num_corners() / 3);
+    FlattenCorners();
+    EncloseGroups();
+    stats.Increment(Stats::kFlattenedVertices, position_indices_.size());
+    stats.Increment(Stats::kFlattenerMapSpills, flattener_.map_spills());
+    stats.Increment(Stats::kFlattenerMapLookups, flattener_.map_lookups());
+  }
+
+  // Adds the color of each vertex's position to its layout, once
+  // flattened.
+  void AddColors(const AttribList& colors) {
+    ScopedTimer timer(Stats::kFlatten);
+    AttribList vertex_colors;
+    vertex_colors.reserve(colorDim() * position_indices_.size());
+    for (size_t v = 0; v < position_indices_.size(); ++v) {
+      const float* color = &colors.at(colorDim() * position_indices_[v]);
+      vertex_colors.insert(vertex_colors.end(), color, color + colorDim());
+    }
+    DrawMesh with_colors;
+    AddAttribColumns(draw_mesh_, kColorAttrib, vertex_colors, &with_colors);
+    std::swap(draw_mesh_, with_colors);
+  }
+
   const DrawMesh& draw_mesh() const {
     return draw_mesh_;
   }
+
+  // The .OBJ position index of each flattened vertex. Vertices that
+  // share one were split by the flattener along a texture or normal
+  // seam.
+  const std::vector<int>& position_indices() const {
+    return position_indices_;
+  }
  private:
   AttribList* positions_, *texcoords_, *normals_;
   DrawMesh draw_mesh_;
+
+  void FlattenCorners() {
+    if (!deferred_) return;
+    ScopedTimer timer(Stats::kFlatten);
+
+    std::vector<uint32> first_corners;
+    if (flatten_mode_ == kFlattenBulk) {
+      FlattenIndicesBulk(corners_, &draw_mesh_.indices, &first_corners);
+    } else {
+      draw_mesh_.indices.reserve(corners_.size() / 3);
+      for (size_t i = 0; i < corners_.size(); i += 3) {
+        const std::pair<int, bool> flattened = flattener_.GetFlattenedIndex(
+            corners_[i], corners_[i + 1], corners_[i + 2]);
+        CHECK(flattened.first >= 0);
+        draw_mesh_.indices.push_back(flattened.first);
+        if (flattened.second) first_corners.push_back(i / 3);
+      }
+    }
+    draw_mesh_.attribs.reserve(draw_mesh_.layout.stride() *
+                              first_corners.size());
+    position_indices_.reserve(first_corners.size());
+    for (size_t v = 0; v < first_corners.size(); ++v) {
+      const size_t corner = first_corners[v];
+      AddVertex(v, corners_[3 * corner + 0], corners_[3 * corner + 1],
+                corners_[3 * corner + 2]);
+    }
+    std::vector<int>().swap(corners_);
+    std::vector<unsigned int>().swap(smoothing_groups_);
+  }
+
+
+  // Appends the attributes of a new flat vertex.
+  void AddVertex(int flat_index, int position_index, int texcoord_index,
+                 int normal_index) {
+    const size_t new_loc = draw_mesh_.attribs.size();
+    CHECK(draw_mesh_.layout.stride() * size_t(flat_index) == new_loc);
+    position_indices_.push_back(position_index);
+    for (size_t i = 0; i < positionDim(); ++i) {
+      draw_mesh_.attribs.push_back(
+          positions_->at(positionDim() * position_index + i));
+    }
+    if (texcoord_index == -1) {
+      for (size_t i = 0; i < texcoordDim(); ++i) {
+        draw_mesh_.attribs.push_back(0);
+      }
+    } else {
+      for (size_t i = 0; i < texcoordDim(); ++i) {
+        draw_mesh_.attribs.push_back(
+            texcoords_->at(texcoordDim() * texcoord_index + i));
+      }
+    }
+    if (normal_index == -1) {
+      for (size_t i = 0; i < normalDim(); ++i) {
+        draw_mesh_.attribs.push_back(0);
+      }
+    } else {
+      for (size_t i = 0; i < normalDim(); ++i) {
+        draw_mesh_.attribs.push_back(
+            normals_->at(normalDim() * normal_index + i));
+      }
+    }
+  }
+
+  // Sets each group's index range and bounds over every vertex its
+  // triangles use, including those first flattened by an earlier group,
+  // so that its box holds all of its geometry.
+  void EncloseGroups() {
+    ScopedTimer timer(Stats::kFlatten);
+    const size_t stride = draw_mesh_.layout.stride();
+    const IndexList& indices = draw_mesh_.indices;
+    for (size_t g = 0; g < group_starts_.size(); ++g) {
+      GroupStart& group = group_starts_[g];
+      const size_t end = (g + 1 < group_starts_.size()) ?
+          group_starts_[g + 1].offset : indices.size();
+      for (size_t i = group.offset; i < end; ++i) {
+        const int index = indices[i];
+        group.min_index = std::min(group.min_index, index);
+        group.max_index = std::max(group.max_index, index);
+        // TODO: is the covariance body useful for anything?
+        group.bounds.EncloseAttrib(&draw_mesh_.attribs[stride * index],
+                                   stride);
+      }
+    }
+  }
+
+  std::vector<int> position_indices_;
   IndexFlattener flattener_;
+  FlattenMode flatten_mode_;
+  bool deferred_;
+  std::vector<int> corners_;  // Unflattened triples, when deferred.
+  std::vector<unsigned int> smoothing_groups_;  // Per triangle, likewise.
   unsigned int current_group_line_;
   std::vector<GroupStart> group_starts_;
 };
 
 struct Material {
+  Material() {
+    Kd[0] = Kd[1] = Kd[2] = 1;
+  }
+
+  // Materials with the same key look the same, as DumpJson writes
+  // them: the same texture or, without one, the same 8-bit color.
+  std::string Key() const {
+    if (!map_Kd.empty()) {
+      return "map_Kd " + map_Kd;
+    }
+    char key[32];
+    snprintf(key, sizeof(key), "Kd %hu %hu %hu",
+             Quantize(Kd[0], 0, 1, 255),
+             Quantize(Kd[1], 0, 1, 255),
+             Quantize(Kd[2], 0, 1, 255));
+    return key;
+  }
+
   std::string name;
   float Kd[3];
   std::string map_Kd;
@@ -473,12 +835,51 @@ typedef std::map<std::string, DrawBatch> MaterialBatches;
 // object.
 class WavefrontObjFile {
  public:
-  explicit WavefrontObjFile(FILE* fp) {
+  // With a weld_epsilon of 0 or more, attributes are welded (see
+  // weld.h) before flattening. With a crease_angle of 0 or more, in
+  // degrees, faces without normals get them (see normals.h).
+  // Flattening, by flatten_mode, then waits until both are done; the
+  // incremental flattener is the faster one on few threads. With
+  // merge_materials, materials with the same Key() share the batch of
+  // the first one.
+  explicit WavefrontObjFile(FILE* fp,
+                            FlattenMode flatten_mode = kFlattenIncremental,
+                            float weld_epsilon = -1,
+                            float crease_angle = -1,
+                            bool merge_materials = false)
+      : flatten_mode_(flatten_mode),
+        deferred_(weld_epsilon >= 0 || crease_angle >= 0),
+        merge_materials_(merge_materials),
+        current_smoothing_group_(0) {
     current_batch_ = &material_batches_[""];
-    current_batch_->Init(&positions_, &texcoords_, &normals_);
+    current_batch_->Init(&positions_, &texcoords_, &normals_, flatten_mode_,
+                         deferred_);
     current_group_line_ = 0;
     line_to_groups_.insert(std::make_pair(0, "default"));
     ParseFile(fp);
+    NormalizeColors();
+    WeldMaps weld_maps;
+    if (weld_epsilon >= 0) {
+      WeldAttribs(positions_, colors_, texcoords_, normals_, weld_epsilon,
+                  &weld_maps);
+    }
+    for (MaterialBatches::iterator iter = material_batches_.begin();
+         iter != material_batches_.end(); ++iter) {
+      if (weld_epsilon >= 0) iter->second.Weld(weld_maps);
+    }
+    if (crease_angle >= 0) GenerateNormals(crease_angle);
+    for (MaterialBatches::iterator iter = material_batches_.begin();
+         iter != material_batches_.end(); ++iter) {
+      iter->second.Flatten();
+      if (!colors_.empty()) iter->second.AddColors(colors_);
+    }
+  }
+
+  // The layout of every batch's vertices: with kColorAttrib only if
+  // the file has colors.
+  VertexLayout layout() const {
+    const VertexLayout layout;
+    return colors_.empty() ? layout : layout.With(kColorAttrib);
   }
 
   const MaterialList& materials() const {
@@ -515,9 +916,34 @@ class WavefrontObjFile {
            positions_.size(), texcoords_.size(), normals_.size());
   }
  private:
-  WavefrontObjFile() { }  // For testing.
+  WavefrontObjFile()  // For testing.
+      : flatten_mode_(kFlattenIncremental),
+        deferred_(false),
+        current_smoothing_group_(0) {
+  }
+
+  // Normals are shaded across batches, so that materials don't seam.
+  void GenerateNormals(float crease_angle) {
+    std::vector<int> corner_positions;
+    std::vector<int> corner_normals;
+    std::vector<unsigned int> smoothing_groups;
+    for (MaterialBatches::const_iterator iter = material_batches_.begin();
+         iter != material_batches_.end(); ++iter) {
+      iter->second.GetCorners(&corner_positions, &corner_normals,
+                              &smoothing_groups);
+    }
+    NormalGenerator(positions_, corner_positions, smoothing_groups,
+                    crease_angle).Generate(&normals_, &corner_normals);
+    size_t offset = 0;
+    for (MaterialBatches::iterator iter = material_batches_.begin();
+         iter != material_batches_.end(); ++iter) {
+      iter->second.SetNormals(corner_normals, offset);
+      offset += iter->second.num_corners();
+    }
+  }
 
   void ParseFile(FILE* fp) {
+    ScopedTimer timer(Stats::kParse);
     // TODO: don't use a fixed-size buffer.
     const size_t kLineBufferSize = 256;
     char buffer[kLineBufferSize] = { 0 };
@@ -527,6 +953,7 @@ class WavefrontObjFile {
       TerminateAtNewlineOrComment(stripped);
       ParseLine(stripped, line_num++);
     }
+    Stats::Get().Increment(Stats::kLines, line_num - 1);
   }
 
   void ParseLine(const char* line, unsigned int line_num) {
@@ -593,10 +1020,31 @@ class WavefrontObjFile {
 
   void ParsePosition(const ShortFloatList& floats, unsigned int line_num) {
     if (floats.size() != positionDim() &&
-        floats.size() != 6) {  // ignore r g b for now.
+        floats.size() != positionDim() + colorDim()) {
       ErrorLine("bad position", line_num);
     }
     floats.AppendNTo(&positions_, positionDim());
+    if (floats.size() == positionDim() + colorDim()) {
+      // Positions before the first color have none.
+      colors_.resize(positions_.size() - positionDim(), kNoColor);
+      for (size_t i = 0; i < colorDim(); ++i) {
+        colors_.push_back(std::max(0.0f, floats[positionDim() + i]));
+      }
+    } else if (!colors_.empty()) {
+      colors_.resize(positions_.size(), kNoColor);
+    }
+  }
+
+  // Colors are in [0, 1], or in [0, 255] if any is above 1. Positions
+  // without one are white.
+  void NormalizeColors() {
+    if (colors_.empty()) return;
+    const float max_color = *std::max_element(colors_.begin(), colors_.end());
+    const float scale = max_color > 1 ? 1.0f / 255 : 1.0f;
+    for (size_t i = 0; i < colors_.size(); ++i) {
+      colors_[i] = (colors_[i] == kNoColor) ?
+          1.0f : std::min(1.0f, scale * colors_[i]);
+    }
   }
 
   void ParseTexCoord(const ShortFloatList& floats, unsigned int line_num) {
@@ -615,9 +1063,9 @@ class WavefrontObjFile {
     floats.AppendTo(&normals_);
   }
 
-  // Parses faces and converts to triangle fans. This is not a
-  // particularly good tesselation in general case, but it is really
-  // simple, and is perfectly fine for triangles and quads.
+  // Parses faces. Triangles and quads become triangle fans; faces
+  // with more vertices are ear clipped, since fans of those are often
+  // slivers, or outside the face when it is concave.
   void ParseFace(const char* line, unsigned int line_num) {
     // Also handle face outlines as faces.
     if (*line == 'o') ++line;
@@ -626,27 +1074,54 @@ class WavefrontObjFile {
     // sense to flatten them right away. This can reduce memory
     // consumption and improve access locality, especially since .OBJ
     // face indices are so needlessly large.
-    int indices[9] = { 0 };
-    // The first index acts as the pivot for the triangle fan.
-    line = ParseIndices(line, line_num, indices + 0, indices + 1, indices + 2);
-    if (line == NULL) {
+    face_indices_.clear();
+    int indices[3] = { 0 };
+    while ((line = ParseIndices(line, line_num,
+                                indices + 0, indices + 1, indices + 2))) {
+      face_indices_.insert(face_indices_.end(), indices, indices + 3);
+    }
+    const size_t num_corners = face_indices_.size() / 3;
+    if (num_corners < 1) {
       ErrorLine("bad first index", line_num);
     }
-    line = ParseIndices(line, line_num, indices + 3, indices + 4, indices + 5);
-    if (line == NULL) {
+    if (num_corners < 2) {
       ErrorLine("bad second index", line_num);
     }
-    // After the first two indices, each index introduces a new
-    // triangle to the fan.
-    while ((line = ParseIndices(line, line_num,
-                                indices + 6, indices + 7, indices + 8))) {
-      current_batch_->AddTriangle(current_group_line_, indices);
-      // The most recent vertex is reused for the next triangle.
-      indices[3] = indices[6];
-      indices[4] = indices[7];
-      indices[5] = indices[8];
-      indices[6] = indices[7] = indices[8] = 0;
+    if (num_corners > 4 && TriangulateFace(num_corners)) return;
+    // The first corner acts as the pivot for the triangle fan.
+    for (size_t i = 2; i < num_corners; ++i) {
+      AddFaceTriangle(0, i - 1, i);
+    }
+  }
+
+  // Ear clips the face in face_indices_, unless it refers to
+  // positions that are not defined yet.
+  bool TriangulateFace(size_t num_corners) {
+    const int num_positions = positions_.size() / positionDim();
+    face_points_.clear();
+    for (size_t i = 0; i < num_corners; ++i) {
+      const int position_index = face_indices_[3 * i] - 1;
+      if (position_index < 0 || position_index >= num_positions) {
+        return false;
+      }
+      const float* position = &positions_[positionDim() * position_index];
+      face_points_.insert(face_points_.end(), position, position + 3);
     }
+    const std::vector<int>& triangles =
+        triangulator_.Triangulate(&face_points_[0], num_corners);
+    for (size_t i = 0; i < triangles.size(); i += 3) {
+      AddFaceTriangle(triangles[i], triangles[i + 1], triangles[i + 2]);
+    }
+    return true;
+  }
+
+  void AddFaceTriangle(size_t a, size_t b, size_t c) {
+    int indices[9];
+    std::copy(&face_indices_[3 * a], &face_indices_[3 * a] + 3, indices);
+    std::copy(&face_indices_[3 * b], &face_indices_[3 * b] + 3, indices + 3);
+    std::copy(&face_indices_[3 * c], &face_indices_[3 * c] + 3, indices + 6);
+    current_batch_->AddTriangle(current_group_line_,
+                                current_smoothing_group_, indices);
   }
 
   // Parse a single group of indices, separated by slashes ('/').
@@ -690,11 +1165,17 @@ class WavefrontObjFile {
     current_group_line_ = line_num;
   }
 
+  // "s off" is the same as "s 0": faces that are not smoothed.
   void ParseSmoothingGroup(const char* line, unsigned int line_num) {
-    static bool once = true;
-    if (once) {
-      WarnLine("s ignored", line_num);
-      once = false;
+    line = StripLeadingWhitespace(line);
+    if (0 == strncmp(line, "off", 3)) {
+      current_smoothing_group_ = 0;
+      return;
+    }
+    char* endptr = NULL;
+    current_smoothing_group_ = strtoul(line, &endptr, 10);
+    if (endptr == line) {
+      WarnLine("bad smoothing group", line_num);
     }
   }
 
@@ -707,15 +1188,47 @@ class WavefrontObjFile {
     WavefrontMtlFile mtlfile(fp);
     fclose(fp);
     materials_ = mtlfile.materials();
+    if (merge_materials_) MergeMaterials();
     for (size_t i = 0; i < materials_.size(); ++i) {
       DrawBatch& draw_batch = material_batches_[materials_[i].name];
-      draw_batch.Init(&positions_, &texcoords_, &normals_);
+      draw_batch.Init(&positions_, &texcoords_, &normals_, flatten_mode_,
+                      deferred_);
     }
   }
 
+  // Texture paths are made canonical, then each material that has the
+  // Key() of one before it is dropped, and its faces go to that one's
+  // batch. Faces of the two can then share vertices, and the vertex
+  // optimizer sees them as one mesh.
+  void MergeMaterials() {
+    std::map<std::string, std::string> canonical_names;  // By Key().
+    MaterialList merged;
+    for (size_t i = 0; i < materials_.size(); ++i) {
+      Material& material = materials_[i];
+      if (!material.map_Kd.empty()) {
+        material.map_Kd = CanonicalPath(material.map_Kd);
+      }
+      const std::pair<std::map<std::string, std::string>::iterator, bool>
+          inserted = canonical_names.insert(
+              std::make_pair(material.Key(), material.name));
+      if (inserted.second) {
+        merged.push_back(material);
+      } else {
+        material_aliases_[material.name] = inserted.first->second;
+        Stats::Get().Increment(Stats::kMergedMaterials);
+      }
+    }
+    materials_.swap(merged);
+  }
+
   void ParseUsemtl(const char* line, unsigned int line_num) {
     std::string usemtl;
     ToLower(StripLeadingWhitespace(line), &usemtl);
+    std::map<std::string, std::string>::const_iterator alias =
+        material_aliases_.find(usemtl);
+    if (alias != material_aliases_.end()) {
+      usemtl = alias->second;
+    }
     MaterialBatches::iterator iter = material_batches_.find(usemtl);
     if (iter == material_batches_.end()) {
       ErrorLine("material not found", line_num);
@@ -732,10 +1245,18 @@ class WavefrontObjFile {
     exit(-1);
   }
 
+  static const float kNoColor;
+
   AttribList positions_;
+  AttribList colors_;  // Per position, if any position has one.
   AttribList texcoords_;
   AttribList normals_;
   MaterialList materials_;
+  FlattenMode flatten_mode_;
+  bool deferred_;  // Flattening waits for welding or normals.
+  bool merge_materials_;
+  // Merged material names, to the one whose batch they share.
+  std::map<std::string, std::string> material_aliases_;
 
   // Currently, batch by texture (i.e. map_Kd).
   MaterialBatches material_batches_;
@@ -745,12 +1266,61 @@ class WavefrontObjFile {
   LineToGroups line_to_groups_;
   std::map<std::string, int> group_counts_;
   unsigned int current_group_line_;
+  unsigned int current_smoothing_group_;
+
+  // Scratch space for faces, kept between them.
+  std::vector<int> face_indices_;
+  AttribList face_points_;
+  PolygonTriangulator triangulator_;
+};
+
+const float WavefrontObjFile::kNoColor = -1;
+
+// How values between two quantization steps are mapped. Truncation
+// decodes up to a step low, rounding up to half a step either way;
+// dithering rounds by a pseudo-random threshold, fixed per word, so
+// errors are unbiased and don't band along smooth gradients.
+enum QuantizeMode {
+  kQuantizeTruncate,
+  kQuantizeRound,
+  kQuantizeDither
 };
 
+// Parses the value of a --quantize flag.
+bool ParseQuantizeMode(const char* value, QuantizeMode* mode) {
+  if (0 == strcmp(value, "truncate")) {
+    *mode = kQuantizeTruncate;
+  } else if (0 == strcmp(value, "round")) {
+    *mode = kQuantizeRound;
+  } else if (0 == strcmp(value, "dither")) {
+    *mode = kQuantizeDither;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// The dither threshold of the nth quantized word, in [0, 1): an
+// integer hash (MurmurHash3's finalizer), so output is reproducible.
+float DitherThreshold(uint32 n) {
+  n ^= n >> 16;
+  n *= 0x85ebca6b;
+  n ^= n >> 13;
+  n *= 0xc2b2ae35;
+  n ^= n >> 16;
+  return (n >> 8) * (1.0f / (1 << 24));
+}
+
 // TODO: make maxPosition et. al. configurable.
 struct BoundsParams {
-  static BoundsParams FromBounds(const Bounds& bounds) {
+  static BoundsParams FromBounds(const Bounds& bounds,
+                                 const VertexLayout& layout = VertexLayout()) {
     BoundsParams ret;
+    ret.layout = layout;
+    ret.mode = kQuantizeTruncate;
+    for (size_t i = 0; i < VertexLayout::kMaxStride; ++i) {
+      ret.tiles[i] = 0;
+    }
     const float scale = bounds.UniformScale();
     // Position. Use a uniform scale.
     for (size_t i = 0; i < 3; ++i) {
@@ -761,9 +1331,10 @@ struct BoundsParams {
       ret.decodeOffsets[i] = maxPosition * bounds.mins[i] / scale;
       ret.decodeScales[i] = scale / maxPosition;
     }
-    // TexCoord.
-    // TODO: get bounds-dependent texcoords working!
-    for (size_t i = 3; i < 5; ++i) {
+    // TexCoord, over [0, 1]. See WithTexcoordBounds for texcoords that
+    // are not.
+    const size_t texcoord = layout.offset(kTexcoordAttrib);
+    for (size_t i = texcoord; i < texcoord + 2; ++i) {
       // const float texScale = bounds.maxes[i] - bounds.mins[i];
       const int maxTexcoord = (1 << 10) - 1;  // 1023
       ret.mins[i] = 0;  //bounds.mins[i];
@@ -773,46 +1344,168 @@ struct BoundsParams {
       ret.decodeScales[i] = 1.0f / maxTexcoord;  // texScale / maxTexcoord;
     }
     // Normal. Always uniform range.
-    for (size_t i = 5; i < 8; ++i) {
+    const size_t normal = layout.offset(kNormalAttrib);
+    for (size_t i = normal; i < normal + 3; ++i) {
       ret.mins[i] = -1;
       ret.scales[i] = 2.f;
       ret.outputMaxes[i] = (1 << 10) - 1;  // 1023
       ret.decodeOffsets[i] = 1 - (1 << 9);  // -511
       ret.decodeScales[i] = 1.0 / 511;
     }
+    if (layout.has(kTangentAttrib)) {
+      // Angle and handedness (see tangents.h).
+      const size_t tangent = layout.offset(kTangentAttrib);
+      ret.mins[tangent] = -M_PI;
+      ret.scales[tangent] = 2 * M_PI;
+      ret.outputMaxes[tangent] = (1 << 10) - 1;  // 1023
+      ret.mins[tangent + 1] = -1;
+      ret.scales[tangent + 1] = 2;
+      ret.outputMaxes[tangent + 1] = 2;
+      for (size_t i = 0; i < kTangentColumns; ++i) {
+        ret.decodeOffsets[tangent + i] = kTangentDecodeOffsets[i];
+        ret.decodeScales[tangent + i] = kTangentDecodeScales[i];
+      }
+    }
+    if (layout.has(kColorAttrib)) {
+      // 8 bits per channel.
+      const size_t color = layout.offset(kColorAttrib);
+      for (size_t i = color; i < color + 3; ++i) {
+        ret.mins[i] = 0;
+        ret.scales[i] = 1;
+        ret.outputMaxes[i] = (1 << 8) - 1;  // 255
+        ret.decodeOffsets[i] = 0;
+        ret.decodeScales[i] = 1.0f / 255;
+      }
+    }
+    return ret;
+  }
+
+  // These params, with texcoords quantized over bounds, the bounds of
+  // one batch, instead of [0, 1]: tiled texcoords are no longer
+  // clamped, and small ones get finer steps. Texcoords are decoded
+  // less the integer tile they start in, which REPEAT wrapping
+  // ignores, to keep decoded values small. Words are capped at 14
+  // bits, like positions, so their ZigZag deltas fit the 15 bits
+  // Uint16ToUtf8 takes: extents over 16 tiles get coarser steps than
+  // over [0, 1]. The grid starts on a whole step from the tile, so
+  // decodeOffsets are exact.
+  BoundsParams WithTexcoordBounds(const Bounds& bounds) const {
+    BoundsParams ret = *this;
+    const size_t texcoord = layout.offset(kTexcoordAttrib);
+    for (size_t i = texcoord; i < texcoord + 2; ++i) {
+      if (bounds.mins[i] > bounds.maxes[i]) continue;  // No vertices.
+      const float tile = floorf(bounds.mins[i]);
+      const float extent = bounds.maxes[i] - bounds.mins[i];
+      // One more step than the extent needs, for aligning the grid.
+      const int maxTexcoord = std::min(
+          (1 << 14) - 1,
+          std::max((1 << 10) - 1, static_cast<int>(ceilf(extent * 1023)) + 1));
+      const float step =
+          std::max(extent / (maxTexcoord - 1), 1.0f / (1 << 20));
+      const int offset =
+          static_cast<int>(floorf((bounds.mins[i] - tile) / step));
+      ret.tiles[i] = tile;
+      ret.mins[i] = tile + offset * step;
+      ret.scales[i] = maxTexcoord * step;
+      ret.outputMaxes[i] = maxTexcoord;
+      ret.decodeOffsets[i] = offset;
+      ret.decodeScales[i] = step;
+    }
     return ret;
   }
 
   void DumpJson() {
     puts("{");
-    printf("    decodeOffsets: [%d,%d,%d,%d,%d,%d,%d,%d],\n",
-           decodeOffsets[0], decodeOffsets[1], decodeOffsets[2],
-           decodeOffsets[3], decodeOffsets[4], decodeOffsets[5],
-           decodeOffsets[6], decodeOffsets[7]);
-    printf("    decodeScales: [%f,%f,%f,%f,%f,%f,%f,%f],\n",
-           decodeScales[0], decodeScales[1], decodeScales[2], decodeScales[3],
-           decodeScales[4], decodeScales[5], decodeScales[6], decodeScales[7]);
-    puts("  },");
-  }
-
-  float mins[8];
-  float scales[8];
-  int outputMaxes[8];
-  int decodeOffsets[8];
-  float decodeScales[8];
+    printf("    decodeOffsets: [");
+    for (size_t i = 0; i < layout.stride(); ++i) {
+      printf(i ? ",%d" : "%d", decodeOffsets[i]);
+    }
+    printf("],\n    decodeScales: [");
+    for (size_t i = 0; i < layout.stride(); ++i) {
+      printf(i ? ",%f" : "%f", decodeScales[i]);
+    }
+    puts("],\n  },");
+  }
+
+  // For a manifest entry with its own params (see WithTexcoordBounds),
+  // on one line. Steps need more digits than DumpJson prints for the
+  // grid to line up.
+  void DumpMeshJson() const {
+    printf("        decodeParams: { decodeOffsets: [");
+    for (size_t i = 0; i < layout.stride(); ++i) {
+      printf(i ? ",%d" : "%d", decodeOffsets[i]);
+    }
+    printf("], decodeScales: [");
+    for (size_t i = 0; i < layout.stride(); ++i) {
+      printf(i ? ",%.9g" : "%.9g", decodeScales[i]);
+    }
+    puts("] },");
+  }
+
+  VertexLayout layout;
+  QuantizeMode mode;
+  // What decoding drops: the integer tile of WithTexcoordBounds.
+  float tiles[VertexLayout::kMaxStride];
+  float mins[VertexLayout::kMaxStride];
+  float scales[VertexLayout::kMaxStride];
+  int outputMaxes[VertexLayout::kMaxStride];
+  int decodeOffsets[VertexLayout::kMaxStride];
+  float decodeScales[VertexLayout::kMaxStride];
 };
 
+template <size_t kStride>
+void QuantizeVertices(const AttribList& interleaved_attribs,
+                      const BoundsParams& bounds_params,
+                      uint16* quantized) {
+  for (size_t i = 0; i < interleaved_attribs.size(); i += kStride) {
+    for (size_t j = 0; j < kStride; ++j) {
+      quantized[i + j] = Quantize(interleaved_attribs[i + j],
+                                  bounds_params.mins[j],
+                                  bounds_params.scales[j],
+                                  bounds_params.outputMaxes[j]);
+    }
+  }
+}
+
+// Quantizes attribs in bounds_params.layout, as bounds_params.mode
+// says. When truncating, the strides of the usual layouts get loops
+// unrolled at compile time. Rounding and dithering are to the steps
+// clients decode to, decodeScales * (word + decodeOffsets), which for
+// positions and normals are not quite the ones truncation uses.
 void AttribsToQuantizedAttribs(const AttribList& interleaved_attribs,
                                const BoundsParams& bounds_params,
                                QuantizedAttribList* quantized_attribs) {
+  ScopedTimer timer(Stats::kQuantize);
   quantized_attribs->resize(interleaved_attribs.size());
-  for (size_t i = 0; i < interleaved_attribs.size(); i += 8) {
-    for (size_t j = 0; j < 8; ++j) {
-      quantized_attribs->at(i + j) = Quantize(interleaved_attribs[i + j],
-                                              bounds_params.mins[j],
-                                              bounds_params.scales[j],
-                                              bounds_params.outputMaxes[j]);
+  if (interleaved_attribs.empty()) return;
+  const AttribList& in = interleaved_attribs;
+  uint16* out = &(*quantized_attribs)[0];
+  const size_t stride = bounds_params.layout.stride();
+  if (bounds_params.mode != kQuantizeTruncate) {
+    const bool dither = bounds_params.mode == kQuantizeDither;
+    for (size_t i = 0; i < in.size(); i += stride) {
+      for (size_t j = 0; j < stride; ++j) {
+        const float step = bounds_params.decodeScales[j];
+        const int max = bounds_params.outputMaxes[j];
+        const float origin = bounds_params.tiles[j] +
+            step * bounds_params.decodeOffsets[j];
+        out[i + j] = Quantize(in[i + j], origin, step * max, max,
+                              dither ? DitherThreshold(i + j) : 0.5f);
+      }
     }
+    return;
+  }
+  switch (stride) {
+    case 8: QuantizeVertices<8>(in, bounds_params, out); break;
+    case 10: QuantizeVertices<10>(in, bounds_params, out); break;
+    default:
+      for (size_t i = 0; i < in.size(); i += stride) {
+        for (size_t j = 0; j < stride; ++j) {
+          out[i + j] = Quantize(in[i + j], bounds_params.mins[j],
+                                bounds_params.scales[j],
+                                bounds_params.outputMaxes[j]);
+        }
+      }
   }
 }
 
@@ -820,18 +1513,40 @@ uint16 ZigZag(int16 word) {
   return (word >> 15) ^ (word << 1);
 }
 
+// The position bounds in the quantized frame of total_bounds, on the
+// grid AttribsToQuantizedAttribs puts vertices on for its mode. When
+// rounding or dithering, mins are truncated and maxes go a step up,
+// past anything a bias below one reaches, so boxes hold the vertices
+// inside them.
+void QuantizeAABB(const Bounds& bounds, const BoundsParams& total_bounds,
+                  uint16* mins, uint16* maxes) {
+  const int maxPosition = (1 << 14) - 1;  // 16383;
+  for (int i = 0; i < 3; ++i) {
+    if (total_bounds.mode == kQuantizeTruncate) {
+      float total_min = total_bounds.mins[i];
+      float total_scale = total_bounds.scales[i];
+      mins[i] = Quantize(bounds.mins[i], total_min, total_scale, maxPosition);
+      maxes[i] = Quantize(bounds.maxes[i], total_min, total_scale,
+                          maxPosition);
+    } else {
+      const float step = total_bounds.decodeScales[i];
+      const float origin = total_bounds.tiles[i] +
+          step * total_bounds.decodeOffsets[i];
+      mins[i] = Quantize(bounds.mins[i], origin, step * maxPosition,
+                         maxPosition);
+      maxes[i] = Quantize(bounds.maxes[i], origin, step * maxPosition,
+                          maxPosition, 1.0f);
+    }
+  }
+}
+
 void CompressAABBToUtf8(const Bounds& bounds,
                         const BoundsParams& total_bounds,
                         std::vector<char>* utf8) {
-  const int maxPosition = (1 << 14) - 1;  // 16383;
+  ScopedTimer timer(Stats::kEncode);
   uint16 mins[3] = { 0 };
   uint16 maxes[3] = { 0 };
-  for (int i = 0; i < 3; ++i) {
-    float total_min = total_bounds.mins[i];
-    float total_scale = total_bounds.scales[i];
-    mins[i] = Quantize(bounds.mins[i], total_min, total_scale, maxPosition);
-    maxes[i] = Quantize(bounds.maxes[i], total_min, total_scale, maxPosition);
-  }
+  QuantizeAABB(bounds, total_bounds, mins, maxes);
   for (int i = 0; i < 3; ++i) {
     Uint16ToUtf8(mins[i], utf8);
   }
@@ -842,6 +1557,7 @@ void CompressAABBToUtf8(const Bounds& bounds,
 
 void CompressIndicesToUtf8(const OptimizedIndexList& list,
                            std::vector<char>* utf8) {
+  ScopedTimer timer(Stats::kEncode);
   // For indices, we don't do delta from the most recent index, but
   // from the high water mark. The assumption is that the high water
   // mark only ever moves by one at a time. Foruntately, the vertex
@@ -859,12 +1575,59 @@ void CompressIndicesToUtf8(const OptimizedIndexList& list,
   }
 }
 
+// As CompressIndicesToUtf8, but for meshes with more vertices than
+// fit in a character: each high water mark delta is written with
+// Uint32ToUtf8Varint. Returns the number of characters written.
+size_t CompressIndicesToUtf8Varint(const OptimizedIndexList& list,
+                                   std::vector<char>* utf8) {
+  ScopedTimer timer(Stats::kEncode);
+  size_t num_codes = 0;
+  uint32 index_high_water_mark = 0;
+  for (size_t i = 0; i < list.size(); ++i) {
+    const uint32 index = list[i];
+    CHECK(index <= index_high_water_mark);
+    num_codes += Uint32ToUtf8Varint(index_high_water_mark - index, utf8);
+    if (index == index_high_water_mark) {
+      ++index_high_water_mark;
+    }
+  }
+  return num_codes;
+}
+
+uint32 ZigZag32(int32 word) {
+  return (static_cast<uint32>(word) << 1) ^ static_cast<uint32>(word >> 31);
+}
+
+// For vertex orders other than first use (see reorder.h): each index
+// is written as ZigZag(next - index), with Uint32ToUtf8Varint, where
+// next is one past the largest index so far. In first-use order every
+// code is even, and a code is twice what CompressIndicesToUtf8 writes.
+// Returns the number of characters written.
+size_t CompressIndicesToUtf8ZigZag(const OptimizedIndexList& list,
+                                   std::vector<char>* utf8) {
+  ScopedTimer timer(Stats::kEncode);
+  size_t num_codes = 0;
+  uint32 next = 0;
+  for (size_t i = 0; i < list.size(); ++i) {
+    const uint32 index = list[i];
+    num_codes += Uint32ToUtf8Varint(
+        ZigZag32(static_cast<int32>(next - index)), utf8);
+    if (index >= next) {
+      next = index + 1;
+    }
+  }
+  return num_codes;
+}
+
+// attribs has the stride columns of a VertexLayout per vertex.
 void CompressQuantizedAttribsToUtf8(const QuantizedAttribList& attribs,
+                                    size_t stride,
                                     std::vector<char>* utf8) {
-  for (size_t i = 0; i < 8; ++i) {
+  ScopedTimer timer(Stats::kEncode);
+  for (size_t i = 0; i < stride; ++i) {
     // Use a transposed representation, and delta compression.
     uint16 prev = 0;
-    for (size_t j = i; j < attribs.size(); j += 8) {
+    for (size_t j = i; j < attribs.size(); j += stride) {
       const uint16 word = attribs[j];
       const uint16 za = ZigZag(static_cast<int16>(word - prev));
       prev = word;
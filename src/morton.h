@@ -0,0 +1,138 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_MORTON_H_
+#define WEBGL_LOADER_MORTON_H_
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+#include "parallel.h"
+
+// Morton (Z-order) codes, and a parallel radix sort to order things by
+// them.
+
+// Spreads the low 21 bits of x out to every third bit.
+static inline uint64 SpreadBits3(uint32 x) {
+  uint64 v = x & 0x1FFFFF;
+  v = (v | (v << 32)) & 0x1F00000000FFFFULL;
+  v = (v | (v << 16)) & 0x1F0000FF0000FFULL;
+  v = (v | (v << 8)) & 0x100F00F00F00F00FULL;
+  v = (v | (v << 4)) & 0x10C30C30C30C30C3ULL;
+  v = (v | (v << 2)) & 0x1249249249249249ULL;
+  return v;
+}
+
+// The Morton code of coordinates of up to 21 bits, x highest.
+static inline uint64 MortonCode3(uint32 x, uint32 y, uint32 z) {
+  return (SpreadBits3(x) << 2) | (SpreadBits3(y) << 1) | SpreadBits3(z);
+}
+
+// Quantized positions have 14 bits per coordinate.
+static const size_t kPositionMortonBits = 3 * 14;
+
+// One pass of an LSD radix sort, on one digit. The input is cut into
+// chunks; each chunk's digits are counted in parallel, the counts are
+// turned into output offsets (digit major, so the sort stays stable),
+// and then each chunk scatters its pairs in parallel.
+class RadixSortPass {
+ public:
+  static const size_t kDigitBits = 11;
+  static const size_t kNumDigits = 1 << kDigitBits;
+
+  RadixSortPass(size_t shift, size_t num_chunks,
+                const std::vector<uint64>& keys,
+                const std::vector<uint32>& values,
+                std::vector<uint64>* sorted_keys,
+                std::vector<uint32>* sorted_values)
+      : shift_(shift),
+        num_chunks_(num_chunks),
+        chunk_size_((keys.size() + num_chunks - 1) / num_chunks),
+        keys_(keys),
+        values_(values),
+        sorted_keys_(sorted_keys),
+        sorted_values_(sorted_values),
+        offsets_(num_chunks * kNumDigits, 0),
+        scattering_(false) {
+  }
+
+  void Run() {
+    ParallelFor(num_chunks_, this);
+    size_t offset = 0;
+    for (size_t d = 0; d < kNumDigits; ++d) {
+      for (size_t c = 0; c < num_chunks_; ++c) {
+        const size_t count = offsets_[c * kNumDigits + d];
+        offsets_[c * kNumDigits + d] = offset;
+        offset += count;
+      }
+    }
+    scattering_ = true;
+    ParallelFor(num_chunks_, this);
+  }
+
+  void operator()(size_t chunk) {
+    const size_t begin = chunk * chunk_size_;
+    const size_t end = std::min(begin + chunk_size_, keys_.size());
+    size_t* offsets = &offsets_[chunk * kNumDigits];
+    if (!scattering_) {
+      for (size_t i = begin; i < end; ++i) {
+        ++offsets[Digit(keys_[i])];
+      }
+      return;
+    }
+    for (size_t i = begin; i < end; ++i) {
+      const size_t to = offsets[Digit(keys_[i])]++;
+      (*sorted_keys_)[to] = keys_[i];
+      (*sorted_values_)[to] = values_[i];
+    }
+  }
+
+ private:
+  size_t Digit(uint64 key) const {
+    return (key >> shift_) & (kNumDigits - 1);
+  }
+
+  size_t shift_;
+  size_t num_chunks_;
+  size_t chunk_size_;
+  const std::vector<uint64>& keys_;
+  const std::vector<uint32>& values_;
+  std::vector<uint64>* sorted_keys_;
+  std::vector<uint32>* sorted_values_;
+  std::vector<size_t> offsets_;  // Counts, then next output positions.
+  bool scattering_;
+};
+
+// Stably sorts keys, and values along with them, by the low key_bits
+// bits of the keys.
+void RadixSort(size_t key_bits, std::vector<uint64>* keys,
+               std::vector<uint32>* values) {
+  CHECK(keys->size() == values->size());
+  // Small inputs are not worth a thread each.
+  static const size_t kMinChunkSize = 1 << 14;
+  const size_t num_chunks = std::max<size_t>(1,
+      std::min(4 * NumThreads(), keys->size() / kMinChunkSize));
+  std::vector<uint64> sorted_keys(keys->size());
+  std::vector<uint32> sorted_values(values->size());
+  for (size_t shift = 0; shift < key_bits;
+       shift += RadixSortPass::kDigitBits) {
+    RadixSortPass(shift, num_chunks, *keys, *values,
+                  &sorted_keys, &sorted_values).Run();
+    keys->swap(sorted_keys);
+    values->swap(sorted_values);
+  }
+}
+
+#endif  // WEBGL_LOADER_MORTON_H_
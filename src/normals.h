@@ -0,0 +1,330 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_NORMALS_H_
+#define WEBGL_LOADER_NORMALS_H_
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base.h"
+#include "morton.h"
+#include "parallel.h"
+#include "stats.h"
+
+// Generates normals for the corners of faces that have none, so that
+// they don't go out as zeros and have to be computed by every client.
+// Like most modelers, a corner's normal is the sum of the normals of
+// the faces around its position that are in the same smoothing group
+// ("s" in .OBJ) and within crease_angle of its own face, each weighted
+// by the face's angle at the position; unlike weighting by area, that
+// doesn't depend on how polygons were triangulated. Faces in smoothing
+// group 0 ("s off", the default) are flat.
+//
+// Corners are grouped by position with a radix sort, and the runs of
+// each position are shaded in parallel chunks. Corners of a position
+// that end up with the same normal share it, so they still flatten to
+// one vertex.
+class NormalGenerator {
+ public:
+  // corner_positions has the 0-based position index of each corner,
+  // 3 per triangle, and smoothing_groups one entry per triangle.
+  NormalGenerator(const AttribList& positions,
+                  const std::vector<int>& corner_positions,
+                  const std::vector<unsigned int>& smoothing_groups,
+                  float crease_angle)
+      : positions_(positions),
+        corner_positions_(corner_positions),
+        smoothing_groups_(smoothing_groups),
+        num_triangles_(corner_positions.size() / 3),
+        min_cosine_(crease_angle >= 180 ? -2 :
+                    cosf(crease_angle * static_cast<float>(M_PI) / 180)),
+        face_normals_(3 * num_triangles_),
+        corner_angles_(corner_positions.size()),
+        normal_indices_(NULL),
+        step_(kFaceNormals) {
+    CHECK(smoothing_groups.size() == num_triangles_);
+  }
+
+  // Appends normals for the corners whose normal_indices are -1, and
+  // points those at them. Returns the number of normals appended.
+  size_t Generate(AttribList* normals, std::vector<int>* normal_indices) {
+    ScopedTimer timer(Stats::kNormals);
+    CHECK(normal_indices->size() == corner_positions_.size());
+    if (normal_indices->empty()) return 0;
+    normal_indices_ = &(*normal_indices)[0];
+    num_chunks_ = std::max<size_t>(
+        1, std::min(4 * NumThreads(), num_triangles_ / (1 << 12)));
+    chunk_size_ = (num_triangles_ + num_chunks_ - 1) / num_chunks_;
+    step_ = kFaceNormals;
+    ParallelFor(num_chunks_, this);
+
+    std::vector<uint64> keys;
+    size_t position_bits = 0;
+    for (size_t c = 0; c < corner_positions_.size(); ++c) {
+      const int position = corner_positions_[c];
+      if (normal_indices_[c] != -1 || position < 0) continue;
+      while (position >> position_bits) ++position_bits;
+      keys.push_back(position);
+      sorted_corners_.push_back(c);
+    }
+    RadixSort(position_bits, &keys, &sorted_corners_);
+    // Chunks of the sorted corners start on a new position.
+    const size_t num_sorted = sorted_corners_.size();
+    const size_t run_chunk_size = (num_sorted + num_chunks_ - 1) / num_chunks_;
+    run_starts_.assign(1, 0);
+    for (size_t i = 1; i < num_chunks_; ++i) {
+      size_t start = std::max(run_starts_.back(), i * run_chunk_size);
+      while (start < num_sorted && keys[start] == keys[start - 1]) ++start;
+      run_starts_.push_back(std::min(start, num_sorted));
+    }
+    run_starts_.push_back(num_sorted);
+    std::vector<uint64>().swap(keys);
+    chunk_normals_.resize(num_chunks_);
+    step_ = kCornerNormals;
+    ParallelFor(num_chunks_, this);
+
+    // Chunk normals go out in order, so the result doesn't depend on
+    // the number of threads.
+    const size_t first_normal = normals->size() / 3;
+    chunk_offsets_.resize(num_chunks_);
+    size_t num_normals = 0;
+    for (size_t i = 0; i < num_chunks_; ++i) {
+      chunk_offsets_[i] = first_normal + num_normals;
+      num_normals += chunk_normals_[i].size() / 3;
+      normals->insert(normals->end(), chunk_normals_[i].begin(),
+                      chunk_normals_[i].end());
+      AttribList().swap(chunk_normals_[i]);
+    }
+    step_ = kNumberNormals;
+    ParallelFor(num_chunks_, this);
+    Stats::Get().Increment(Stats::kGeneratedNormals, num_normals);
+    return num_normals;
+  }
+
+  void operator()(size_t chunk) {
+    if (step_ == kFaceNormals) {
+      const size_t begin = chunk * chunk_size_;
+      const size_t end = std::min(begin + chunk_size_, num_triangles_);
+      for (size_t t = begin; t < end; ++t) FaceNormal(t);
+    } else if (step_ == kCornerNormals) {
+      CornerNormals(chunk);
+    } else {
+      for (size_t i = run_starts_[chunk]; i < run_starts_[chunk + 1]; ++i) {
+        normal_indices_[sorted_corners_[i]] += chunk_offsets_[chunk];
+      }
+    }
+  }
+
+ private:
+  enum Step {
+    kFaceNormals,
+    kCornerNormals,
+    kNumberNormals,
+  };
+
+  // The unit normal of a triangle, and its angle at each corner.
+  void FaceNormal(size_t triangle) {
+    float* normal = &face_normals_[3 * triangle];
+    normal[0] = normal[1] = normal[2] = 0;
+    float* angles = &corner_angles_[3 * triangle];
+    angles[0] = angles[1] = angles[2] = 0;
+    float corners[3][3];
+    for (size_t i = 0; i < 3; ++i) {
+      const int position = corner_positions_[3 * triangle + i];
+      if (position < 0 ||
+          3 * static_cast<size_t>(position) + 3 > positions_.size()) {
+        return;
+      }
+      for (size_t k = 0; k < 3; ++k) {
+        corners[i][k] = positions_[3 * position + k];
+      }
+    }
+    float ab[3], ac[3];
+    for (size_t k = 0; k < 3; ++k) {
+      ab[k] = corners[1][k] - corners[0][k];
+      ac[k] = corners[2][k] - corners[0][k];
+    }
+    normal[0] = ab[1] * ac[2] - ab[2] * ac[1];
+    normal[1] = ab[2] * ac[0] - ab[0] * ac[2];
+    normal[2] = ab[0] * ac[1] - ab[1] * ac[0];
+    const float length = sqrtf(Dot(normal, normal));
+    if (length == 0) return;
+    for (size_t k = 0; k < 3; ++k) normal[k] /= length;
+    for (size_t i = 0; i < 3; ++i) {
+      float u[3], v[3];
+      for (size_t k = 0; k < 3; ++k) {
+        u[k] = corners[(i + 1) % 3][k] - corners[i][k];
+        v[k] = corners[(i + 2) % 3][k] - corners[i][k];
+      }
+      const float uv = sqrtf(Dot(u, u) * Dot(v, v));
+      angles[i] = uv > 0 ?
+          acosf(std::max(-1.0f, std::min(1.0f, Dot(u, v) / uv))) : 0;
+    }
+  }
+
+  static float Dot(const float* a, const float* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  }
+
+  // Whether the faces of corners a and b are smoothed together.
+  bool Smoothed(size_t a, size_t b) const {
+    const size_t ta = a / 3, tb = b / 3;
+    if (ta == tb) return true;
+    if (smoothing_groups_[ta] == 0 ||
+        smoothing_groups_[ta] != smoothing_groups_[tb]) {
+      return false;
+    }
+    return Dot(&face_normals_[3 * ta], &face_normals_[3 * tb]) >=
+        min_cosine_;
+  }
+
+  // Adds the angle-weighted face normal of corner to normal.
+  void AddCorner(size_t corner, float* normal) const {
+    for (size_t k = 0; k < 3; ++k) {
+      normal[k] += corner_angles_[corner] *
+          face_normals_[3 * (corner / 3) + k];
+    }
+  }
+
+  // A corner's normal, keyed by its bits so that equal normals sort
+  // together; +0 and -0 are the same.
+  struct SortedNormal {
+    uint32 bits[3];
+    uint32 index;  // In the run.
+
+    bool operator<(const SortedNormal& other) const {
+      for (size_t k = 0; k < 3; ++k) {
+        if (bits[k] != other.bits[k]) return bits[k] < other.bits[k];
+      }
+      return index < other.index;
+    }
+  };
+
+  // Shades the runs of each position in a chunk, numbering the new
+  // normals from 0 in the chunk. A run is sorted into its smoothing
+  // groups, each triangle of group 0 on its own, and without a crease
+  // angle the corners of a group share one sum; with one, a group's
+  // corners are still compared pairwise. Sums add corners in run
+  // order either way. Equal normals are then merged by sorting, and
+  // numbered in run order.
+  void CornerNormals(size_t chunk) {
+    AttribList& normals = chunk_normals_[chunk];
+    std::vector<std::pair<uint64, uint32> > groups;  // Key, index.
+    AttribList run_normals;
+    std::vector<SortedNormal> sorted;
+    std::vector<size_t> run_normal_indices;
+    const size_t end = run_starts_[chunk + 1];
+    for (size_t begin = run_starts_[chunk]; begin < end; ) {
+      const int position = corner_positions_[sorted_corners_[begin]];
+      size_t run_end = begin;
+      while (run_end < end &&
+             corner_positions_[sorted_corners_[run_end]] == position) {
+        ++run_end;
+      }
+      const uint32* run = &sorted_corners_[begin];
+      const size_t run_size = run_end - begin;
+      groups.resize(run_size);
+      for (size_t i = 0; i < run_size; ++i) {
+        const uint32 triangle = run[i] / 3;
+        const uint64 group = smoothing_groups_[triangle];
+        groups[i].first = (group << 32) | (group ? 0 : triangle);
+        groups[i].second = i;
+      }
+      std::sort(groups.begin(), groups.end());
+      run_normals.assign(3 * run_size, 0);
+      for (size_t g = 0; g < run_size; ) {
+        size_t g_end = g + 1;
+        while (g_end < run_size && groups[g_end].first == groups[g].first) {
+          ++g_end;
+        }
+        if (min_cosine_ < -1) {
+          float normal[3] = { 0, 0, 0 };
+          for (size_t j = g; j < g_end; ++j) {
+            AddCorner(run[groups[j].second], normal);
+          }
+          for (size_t i = g; i < g_end; ++i) {
+            std::copy(normal, normal + 3, &run_normals[3 * groups[i].second]);
+          }
+        } else {
+          for (size_t i = g; i < g_end; ++i) {
+            const size_t corner = run[groups[i].second];
+            float* normal = &run_normals[3 * groups[i].second];
+            for (size_t j = g; j < g_end; ++j) {
+              const size_t other = run[groups[j].second];
+              if (Smoothed(corner, other)) AddCorner(other, normal);
+            }
+          }
+        }
+        g = g_end;
+      }
+      sorted.resize(run_size);
+      for (size_t i = 0; i < run_size; ++i) {
+        float* normal = &run_normals[3 * i];
+        const float length = sqrtf(Dot(normal, normal));
+        if (length > 0) {
+          for (size_t k = 0; k < 3; ++k) normal[k] /= length;
+        }
+        for (size_t k = 0; k < 3; ++k) {
+          const float value = normal[k] + 0.0f;  // -0 to +0.
+          memcpy(&sorted[i].bits[k], &value, sizeof(value));
+        }
+        sorted[i].index = i;
+      }
+      std::sort(sorted.begin(), sorted.end());
+      // Each corner's first equal in the run, which is numbered first.
+      run_normal_indices.resize(run_size);
+      for (size_t i = 0; i < run_size; ++i) {
+        const bool same = i > 0 &&
+            std::equal(sorted[i].bits, sorted[i].bits + 3, sorted[i - 1].bits);
+        run_normal_indices[sorted[i].index] =
+            same ? run_normal_indices[sorted[i - 1].index] : sorted[i].index;
+      }
+      for (size_t i = 0; i < run_size; ++i) {
+        const size_t first = run_normal_indices[i];
+        if (first == i) {
+          run_normal_indices[i] = normals.size() / 3;
+          normals.insert(normals.end(), &run_normals[3 * i],
+                         &run_normals[3 * i] + 3);
+        } else {
+          run_normal_indices[i] = run_normal_indices[first];
+        }
+        normal_indices_[run[i]] = run_normal_indices[i];
+      }
+      begin = run_end;
+    }
+  }
+
+  const AttribList& positions_;
+  const std::vector<int>& corner_positions_;
+  const std::vector<unsigned int>& smoothing_groups_;
+  size_t num_triangles_;
+  float min_cosine_;
+  size_t num_chunks_;
+  size_t chunk_size_;  // In triangles, for kFaceNormals.
+  AttribList face_normals_;
+  AttribList corner_angles_;
+  std::vector<uint32> sorted_corners_;  // That need a normal.
+  std::vector<size_t> run_starts_;  // Chunks of sorted_corners_.
+  std::vector<AttribList> chunk_normals_;
+  std::vector<size_t> chunk_offsets_;  // First normal index of each.
+  int* normal_indices_;
+  Step step_;
+};
+
+#endif  // WEBGL_LOADER_NORMALS_H_
@@ -1,5 +1,5 @@
 #if 0  // A cute trick to making this .cc self-building from shell.
-g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
 exit;
 #endif
 // Copyright 2011 Google Inc. All Rights Reserved.
@@ -16,102 +16,468 @@ exit;
 // implied. See the License for the specific language governing
 // permissions and limitations under the License.
 
+#include <math.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "cache.h"
+#include "cleanup.h"
 #include "mesh.h"
 #include "optimize.h"
+#include "overdraw.h"
+#include "parallel.h"
+#include "partition.h"
+#include "quantize.h"
+#include "raster.h"
+#include "reorder.h"
+#include "stats.h"
+
+template <typename IndexListT>
+void PrintCacheAnalysisRow(const IndexListT& indices, const CacheModel& model) {
+  const CacheStats stats = SimulateCache(model, indices);
+  printf("||%s||%zu||%f||%f||\n", model.Name().c_str(), stats.misses,
+         stats.atvr(), stats.acmr());
+}
 
-// Return cache misses from a simulated FIFO cache.
 template <typename IndexListT>
-size_t CountFifoCacheMisses(const IndexListT& indices, const size_t cache_size) {
-  static const size_t kMaxCacheSize = 32;
-  static const int kUnknownIndex = -1;
-  CHECK(cache_size <= kMaxCacheSize);
-  int fifo[kMaxCacheSize + 1];
-  for (size_t i = 0; i < cache_size; ++i) {
-    fifo[i] = kUnknownIndex;
-  }
-  size_t misses = 0;
-  for (size_t i = 0; i < indices.size(); ++i) {
-    const int idx = indices[i];
-    // Use a sentry to simplify the FIFO search.
-    fifo[cache_size] = idx;
-    size_t at = 0;
-    while (fifo[at] != idx) ++at;
-    if (at == cache_size) {
-      ++misses;
-      int write_idx = idx;
-      for (size_t j = 0; j < cache_size; ++j) {
-        const int swap_idx = fifo[j];
-        fifo[j] = write_idx;
-        write_idx = swap_idx;
+void PrintCacheAnalysisTable(const std::vector<CacheModel>& models,
+                             const IndexListT& indices,
+                             const VertexLayout& layout) {
+  const size_t num_verts = CountDistinctIndices(indices);
+  const size_t num_tris = indices.size() / 3;
+  printf("%zu vertices, %zu triangles\n\n", num_verts, num_tris);
+  puts("||Cache||# misses||ATVR||ACMR||");
+  for (size_t i = 0; i < models.size(); ++i) {
+    PrintCacheAnalysisRow(indices, models[i]);
+  }
+  const FetchStats fetch =
+      SimulateVertexFetch(indices, layout.stride() * sizeof(uint16));
+  printf("\nVertex fetch: %f bytes/vertex, overfetch %f\n",
+         fetch.bytes_per_vertex(), fetch.overfetch());
+}
+
+// Order-0 entropy of the attribute deltas that
+// CompressQuantizedAttribsToUtf8 writes, with a histogram per
+// attribute, summed over meshes. This is what the vertex order can
+// win before the UTF-8 and gzip framing blurs it.
+class AttribEntropy {
+ public:
+  explicit AttribEntropy(const VertexLayout& layout)
+      : stride_(layout.stride()),
+        counts_(stride_ * 65536, 0) {
+  }
+
+  void Add(const QuantizedAttribList& attribs) {
+    for (size_t i = 0; i < stride_; ++i) {
+      size_t* counts = &counts_[65536 * i];
+      uint16 prev = 0;
+      for (size_t j = i; j < attribs.size(); j += stride_) {
+        const uint16 word = attribs[j];
+        ++counts[ZigZag(static_cast<int16>(word - prev))];
+        prev = word;
+      }
+    }
+  }
+
+  double bits() const {
+    double bits = 0;
+    for (size_t i = 0; i < stride_; ++i) {
+      const size_t* counts = &counts_[65536 * i];
+      size_t total = 0;
+      for (size_t j = 0; j < 65536; ++j) total += counts[j];
+      for (size_t j = 0; j < 65536; ++j) {
+        if (counts[j]) {
+          bits -= counts[j] * log2(static_cast<double>(counts[j]) / total);
+        }
       }
     }
+    return bits;
+  }
+
+ private:
+  size_t stride_;
+  std::vector<size_t> counts_;
+};
+
+typedef std::vector<std::pair<std::string, double> > Metrics;
+
+// Baselines are text files of "name value" lines.
+bool ReadBaseline(const char* fn, Metrics* metrics) {
+  FILE* fp = fopen(fn, "r");
+  if (!fp) return false;
+  char name[256];
+  double value;
+  while (2 == fscanf(fp, "%255s %lf", name, &value)) {
+    metrics->push_back(std::make_pair(std::string(name), value));
   }
-  return misses;
+  fclose(fp);
+  return true;
 }
 
-template <typename IndexListT>
-void PrintCacheAnalysisRow(const IndexListT& indices, const size_t cache_size,
-                           const size_t num_verts, const size_t num_tris) {
-  const size_t misses = CountFifoCacheMisses(indices, cache_size);
-  const double misses_as_double = static_cast<double>(misses);
-  printf("||%zu||%zu||%f||%f||\n", cache_size, misses,
-         misses_as_double / num_verts, misses_as_double / num_tris);
+bool WriteBaseline(const char* fn, const Metrics& metrics) {
+  FILE* fp = fopen(fn, "w");
+  if (!fp) return false;
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    fprintf(fp, "%s %f\n", metrics[i].first.c_str(), metrics[i].second);
+  }
+  fclose(fp);
+  return true;
 }
 
-template <typename IndexListT>
-void PrintCacheAnalysisTable(const size_t count, const char** args,
-                             const IndexListT& indices, 
-                             const size_t num_verts, const size_t num_tris) {
-  printf("%zu vertices, %zu triangles\n\n", num_verts, num_tris);
-  puts("||Cache Size||# misses||ATVR||ACMR||");
-  for (size_t i = 0; i < count; ++i) {
-    int cache_size = atoi(args[i]);
-    if (cache_size > 1) {
-      PrintCacheAnalysisRow(indices, cache_size, num_verts, num_tris);
+// All metrics are "lower is better." Returns the number of metrics
+// that got worse than the baseline by more than tolerance (relative).
+size_t CountRegressions(const Metrics& baseline, const Metrics& current,
+                        double tolerance) {
+  size_t regressions = 0;
+  puts("\n||Metric||Baseline||Current||Change||");
+  for (size_t i = 0; i < baseline.size(); ++i) {
+    const std::string& name = baseline[i].first;
+    const double expected = baseline[i].second;
+    size_t j = 0;
+    while (j < current.size() && current[j].first != name) ++j;
+    if (j == current.size()) {
+      printf("||%s||%f||missing||||\n", name.c_str(), expected);
+      ++regressions;
+      continue;
     }
+    const double actual = current[j].second;
+    const double change = expected ? (actual - expected) / expected : 0;
+    const bool regressed = actual > expected * (1 + tolerance) + 1e-6;
+    printf("||%s||%f||%f||%+.2f%%%s||\n", name.c_str(), expected, actual,
+           100 * change, regressed ? " REGRESSION" : "");
+    regressions += regressed;
   }
+  return regressions;
 }
 
 int main(int argc, const char* argv[]) {
-  if (argc < 2) {
-    fprintf(stderr, "Usage: %s in.obj [list of cache sizes]\n\n"
-            "\tPerform vertex cache analysis on in.obj using specified sizes.\n"
-            "\tFor example: %s in.obj 6 16 24 32\n"
-            "\tMaximum cache size is 32.\n\n",
+  const char* stats_fn = NULL;
+  bool dump_stats = false;
+  const char* baseline_fn = NULL;
+  const char* write_baseline_fn = NULL;
+  double tolerance = 0.001;
+  SplitMode split_mode = kSplitSequential;
+  FlattenMode flatten_mode = kFlattenIncremental;
+  float weld_epsilon = -1;  // No welding.
+  float crease_angle = -1;  // No generated normals.
+  bool cleanup = false;
+  bool merge_materials = false;
+  bool wide_indices = false;
+  float overdraw_threshold = 0;  // No overdraw optimization.
+  AttribOrder attrib_order = kAttribOrderFirstUse;
+  size_t vertex_window = 0;
+  QuantizeMode quantize_mode = kQuantizeTruncate;
+  bool quantize_error = false;
+  bool uv_bounds = false;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; ++i) {
+    if (0 == strncmp(argv[i], "--attrib-order=", 15)) {
+      if (!ParseAttribOrder(argv[i] + 15, &attrib_order, &vertex_window)) {
+        fprintf(stderr, "ERROR: bad vertex order: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strncmp(argv[i], "--quantize=", 11)) {
+      if (!ParseQuantizeMode(argv[i] + 11, &quantize_mode)) {
+        fprintf(stderr, "ERROR: bad quantize mode: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--quantize-error")) {
+      quantize_error = true;
+    } else if (0 == strcmp(argv[i], "--uv-bounds")) {
+      uv_bounds = true;
+    } else if (0 == strcmp(argv[i], "--overdraw")) {
+      overdraw_threshold = 1.05f;
+    } else if (0 == strncmp(argv[i], "--overdraw=", 11)) {
+      overdraw_threshold = atof(argv[i] + 11);
+      if (overdraw_threshold < 1) {
+        fprintf(stderr, "ERROR: bad overdraw threshold: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--indices=16")) {
+      wide_indices = false;
+    } else if (0 == strcmp(argv[i], "--indices=32")) {
+      wide_indices = true;
+    } else if (0 == strcmp(argv[i], "--split=sequential")) {
+      split_mode = kSplitSequential;
+    } else if (0 == strcmp(argv[i], "--split=spatial")) {
+      split_mode = kSplitSpatial;
+    } else if (0 == strcmp(argv[i], "--flatten=incremental")) {
+      flatten_mode = kFlattenIncremental;
+    } else if (0 == strcmp(argv[i], "--flatten=bulk")) {
+      flatten_mode = kFlattenBulk;
+    } else if (0 == strcmp(argv[i], "--cleanup")) {
+      cleanup = true;
+    } else if (0 == strcmp(argv[i], "--merge-materials")) {
+      merge_materials = true;
+    } else if (0 == strcmp(argv[i], "--weld")) {
+      weld_epsilon = 1;
+    } else if (0 == strncmp(argv[i], "--weld=", 7)) {
+      weld_epsilon = atof(argv[i] + 7);
+      if (weld_epsilon < 0) {
+        fprintf(stderr, "ERROR: bad weld epsilon: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--normals")) {
+      crease_angle = 180;
+    } else if (0 == strncmp(argv[i], "--normals=", 10)) {
+      crease_angle = atof(argv[i] + 10);
+      if (crease_angle < 0) {
+        fprintf(stderr, "ERROR: bad crease angle: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strncmp(argv[i], "--threads=", 10)) {
+      if (!ParseThreads(argv[i] + 10, &NumThreads())) {
+        fprintf(stderr, "ERROR: bad thread count: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--stats")) {
+      dump_stats = true;
+    } else if (0 == strncmp(argv[i], "--stats=", 8)) {
+      dump_stats = true;
+      stats_fn = argv[i] + 8;
+    } else if (0 == strncmp(argv[i], "--baseline=", 11)) {
+      baseline_fn = argv[i] + 11;
+    } else if (0 == strncmp(argv[i], "--write-baseline=", 17)) {
+      write_baseline_fn = argv[i] + 17;
+    } else if (0 == strncmp(argv[i], "--tolerance=", 12)) {
+      tolerance = atof(argv[i] + 12);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.size() < 1) {
+    fprintf(stderr, "Usage: %s [flags] in.obj [list of cache models]\n\n"
+            "\tPerform vertex cache analysis on in.obj using specified\n"
+            "\tcache models: fifo:N, lru:N, batch:VERTS:TRIS, nvidia, amd,\n"
+            "\tor just N for a FIFO of size N.\n"
+            "\tFor example: %s in.obj 6 16 lru:32 nvidia\n\n"
+            "\t--stats[=stats.json]   JSON report to stats.json or STDERR\n"
+            "\t--write-baseline=file  save ACMR and bytes/triangle\n"
+            "\t--baseline=file        fail if worse than a saved baseline\n"
+            "\t--tolerance=R          allowed relative regression "
+            "(default 0.001)\n"
+            "\t--split=sequential|spatial  mesh splitting, as objcompress\n"
+            "\t--flatten=incremental|bulk  vertex dedup, as objcompress\n"
+            "\t--weld[=E]            weld attributes, as objcompress\n"
+            "\t--normals[=A]         generate normals, as objcompress\n"
+            "\t--cleanup             drop degenerate and duplicate triangles\n"
+            "\t--merge-materials     merge materials, as objcompress\n"
+            "\t--threads=N           worker threads (default: all cores)\n"
+            "\t--indices=16|32       index width, as objcompress\n"
+            "\t--overdraw[=T]        reorder for overdraw, as objcompress\n"
+            "\t--attrib-order=ORDER  vertex order, as objcompress\n"
+            "\t--quantize=MODE       truncate, round or dither, as "
+            "objcompress\n"
+            "\t--uv-bounds           per-material texcoords, as objcompress\n"
+            "\t--quantize-error      report quantization error per column\n"
+            "\t                      and per group\n\n",
             argv[0], argv[0]);
     return -1;
   }
-  FILE* fp = fopen(argv[1], "r");
-  WavefrontObjFile obj(fp);
+  if (dump_stats) {
+    Stats::Get().Enable();
+  }
+
+  std::vector<CacheModel> models = StandardCacheModels();
+  if (args.size() > 1) {
+    models.clear();
+    for (size_t i = 1; i < args.size(); ++i) {
+      CacheModel model = CacheModel::Fifo(1);
+      if (!CacheModel::Parse(args[i], &model)) {
+        fprintf(stderr, "ERROR: bad cache model: %s\n", args[i]);
+        return -1;
+      }
+      models.push_back(model);
+    }
+  }
+
+  FILE* fp = fopen(args[0], "r");
+  if (!fp) {
+    fprintf(stderr, "ERROR: could not open %s\n", args[0]);
+    return -1;
+  }
+  WavefrontObjFile obj(fp, flatten_mode, weld_epsilon, crease_angle,
+                       merge_materials);
   fclose(fp);
-  std::vector<DrawMesh> meshes;
-  obj.CreateDrawMeshes(&meshes);
-  const DrawMesh& draw_mesh = meshes[0];
-
-  size_t count = 4;
-  const char* default_args[] = { "6", "16", "24", "32" };
-  const char** args = &default_args[0];
-  if (argc > 2) {
-    count = argc - 1;
-    args = argv + 1;
-  }
-
-  puts("\nBefore:\n");
-  PrintCacheAnalysisTable(count, args, draw_mesh.indices,
-                          draw_mesh.attribs.size() / 8,
-                          draw_mesh.indices.size() / 3);
-
-  QuantizedAttribList attribs;
-  BoundsParams bounds_params;
-  AttribsToQuantizedAttribs(meshes[0].attribs, &bounds_params, &attribs);
-  VertexOptimizer vertex_optimizer(attribs, meshes[0].indices);
-  WebGLMeshList webgl_meshes;
-  vertex_optimizer.GetOptimizedMeshes(&webgl_meshes);
-  for (size_t i = 0; i < webgl_meshes.size(); ++i) {
-    puts("\nAfter:\n");
-    PrintCacheAnalysisTable(count, args, webgl_meshes[i].indices,
-                            webgl_meshes[i].attribs.size() / 8,
-                            webgl_meshes[i].indices.size() / 3);
+
+  const MaterialBatches& batches = obj.material_batches();
+  const VertexLayout layout = obj.layout();
+  Bounds bounds;
+  bounds.Clear();
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    bounds.Enclose(iter->second.draw_mesh().attribs, layout.stride());
+  }
+  BoundsParams bounds_params = BoundsParams::FromBounds(bounds, layout);
+  bounds_params.mode = quantize_mode;
+
+  CacheReport report_before(models, layout.stride() * sizeof(uint16));
+  CacheReport report_after(models, layout.stride() * sizeof(uint16));
+  OverdrawRasterizer overdraw_before;
+  OverdrawRasterizer overdraw_after;
+  size_t total_bytes = 0;
+  size_t total_attrib_bytes = 0;
+  AttribEntropy attrib_entropy(layout);
+  QuantizeErrorReport quantize_report(layout);
+  size_t total_vertices = 0;
+  size_t total_triangles = 0;
+  std::vector<char> utf8;
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    const DrawMesh& draw_mesh = iter->second.draw_mesh();
+    if (draw_mesh.indices.empty()) continue;
+    printf("\nMaterial '%s':\n", iter->first.c_str());
+    puts("\nBefore:\n");
+    PrintCacheAnalysisTable(models, draw_mesh.indices, layout);
+    report_before.Add(draw_mesh.indices);
+
+    Bounds batch_bounds;
+    batch_bounds.Clear();
+    batch_bounds.Enclose(draw_mesh.attribs, layout.stride());
+    const BoundsParams batch_params = uv_bounds ?
+        bounds_params.WithTexcoordBounds(batch_bounds) : bounds_params;
+    QuantizedAttribList quantized_attribs;
+    AttribsToQuantizedAttribs(draw_mesh.attribs, batch_params,
+                              &quantized_attribs);
+    if (quantize_error) {
+      quantize_report.Add(iter->first, draw_mesh, batch_params,
+                          quantized_attribs, iter->second.group_starts(), obj);
+    }
+    overdraw_before.Rasterize(quantized_attribs, layout.stride(),
+                              draw_mesh.indices);
+    DrawMesh cleaned_mesh;
+    std::vector<GroupStart> cleaned_group_starts;
+    if (cleanup) {
+      const size_t degenerate = Stats::Get().count(Stats::kDegenerateTriangles);
+      const size_t duplicate = Stats::Get().count(Stats::kDuplicateTriangles);
+      CleanupTriangles(draw_mesh, iter->second.group_starts(),
+                       quantized_attribs, &cleaned_mesh,
+                       &cleaned_group_starts);
+      printf("\nCleanup: dropped %zu degenerate and %zu duplicate "
+             "triangles\n",
+             Stats::Get().count(Stats::kDegenerateTriangles) - degenerate,
+             Stats::Get().count(Stats::kDuplicateTriangles) - duplicate);
+    }
+    WebGLMeshList webgl_meshes;
+    std::vector<GroupRunList> group_runs;
+    OptimizeBatch(cleanup ? cleaned_mesh : draw_mesh,
+                  cleanup ? cleaned_group_starts : iter->second.group_starts(),
+                  quantized_attribs, split_mode,
+                  wide_indices ? VertexOptimizer::kMaxWideOutputIndex
+                               : VertexOptimizer::kMaxOutputIndex,
+                  &webgl_meshes, &group_runs);
+    if (overdraw_threshold) {
+      OptimizeOverdraw(group_runs, overdraw_threshold, &webgl_meshes);
+    }
+    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+      ReorderVertices(attrib_order, vertex_window, &webgl_meshes[i]);
+      const WebGLMesh& mesh = webgl_meshes[i];
+      printf("\nAfter (mesh %zu of %zu):\n\n", i + 1, webgl_meshes.size());
+      PrintCacheAnalysisTable(models, mesh.indices, layout);
+      report_after.Add(mesh.indices);
+      overdraw_after.Rasterize(mesh.attribs, layout.stride(), mesh.indices);
+      utf8.clear();
+      CompressQuantizedAttribsToUtf8(mesh.attribs, layout.stride(), &utf8);
+      const size_t attrib_bytes = utf8.size();
+      attrib_entropy.Add(mesh.attribs);
+      if (attrib_order != kAttribOrderFirstUse) {
+        CompressIndicesToUtf8ZigZag(mesh.indices, &utf8);
+      } else if (wide_indices) {
+        CompressIndicesToUtf8Varint(mesh.indices, &utf8);
+      } else {
+        CompressIndicesToUtf8(mesh.indices, &utf8);
+      }
+      const size_t num_verts = mesh.attribs.size() / layout.stride();
+      const size_t num_tris = mesh.indices.size() / 3;
+      printf("Compressed: %zu bytes, %f bytes/triangle "
+             "(attribs %f bytes/vertex, indices %f bytes/triangle)\n",
+             utf8.size(), static_cast<double>(utf8.size()) / num_tris,
+             static_cast<double>(attrib_bytes) / num_verts,
+             static_cast<double>(utf8.size() - attrib_bytes) / num_tris);
+      total_bytes += utf8.size();
+      total_attrib_bytes += attrib_bytes;
+      total_vertices += num_verts;
+      total_triangles += num_tris;
+    }
+  }
+
+  // Summary metrics, for baselines and dashboards.
+  Metrics metrics;
+  for (size_t i = 0; i < models.size(); ++i) {
+    const std::string name = models[i].Name();
+    metrics.push_back(std::make_pair(name + "_acmr_before",
+                                     report_before.stats()[i].acmr()));
+    metrics.push_back(std::make_pair(name + "_acmr",
+                                     report_after.stats()[i].acmr()));
+    metrics.push_back(std::make_pair(name + "_atvr",
+                                     report_after.stats()[i].atvr()));
+  }
+  metrics.push_back(std::make_pair(std::string("fetch_overfetch"),
+                                   report_after.fetch().overfetch()));
+  metrics.push_back(std::make_pair(std::string("fetch_bytes_per_vertex"),
+                                   report_after.fetch().bytes_per_vertex()));
+  metrics.push_back(std::make_pair(std::string("overdraw_before"),
+                                   overdraw_before.stats().overdraw()));
+  metrics.push_back(std::make_pair(std::string("overdraw"),
+                                   overdraw_after.stats().overdraw()));
+  metrics.push_back(std::make_pair(std::string("bytes_per_triangle"),
+      total_triangles ? static_cast<double>(total_bytes) / total_triangles
+                      : 0.0));
+  metrics.push_back(std::make_pair(std::string("attrib_bytes_per_vertex"),
+      total_vertices ? static_cast<double>(total_attrib_bytes) / total_vertices
+                     : 0.0));
+  metrics.push_back(std::make_pair(
+      std::string("attrib_entropy_bits_per_vertex"),
+      total_vertices ? attrib_entropy.bits() / total_vertices : 0.0));
+  metrics.push_back(std::make_pair(std::string("index_bytes_per_triangle"),
+      total_triangles ?
+          static_cast<double>(total_bytes - total_attrib_bytes) /
+              total_triangles : 0.0));
+  if (quantize_error) {
+    quantize_report.Print();
+    for (size_t i = 0; i < layout.stride(); ++i) {
+      const std::string name = ColumnName(layout, i);
+      metrics.push_back(std::make_pair("quantize_error_max_" + name,
+                                       quantize_report.column(i).max_steps));
+      metrics.push_back(std::make_pair("quantize_error_mean_" + name,
+                                       quantize_report.column(i).mean()));
+    }
+  }
+  puts("\nSummary:\n");
+  for (size_t i = 0; i < metrics.size(); ++i) {
+    printf("%s %f\n", metrics[i].first.c_str(), metrics[i].second);
+    Stats::Get().SetMetric(metrics[i].first, metrics[i].second);
+  }
+
+  if (dump_stats) {
+    FILE* stats_fp = stats_fn ? fopen(stats_fn, "w") : stderr;
+    if (!stats_fp) {
+      fprintf(stderr, "ERROR: could not open %s\n", stats_fn);
+      return -1;
+    }
+    Stats::Get().DumpJson(stats_fp, StripLeadingDir(args[0]));
+    if (stats_fn) {
+      fclose(stats_fp);
+    }
+  }
+  if (write_baseline_fn && !WriteBaseline(write_baseline_fn, metrics)) {
+    fprintf(stderr, "ERROR: could not write %s\n", write_baseline_fn);
+    return -1;
+  }
+  if (baseline_fn) {
+    Metrics baseline;
+    if (!ReadBaseline(baseline_fn, &baseline)) {
+      fprintf(stderr, "ERROR: could not read %s\n", baseline_fn);
+      return -1;
+    }
+    const size_t regressions = CountRegressions(baseline, metrics, tolerance);
+    if (regressions) {
+      fprintf(stderr, "ERROR: %zu metrics regressed past %s\n", regressions,
+              baseline_fn);
+      return 1;
+    }
   }
   return 0;
 }
@@ -1,5 +1,5 @@
 #if 0  // A cute trick to making this .cc self-building from shell.
-g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
 exit;
 #endif
 // Copyright 2011 Google Inc. All Rights Reserved.
@@ -16,21 +16,211 @@ exit;
 // implied. See the License for the specific language governing
 // permissions and limitations under the License.
 
+#include "bvh.h"
+#include "cache.h"
+#include "cleanup.h"
+#include "cluster.h"
 #include "mesh.h"
 #include "optimize.h"
+#include "overdraw.h"
+#include "parallel.h"
+#include "partition.h"
+#include "progressive.h"
+#include "reorder.h"
+#include "simplify.h"
+#include "tangents.h"
 
 int main(int argc, const char* argv[]) {
-  if (argc != 3) {
-    fprintf(stderr, "Usage: %s in.obj out.utf8\n\n"
-            "\tCompress in.obj to out.utf8 and writes JS to STDOUT.\n\n",
+  // Flags may appear anywhere; everything else is positional.
+  const char* stats_fn = NULL;
+  bool dump_stats = false;
+  SplitMode split_mode = kSplitSequential;
+  FlattenMode flatten_mode = kFlattenIncremental;
+  float weld_epsilon = -1;  // No welding.
+  float crease_angle = -1;  // No generated normals.
+  bool cleanup = false;
+  bool merge_materials = false;
+  bool tangents = false;
+  bool uv_bounds = false;
+  QuantizeMode quantize_mode = kQuantizeTruncate;
+  bool wide_indices = false;
+  float overdraw_threshold = 0;  // No overdraw optimization.
+  AttribOrder attrib_order = kAttribOrderFirstUse;
+  size_t vertex_window = 0;
+  size_t cluster_vertices = 0;  // No clusters.
+  size_t cluster_triangles = 0;
+  size_t num_lods = 0;
+  float lod_ratio = 0.5f;
+  bool progressive = false;
+  bool bvh = false;
+  std::vector<const char*> args;
+  for (int i = 1; i < argc; ++i) {
+    if (0 == strncmp(argv[i], "--lods=", 7)) {
+      if (!ParseLods(argv[i] + 7, &num_lods, &lod_ratio)) {
+        fprintf(stderr, "ERROR: bad levels of detail: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strncmp(argv[i], "--attrib-order=", 15)) {
+      if (!ParseAttribOrder(argv[i] + 15, &attrib_order, &vertex_window)) {
+        fprintf(stderr, "ERROR: bad vertex order: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--progressive")) {
+      progressive = true;
+    } else if (0 == strcmp(argv[i], "--bvh")) {
+      bvh = true;
+    } else if (0 == strcmp(argv[i], "--overdraw")) {
+      overdraw_threshold = 1.05f;
+    } else if (0 == strncmp(argv[i], "--overdraw=", 11)) {
+      overdraw_threshold = atof(argv[i] + 11);
+      if (overdraw_threshold < 1) {
+        fprintf(stderr, "ERROR: bad overdraw threshold: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--clusters")) {
+      cluster_vertices = 64;
+      cluster_triangles = 124;
+    } else if (0 == strncmp(argv[i], "--clusters=", 11)) {
+      if (!ParseClusters(argv[i] + 11, &cluster_vertices,
+                         &cluster_triangles)) {
+        fprintf(stderr, "ERROR: bad cluster size: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--indices=16")) {
+      wide_indices = false;
+    } else if (0 == strcmp(argv[i], "--indices=32")) {
+      wide_indices = true;
+    } else if (0 == strcmp(argv[i], "--split=sequential")) {
+      split_mode = kSplitSequential;
+    } else if (0 == strcmp(argv[i], "--split=spatial")) {
+      split_mode = kSplitSpatial;
+    } else if (0 == strcmp(argv[i], "--flatten=incremental")) {
+      flatten_mode = kFlattenIncremental;
+    } else if (0 == strcmp(argv[i], "--flatten=bulk")) {
+      flatten_mode = kFlattenBulk;
+    } else if (0 == strcmp(argv[i], "--cleanup")) {
+      cleanup = true;
+    } else if (0 == strcmp(argv[i], "--merge-materials")) {
+      merge_materials = true;
+    } else if (0 == strcmp(argv[i], "--tangents")) {
+      tangents = true;
+    } else if (0 == strcmp(argv[i], "--uv-bounds")) {
+      uv_bounds = true;
+    } else if (0 == strncmp(argv[i], "--quantize=", 11)) {
+      if (!ParseQuantizeMode(argv[i] + 11, &quantize_mode)) {
+        fprintf(stderr, "ERROR: bad quantize mode: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--weld")) {
+      weld_epsilon = 1;
+    } else if (0 == strncmp(argv[i], "--weld=", 7)) {
+      weld_epsilon = atof(argv[i] + 7);
+      if (weld_epsilon < 0) {
+        fprintf(stderr, "ERROR: bad weld epsilon: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--normals")) {
+      crease_angle = 180;
+    } else if (0 == strncmp(argv[i], "--normals=", 10)) {
+      crease_angle = atof(argv[i] + 10);
+      if (crease_angle < 0) {
+        fprintf(stderr, "ERROR: bad crease angle: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strncmp(argv[i], "--threads=", 10)) {
+      if (!ParseThreads(argv[i] + 10, &NumThreads())) {
+        fprintf(stderr, "ERROR: bad thread count: %s\n", argv[i]);
+        return -1;
+      }
+    } else if (0 == strcmp(argv[i], "--stats")) {
+      dump_stats = true;
+    } else if (0 == strncmp(argv[i], "--stats=", 8)) {
+      dump_stats = true;
+      stats_fn = argv[i] + 8;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.size() != 2) {
+    fprintf(stderr, "Usage: %s [flags] in.obj out.utf8\n\n"
+            "\tCompress in.obj to out.utf8 and writes JS to STDOUT.\n\n"
+            "\t--stats[=stats.json]  JSON report of phase timings and\n"
+            "\t                      counters to stats.json or STDERR\n"
+            "\t--split=sequential    split meshes as the optimizer fills\n"
+            "\t                      them (default)\n"
+            "\t--split=spatial       partition into spatially coherent\n"
+            "\t                      meshes up front, optimized in parallel\n"
+            "\t--flatten=incremental  dedupe vertices as faces are parsed\n"
+            "\t                      (default)\n"
+            "\t--flatten=bulk        dedupe all vertices at once with a\n"
+            "\t                      parallel radix sort; same output\n"
+            "\t--cleanup             drop zero-area and duplicate triangles\n"
+            "\t--merge-materials     one batch for materials with the same\n"
+            "\t                      texture, or the same color\n"
+            "\t--weld[=E]            merge attributes closer than E (default\n"
+            "\t                      1) quantization steps before\n"
+            "\t                      flattening\n"
+            "\t--normals[=A]         generate normals for faces without\n"
+            "\t                      them, by smoothing group, creased at\n"
+            "\t                      A degrees (default 180: no crease)\n"
+            "\t--tangents            also write tangents for normal maps,\n"
+            "\t                      as an angle and a handedness\n"
+            "\t--uv-bounds           quantize texcoords over the bounds of\n"
+            "\t                      each material, less their tile,\n"
+            "\t                      instead of [0, 1]\n"
+            "\t--quantize=MODE       truncate (default), round or dither\n"
+            "\t                      attributes between two steps\n"
+            "\t--threads=N           worker threads (default: all cores)\n"
+            "\t--indices=16          meshes of at most 55296 vertices,\n"
+            "\t                      for UNSIGNED_SHORT indices (default)\n"
+            "\t--indices=32          unbounded meshes for UNSIGNED_INT\n"
+            "\t                      indices, with variable-length codes\n"
+            "\t--clusters[=V:T]      also write tables of clusters of at\n"
+            "\t                      most V vertices and T triangles\n"
+            "\t                      (default 64:124, each up to 63487)\n"
+            "\t                      for culling\n"
+            "\t--bvh                 write a bounding volume hierarchy over\n"
+            "\t                      the groups at the head of each file,\n"
+            "\t                      instead of a box per group and mesh\n"
+            "\t--overdraw[=T]        reorder triangles to reduce overdraw,\n"
+            "\t                      letting ACMR grow by at most a factor\n"
+            "\t                      of T within a cluster (default 1.05)\n"
+            "\t--attrib-order=first-use  vertices in order of first use\n"
+            "\t                      (default)\n"
+            "\t--attrib-order=spatial[:W]  reorder vertices within windows\n"
+            "\t                      of W (default 32) for smaller\n"
+            "\t                      attribute deltas\n"
+            "\t--attrib-order=morton[:W]  sort vertices along a Morton\n"
+            "\t                      curve, within windows of W (default:\n"
+            "\t                      the whole mesh)\n"
+            "\t--lods=N[:R]          also write N (1 to 8) coarser levels of\n"
+            "\t                      detail, each with R (default 0.5)\n"
+            "\t                      of the triangles of the one before\n"
+            "\t--progressive         write the --lods levels as one stream\n"
+            "\t                      of refinements per mesh, instead of\n"
+            "\t                      separate files\n\n",
             argv[0]);
     return -1;
   }
-  FILE* fp = fopen(argv[1], "r");
-  WavefrontObjFile obj(fp);
+  if (progressive && (!num_lods || attrib_order != kAttribOrderFirstUse)) {
+    fprintf(stderr, "ERROR: --progressive needs --lods, and its own "
+            "vertex order\n");
+    return -1;
+  }
+  const char* in_fn = args[0];
+  const char* out_suffix = args[1];
+  const uint32 max_output_index = wide_indices ?
+      VertexOptimizer::kMaxWideOutputIndex : VertexOptimizer::kMaxOutputIndex;
+  if (dump_stats) {
+    Stats::Get().Enable();
+  }
+
+  FILE* fp = fopen(in_fn, "r");
+  WavefrontObjFile obj(fp, flatten_mode, weld_epsilon, crease_angle,
+                       merge_materials);
   fclose(fp);
 
-  printf("MODELS[\'%s\'] = {\n", StripLeadingDir(argv[1]));
+  printf("MODELS[\'%s\'] = {\n", StripLeadingDir(in_fn));
   puts("  materials: {");
   const MaterialList& materials = obj.materials();
   for (size_t i = 0; i < materials.size(); ++i) {
@@ -40,120 +230,347 @@ int main(int argc, const char* argv[]) {
   
   const MaterialBatches& batches = obj.material_batches();
 
-  // Pass 1: compute bounds.
+  // Pass 1: compute bounds, of the model and of each batch.
   Bounds bounds;
   bounds.Clear();
-  for (MaterialBatches::const_iterator iter = batches.begin();
-       iter != batches.end(); ++iter) {
-    const DrawBatch& draw_batch = iter->second;
-    bounds.Enclose(draw_batch.draw_mesh().attribs);
+  std::vector<Bounds> batch_bounds(batches.size());
+  {
+    ScopedTimer timer(Stats::kBounds);
+    size_t batch_index = 0;
+    for (MaterialBatches::const_iterator iter = batches.begin();
+         iter != batches.end(); ++iter, ++batch_index) {
+      const DrawMesh& draw_mesh = iter->second.draw_mesh();
+      Bounds& batch = batch_bounds[batch_index];
+      batch.Clear();
+      batch.Enclose(draw_mesh.attribs, draw_mesh.layout.stride());
+      for (size_t i = 0; i < draw_mesh.layout.stride(); ++i) {
+        bounds.mins[i] = std::min(bounds.mins[i], batch.mins[i]);
+        bounds.maxes[i] = std::max(bounds.maxes[i], batch.maxes[i]);
+      }
+    }
   }
-  BoundsParams bounds_params = BoundsParams::FromBounds(bounds);
+  // Tangents are added to the parsed layout, batch by batch, so the
+  // stages after only see a wider vertex.
+  const VertexLayout layout = tangents ?
+      obj.layout().With(kTangentAttrib) : obj.layout();
+  BoundsParams bounds_params = BoundsParams::FromBounds(bounds, layout);
+  bounds_params.mode = quantize_mode;
   printf("  decodeParams: ");
   bounds_params.DumpJson();
 
+  // The batches with tangents, computed in parallel.
+  std::vector<DrawMesh> tangent_meshes;
+  if (tangents) {
+    std::vector<const DrawMesh*> meshes;
+    for (MaterialBatches::const_iterator iter = batches.begin();
+         iter != batches.end(); ++iter) {
+      meshes.push_back(&iter->second.draw_mesh());
+    }
+    GenerateTangents(meshes, &tangent_meshes);
+  }
+
+  // Only simulate caches when someone will look at the results.
+  const std::vector<CacheModel> cache_models = StandardCacheModels();
+  CacheReport cache_before(cache_models, layout.stride() * sizeof(uint16));
+  CacheReport cache_after(cache_models, layout.stride() * sizeof(uint16));
+
   puts("  urls: {");
   std::vector<char> utf8;
   // Pass 2: quantize, optimize, compress, report.
+  size_t batch_index = 0;
   for (MaterialBatches::const_iterator iter = batches.begin();
-       iter != batches.end(); ++iter) {
-    size_t offset = 0;
-    utf8.clear();
-    const DrawMesh& draw_mesh = iter->second.draw_mesh();
-    if (draw_mesh.indices.empty()) continue;
-    
-    QuantizedAttribList quantized_attribs;
-    AttribsToQuantizedAttribs(draw_mesh.attribs, bounds_params,
-                              &quantized_attribs);
-    VertexOptimizer vertex_optimizer(quantized_attribs);
-    const std::vector<GroupStart>& group_starts = iter->second.group_starts();
-    WebGLMeshList webgl_meshes;
-    std::vector<size_t> group_lengths;
-    for (size_t i = 1; i < group_starts.size(); ++i) {
-      const size_t here = group_starts[i-1].offset;
-      const size_t length = group_starts[i].offset - here;
-      group_lengths.push_back(length);
-      vertex_optimizer.AddTriangles(&draw_mesh.indices[here], length,
-                                    &webgl_meshes);
+       iter != batches.end(); ++iter, ++batch_index) {
+    const DrawBatch& draw_batch = iter->second;
+    const BoundsParams batch_params = uv_bounds ?
+        bounds_params.WithTexcoordBounds(batch_bounds[batch_index]) :
+        bounds_params;
+    // Coarser levels of detail, each simplified from the one before.
+    // Progressive meshes make their own, per mesh.
+    const size_t num_lod_files = progressive ? 0 : num_lods;
+    std::vector<DrawMesh> lod_meshes(num_lod_files);
+    std::vector<std::vector<GroupStart> > lod_group_starts(num_lod_files);
+    if (num_lod_files && !draw_batch.draw_mesh().indices.empty()) {
+      MeshSimplifier simplifier(draw_batch.draw_mesh(),
+                                draw_batch.position_indices());
+      size_t target_triangles = simplifier.num_triangles();
+      for (size_t lod = 0; lod < num_lod_files; ++lod) {
+        target_triangles = static_cast<size_t>(lod_ratio * target_triangles);
+        simplifier.Simplify(target_triangles);
+        simplifier.GetLevel(draw_batch.group_starts(), &lod_meshes[lod],
+                            &lod_group_starts[lod]);
+      }
     }
-    const size_t here = group_starts.back().offset;
-    const size_t length = draw_mesh.indices.size() - here;
-    const bool divisible_by_3 = length % 3 == 0;
-    CHECK(divisible_by_3);
-    group_lengths.push_back(length);
-    vertex_optimizer.AddTriangles(&draw_mesh.indices[here], length,
-                                  &webgl_meshes);
+    // Coarsest level first, so clients can stream it first.
+    for (size_t level = num_lod_files + 1; level-- > 0; ) {
+      size_t offset = 0;
+      utf8.clear();
+      const DrawMesh& parsed_mesh =
+          level ? lod_meshes[level - 1] : draw_batch.draw_mesh();
+      if (parsed_mesh.indices.empty()) continue;
+      // Levels of detail get tangents of their own.
+      DrawMesh lod_tangent_mesh;
+      if (tangents && level) {
+        ScopedTimer timer(Stats::kTangents);
+        AttribList lod_tangents;
+        TangentGenerator(parsed_mesh).Generate(&lod_tangents);
+        AddTangentColumns(parsed_mesh, lod_tangents, &lod_tangent_mesh);
+      }
+      const DrawMesh& level_mesh = !tangents ? parsed_mesh :
+          level ? lod_tangent_mesh : tangent_meshes[batch_index];
+    
+      QuantizedAttribList quantized_attribs;
+      AttribsToQuantizedAttribs(level_mesh.attribs, batch_params,
+                                &quantized_attribs);
+      const std::vector<GroupStart>& level_group_starts =
+          level ? lod_group_starts[level - 1] : draw_batch.group_starts();
+      DrawMesh cleaned_mesh;
+      std::vector<GroupStart> cleaned_group_starts;
+      if (cleanup) {
+        CleanupTriangles(level_mesh, level_group_starts, quantized_attribs,
+                         &cleaned_mesh, &cleaned_group_starts);
+      }
+      const DrawMesh& draw_mesh = cleanup ? cleaned_mesh : level_mesh;
+      const std::vector<GroupStart>& group_starts =
+          cleanup ? cleaned_group_starts : level_group_starts;
+      if (draw_mesh.indices.empty()) continue;
+      WebGLMeshList webgl_meshes;
+      std::vector<GroupRunList> group_runs;
+      OptimizeBatch(draw_mesh, group_starts, quantized_attribs, split_mode,
+                    max_output_index, &webgl_meshes, &group_runs);
+      if (overdraw_threshold) {
+        OptimizeOverdraw(group_runs, overdraw_threshold, &webgl_meshes);
+      }
+      if (attrib_order != kAttribOrderFirstUse) {
+        for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+          ReorderVertices(attrib_order, vertex_window, &webgl_meshes[i]);
+        }
+      }
+      std::vector<ProgressiveLevelList> progressive_levels;
+      if (progressive) {
+        MakeProgressiveMeshes(num_lods, lod_ratio, &webgl_meshes,
+                              &progressive_levels, &group_runs);
+      }
+      if (dump_stats && !level) {
+        cache_before.Add(draw_mesh.indices);
+        for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+          cache_after.Add(webgl_meshes[i].indices);
+        }
+      }
 
-    std::vector<std::string> material;
-    std::vector<size_t> attrib_start, attrib_length, index_start, index_length;
-    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
-      const size_t num_attribs = webgl_meshes[i].attribs.size();
-      const size_t num_indices = webgl_meshes[i].indices.size();
-      const bool kBadSizes = num_attribs % 8 || num_indices % 3;
-      CHECK(!kBadSizes);
-      CompressQuantizedAttribsToUtf8(webgl_meshes[i].attribs, &utf8);
-      CompressIndicesToUtf8(webgl_meshes[i].indices, &utf8);
-      material.push_back(iter->first);
-      attrib_start.push_back(offset);
-      attrib_length.push_back(num_attribs / 8);
-      index_start.push_back(offset + num_attribs);
-      index_length.push_back(num_indices / 3);
-      offset += num_attribs + num_indices;
-    }
-    const uint32 hash = SimpleHash(&utf8[0], utf8.size());
-    char buf[9] = { '\0' };
-    ToHex(hash, buf);
-    // TODO: this needs to handle paths.
-    std::string out_fn = std::string(buf) + "." + argv[2];
-    FILE* out_fp = fopen(out_fn.c_str(), "wb");
-    printf("    \'%s\': [\n", out_fn.c_str());
-    size_t group_index = 0;
-    for (size_t i = 0; i < webgl_meshes.size(); ++i) {
-      printf("      { material: \'%s\',\n"
-             "        attribRange: [%zu, %zu],\n"
-             "        indexRange: [%zu, %zu],\n"
-             "        bboxes: %zu,\n"
-             "        names: [",
-             material[i].c_str(),
-             attrib_start[i], attrib_length[i],
-             index_start[i], index_length[i],
-             offset);
-      std::vector<size_t> buffered_lengths;
-      size_t group_start = 0;
-      while (group_index < group_lengths.size()) {
-        printf("\'%s\', ",
-               obj.LineToGroup(group_starts[group_index].group_line).c_str());
-        const size_t group_length = group_lengths[group_index];
-        const size_t next_start = group_start + group_length;
-        const size_t webgl_index_length = webgl_meshes[i].indices.size();
-        // TODO: bbox info is better placed at the head of the file,
-        // perhaps transposed. Also, when a group gets split between
-        // batches, the bbox gets stored twice.
-        CompressAABBToUtf8(group_starts[group_index].bounds,
-                           bounds_params, &utf8);
-        offset += 6;
-        if (next_start < webgl_index_length) {
-          buffered_lengths.push_back(group_length);
-          group_start = next_start;
-          ++group_index;
+      // One box per group, however many meshes it was split between,
+      // at the head of the file.
+      std::vector<size_t> group_leaves(group_starts.size());
+      size_t num_bvh_nodes = 0;
+      if (bvh) {
+        std::vector<size_t> group_indices;
+        std::vector<bool> used(group_starts.size(), false);
+        for (size_t i = 0; i < group_runs.size(); ++i) {
+          for (size_t k = 0; k < group_runs[i].size(); ++k) {
+            const size_t group_index = group_runs[i][k].group_index;
+            if (!used[group_index]) {
+              used[group_index] = true;
+              group_indices.push_back(group_index);
+            }
+          }
+        }
+        BvhNodeList leaves(group_indices.size());
+        for (size_t k = 0; k < leaves.size(); ++k) {
+          QuantizeAABB(group_starts[group_indices[k]].bounds, bounds_params,
+                       leaves[k].mins, leaves[k].maxes);
+          leaves[k].num_groups = 1;
+        }
+        BvhNodeList nodes;
+        std::vector<size_t> leaf_order;
+        BvhBuilder(leaves).Build(&nodes, &leaf_order);
+        for (size_t k = 0; k < leaf_order.size(); ++k) {
+          group_leaves[group_indices[leaf_order[k]]] = k;
+        }
+        offset = CompressBvhToUtf8(nodes, &utf8);
+        num_bvh_nodes = nodes.size();
+      }
+
+      std::vector<std::string> material;
+      std::vector<size_t> attrib_start, attrib_length;
+      std::vector<size_t> index_start, index_length;
+      std::vector<size_t> index_codes;
+      std::vector<LevelRangeList> level_ranges;
+      if (progressive) {
+        offset = CompressProgressiveMeshesToUtf8(
+            webgl_meshes, progressive_levels, offset, &level_ranges, &utf8);
+      }
+      for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+        const size_t num_attribs = webgl_meshes[i].attribs.size();
+        const size_t num_indices = webgl_meshes[i].indices.size();
+        const size_t stride = layout.stride();
+        const bool kBadSizes = num_attribs % stride || num_indices % 3;
+        CHECK(!kBadSizes);
+        if (progressive) {
+          // The finest level is the whole mesh.
+          const LevelRangeList& ranges = level_ranges[i];
+          material.push_back(iter->first);
+          attrib_start.push_back(ranges.front().attrib_start);
+          attrib_length.push_back(num_attribs / stride);
+          index_start.push_back(ranges.back().index_start);
+          index_length.push_back(num_indices / 3);
+          index_codes.push_back(ranges.back().index_codes);
+          continue;
+        }
+        CompressQuantizedAttribsToUtf8(webgl_meshes[i].attribs, stride,
+                                       &utf8);
+        size_t num_codes = num_indices;
+        if (attrib_order != kAttribOrderFirstUse) {
+          num_codes = CompressIndicesToUtf8ZigZag(webgl_meshes[i].indices,
+                                                  &utf8);
+        } else if (wide_indices) {
+          num_codes = CompressIndicesToUtf8Varint(webgl_meshes[i].indices,
+                                                  &utf8);
+        } else {
+          CompressIndicesToUtf8(webgl_meshes[i].indices, &utf8);
+        }
+        material.push_back(iter->first);
+        attrib_start.push_back(offset);
+        attrib_length.push_back(num_attribs / stride);
+        index_start.push_back(offset + num_attribs);
+        index_length.push_back(num_indices / 3);
+        index_codes.push_back(num_codes);
+        offset += num_attribs + num_codes;
+      }
+      // Each mesh's group boxes, and clusters, follow the meshes. They
+      // are appended before hashing, so the file name covers them too.
+      std::vector<size_t> bboxes_start, clusters_start, num_clusters;
+      for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+        bboxes_start.push_back(offset);
+        // Without --bvh, a group split between meshes gets a box in
+        // each of them.
+        const GroupRunList& runs = group_runs[i];
+        for (size_t k = 0; !bvh && k < runs.size(); ++k) {
+          CompressAABBToUtf8(group_starts[runs[k].group_index].bounds,
+                             bounds_params, &utf8);
+          offset += 6;
+        }
+        clusters_start.push_back(offset);
+        num_clusters.push_back(0);
+        if (cluster_vertices) {
+          ClusterList clusters;
+          ClusterBuilder(webgl_meshes[i], cluster_vertices,
+                         cluster_triangles).Build(&clusters);
+          CompressClustersToUtf8(clusters, &utf8);
+          num_clusters.back() = clusters.size();
+          offset += kClusterCodes * clusters.size();
+        }
+      }
+      uint32 hash;
+      {
+        ScopedTimer timer(Stats::kHash);
+        hash = SimpleHash(&utf8[0], utf8.size());
+      }
+      char buf[9] = { '\0' };
+      ToHex(hash, buf);
+      // TODO: this needs to handle paths.
+      std::string out_fn = std::string(buf) + "." + out_suffix;
+      printf("    \'%s\': [\n", out_fn.c_str());
+      for (size_t i = 0; i < webgl_meshes.size(); ++i) {
+        printf("      { material: \'%s\',\n"
+               "        attribRange: [%zu, %zu],\n"
+               "        indexRange: [%zu, %zu],\n",
+               material[i].c_str(),
+               attrib_start[i], attrib_length[i],
+               index_start[i], index_length[i]);
+        if (bvh) {
+          printf("        bvh: [0, %zu],\n", num_bvh_nodes);
         } else {
-          const size_t fits = webgl_index_length - group_start;
-          buffered_lengths.push_back(fits);
-          group_start = 0;
-          group_lengths[group_index] -= fits;
-          break;
+          printf("        bboxes: %zu,\n", bboxes_start[i]);
+        }
+        if (level) {
+          printf("        lod: %zu,\n", level);
+        }
+        if (uv_bounds) {
+          batch_params.DumpMeshJson();
+        }
+        const bool reordered = attrib_order != kAttribOrderFirstUse;
+        if (reordered || progressive || wide_indices) {
+          const char* index_format = progressive ? "levels" :
+              reordered ? "zigzag" : "varint32";
+          printf("        indexFormat: \'%s\',\n"
+                 "        indexCodes: %zu,\n",
+                 index_format, index_codes[i]);
+        }
+        if (progressive) {
+          printf("        levels: [");
+          for (size_t l = 0; l < level_ranges[i].size(); ++l) {
+            const LevelRange& range = level_ranges[i][l];
+            printf("[%zu, %zu, %zu, %zu, %zu], ", range.attrib_start,
+                   range.num_new_vertices, range.index_start,
+                   range.num_triangles, range.index_codes);
+          }
+          // Each level's lengths, for names; coarse levels drop groups.
+          printf("],\n        levelLengths: [");
+          for (size_t l = 0; l < progressive_levels[i].size(); ++l) {
+            const std::vector<size_t>& lengths =
+                progressive_levels[i][l].run_lengths;
+            printf("[");
+            for (size_t k = 0; k < lengths.size(); ++k) {
+              printf("%zu, ", lengths[k]);
+            }
+            printf("], ");
+          }
+          puts("],");
+        }
+        printf("        names: [");
+        const GroupRunList& runs = group_runs[i];
+        for (size_t k = 0; k < runs.size(); ++k) {
+          const GroupStart& group_start = group_starts[runs[k].group_index];
+          printf("\'%s\', ", obj.LineToGroup(group_start.group_line).c_str());
         }
+        printf("],\n        lengths: [");
+        for (size_t k = 0; k < runs.size(); ++k) {
+          printf("%zu, ", runs[k].length);
+        }
+        puts("],");
+        if (bvh) {
+          printf("        groups: [");
+          for (size_t k = 0; k < runs.size(); ++k) {
+            printf("%zu, ", group_leaves[runs[k].group_index]);
+          }
+          puts("],");
+        }
+        if (cluster_vertices) {
+          printf("        clusters: [%zu, %zu],\n", clusters_start[i],
+                 num_clusters[i]);
+        }
+        puts("      },");
       }
-      printf("],\n        lengths: [");
-      for (size_t k = 0; k < buffered_lengths.size(); ++k) {
-        printf("%zu, ", buffered_lengths[k]);
+      {
+        ScopedTimer timer(Stats::kWrite);
+        FILE* out_fp = fopen(out_fn.c_str(), "wb");
+        fwrite(&utf8[0], 1, utf8.size(), out_fp);
+        fclose(out_fp);
       }
-      puts("],\n      },");
+      Stats::Get().Increment(Stats::kOutputBytes, utf8.size());
+      puts("    ],");
     }
-    fwrite(&utf8[0], 1, utf8.size(), out_fp);
-    fclose(out_fp);
-    puts("    ],");
   }
   puts("  }\n};");
+  if (dump_stats) {
+    Stats& stats = Stats::Get();
+    for (size_t i = 0; i < cache_models.size(); ++i) {
+      const std::string name = cache_models[i].Name();
+      stats.SetMetric(name + "_acmr_before", cache_before.stats()[i].acmr());
+      stats.SetMetric(name + "_acmr_after", cache_after.stats()[i].acmr());
+      stats.SetMetric(name + "_atvr_before", cache_before.stats()[i].atvr());
+      stats.SetMetric(name + "_atvr_after", cache_after.stats()[i].atvr());
+    }
+    stats.SetMetric("fetch_overfetch_before", cache_before.fetch().overfetch());
+    stats.SetMetric("fetch_overfetch_after", cache_after.fetch().overfetch());
+    FILE* stats_fp = stats_fn ? fopen(stats_fn, "w") : stderr;
+    if (!stats_fp) {
+      fprintf(stderr, "ERROR: could not open %s\n", stats_fn);
+      return -1;
+    }
+    Stats::Get().DumpJson(stats_fp, StripLeadingDir(in_fn));
+    if (stats_fn) {
+      fclose(stats_fp);
+    }
+  }
   return 0;
 }
@@ -0,0 +1,365 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "base.h"
+
+// Writes synthetic .OBJ files of arbitrary size, for measuring how the
+// parser, IndexFlattener and VertexOptimizer scale.
+//
+// The mesh is a w x h grid of cells, processed in "units" of two
+// horizontally adjacent cells. Each unit is written as two quads (or,
+// for the scanned topology, four triangles), or as a single hexagon
+// when it is chosen to be an n-gon. Units are the granularity for UV
+// seams, groups, materials and face shuffling.
+
+struct GenOptions {
+  GenOptions()
+      : triangles(1 << 20),
+        scan(false),
+        seams(0.05),
+        materials(1),
+        groups(1),
+        ngons(0),
+        shuffle(0),
+        seed(1) {
+  }
+
+  size_t triangles;  // Approximate number of output triangles.
+  bool scan;  // Jittered height field instead of a regular grid.
+  double seams;  // Probability that a unit starts a new UV chart.
+  size_t materials;
+  size_t groups;
+  double ngons;  // Fraction of units written as hexagons.
+  double shuffle;  // 0 is row-major order, 1 is completely random.
+  uint32 seed;
+};
+
+// xorshift64*, so that output is identical across platforms.
+class Random {
+ public:
+  explicit Random(uint32 seed)
+      : state_(0x9E3779B97F4A7C15ULL ^ seed) {
+  }
+
+  unsigned long long Next() {
+    state_ ^= state_ >> 12;
+    state_ ^= state_ << 25;
+    state_ ^= state_ >> 27;
+    return state_ * 2685821657736338717ULL;
+  }
+
+  // Uniform in [0, 1).
+  double Uniform() {
+    return (Next() >> 11) * (1.0 / 9007199254740992.0);
+  }
+
+  size_t Below(size_t n) {
+    return static_cast<size_t>(Next() % n);
+  }
+
+ private:
+  unsigned long long state_;
+};
+
+// Partial Fisher-Yates: each element is swapped with a random later
+// element with probability "amount".
+void PartialShuffle(double amount, Random* random, std::vector<uint32>* v) {
+  std::vector<uint32>& a = *v;
+  for (size_t i = 0; i + 1 < a.size(); ++i) {
+    if (amount > 0 && random->Uniform() < amount) {
+      const size_t j = i + random->Below(a.size() - i);
+      const uint32 tmp = a[i];
+      a[i] = a[j];
+      a[j] = tmp;
+    }
+  }
+}
+
+class ObjGenerator {
+ public:
+  ObjGenerator(const GenOptions& options)
+      : options_(options),
+        random_(options.seed) {
+    // Each cell is two triangles; round up to an even width so that
+    // units tile each row.
+    const double cells = 0.5 * options.triangles;
+    w_ = 2 * static_cast<size_t>(ceil(0.5 * sqrt(cells)));
+    if (w_ < 2) w_ = 2;
+    h_ = static_cast<size_t>(ceil(cells / w_));
+    if (h_ < 1) h_ = 1;
+    row_ = w_ + 1;
+  }
+
+  void Write(const char* mtl_fn, FILE* fp) {
+    fprintf(fp, "# objgen: %zu x %zu cells, %s, seams %g, ngons %g, "
+            "shuffle %g, seed %u\n", w_, h_,
+            options_.scan ? "scan" : "grid", options_.seams, options_.ngons,
+            options_.shuffle, options_.seed);
+    if (mtl_fn) {
+      fprintf(fp, "mtllib %s\n", mtl_fn);
+    }
+    const size_t num_verts = row_ * (h_ + 1);
+    const size_t units_per_row = w_ / 2;
+    const size_t num_units = units_per_row * h_;
+
+    // Vertex order. perm maps a grid vertex to its output index.
+    std::vector<uint32> order(num_verts);
+    for (size_t i = 0; i < num_verts; ++i) order[i] = i;
+    PartialShuffle(options_.shuffle, &random_, &order);
+    perm_.resize(num_verts);
+    for (size_t i = 0; i < num_verts; ++i) perm_[order[i]] = i;
+
+    for (size_t i = 0; i < num_verts; ++i) {
+      float xyz[3], normal[3];
+      Position(order[i], xyz, normal);
+      fprintf(fp, "v %f %f %f\n", xyz[0], xyz[1], xyz[2]);
+    }
+    // Two texcoord sets: charts alternate between them, so vertices on
+    // a chart boundary have two texcoords. They share the vertex order.
+    for (size_t set = 0; set < 2; ++set) {
+      for (size_t i = 0; i < num_verts; ++i) {
+        const size_t v = order[i];
+        fprintf(fp, "vt %f %f\n",
+                0.5f * set + 0.5f * (v % row_) / w_,
+                static_cast<float>(v / row_) / h_);
+      }
+    }
+    for (size_t i = 0; i < num_verts; ++i) {
+      float xyz[3], normal[3];
+      Position(order[i], xyz, normal);
+      fprintf(fp, "vn %f %f %f\n", normal[0], normal[1], normal[2]);
+    }
+
+    // Per-unit properties, decided in grid order so that they do not
+    // depend on the shuffle.
+    std::vector<unsigned char> unit_flags(num_units);
+    unsigned char chart = 0;
+    for (size_t u = 0; u < num_units; ++u) {
+      if (u % units_per_row == 0 || random_.Uniform() < options_.seams) {
+        chart ^= kSecondChart;
+      }
+      unit_flags[u] = chart;
+      if (random_.Uniform() < options_.ngons) unit_flags[u] |= kHexagon;
+      if (random_.Uniform() < 0.5) unit_flags[u] |= kFlipLeft;
+      if (random_.Uniform() < 0.5) unit_flags[u] |= kFlipRight;
+    }
+
+    std::vector<uint32> units(num_units);
+    for (size_t i = 0; i < num_units; ++i) units[i] = i;
+    PartialShuffle(options_.shuffle, &random_, &units);
+
+    // Groups and materials are contiguous runs of the output order.
+    size_t current_group = num_units;
+    for (size_t i = 0; i < num_units; ++i) {
+      const size_t group = i * options_.groups / num_units;
+      if (group != current_group) {
+        current_group = group;
+        fprintf(fp, "g group_%zu\n", group);
+        if (options_.materials > 1) {
+          fprintf(fp, "usemtl material_%zu\n", group % options_.materials);
+        }
+      }
+      const size_t u = units[i];
+      WriteUnit(u / units_per_row, 2 * (u % units_per_row), unit_flags[u],
+                fp);
+    }
+  }
+
+  void WriteMtl(FILE* fp) const {
+    for (size_t i = 0; i < options_.materials; ++i) {
+      fprintf(fp, "newmtl material_%zu\n", i);
+      fprintf(fp, "Kd %f %f %f\n", 0.2f + 0.6f * i / options_.materials,
+              0.5f, 0.8f - 0.6f * i / options_.materials);
+    }
+  }
+
+ private:
+  static const unsigned char kSecondChart = 1;
+  static const unsigned char kHexagon = 2;
+  static const unsigned char kFlipLeft = 4;
+  static const unsigned char kFlipRight = 8;
+
+  // A height field, with analytic normals. The scanned topology adds
+  // jitter within each cell.
+  void Position(size_t v, float xyz[3], float normal[3]) {
+    const size_t i = v / row_;
+    const size_t j = v % row_;
+    float x = static_cast<float>(j) / w_;
+    float y = static_cast<float>(i) / w_;
+    if (options_.scan && i != 0 && j != 0 && i != h_ && j != w_) {
+      // Deterministic per-vertex jitter, so that the position and
+      // normal passes agree.
+      Random jitter(SimpleHash(reinterpret_cast<char*>(&v), sizeof(v),
+                               options_.seed));
+      x += 0.35f * (jitter.Uniform() - 0.5) / w_;
+      y += 0.35f * (jitter.Uniform() - 0.5) / w_;
+    }
+    const float kFreq = 6.f;
+    const float kAmp = options_.scan ? 0.08f : 0.02f;
+    xyz[0] = x;
+    xyz[1] = y;
+    xyz[2] = kAmp * sinf(kFreq * x) * cosf(kFreq * y);
+    const float dx = kAmp * kFreq * cosf(kFreq * x) * cosf(kFreq * y);
+    const float dy = -kAmp * kFreq * sinf(kFreq * x) * sinf(kFreq * y);
+    const float inv_len = 1.f / sqrtf(dx*dx + dy*dy + 1.f);
+    normal[0] = -dx * inv_len;
+    normal[1] = -dy * inv_len;
+    normal[2] = inv_len;
+  }
+
+  void WriteCorner(size_t v, unsigned char flags, FILE* fp) const {
+    const size_t out = perm_[v] + 1;  // .OBJ files use 1-based indexing.
+    const size_t tex = out + ((flags & kSecondChart) ? perm_.size() : 0);
+    fprintf(fp, " %zu/%zu/%zu", out, tex, out);
+  }
+
+  void WriteFace(const size_t* corners, size_t n, unsigned char flags,
+                 FILE* fp) const {
+    fputc('f', fp);
+    for (size_t k = 0; k < n; ++k) {
+      WriteCorner(corners[k], flags, fp);
+    }
+    fputc('\n', fp);
+  }
+
+  void WriteCell(size_t a, bool flip, unsigned char flags, FILE* fp) const {
+    const size_t b = a + 1, c = a + row_ + 1, d = a + row_;
+    if (!options_.scan) {
+      const size_t quad[4] = { a, b, c, d };
+      WriteFace(quad, 4, flags, fp);
+    } else if (flip) {
+      const size_t tri0[3] = { a, b, d };
+      const size_t tri1[3] = { b, c, d };
+      WriteFace(tri0, 3, flags, fp);
+      WriteFace(tri1, 3, flags, fp);
+    } else {
+      const size_t tri0[3] = { a, b, c };
+      const size_t tri1[3] = { a, c, d };
+      WriteFace(tri0, 3, flags, fp);
+      WriteFace(tri1, 3, flags, fp);
+    }
+  }
+
+  void WriteUnit(size_t i, size_t j, unsigned char flags, FILE* fp) const {
+    const size_t a = i * row_ + j;
+    if (flags & kHexagon) {
+      const size_t hexagon[6] = {
+        a, a + 1, a + 2, a + row_ + 2, a + row_ + 1, a + row_
+      };
+      WriteFace(hexagon, 6, flags, fp);
+    } else {
+      WriteCell(a, (flags & kFlipLeft) != 0, flags, fp);
+      WriteCell(a + 1, (flags & kFlipRight) != 0, flags, fp);
+    }
+  }
+
+  GenOptions options_;
+  Random random_;
+  size_t w_, h_, row_;
+  std::vector<uint32> perm_;
+};
+
+bool ParseDouble(const char* arg, const char* name, double* out) {
+  const size_t len = strlen(name);
+  if (0 != strncmp(arg, name, len)) return false;
+  *out = atof(arg + len);
+  return true;
+}
+
+bool ParseSize(const char* arg, const char* name, size_t* out) {
+  double d = 0;
+  if (!ParseDouble(arg, name, &d)) return false;
+  *out = static_cast<size_t>(d);
+  return true;
+}
+
+int main(int argc, const char* argv[]) {
+  GenOptions options;
+  const char* out_fn = NULL;
+  bool bad_args = false;
+  for (int i = 1; i < argc; ++i) {
+    const char* arg = argv[i];
+    double seed = 0;
+    if (ParseSize(arg, "--triangles=", &options.triangles) ||
+        ParseDouble(arg, "--seams=", &options.seams) ||
+        ParseSize(arg, "--materials=", &options.materials) ||
+        ParseSize(arg, "--groups=", &options.groups) ||
+        ParseDouble(arg, "--ngons=", &options.ngons) ||
+        ParseDouble(arg, "--shuffle=", &options.shuffle)) {
+      continue;
+    } else if (ParseDouble(arg, "--seed=", &seed)) {
+      options.seed = static_cast<uint32>(seed);
+    } else if (0 == strcmp(arg, "--topology=grid")) {
+      options.scan = false;
+    } else if (0 == strcmp(arg, "--topology=scan")) {
+      options.scan = true;
+    } else if (arg[0] != '-' && !out_fn) {
+      out_fn = arg;
+    } else {
+      bad_args = true;
+    }
+  }
+  if (bad_args || !out_fn || options.materials < 1 || options.groups < 1) {
+    fprintf(stderr, "Usage: %s [flags] out.obj\n\n"
+            "\tWrite a synthetic mesh to out.obj (and out.mtl, when there\n"
+            "\tis more than one material). Flags:\n"
+            "\t--triangles=N      approximate triangle count (1e6 ok)\n"
+            "\t--topology=grid    regular grid of quads (default)\n"
+            "\t--topology=scan    jittered triangulated height field\n"
+            "\t--seams=P          probability of a UV seam per 2 cells\n"
+            "\t--materials=N      number of materials\n"
+            "\t--groups=N         number of groups\n"
+            "\t--ngons=P          fraction of cell pairs as hexagons\n"
+            "\t--shuffle=P        vertex and face order randomness, 0..1\n"
+            "\t--seed=N           random seed\n\n",
+            argv[0]);
+    return -1;
+  }
+  std::string mtl_fn;
+  if (options.materials > 1) {
+    mtl_fn = out_fn;
+    const size_t dot = mtl_fn.rfind('.');
+    if (dot != std::string::npos) mtl_fn.resize(dot);
+    mtl_fn += ".mtl";
+    FILE* mtl_fp = fopen(mtl_fn.c_str(), "w");
+    if (!mtl_fp) {
+      fprintf(stderr, "ERROR: could not open %s\n", mtl_fn.c_str());
+      return -1;
+    }
+    ObjGenerator(options).WriteMtl(mtl_fp);
+    fclose(mtl_fp);
+  }
+  FILE* fp = fopen(out_fn, "w");
+  if (!fp) {
+    fprintf(stderr, "ERROR: could not open %s\n", out_fn);
+    return -1;
+  }
+  ObjGenerator generator(options);
+  generator.Write(mtl_fn.empty() ? NULL : StripLeadingDir(mtl_fn.c_str()),
+                  fp);
+  fclose(fp);
+  return 0;
+}
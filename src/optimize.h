@@ -20,6 +20,7 @@
 #include <string.h>
 
 #include "base.h"
+#include "stats.h"
 
 // TODO: since most vertices are part of 6 faces, you can optimize
 // this by using a small inline buffer.
@@ -35,10 +36,23 @@ class VertexOptimizer {
     // float score;
   };
 
-  VertexOptimizer(const QuantizedAttribList& attribs)
+  // By default, output indices stay below the UTF-8 surrogate pair
+  // range, so each fits in a single character and in a uint16. With
+  // 32-bit indices, a mesh is only limited by the input vertex count.
+  static const uint32 kMaxOutputIndex = 0xD800;
+  static const uint32 kMaxWideOutputIndex = 0x7FFFFFFF;
+
+  // attribs are interleaved as layout says; so are the meshes'.
+  explicit VertexOptimizer(const QuantizedAttribList& attribs,
+                           uint32 max_output_index = kMaxOutputIndex,
+                           const VertexLayout& layout = VertexLayout())
       : attribs_(attribs),
-        per_vertex_(attribs_.size() / 8),
-        next_unused_index_(0)
+        layout_(layout),
+        stride_(layout.stride()),
+        per_vertex_(attribs_.size() / stride_),
+        max_output_index_(max_output_index),
+        next_unused_index_(0),
+        slow_paths_(0)
   {
     // The cache has an extra slot allocated to simplify the logic in
     // InsertIndexToCache.
@@ -50,12 +64,13 @@ class VertexOptimizer {
     for (size_t i = 0; i < per_vertex_.size(); ++i) {
       VertexData& vertex_data = per_vertex_[i];
       vertex_data.cache_tag = kCacheSize;
-      vertex_data.output_index = kMaxOutputIndex;
+      vertex_data.output_index = kUnknownOutputIndex;
     }
   }
 
   void AddTriangles(const int* indices, size_t length,
                     WebGLMeshList* meshes) {
+    ScopedTimer timer(Stats::kOptimize);
     std::vector<TriangleData> per_tri(length / 3);
 
     // Loop through the triangles, updating vertex->face lists.
@@ -71,13 +86,18 @@ class VertexOptimizer {
     for (size_t i = 0; i < per_vertex_.size(); ++i) {
       VertexData& vertex_data = per_vertex_[i];
       vertex_data.cache_tag = kCacheSize;
-      vertex_data.output_index = kMaxOutputIndex;
+      vertex_data.output_index = kUnknownOutputIndex;
       vertex_data.UpdateScore();
     }
 
-    // Prepare output.
+    // Prepare output. Stats are counted here, and published once at
+    // the end.
+    size_t new_meshes = 0, splits = 0;
+    slow_paths_ = 0;
     if (meshes->empty()) {
       meshes->push_back(WebGLMesh());
+      meshes->back().layout = layout_;
+      ++new_meshes;
     }
     WebGLMesh* mesh = &meshes->back();
 
@@ -93,9 +113,9 @@ class VertexOptimizer {
         vertex_data.RemoveFace(best_triangle);
       
         InsertIndexToCache(index);
-        const int cached_output_index = per_vertex_[index].output_index;
+        const uint32 cached_output_index = per_vertex_[index].output_index;
         // Have we seen this index before?
-        if (cached_output_index != kMaxOutputIndex) {
+        if (cached_output_index != kUnknownOutputIndex) {
           mesh->indices.push_back(cached_output_index);
           continue;
         }
@@ -103,31 +123,39 @@ class VertexOptimizer {
         // next_unused_index_ counter, but we must also copy the
         // corresponding attributes.  TODO: do quantization here?
         per_vertex_[index].output_index = next_unused_index_;
-        for (size_t j = 0; j < 8; ++j) {
-          mesh->attribs.push_back(attribs_[8*index + j]);
-        }
+        const size_t attribs_size = mesh->attribs.size();
+        mesh->attribs.resize(attribs_size + stride_);
+        CopyVertex(&attribs_[stride_*index], stride_,
+                   &mesh->attribs[attribs_size]);
         mesh->indices.push_back(next_unused_index_++);
       }
       // Check if there is room for another triangle.
-      if (next_unused_index_ > kMaxOutputIndex - 3) {
+      if (next_unused_index_ > max_output_index_ - 3) {
         // Is it worth figuring out which other triangles can be added
         // given the verties already added? Then, perhaps
         // re-optimizing?
         next_unused_index_ = 0;
         meshes->push_back(WebGLMesh());
+        meshes->back().layout = layout_;
         mesh = &meshes->back();
+        ++new_meshes;
+        ++splits;
         for (size_t i = 0; i <= kCacheSize; ++i) {
           cache_[i] = kUnknownIndex;
         }
         for (size_t i = 0; i < per_vertex_.size(); ++i) {
-          per_vertex_[i].output_index = kMaxOutputIndex;
+          per_vertex_[i].output_index = kUnknownOutputIndex;
         }
       }
     }
+    Stats& stats = Stats::Get();
+    stats.Increment(Stats::kWebGLMeshes, new_meshes);
+    stats.Increment(Stats::kWebGLMeshSplits, splits);
+    stats.Increment(Stats::kFindBestTriangleSlowPath, slow_paths_);
   }
  private:
   static const int kUnknownIndex = -1;
-  static const uint16 kMaxOutputIndex = 0xD800;
+  static const uint32 kUnknownOutputIndex = 0xFFFFFFFF;
   static const size_t kCacheSize = 32;  // Does larger improve compression?
 
   struct VertexData {
@@ -175,7 +203,7 @@ class VertexOptimizer {
     FaceList faces;
     unsigned int cache_tag;  // kCacheSize means not in cache.
     float score;
-    uint16 output_index;
+    uint32 output_index;
   };
 
   int FindBestTriangle(const int* indices,
@@ -213,6 +241,7 @@ class VertexOptimizer {
       // If no triangles can be found through the cache (e.g. for the
       // first triangle) go through all the active triangles and find
       // the best one.
+      ++slow_paths_;
       for (size_t i = 0; i < per_tri.size(); ++i) {
         if (per_tri[i].active) {
           const float score =
@@ -265,9 +294,13 @@ class VertexOptimizer {
   }
 
   const QuantizedAttribList& attribs_;
+  VertexLayout layout_;
+  size_t stride_;
   std::vector<VertexData> per_vertex_;
   int cache_[kCacheSize + 1];
-  uint16 next_unused_index_;
+  uint32 max_output_index_;
+  uint32 next_unused_index_;
+  size_t slow_paths_;  // Of FindBestTriangle, in one AddTriangles.
 };
 
 #endif  // WEBGL_LOADER_OPTIMIZE_H_
@@ -0,0 +1,92 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_PARALLEL_H_
+#define WEBGL_LOADER_PARALLEL_H_
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#include "base.h"
+
+// The number of worker threads for ParallelFor. Defaults to the
+// number of hardware threads; set to 1 to run everything inline.
+static inline size_t& NumThreads() {
+  static size_t num_threads = 0;
+  if (num_threads == 0) {
+    num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0) num_threads = 1;
+  }
+  return num_threads;
+}
+
+// Parses the value of a --threads=N flag: a positive integer.
+bool ParseThreads(const char* value, size_t* num_threads) {
+  char* end = NULL;
+  const long n = strtol(value, &end, 10);
+  if (end == value || *end != '\0' || n < 1) return false;
+  *num_threads = n;
+  return true;
+}
+
+template <typename FunctionT>
+class ParallelForWorker {
+ public:
+  ParallelForWorker(size_t n, FunctionT* fn, std::atomic<size_t>* next)
+      : n_(n),
+        fn_(fn),
+        next_(next) {
+  }
+
+  void operator()() {
+    for (;;) {
+      const size_t i = next_->fetch_add(1);
+      if (i >= n_) return;
+      (*fn_)(i);
+    }
+  }
+
+ private:
+  size_t n_;
+  FunctionT* fn_;
+  std::atomic<size_t>* next_;
+};
+
+// Calls (*fn)(i) for every i in [0, n), on up to NumThreads() threads.
+// Items are handed out one at a time, so this is meant for a modest
+// number of coarse items (chunks, batches, blocks of triangles). fn
+// must be safe to call concurrently for different i.
+template <typename FunctionT>
+void ParallelFor(size_t n, FunctionT* fn) {
+  size_t num_threads = NumThreads();
+  if (num_threads > n) num_threads = n;
+  if (num_threads <= 1) {
+    for (size_t i = 0; i < n; ++i) {
+      (*fn)(i);
+    }
+    return;
+  }
+  std::atomic<size_t> next(0);
+  std::vector<std::thread> threads;
+  for (size_t t = 1; t < num_threads; ++t) {
+    threads.push_back(std::thread(ParallelForWorker<FunctionT>(n, fn, &next)));
+  }
+  ParallelForWorker<FunctionT>(n, fn, &next)();
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+}
+
+#endif  // WEBGL_LOADER_PARALLEL_H_
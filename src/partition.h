@@ -0,0 +1,436 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_PARTITION_H_
+#define WEBGL_LOADER_PARTITION_H_
+
+#include <float.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "base.h"
+#include "mesh.h"
+#include "optimize.h"
+#include "parallel.h"
+
+// Deciding which triangles of a DrawBatch end up in which WebGLMesh.
+
+// A run of a WebGLMesh's indices that came from a single group.
+struct GroupRun {
+  size_t group_index;  // Into DrawBatch::group_starts().
+  size_t length;  // In indices.
+};
+
+typedef std::vector<GroupRun> GroupRunList;
+
+enum SplitMode {
+  // Feed groups through one VertexOptimizer, which starts a new
+  // WebGLMesh whenever it runs out of indices.
+  kSplitSequential,
+  // Partition the batch into spatially coherent chunks that each fit
+  // in a WebGLMesh, then optimize the chunks independently.
+  kSplitSpatial
+};
+
+// Works out which groups (or parts of groups) landed in which mesh,
+// given the number of indices in each group, when a single
+// VertexOptimizer has split the batch.
+void ComputeGroupRuns(const std::vector<size_t>& group_lengths,
+                      const WebGLMeshList& meshes,
+                      std::vector<GroupRunList>* runs) {
+  std::vector<size_t> lengths(group_lengths);
+  runs->resize(meshes.size());
+  size_t group_index = 0;
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    GroupRunList& mesh_runs = (*runs)[i];
+    const size_t webgl_index_length = meshes[i].indices.size();
+    size_t group_start = 0;
+    while (group_index < lengths.size()) {
+      GroupRun run;
+      run.group_index = group_index;
+      const size_t group_length = lengths[group_index];
+      const size_t next_start = group_start + group_length;
+      if (next_start < webgl_index_length) {
+        run.length = group_length;
+        mesh_runs.push_back(run);
+        group_start = next_start;
+        ++group_index;
+      } else {
+        const size_t fits = webgl_index_length - group_start;
+        run.length = fits;
+        mesh_runs.push_back(run);
+        lengths[group_index] -= fits;
+        break;
+      }
+    }
+  }
+}
+
+// A set of triangles that fits in one WebGLMesh, with its own compact
+// vertex numbering.
+struct MeshChunk {
+  std::vector<int> vertices;  // Batch vertex index for each local index.
+  IndexList indices;  // Local indices, ordered by group run.
+  GroupRunList runs;
+};
+
+// Recursively bisects a batch into small pieces, of at most
+// max_vertices / kPiecesPerChunk distinct vertices. While a piece
+// spans several groups it is cut between groups, sorted by centroid
+// along the axis of greatest spread, so that groups stay whole; a
+// single group that is too large is cut at the median triangle
+// centroid. Pieces, in the order bisection visits them, are then
+// packed into chunks of at most max_vertices while they fit, so each
+// chunk but the last is nearly full, like a sequential split's meshes.
+// Bisecting straight down to max_vertices would leave chunks anywhere
+// from half full up.
+class SpatialPartitioner {
+ public:
+  SpatialPartitioner(const DrawMesh& draw_mesh,
+                     const std::vector<GroupStart>& group_starts,
+                     size_t max_vertices)
+      : draw_mesh_(draw_mesh),
+        max_vertices_(max_vertices),
+        num_triangles_(draw_mesh.indices.size() / 3),
+        tri_group_(num_triangles_),
+        centroids_(3 * num_triangles_),
+        stamps_(draw_mesh.attribs.size() / draw_mesh.layout.stride(), 0),
+        current_stamp_(0),
+        chunk_stamps_(stamps_.size(), 0) {
+    for (size_t g = 0; g < group_starts.size(); ++g) {
+      const size_t begin = group_starts[g].offset / 3;
+      const size_t end = (g + 1 < group_starts.size()) ?
+          group_starts[g + 1].offset / 3 : num_triangles_;
+      for (size_t t = begin; t < end; ++t) {
+        tri_group_[t] = g;
+      }
+    }
+    for (size_t t = 0; t < num_triangles_; ++t) {
+      for (size_t i = 0; i < 3; ++i) {
+        const float* position =
+            &draw_mesh.attribs[draw_mesh.layout.stride() * Index(t, i)];
+        for (size_t j = 0; j < 3; ++j) {
+          centroids_[3*t + j] += position[j] * (1.f / 3);
+        }
+      }
+    }
+  }
+
+  void Partition(std::vector<MeshChunk>* chunks) {
+    std::vector<int> tris(num_triangles_);
+    for (size_t t = 0; t < num_triangles_; ++t) {
+      tris[t] = t;
+    }
+    std::vector<std::vector<int> > pieces;
+    Split(std::max<size_t>(1, max_vertices_ / kPiecesPerChunk), &tris,
+          &pieces);
+    // Vertices already in tris are stamped with the number of chunks.
+    unsigned int chunk_stamp = 1;
+    size_t num_vertices = 0;
+    for (size_t i = 0; i < pieces.size(); ++i) {
+      const std::vector<int>& piece = pieces[i];
+      ++current_stamp_;
+      size_t new_vertices = 0;
+      for (size_t k = 0; k < piece.size(); ++k) {
+        for (size_t j = 0; j < 3; ++j) {
+          const int index = Index(piece[k], j);
+          if (chunk_stamps_[index] != chunk_stamp &&
+              stamps_[index] != current_stamp_) {
+            stamps_[index] = current_stamp_;
+            ++new_vertices;
+          }
+        }
+      }
+      if (!tris.empty() && num_vertices + new_vertices > max_vertices_) {
+        chunks->push_back(MeshChunk());
+        MakeChunk(tris, &chunks->back());
+        tris.clear();
+        ++chunk_stamp;
+        num_vertices = 0;
+        new_vertices = CountVertices(piece);
+      }
+      for (size_t k = 0; k < piece.size(); ++k) {
+        for (size_t j = 0; j < 3; ++j) {
+          chunk_stamps_[Index(piece[k], j)] = chunk_stamp;
+        }
+      }
+      num_vertices += new_vertices;
+      // Both are sorted, so the groups of tris stay contiguous.
+      const size_t middle = tris.size();
+      tris.insert(tris.end(), piece.begin(), piece.end());
+      std::inplace_merge(tris.begin(), tris.begin() + middle, tris.end());
+    }
+    if (!tris.empty()) {
+      chunks->push_back(MeshChunk());
+      MakeChunk(tris, &chunks->back());
+    }
+  }
+
+ private:
+  static const size_t kPiecesPerChunk = 8;
+
+  int Index(size_t tri, size_t corner) const {
+    return draw_mesh_.indices[3*tri + corner];
+  }
+
+  size_t CountVertices(const std::vector<int>& tris) {
+    ++current_stamp_;
+    size_t count = 0;
+    for (size_t i = 0; i < tris.size(); ++i) {
+      for (size_t j = 0; j < 3; ++j) {
+        unsigned int& stamp = stamps_[Index(tris[i], j)];
+        if (stamp != current_stamp_) {
+          stamp = current_stamp_;
+          ++count;
+        }
+      }
+    }
+    return count;
+  }
+
+  // Returns the axis along which the points spread out the most.
+  static size_t WidestAxis(const std::vector<float>& points) {
+    float mins[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+    float maxes[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (size_t i = 0; i < points.size(); i += 3) {
+      for (size_t j = 0; j < 3; ++j) {
+        mins[j] = std::min(mins[j], points[i + j]);
+        maxes[j] = std::max(maxes[j], points[i + j]);
+      }
+    }
+    size_t axis = 0;
+    for (size_t j = 1; j < 3; ++j) {
+      if (maxes[j] - mins[j] > maxes[axis] - mins[axis]) axis = j;
+    }
+    return axis;
+  }
+
+  // Splits tris into pieces of at most max_vertices. tris is sorted,
+  // so the triangles of a group are contiguous.
+  void Split(size_t max_vertices, std::vector<int>* tris,
+             std::vector<std::vector<int> >* pieces) {
+    if (tris->empty()) return;
+    if (CountVertices(*tris) <= max_vertices) {
+      pieces->push_back(std::vector<int>());
+      pieces->back().swap(*tris);
+      return;
+    }
+    std::vector<int> left, right;
+    // Gather each group's triangle count and centroid.
+    std::vector<size_t> groups, counts;
+    std::vector<float> centers;
+    for (size_t i = 0; i < tris->size(); ++i) {
+      const int t = (*tris)[i];
+      if (groups.empty() || groups.back() != tri_group_[t]) {
+        groups.push_back(tri_group_[t]);
+        counts.push_back(0);
+        centers.insert(centers.end(), 3, 0.f);
+      }
+      ++counts.back();
+      for (size_t j = 0; j < 3; ++j) {
+        centers[centers.size() - 3 + j] += centroids_[3*t + j];
+      }
+    }
+    if (groups.size() > 1) {
+      for (size_t g = 0; g < groups.size(); ++g) {
+        for (size_t j = 0; j < 3; ++j) {
+          centers[3*g + j] /= counts[g];
+        }
+      }
+      const size_t axis = WidestAxis(centers);
+      std::vector<std::pair<float, size_t> > order;
+      for (size_t g = 0; g < groups.size(); ++g) {
+        order.push_back(std::make_pair(centers[3*g + axis], g));
+      }
+      std::sort(order.begin(), order.end());
+      // Send groups left until half the triangles have gone, but
+      // always leave at least one group on each side.
+      std::vector<bool> goes_left(groups.size(), false);
+      size_t sent = 0;
+      for (size_t k = 0; k + 1 < order.size(); ++k) {
+        if (k > 0 && 2 * sent >= tris->size()) break;
+        goes_left[order[k].second] = true;
+        sent += counts[order[k].second];
+      }
+      size_t g = 0;
+      for (size_t i = 0; i < tris->size(); ++i) {
+        const int t = (*tris)[i];
+        if (tri_group_[t] != groups[g]) ++g;
+        (goes_left[g] ? left : right).push_back(t);
+      }
+    } else {
+      std::vector<float> points;
+      for (size_t i = 0; i < tris->size(); ++i) {
+        const float* centroid = &centroids_[3 * (*tris)[i]];
+        points.insert(points.end(), centroid, centroid + 3);
+      }
+      const size_t axis = WidestAxis(points);
+      std::vector<std::pair<float, int> > order;
+      for (size_t i = 0; i < tris->size(); ++i) {
+        order.push_back(std::make_pair(points[3*i + axis], (*tris)[i]));
+      }
+      const size_t half = order.size() / 2;
+      std::nth_element(order.begin(), order.begin() + half, order.end());
+      for (size_t i = 0; i < order.size(); ++i) {
+        (i < half ? left : right).push_back(order[i].second);
+      }
+      std::sort(left.begin(), left.end());
+      std::sort(right.begin(), right.end());
+    }
+    std::vector<int>().swap(*tris);
+    Split(max_vertices, &left, pieces);
+    Split(max_vertices, &right, pieces);
+  }
+
+  void MakeChunk(const std::vector<int>& tris, MeshChunk* chunk) {
+    ++current_stamp_;
+    std::vector<int>& local = local_index_;
+    local.resize(stamps_.size());
+    for (size_t i = 0; i < tris.size(); ++i) {
+      const int t = tris[i];
+      if (chunk->runs.empty() ||
+          chunk->runs.back().group_index != tri_group_[t]) {
+        GroupRun run;
+        run.group_index = tri_group_[t];
+        run.length = 0;
+        chunk->runs.push_back(run);
+      }
+      chunk->runs.back().length += 3;
+      for (size_t j = 0; j < 3; ++j) {
+        const int index = Index(t, j);
+        if (stamps_[index] != current_stamp_) {
+          stamps_[index] = current_stamp_;
+          local[index] = chunk->vertices.size();
+          chunk->vertices.push_back(index);
+        }
+        chunk->indices.push_back(local[index]);
+      }
+    }
+  }
+
+  const DrawMesh& draw_mesh_;
+  size_t max_vertices_;
+  size_t num_triangles_;
+  std::vector<size_t> tri_group_;
+  std::vector<float> centroids_;
+  std::vector<unsigned int> stamps_;
+  unsigned int current_stamp_;
+  std::vector<unsigned int> chunk_stamps_;  // For Partition.
+  std::vector<int> local_index_;
+};
+
+// Optimizes each chunk into exactly one WebGLMesh, in parallel.
+class ChunkOptimizer {
+ public:
+  ChunkOptimizer(const std::vector<MeshChunk>& chunks,
+                 const QuantizedAttribList& attribs,
+                 const VertexLayout& layout,
+                 uint32 max_output_index,
+                 WebGLMeshList* meshes)
+      : chunks_(chunks),
+        attribs_(attribs),
+        layout_(layout),
+        stride_(layout.stride()),
+        max_output_index_(max_output_index),
+        meshes_(meshes) {
+    meshes_->resize(chunks.size());
+  }
+
+  void operator()(size_t i) {
+    const MeshChunk& chunk = chunks_[i];
+    QuantizedAttribList local_attribs(stride_ * chunk.vertices.size());
+    for (size_t v = 0; v < chunk.vertices.size(); ++v) {
+      const uint16* from = &attribs_[stride_ * chunk.vertices[v]];
+      CopyVertex(from, stride_, &local_attribs[stride_ * v]);
+    }
+    VertexOptimizer vertex_optimizer(local_attribs, max_output_index_,
+                                     layout_);
+    WebGLMeshList local_meshes;
+    size_t offset = 0;
+    for (size_t r = 0; r < chunk.runs.size(); ++r) {
+      vertex_optimizer.AddTriangles(&chunk.indices[offset],
+                                    chunk.runs[r].length, &local_meshes);
+      offset += chunk.runs[r].length;
+    }
+    CHECK(local_meshes.size() == 1);
+    std::swap((*meshes_)[i], local_meshes[0]);
+  }
+
+ private:
+  const std::vector<MeshChunk>& chunks_;
+  const QuantizedAttribList& attribs_;
+  VertexLayout layout_;
+  size_t stride_;
+  uint32 max_output_index_;
+  WebGLMeshList* meshes_;
+};
+
+// Quantized attribs to optimized WebGLMeshes, along with the group
+// runs of each mesh. The attribs are quantized from draw_mesh, so they
+// are in its layout. max_output_index bounds the number of vertices in
+// a mesh; see VertexOptimizer.
+void OptimizeBatch(const DrawMesh& draw_mesh,
+                   const std::vector<GroupStart>& group_starts,
+                   const QuantizedAttribList& quantized_attribs,
+                   SplitMode split_mode,
+                   uint32 max_output_index,
+                   WebGLMeshList* webgl_meshes,
+                   std::vector<GroupRunList>* group_runs) {
+  CHECK(quantized_attribs.size() == draw_mesh.attribs.size());
+  if (split_mode == kSplitSpatial) {
+    std::vector<MeshChunk> chunks;
+    SpatialPartitioner partitioner(draw_mesh, group_starts,
+                                   max_output_index - 3);
+    partitioner.Partition(&chunks);
+    ChunkOptimizer chunk_optimizer(chunks, quantized_attribs,
+                                   draw_mesh.layout, max_output_index,
+                                   webgl_meshes);
+    ParallelFor(chunks.size(), &chunk_optimizer);
+    group_runs->resize(chunks.size());
+    for (size_t i = 0; i < chunks.size(); ++i) {
+      (*group_runs)[i].swap(chunks[i].runs);
+    }
+    return;
+  }
+  VertexOptimizer vertex_optimizer(quantized_attribs, max_output_index,
+                                   draw_mesh.layout);
+  std::vector<size_t> group_lengths;
+  for (size_t i = 0; i < group_starts.size(); ++i) {
+    const size_t here = group_starts[i].offset;
+    const size_t end = (i + 1 < group_starts.size()) ?
+        group_starts[i + 1].offset : draw_mesh.indices.size();
+    const size_t length = end - here;
+    const bool divisible_by_3 = length % 3 == 0;
+    CHECK(divisible_by_3);
+    group_lengths.push_back(length);
+    vertex_optimizer.AddTriangles(&draw_mesh.indices[here], length,
+                                  webgl_meshes);
+  }
+  ComputeGroupRuns(group_lengths, *webgl_meshes, group_runs);
+}
+
+void OptimizeBatch(const DrawBatch& draw_batch,
+                   const QuantizedAttribList& quantized_attribs,
+                   SplitMode split_mode,
+                   uint32 max_output_index,
+                   WebGLMeshList* webgl_meshes,
+                   std::vector<GroupRunList>* group_runs) {
+  OptimizeBatch(draw_batch.draw_mesh(), draw_batch.group_starts(),
+                quantized_attribs, split_mode, max_output_index,
+                webgl_meshes, group_runs);
+}
+
+#endif  // WEBGL_LOADER_PARTITION_H_
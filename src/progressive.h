@@ -0,0 +1,335 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_PROGRESSIVE_H_
+#define WEBGL_LOADER_PROGRESSIVE_H_
+
+#include <algorithm>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "base.h"
+#include "decode.h"
+#include "mesh.h"
+#include "parallel.h"
+#include "partition.h"
+#include "reorder.h"
+#include "simplify.h"
+#include "stats.h"
+
+// Progressive meshes, streamed coarse to fine. A WebGLMesh is
+// simplified into nested levels of detail; since simplify.h only
+// removes vertices, every vertex of a level is also a vertex of the
+// levels finer than it. Vertices are numbered in the order the levels
+// introduce them, so each level only needs to send its new vertices,
+// plus its whole index list (see CompressLevelIndicesToUtf8). The last
+// level is the mesh itself.
+
+struct ProgressiveLevel {
+  size_t num_new_vertices;
+  OptimizedIndexList indices;  // Into the vertices of all levels so far.
+  // With group runs, how many of the indices of each run of the mesh
+  // the level keeps, in order: 0 for the groups it drops.
+  std::vector<size_t> run_lengths;
+};
+
+typedef std::vector<ProgressiveLevel> ProgressiveLevelList;
+
+// Where a level sits in the stream, in characters.
+struct LevelRange {
+  size_t attrib_start;
+  size_t num_new_vertices;
+  size_t index_start;
+  size_t num_triangles;
+  size_t index_codes;
+};
+
+typedef std::vector<LevelRange> LevelRangeList;
+
+// Splits mesh into num_lods + 1 levels, coarsest first, each with
+// ratio of the triangles of the next finer one, and renumbers the
+// vertices of mesh to match. Positions shared by several vertices are
+// treated as seams, as the flattener would have split them. Levels
+// keep the order of the triangles of mesh, so with the group runs of
+// mesh, they get run_lengths.
+void MakeProgressiveMesh(size_t num_lods, float ratio, WebGLMesh* mesh,
+                         ProgressiveLevelList* levels,
+                         const GroupRunList* runs = NULL) {
+  const size_t stride = mesh->layout.stride();
+  const size_t num_vertices = mesh->attribs.size() / stride;
+  DrawMesh draw_mesh;
+  draw_mesh.layout = mesh->layout;
+  draw_mesh.attribs.assign(mesh->attribs.begin(), mesh->attribs.end());
+  draw_mesh.indices.assign(mesh->indices.begin(), mesh->indices.end());
+  std::vector<int> position_indices(num_vertices);
+  std::map<std::pair<uint32, uint16>, int> positions;
+  for (size_t v = 0; v < num_vertices; ++v) {
+    const uint16* attribs = &mesh->attribs[stride * v];
+    const std::pair<uint32, uint16> key((attribs[0] << 16) | attribs[1],
+                                        attribs[2]);
+    position_indices[v] = positions.insert(
+        std::make_pair(key, static_cast<int>(positions.size()))).first->second;
+  }
+  std::vector<IndexList> lods(num_lods + 1);
+  lods[0] = draw_mesh.indices;
+  std::vector<std::vector<size_t> > lod_run_lengths(num_lods + 1);
+  for (size_t r = 0; runs && r < runs->size(); ++r) {
+    lod_run_lengths[0].push_back((*runs)[r].length);
+  }
+  MeshSimplifier simplifier(draw_mesh, position_indices);
+  size_t target_triangles = simplifier.num_triangles();
+  for (size_t lod = 1; lod <= num_lods; ++lod) {
+    target_triangles = static_cast<size_t>(ratio * target_triangles);
+    simplifier.Simplify(target_triangles);
+    simplifier.GetIndices(&lods[lod]);
+    Stats::Get().Increment(Stats::kLodTriangles, lods[lod].size() / 3);
+    size_t t = 0;
+    for (size_t r = 0; runs && r < runs->size(); ++r) {
+      size_t length = 0;
+      for (const size_t end = t + (*runs)[r].length / 3; t < end; ++t) {
+        if (simplifier.alive(t)) length += 3;
+      }
+      lod_run_lengths[lod].push_back(length);
+    }
+  }
+  // Number vertices as the levels first use them, coarsest first.
+  std::vector<uint32> order;
+  order.reserve(num_vertices);
+  std::vector<bool> seen(num_vertices, false);
+  levels->resize(num_lods + 1);
+  for (size_t l = 0; l <= num_lods; ++l) {
+    const IndexList& indices = lods[num_lods - l];
+    const size_t before = order.size();
+    for (size_t i = 0; i < indices.size(); ++i) {
+      if (!seen[indices[i]]) {
+        seen[indices[i]] = true;
+        order.push_back(indices[i]);
+      }
+    }
+    (*levels)[l].num_new_vertices = order.size() - before;
+  }
+  PermuteVertices(order, mesh);
+  std::vector<uint32> remap(num_vertices);
+  for (size_t i = 0; i < num_vertices; ++i) remap[order[i]] = i;
+  for (size_t l = 0; l <= num_lods; ++l) {
+    const IndexList& indices = lods[num_lods - l];
+    (*levels)[l].run_lengths.swap(lod_run_lengths[num_lods - l]);
+    OptimizedIndexList& level_indices = (*levels)[l].indices;
+    level_indices.resize(indices.size());
+    for (size_t i = 0; i < indices.size(); ++i) {
+      level_indices[i] = remap[indices[i]];
+    }
+  }
+}
+
+class ProgressiveMeshMaker {
+ public:
+  ProgressiveMeshMaker(size_t num_lods, float ratio, WebGLMeshList* meshes,
+                       std::vector<ProgressiveLevelList>* levels,
+                       const std::vector<GroupRunList>* runs)
+      : num_lods_(num_lods),
+        ratio_(ratio),
+        meshes_(meshes),
+        levels_(levels),
+        runs_(runs) {
+  }
+
+  void operator()(size_t i) {
+    MakeProgressiveMesh(num_lods_, ratio_, &(*meshes_)[i], &(*levels_)[i],
+                        runs_ ? &(*runs_)[i] : NULL);
+  }
+
+ private:
+  size_t num_lods_;
+  float ratio_;
+  WebGLMeshList* meshes_;
+  std::vector<ProgressiveLevelList>* levels_;
+  const std::vector<GroupRunList>* runs_;
+};
+
+// Makes every mesh of a batch progressive, in parallel. runs, if
+// given, has the group runs of each mesh.
+void MakeProgressiveMeshes(size_t num_lods, float ratio,
+                           WebGLMeshList* meshes,
+                           std::vector<ProgressiveLevelList>* levels,
+                           const std::vector<GroupRunList>* runs = NULL) {
+  levels->resize(meshes->size());
+  ProgressiveMeshMaker maker(num_lods, ratio, meshes, levels, runs);
+  ParallelFor(meshes->size(), &maker);
+}
+
+// The indices of a level, whose coarser levels brought num_known
+// vertices. Vertices are numbered here in order of first use within
+// the level, as for CompressIndicesToUtf8, and each index becomes a
+// variable-length code:
+//   0: the first use of the next new vertex, which are in first-use
+//      order already;
+//   1: the first use of a known vertex, followed by ZigZag(vertex -
+//      next_known), where next_known is one past the last known vertex
+//      used;
+//   c >= 2: the vertex first used c - 1 first uses ago.
+// Known vertices tend to be used in much the order the coarser levels
+// used them, so that deltas stay small. Returns the number of
+// characters written.
+size_t CompressLevelIndicesToUtf8(const OptimizedIndexList& indices,
+                                  uint32 num_known,
+                                  std::vector<char>* utf8) {
+  ScopedTimer timer(Stats::kEncode);
+  static const uint32 kUnused = 0xFFFFFFFF;
+  std::vector<uint32> first_uses;
+  uint32 next_first_use = 0;
+  uint32 next_new = num_known;
+  uint32 next_known = 0;
+  size_t num_codes = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const uint32 index = indices[i];
+    if (index >= first_uses.size()) first_uses.resize(index + 1, kUnused);
+    if (first_uses[index] != kUnused) {
+      num_codes += Uint32ToUtf8Varint(
+          next_first_use - first_uses[index] + 1, utf8);
+      continue;
+    }
+    first_uses[index] = next_first_use++;
+    if (index >= num_known) {
+      CHECK(index == next_new);
+      ++next_new;
+      num_codes += Uint32ToUtf8Varint(0, utf8);
+    } else {
+      num_codes += Uint32ToUtf8Varint(1, utf8);
+      num_codes += Uint32ToUtf8Varint(
+          ZigZag32(static_cast<int32>(index - next_known)), utf8);
+      next_known = index + 1;
+    }
+  }
+  return num_codes;
+}
+
+// Writes the levels of all meshes level by level, so that every mesh
+// has something to draw before any mesh is refined. offset is where
+// utf8 starts in the stream, in characters; returns where it ends.
+size_t CompressProgressiveMeshesToUtf8(
+    const WebGLMeshList& meshes,
+    const std::vector<ProgressiveLevelList>& levels,
+    size_t offset,
+    std::vector<LevelRangeList>* ranges,
+    std::vector<char>* utf8) {
+  ranges->resize(meshes.size());
+  std::vector<size_t> vertex_starts(meshes.size(), 0);
+  size_t num_levels = 0;
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    num_levels = std::max(num_levels, levels[i].size());
+    (*ranges)[i].clear();
+  }
+  QuantizedAttribList new_attribs;
+  for (size_t l = 0; l < num_levels; ++l) {
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      if (l >= levels[i].size()) continue;
+      const ProgressiveLevel& level = levels[i][l];
+      LevelRange range;
+      range.attrib_start = offset;
+      range.num_new_vertices = level.num_new_vertices;
+      const size_t num_known = vertex_starts[i];
+      const size_t stride = meshes[i].layout.stride();
+      QuantizedAttribList::const_iterator attribs =
+          meshes[i].attribs.begin() + stride * num_known;
+      new_attribs.assign(attribs, attribs + stride * level.num_new_vertices);
+      CompressQuantizedAttribsToUtf8(new_attribs, stride, utf8);
+      vertex_starts[i] += level.num_new_vertices;
+      offset += new_attribs.size();
+      range.index_start = offset;
+      range.num_triangles = level.indices.size() / 3;
+      range.index_codes = CompressLevelIndicesToUtf8(level.indices, num_known,
+                                                     utf8);
+      offset += range.index_codes;
+      (*ranges)[i].push_back(range);
+    }
+  }
+  return offset;
+}
+
+// Decodes a progressive stream as it arrives: each mesh holds the
+// vertices received so far, in layout, and the indices of its finest
+// complete level.
+class ProgressiveDecoder {
+ public:
+  explicit ProgressiveDecoder(const std::vector<LevelRangeList>& ranges,
+                              const VertexLayout& layout = VertexLayout())
+      : ranges_(ranges),
+        meshes_(ranges.size()),
+        next_level_(ranges.size(), 0),
+        num_triangles_(0) {
+    for (size_t i = 0; i < meshes_.size(); ++i) {
+      meshes_[i].layout = layout;
+    }
+  }
+
+  // Decodes every level whose characters have all arrived, where codes
+  // is the stream so far. Returns how many levels that was.
+  size_t Update(const std::vector<uint32>& codes) {
+    size_t num_decoded = 0;
+    bool progress = true;
+    while (progress) {
+      progress = false;
+      for (size_t i = 0; i < ranges_.size(); ++i) {
+        if (next_level_[i] == ranges_[i].size()) continue;
+        const LevelRange& range = ranges_[i][next_level_[i]];
+        if (codes.size() < range.index_start + range.index_codes) continue;
+        DecodeLevel(codes, range, &meshes_[i]);
+        ++next_level_[i];
+        ++num_decoded;
+        progress = true;
+      }
+    }
+    return num_decoded;
+  }
+
+  const WebGLMesh& mesh(size_t i) const { return meshes_[i]; }
+
+  // Over all meshes, at their finest complete levels.
+  size_t num_triangles() const { return num_triangles_; }
+
+  bool done() const {
+    for (size_t i = 0; i < ranges_.size(); ++i) {
+      if (next_level_[i] != ranges_[i].size()) return false;
+    }
+    return true;
+  }
+
+ private:
+  void DecodeLevel(const std::vector<uint32>& codes, const LevelRange& range,
+                   WebGLMesh* mesh) {
+    const size_t stride = mesh->layout.stride();
+    const size_t num_vertices = mesh->attribs.size() / stride;
+    mesh->attribs.resize(stride * (num_vertices + range.num_new_vertices));
+    if (range.num_new_vertices) {
+      DecompressAttribs(&codes[range.attrib_start], range.num_new_vertices,
+                        stride, &mesh->attribs[stride * num_vertices]);
+    }
+    num_triangles_ -= mesh->indices.size() / 3;
+    mesh->indices.resize(3 * range.num_triangles);
+    if (range.num_triangles) {
+      DecompressLevelIndices(&codes[range.index_start], mesh->indices.size(),
+                             num_vertices, &mesh->indices[0]);
+    }
+    num_triangles_ += range.num_triangles;
+  }
+
+  const std::vector<LevelRangeList>& ranges_;
+  WebGLMeshList meshes_;
+  std::vector<size_t> next_level_;
+  size_t num_triangles_;
+};
+
+#endif  // WEBGL_LOADER_PROGRESSIVE_H_
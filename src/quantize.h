@@ -0,0 +1,206 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_QUANTIZE_H_
+#define WEBGL_LOADER_QUANTIZE_H_
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "base.h"
+#include "mesh.h"
+
+// Measures quantization error the way clients see it: quantized
+// attributes are decoded as decodeScales * (word + decodeOffsets) and
+// the original floats subtracted. Errors are in steps (decodeScales),
+// so columns of different scales compare, and signed, so a bias
+// shows: truncation errs by (-1, 0] steps, rounding by [-0.5, 0.5].
+// The tiles --uv-bounds drops from texcoords are added back.
+
+// The name of a column of layout, for reports.
+const char* ColumnName(const VertexLayout& layout, size_t column) {
+  static const char* const kNames[kNumVertexAttribs][3] = {
+    { "x", "y", "z" },
+    { "u", "v", NULL },
+    { "nx", "ny", "nz" },
+    { "angle", "sign", NULL },
+    { "r", "g", "b" },
+  };
+  for (size_t i = 0; i < kNumVertexAttribs; ++i) {
+    const VertexAttrib attrib = static_cast<VertexAttrib>(i);
+    if (!layout.has(attrib)) continue;
+    const size_t offset = layout.offset(attrib);
+    if (column >= offset && column < offset + VertexLayout::size(attrib)) {
+      return kNames[i][column - offset];
+    }
+  }
+  return "?";
+}
+
+// The error distribution of one column.
+struct ColumnError {
+  // Quarter steps over [-1, 1), and one bin each for the outliers
+  // either side, which only clamping makes.
+  static const size_t kNumBins = 10;
+
+  ColumnError()
+      : count(0),
+        max_steps(0),
+        max_error(0),
+        sum_steps(0),
+        sum_abs_steps(0) {
+    for (size_t i = 0; i < kNumBins; ++i) {
+      bins[i] = 0;
+    }
+  }
+
+  static size_t Bin(double steps) {
+    if (steps < -1) return 0;
+    if (steps >= 1) return kNumBins - 1;
+    return 1 + std::min(static_cast<size_t>(4 * (steps + 1)),
+                        kNumBins - 3);
+  }
+
+  void Add(double error, double step) {
+    const double steps = error / step;
+    ++count;
+    max_steps = std::max(max_steps, fabs(steps));
+    max_error = std::max(max_error, fabs(error));
+    sum_steps += steps;
+    sum_abs_steps += fabs(steps);
+    ++bins[Bin(steps)];
+  }
+
+  double mean() const {
+    return count ? sum_abs_steps / count : 0;
+  }
+
+  double bias() const {
+    return count ? sum_steps / count : 0;
+  }
+
+  size_t count;
+  double max_steps;
+  double max_error;  // In attribute units.
+  double sum_steps;
+  double sum_abs_steps;
+  size_t bins[kNumBins];
+};
+
+class QuantizeErrorReport {
+ public:
+  explicit QuantizeErrorReport(const VertexLayout& layout)
+      : layout_(layout),
+        columns_(layout.stride()) {
+  }
+
+  // Adds each vertex of mesh, quantized with params as quantized, and
+  // each group of group_starts, named by obj, under material.
+  void Add(const std::string& material, const DrawMesh& mesh,
+           const BoundsParams& params, const QuantizedAttribList& quantized,
+           const std::vector<GroupStart>& group_starts,
+           const WavefrontObjFile& obj) {
+    const size_t stride = layout_.stride();
+    CHECK(mesh.layout == layout_);
+    CHECK(params.layout == layout_);
+    CHECK(quantized.size() == mesh.attribs.size());
+    const size_t num_vertices = mesh.attribs.size() / stride;
+    for (size_t i = 0; i < mesh.attribs.size(); i += stride) {
+      AddVertex(mesh.attribs, params, quantized, i, &columns_[0]);
+    }
+    // A group has the vertices its triangles use.
+    std::vector<size_t> last_group(num_vertices, 0);
+    for (size_t g = 0; g < group_starts.size(); ++g) {
+      groups_.push_back(Group());
+      Group& group = groups_.back();
+      group.name = material + "/" + obj.LineToGroup(group_starts[g].group_line);
+      group.vertices = 0;
+      group.columns.resize(stride);
+      const size_t end = g + 1 < group_starts.size() ?
+          group_starts[g + 1].offset : mesh.indices.size();
+      for (size_t i = group_starts[g].offset; i < end; ++i) {
+        const int vertex = mesh.indices[i];
+        if (last_group[vertex] == g + 1) continue;
+        last_group[vertex] = g + 1;
+        ++group.vertices;
+        AddVertex(mesh.attribs, params, quantized, stride * vertex,
+                  &group.columns[0]);
+      }
+    }
+  }
+
+  const ColumnError& column(size_t i) const {
+    return columns_[i];
+  }
+
+  void Print() const {
+    puts("\nQuantization error, in steps (decoded - original):\n");
+    puts("||Column||Max||Mean||Bias||Max (units)||<-1||-1||-0.75||-0.5"
+         "||-0.25||0||0.25||0.5||0.75||>=1||");
+    for (size_t i = 0; i < columns_.size(); ++i) {
+      const ColumnError& column = columns_[i];
+      printf("||%s||%f||%f||%+f||%g", ColumnName(layout_, i),
+             column.max_steps, column.mean(), column.bias(),
+             column.max_error);
+      for (size_t j = 0; j < ColumnError::kNumBins; ++j) {
+        printf("||%.4f", column.count ?
+               static_cast<double>(column.bins[j]) / column.count : 0.0);
+      }
+      puts("||");
+    }
+    puts("\nPer group, max/mean error in steps:\n");
+    printf("||Group||Vertices");
+    for (size_t i = 0; i < columns_.size(); ++i) {
+      printf("||%s", ColumnName(layout_, i));
+    }
+    puts("||");
+    for (size_t g = 0; g < groups_.size(); ++g) {
+      const Group& group = groups_[g];
+      printf("||%s||%zu", group.name.c_str(), group.vertices);
+      for (size_t i = 0; i < group.columns.size(); ++i) {
+        printf("||%.2f/%.2f", group.columns[i].max_steps,
+               group.columns[i].mean());
+      }
+      puts("||");
+    }
+  }
+
+ private:
+  struct Group {
+    std::string name;
+    size_t vertices;
+    std::vector<ColumnError> columns;
+  };
+
+  void AddVertex(const AttribList& attribs, const BoundsParams& params,
+                 const QuantizedAttribList& quantized, size_t start,
+                 ColumnError* columns) const {
+    for (size_t j = 0; j < layout_.stride(); ++j) {
+      const double step = params.decodeScales[j];
+      const double decoded = params.tiles[j] +
+          step * (quantized[start + j] + params.decodeOffsets[j]);
+      columns[j].Add(decoded - attribs[start + j], step);
+    }
+  }
+
+  VertexLayout layout_;
+  std::vector<ColumnError> columns_;
+  std::vector<Group> groups_;
+};
+
+#endif  // WEBGL_LOADER_QUANTIZE_H_
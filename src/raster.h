@@ -0,0 +1,154 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_RASTER_H_
+#define WEBGL_LOADER_RASTER_H_
+
+#include <float.h>
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+
+// A tiny software rasterizer for estimating overdraw without a GPU.
+// Triangles are drawn, in order, with back face culling and a LESS
+// depth test into orthographic depth buffers looking down each of the
+// six axis directions. Overdraw is the number of pixels that passed
+// the depth test over the number of distinct pixels covered, so 1.0
+// means every pixel was shaded exactly once.
+
+struct OverdrawStats {
+  OverdrawStats()
+      : pixels_shaded(0),
+        pixels_covered(0) {
+  }
+
+  double overdraw() const {
+    return pixels_covered ?
+        static_cast<double>(pixels_shaded) / pixels_covered : 0.0;
+  }
+
+  size_t pixels_shaded;
+  size_t pixels_covered;
+};
+
+class OverdrawRasterizer {
+ public:
+  static const size_t kNumViews = 6;
+
+  // Positions are the first three of every stride quantized
+  // attributes, in [0, max_position].
+  explicit OverdrawRasterizer(size_t resolution = 256,
+                              int max_position = (1 << 14) - 1)
+      : resolution_(resolution),
+        scale_(static_cast<float>(resolution) / (max_position + 1)),
+        pixels_shaded_(0) {
+    for (size_t v = 0; v < kNumViews; ++v) {
+      depths_[v].assign(resolution * resolution, FLT_MAX);
+    }
+  }
+
+  template <typename IndexListT>
+  void Rasterize(const QuantizedAttribList& attribs, size_t stride,
+                 const IndexListT& indices) {
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+      const uint16* p[3] = { &attribs[stride * indices[i]],
+                             &attribs[stride * indices[i + 1]],
+                             &attribs[stride * indices[i + 2]] };
+      for (size_t v = 0; v < kNumViews; ++v) {
+        RasterizeTriangle(v, p);
+      }
+    }
+  }
+
+  OverdrawStats stats() const {
+    OverdrawStats stats;
+    stats.pixels_shaded = pixels_shaded_;
+    for (size_t v = 0; v < kNumViews; ++v) {
+      for (size_t i = 0; i < depths_[v].size(); ++i) {
+        stats.pixels_covered += depths_[v][i] != FLT_MAX;
+      }
+    }
+    return stats;
+  }
+
+ private:
+  // View v looks down axis v / 2, from the positive side when v is
+  // even. Screen axes are the next two axes in cyclic order, swapped
+  // for the negative side, so that front faces are counter-clockwise.
+  void RasterizeTriangle(size_t v, const uint16* const* p) {
+    const size_t axis = v / 2;
+    const bool positive = (v % 2) == 0;
+    size_t u_axis = (axis + 1) % 3;
+    size_t v_axis = (axis + 2) % 3;
+    if (!positive) std::swap(u_axis, v_axis);
+    float x[3], y[3], z[3];
+    for (size_t j = 0; j < 3; ++j) {
+      x[j] = scale_ * p[j][u_axis];
+      y[j] = scale_ * p[j][v_axis];
+      z[j] = positive ? -static_cast<float>(p[j][axis]) : p[j][axis];
+    }
+    const float area = (x[1] - x[0]) * (y[2] - y[0]) -
+        (x[2] - x[0]) * (y[1] - y[0]);
+    if (area <= 0) return;  // Back facing or degenerate.
+    const float inv_area = 1.0f / area;
+    const int min_x = Clamp(floorf(Min3(x) - 0.5f));
+    const int max_x = Clamp(ceilf(Max3(x) - 0.5f));
+    const int min_y = Clamp(floorf(Min3(y) - 0.5f));
+    const int max_y = Clamp(ceilf(Max3(y) - 0.5f));
+    std::vector<float>& depths = depths_[v];
+    for (int py = min_y; py <= max_y; ++py) {
+      const float cy = py + 0.5f;
+      for (int px = min_x; px <= max_x; ++px) {
+        const float cx = px + 0.5f;
+        const float w0 = (x[2] - x[1]) * (cy - y[1]) -
+            (y[2] - y[1]) * (cx - x[1]);
+        const float w1 = (x[0] - x[2]) * (cy - y[2]) -
+            (y[0] - y[2]) * (cx - x[2]);
+        const float w2 = (x[1] - x[0]) * (cy - y[0]) -
+            (y[1] - y[0]) * (cx - x[0]);
+        if (w0 < 0 || w1 < 0 || w2 < 0) continue;
+        const float depth = inv_area * (w0 * z[0] + w1 * z[1] + w2 * z[2]);
+        float& stored = depths[py * resolution_ + px];
+        if (depth < stored) {
+          stored = depth;
+          ++pixels_shaded_;
+        }
+      }
+    }
+  }
+
+  int Clamp(float f) const {
+    if (f < 0) return 0;
+    if (f > resolution_ - 1) return resolution_ - 1;
+    return static_cast<int>(f);
+  }
+
+  static float Min3(const float* f) {
+    return std::min(f[0], std::min(f[1], f[2]));
+  }
+
+  static float Max3(const float* f) {
+    return std::max(f[0], std::max(f[1], f[2]));
+  }
+
+  size_t resolution_;
+  float scale_;
+  size_t pixels_shaded_;
+  std::vector<float> depths_[kNumViews];
+};
+
+#endif  // WEBGL_LOADER_RASTER_H_
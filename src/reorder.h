@@ -0,0 +1,174 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_REORDER_H_
+#define WEBGL_LOADER_REORDER_H_
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+#include "morton.h"
+#include "stats.h"
+
+// Vertex (attribute) orders other than first use. VertexOptimizer
+// emits vertices in the order the triangles first use them, which is
+// what CompressIndicesToUtf8 needs, but attribute deltas are then at
+// the mercy of the triangle order. Reordering vertices shrinks the
+// attribute deltas at the cost of indices that no longer follow the
+// high water mark, so reordered meshes must use
+// CompressIndicesToUtf8ZigZag.
+
+// Moves vertex order[i] to position i, for every i.
+void PermuteVertices(const std::vector<uint32>& order, WebGLMesh* mesh) {
+  const size_t stride = mesh->layout.stride();
+  const size_t num_vertices = mesh->attribs.size() / stride;
+  CHECK(order.size() == num_vertices);
+  QuantizedAttribList attribs(mesh->attribs.size());
+  std::vector<uint32> remap(num_vertices);
+  for (size_t i = 0; i < num_vertices; ++i) {
+    const uint16* from = &mesh->attribs[stride * order[i]];
+    CopyVertex(from, stride, &attribs[stride * i]);
+    remap[order[i]] = i;
+  }
+  for (size_t i = 0; i < mesh->indices.size(); ++i) {
+    mesh->indices[i] = remap[mesh->indices[i]];
+  }
+  mesh->attribs.swap(attribs);
+}
+
+// Sum of absolute differences over all stride quantized attributes; a
+// cheap stand-in for the size of the deltas
+// CompressQuantizedAttribsToUtf8 writes.
+static inline int AttribDistance(const uint16* a, const uint16* b,
+                                 size_t stride) {
+  int distance = 0;
+  for (size_t k = 0; k < stride; ++k) {
+    distance += abs(static_cast<int>(a[k]) - b[k]);
+  }
+  return distance;
+}
+
+static const size_t kDefaultVertexWindow = 32;
+
+// Reorders vertices within consecutive windows of the first-use order,
+// so every vertex moves by less than window places and the index
+// stream stays nearly first-use. Within a window, vertices are chained
+// greedily, each followed by its nearest remaining neighbor.
+void ReorderVerticesInWindows(size_t window, WebGLMesh* mesh) {
+  ScopedTimer timer(Stats::kOptimize);
+  const size_t stride = mesh->layout.stride();
+  const size_t num_vertices = mesh->attribs.size() / stride;
+  const QuantizedAttribList& attribs = mesh->attribs;
+  std::vector<uint32> order;
+  order.reserve(num_vertices);
+  std::vector<uint32> remaining;
+  for (size_t start = 0; start < num_vertices; start += window) {
+    const size_t end = std::min(start + window, num_vertices);
+    remaining.clear();
+    for (size_t v = start; v < end; ++v) remaining.push_back(v);
+    while (!remaining.empty()) {
+      size_t best = 0;
+      if (!order.empty()) {
+        const uint16* last = &attribs[stride * order.back()];
+        int best_distance =
+            AttribDistance(last, &attribs[stride * remaining[0]], stride);
+        for (size_t r = 1; r < remaining.size(); ++r) {
+          const int distance =
+              AttribDistance(last, &attribs[stride * remaining[r]], stride);
+          if (distance < best_distance) {
+            best_distance = distance;
+            best = r;
+          }
+        }
+      }
+      order.push_back(remaining[best]);
+      remaining.erase(remaining.begin() + best);
+    }
+  }
+  PermuteVertices(order, mesh);
+}
+
+// Reorders vertices along the Morton curve of their quantized
+// positions, within consecutive windows of window vertices of the
+// first-use order, or over the whole mesh if window is 0. Vertices at
+// the same position keep their first-use order. Deltas between
+// neighbors on the curve are small in every position coordinate, but
+// the wider the window, the further indices stray from first use.
+void ReorderVerticesMorton(size_t window, WebGLMesh* mesh) {
+  ScopedTimer timer(Stats::kOptimize);
+  const size_t stride = mesh->layout.stride();
+  const size_t num_vertices = mesh->attribs.size() / stride;
+  if (!window) window = num_vertices;
+  // The window goes above the position, so one sort does every window.
+  size_t window_bits = 0;
+  while (window && (num_vertices - 1) / window >> window_bits) ++window_bits;
+  std::vector<uint64> keys(num_vertices);
+  std::vector<uint32> order(num_vertices);
+  for (size_t v = 0; v < num_vertices; ++v) {
+    const uint16* position = &mesh->attribs[stride * v];
+    keys[v] = (static_cast<uint64>(v / window) << kPositionMortonBits) |
+        MortonCode3(position[0], position[1], position[2]);
+    order[v] = v;
+  }
+  RadixSort(kPositionMortonBits + window_bits, &keys, &order);
+  PermuteVertices(order, mesh);
+}
+
+enum AttribOrder {
+  kAttribOrderFirstUse,
+  kAttribOrderSpatial,  // ReorderVerticesInWindows.
+  kAttribOrderMorton,  // ReorderVerticesMorton.
+};
+
+// Parses the value of an --attrib-order flag: first-use, spatial[:W]
+// or morton[:W].
+bool ParseAttribOrder(const char* value, AttribOrder* order, size_t* window) {
+  if (0 == strcmp(value, "first-use")) {
+    *order = kAttribOrderFirstUse;
+    *window = 0;
+    return true;
+  }
+  const char* rest = NULL;
+  if (0 == strncmp(value, "spatial", 7)) {
+    *order = kAttribOrderSpatial;
+    *window = kDefaultVertexWindow;
+    rest = value + 7;
+  } else if (0 == strncmp(value, "morton", 6)) {
+    *order = kAttribOrderMorton;
+    *window = 0;
+    rest = value + 6;
+  } else {
+    return false;
+  }
+  if (!*rest) return true;
+  if (*rest != ':') return false;
+  char* end = NULL;
+  const long window_arg = strtol(rest + 1, &end, 10);
+  if (end == rest + 1 || *end != '\0' || window_arg < 1) return false;
+  *window = window_arg;
+  return true;
+}
+
+void ReorderVertices(AttribOrder order, size_t window, WebGLMesh* mesh) {
+  if (order == kAttribOrderSpatial) {
+    ReorderVerticesInWindows(window, mesh);
+  } else if (order == kAttribOrderMorton) {
+    ReorderVerticesMorton(window, mesh);
+  }
+}
+
+#endif  // WEBGL_LOADER_REORDER_H_
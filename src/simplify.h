@@ -0,0 +1,447 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_SIMPLIFY_H_
+#define WEBGL_LOADER_SIMPLIFY_H_
+
+#include <limits.h>
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+#include "mesh.h"
+#include "stats.h"
+
+// Levels of detail by quadric error edge collapse, after:
+//   Garland and Heckbert, "Surface Simplification Using Quadric Error
+//   Metrics," SIGGRAPH 1997.
+// Collapses work on .OBJ positions rather than flattened vertices.
+// Each position sums the area-weighted planes of its triangles, plus
+// planes perpendicular to open borders so that they do not shrink. A
+// collapse moves one position onto a neighbor (a half-edge collapse),
+// so surviving vertices keep their attributes exactly. Positions that
+// the flattener split along a texture or normal seam never move, which
+// keeps seams where they are.
+
+// Border planes count this many times as much as triangle planes.
+static const double kBorderWeight = 10.0;
+
+// The most levels of detail a --lods flag may ask for.
+static const long kMaxLods = 8;
+
+// Parses the value of a --lods=N[:R] flag: N in [1, kMaxLods] levels,
+// each with R in (0, 1) of the triangles of the one before. Leaves
+// ratio alone without :R.
+bool ParseLods(const char* value, size_t* num_lods, float* ratio) {
+  char* end = NULL;
+  const long n = strtol(value, &end, 10);
+  if (end == value || n < 1 || n > kMaxLods) return false;
+  float r = *ratio;
+  if (*end == ':') {
+    const char* start = end + 1;
+    r = strtof(start, &end);
+    if (end == start) return false;
+  }
+  if (*end != '\0' || !(r > 0 && r < 1)) return false;
+  *num_lods = n;
+  *ratio = r;
+  return true;
+}
+
+// A symmetric 4x4 matrix, as its upper triangle by rows.
+struct Quadric {
+  double m[10];
+
+  void Clear() {
+    for (size_t k = 0; k < 10; ++k) m[k] = 0;
+  }
+
+  // Adds weight times the squared distance to the plane n.x + d = 0,
+  // for unit n.
+  void AddPlane(const double* n, double d, double weight) {
+    const double p[4] = { n[0], n[1], n[2], d };
+    size_t k = 0;
+    for (size_t i = 0; i < 4; ++i) {
+      for (size_t j = i; j < 4; ++j) {
+        m[k++] += weight * p[i] * p[j];
+      }
+    }
+  }
+
+  void Add(const Quadric& that) {
+    for (size_t k = 0; k < 10; ++k) m[k] += that.m[k];
+  }
+
+  double Error(const double* v) const {
+    const double p[4] = { v[0], v[1], v[2], 1 };
+    double error = 0;
+    size_t k = 0;
+    for (size_t i = 0; i < 4; ++i) {
+      for (size_t j = i; j < 4; ++j) {
+        error += (i == j ? 1 : 2) * m[k++] * p[i] * p[j];
+      }
+    }
+    return fabs(error);
+  }
+};
+
+static inline void Cross(const double* a, const double* b, double* out) {
+  out[0] = a[1] * b[2] - a[2] * b[1];
+  out[1] = a[2] * b[0] - a[0] * b[2];
+  out[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+static inline double Dot(const double* a, const double* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+class MeshSimplifier {
+ public:
+  // position_indices are from DrawBatch::position_indices().
+  MeshSimplifier(const DrawMesh& mesh,
+                 const std::vector<int>& position_indices)
+      : mesh_(mesh),
+        corners_(mesh.indices),
+        alive_(mesh.indices.size() / 3, true),
+        num_alive_(mesh.indices.size() / 3) {
+    ScopedTimer timer(Stats::kSimplify);
+    const size_t stride = mesh.layout.stride();
+    const size_t num_vertices = mesh.attribs.size() / stride;
+    CHECK(position_indices.size() == num_vertices);
+    // Number positions densely, in order of first appearance.
+    std::vector<int> position_ids;
+    vertex_positions_.resize(num_vertices);
+    remap_.resize(num_vertices);
+    for (size_t v = 0; v < num_vertices; ++v) {
+      const size_t position_index = position_indices[v];
+      if (position_index >= position_ids.size()) {
+        position_ids.resize(position_index + 1, -1);
+      }
+      if (position_ids[position_index] < 0) {
+        position_ids[position_index] = positions_.size() / 3;
+        positions_.insert(positions_.end(), &mesh.attribs[stride * v],
+                          &mesh.attribs[stride * v] + 3);
+      }
+      vertex_positions_[v] = position_ids[position_index];
+      remap_[v] = v;
+    }
+    const size_t num_positions = positions_.size() / 3;
+    // Seams: positions whose triangles use more than one vertex.
+    std::vector<int> first_vertex(num_positions, -1);
+    locked_.resize(num_positions, false);
+    for (size_t i = 0; i < corners_.size(); ++i) {
+      const int v = corners_[i];
+      int& first = first_vertex[vertex_positions_[v]];
+      if (first < 0) {
+        first = v;
+      } else if (first != v) {
+        locked_[vertex_positions_[v]] = true;
+      }
+    }
+    quadrics_.resize(num_positions);
+    for (size_t p = 0; p < num_positions; ++p) quadrics_[p].Clear();
+    AddTriangleQuadrics();
+  }
+
+  size_t num_triangles() const { return num_alive_; }
+
+  // Whether triangle, of the mesh as given, is still there.
+  bool alive(size_t triangle) const { return alive_[triangle]; }
+
+  // Collapses edges, cheapest first, until at most target_triangles
+  // remain or no collapse is allowed. Simplifying again continues from
+  // where the last call stopped.
+  void Simplify(size_t target_triangles) {
+    ScopedTimer timer(Stats::kSimplify);
+    while (num_alive_ > target_triangles && CollapsePass(target_triangles)) {
+    }
+  }
+
+  // The surviving triangles in their original order, with only the
+  // vertices they use. Groups keep their group_line; offsets, index
+  // ranges and bounds are recomputed, and groups left empty are
+  // dropped.
+  void GetLevel(const std::vector<GroupStart>& group_starts,
+                DrawMesh* level,
+                std::vector<GroupStart>* level_group_starts) const {
+    const size_t stride = mesh_.layout.stride();
+    level->layout = mesh_.layout;
+    level->attribs.clear();
+    level->indices.clear();
+    level_group_starts->clear();
+    std::vector<int> new_indices(mesh_.attribs.size() / stride, -1);
+    for (size_t g = 0; g < group_starts.size(); ++g) {
+      const size_t begin = group_starts[g].offset / 3;
+      const size_t end = (g + 1 < group_starts.size()) ?
+          group_starts[g + 1].offset / 3 : alive_.size();
+      GroupStart group_start = group_starts[g];
+      group_start.offset = level->indices.size();
+      group_start.min_index = INT_MAX;
+      group_start.max_index = INT_MIN;
+      group_start.bounds.Clear();
+      for (size_t t = begin; t < end; ++t) {
+        if (!alive_[t]) continue;
+        for (size_t j = 0; j < 3; ++j) {
+          const int v = corners_[3 * t + j];
+          if (new_indices[v] < 0) {
+            new_indices[v] = level->attribs.size() / stride;
+            const float* from = &mesh_.attribs[stride * v];
+            level->attribs.insert(level->attribs.end(), from, from + stride);
+          }
+          const int index = new_indices[v];
+          level->indices.push_back(index);
+          group_start.min_index = std::min(group_start.min_index, index);
+          group_start.max_index = std::max(group_start.max_index, index);
+          group_start.bounds.EncloseAttrib(&level->attribs[stride * index],
+                                           stride);
+        }
+      }
+      if (level->indices.size() > group_start.offset) {
+        level_group_starts->push_back(group_start);
+      }
+    }
+    Stats::Get().Increment(Stats::kLodTriangles, level->indices.size() / 3);
+  }
+
+  // The surviving triangles in their original order, as indices into
+  // the original vertices.
+  void GetIndices(IndexList* indices) const {
+    indices->clear();
+    for (size_t t = 0; t < alive_.size(); ++t) {
+      if (!alive_[t]) continue;
+      indices->insert(indices->end(), &corners_[3 * t], &corners_[3 * t] + 3);
+    }
+  }
+
+ private:
+  struct Collapse {
+    double cost;
+    int from, to;
+
+    bool operator<(const Collapse& that) const {
+      return cost < that.cost;
+    }
+  };
+
+  int Position(size_t t, size_t j) const {
+    return vertex_positions_[remap_[corners_[3 * t + j]]];
+  }
+
+  void Normal(const double* p0, const double* p1, const double* p2,
+              double* normal) const {
+    double e1[3], e2[3];
+    for (size_t k = 0; k < 3; ++k) {
+      e1[k] = p1[k] - p0[k];
+      e2[k] = p2[k] - p0[k];
+    }
+    Cross(e1, e2, normal);
+  }
+
+  void AddTriangleQuadrics() {
+    std::vector<std::pair<std::pair<int, int>, size_t> > edges;
+    for (size_t t = 0; t < alive_.size(); ++t) {
+      const int p[3] = { Position(t, 0), Position(t, 1), Position(t, 2) };
+      if (p[0] == p[1] || p[1] == p[2] || p[2] == p[0]) {
+        alive_[t] = false;
+        --num_alive_;
+        continue;
+      }
+      double n[3];
+      Normal(&positions_[3 * p[0]], &positions_[3 * p[1]],
+             &positions_[3 * p[2]], n);
+      const double length = sqrt(Dot(n, n));
+      if (length == 0) continue;
+      for (size_t k = 0; k < 3; ++k) n[k] /= length;
+      const double d = -Dot(n, &positions_[3 * p[0]]);
+      for (size_t j = 0; j < 3; ++j) {
+        quadrics_[p[j]].AddPlane(n, d, 0.5 * length);
+        const int a = p[j], b = p[(j + 1) % 3];
+        edges.push_back(std::make_pair(std::make_pair(std::min(a, b),
+                                                      std::max(a, b)), t));
+      }
+    }
+    // Border edges belong to a single triangle.
+    std::sort(edges.begin(), edges.end());
+    for (size_t i = 0; i < edges.size(); ) {
+      size_t run = i + 1;
+      while (run < edges.size() && edges[run].first == edges[i].first) ++run;
+      if (run == i + 1) AddBorderQuadric(edges[i].first, edges[i].second);
+      i = run;
+    }
+  }
+
+  // A plane through the edge, perpendicular to its triangle.
+  void AddBorderQuadric(const std::pair<int, int>& edge, size_t t) {
+    const double* a = &positions_[3 * edge.first];
+    const double* b = &positions_[3 * edge.second];
+    double n[3];
+    Normal(&positions_[3 * Position(t, 0)], &positions_[3 * Position(t, 1)],
+           &positions_[3 * Position(t, 2)], n);
+    const double e[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    double perpendicular[3];
+    Cross(e, n, perpendicular);
+    const double length = sqrt(Dot(perpendicular, perpendicular));
+    if (length == 0) return;
+    for (size_t k = 0; k < 3; ++k) perpendicular[k] /= length;
+    const double d = -Dot(perpendicular, a);
+    const double weight = kBorderWeight * Dot(e, e);
+    quadrics_[edge.first].AddPlane(perpendicular, d, weight);
+    quadrics_[edge.second].AddPlane(perpendicular, d, weight);
+  }
+
+  // The live triangles around each position, as of the pass start.
+  void BuildFans() {
+    const size_t num_positions = positions_.size() / 3;
+    fan_offsets_.assign(num_positions + 1, 0);
+    for (size_t t = 0; t < alive_.size(); ++t) {
+      if (!alive_[t]) continue;
+      for (size_t j = 0; j < 3; ++j) ++fan_offsets_[Position(t, j) + 1];
+    }
+    for (size_t p = 0; p < num_positions; ++p) {
+      fan_offsets_[p + 1] += fan_offsets_[p];
+    }
+    fan_triangles_.resize(fan_offsets_[num_positions]);
+    std::vector<size_t> fill(fan_offsets_.begin(), fan_offsets_.end() - 1);
+    for (size_t t = 0; t < alive_.size(); ++t) {
+      if (!alive_[t]) continue;
+      for (size_t j = 0; j < 3; ++j) fan_triangles_[fill[Position(t, j)]++] = t;
+    }
+  }
+
+  double Cost(int from, int to) const {
+    Quadric quadric = quadrics_[from];
+    quadric.Add(quadrics_[to]);
+    return quadric.Error(&positions_[3 * to]);
+  }
+
+  // The cheaper direction of every edge that has one.
+  void FindCollapses(std::vector<Collapse>* collapses) const {
+    std::vector<std::pair<int, int> > edges;
+    edges.reserve(3 * num_alive_);
+    for (size_t t = 0; t < alive_.size(); ++t) {
+      if (!alive_[t]) continue;
+      for (size_t j = 0; j < 3; ++j) {
+        const int a = Position(t, j), b = Position(t, (j + 1) % 3);
+        edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+      }
+    }
+    std::sort(edges.begin(), edges.end());
+    edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+    for (size_t i = 0; i < edges.size(); ++i) {
+      const int a = edges[i].first, b = edges[i].second;
+      if (locked_[a] && locked_[b]) continue;
+      Collapse collapse;
+      if (locked_[a] || (!locked_[b] && Cost(b, a) < Cost(a, b))) {
+        collapse.from = b;
+        collapse.to = a;
+      } else {
+        collapse.from = a;
+        collapse.to = b;
+      }
+      collapse.cost = Cost(collapse.from, collapse.to);
+      collapses->push_back(collapse);
+    }
+  }
+
+  // One round of non-overlapping collapses. Returns how many it made.
+  size_t CollapsePass(size_t target_triangles) {
+    BuildFans();
+    std::vector<Collapse> collapses;
+    FindCollapses(&collapses);
+    if (collapses.empty()) return 0;
+    std::sort(collapses.begin(), collapses.end());
+    // Each collapse removes about two triangles. Stop well before
+    // collapses get much costlier than the cheapest that would reach
+    // the target, leaving those for later passes.
+    const size_t goal = std::min((num_alive_ - target_triangles) / 2,
+                                 collapses.size() - 1);
+    const double max_cost = 1.5 * collapses[goal].cost;
+    touched_.assign(positions_.size() / 3, false);
+    size_t num_collapsed = 0;
+    for (size_t i = 0; i < collapses.size(); ++i) {
+      const Collapse& collapse = collapses[i];
+      if (num_alive_ <= target_triangles || collapse.cost > max_cost) break;
+      if (touched_[collapse.from] || touched_[collapse.to]) continue;
+      if (TryCollapse(collapse.from, collapse.to)) {
+        touched_[collapse.from] = touched_[collapse.to] = true;
+        ++num_collapsed;
+      }
+    }
+    for (size_t i = 0; i < corners_.size(); ++i) {
+      corners_[i] = remap_[corners_[i]];
+    }
+    return num_collapsed;
+  }
+
+  // Moves position from onto position to, unless that would flip a
+  // triangle or the triangles across the edge disagree on which
+  // vertex of to to use.
+  bool TryCollapse(int from, int to) {
+    int from_vertex = -1, to_vertex = -1;
+    for (size_t f = fan_offsets_[from]; f < fan_offsets_[from + 1]; ++f) {
+      const size_t t = fan_triangles_[f];
+      if (!alive_[t]) continue;
+      const int p[3] = { Position(t, 0), Position(t, 1), Position(t, 2) };
+      size_t k = 0;
+      while (p[k] != from) ++k;
+      from_vertex = remap_[corners_[3 * t + k]];
+      if (p[0] == to || p[1] == to || p[2] == to) {
+        size_t j = 0;
+        while (p[j] != to) ++j;
+        const int vertex = remap_[corners_[3 * t + j]];
+        if (to_vertex >= 0 && to_vertex != vertex) return false;
+        to_vertex = vertex;
+        continue;
+      }
+      const double* q[3] = { &positions_[3 * p[0]], &positions_[3 * p[1]],
+                             &positions_[3 * p[2]] };
+      double before[3], after[3];
+      Normal(q[0], q[1], q[2], before);
+      q[k] = &positions_[3 * to];
+      Normal(q[0], q[1], q[2], after);
+      if (Dot(before, before) > 0 && Dot(before, after) <= 0) return false;
+    }
+    if (to_vertex < 0) return false;
+    for (size_t f = fan_offsets_[from]; f < fan_offsets_[from + 1]; ++f) {
+      const size_t t = fan_triangles_[f];
+      if (!alive_[t]) continue;
+      if (Position(t, 0) == to || Position(t, 1) == to ||
+          Position(t, 2) == to) {
+        alive_[t] = false;
+        --num_alive_;
+      }
+    }
+    remap_[from_vertex] = to_vertex;
+    quadrics_[to].Add(quadrics_[from]);
+    return true;
+  }
+
+  const DrawMesh& mesh_;
+  IndexList corners_;
+  std::vector<bool> alive_;
+  size_t num_alive_;
+  std::vector<double> positions_;
+  std::vector<int> vertex_positions_;
+  std::vector<int> remap_;
+  std::vector<bool> locked_;
+  std::vector<Quadric> quadrics_;
+  std::vector<size_t> fan_offsets_;
+  std::vector<size_t> fan_triangles_;
+  std::vector<bool> touched_;
+};
+
+#endif  // WEBGL_LOADER_SIMPLIFY_H_
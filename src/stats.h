@@ -0,0 +1,214 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_STATS_H_
+#define WEBGL_LOADER_STATS_H_
+
+#include <stdio.h>
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "base.h"
+
+// Phase timers and event counters for the conversion pipeline. There
+// is a single, process-wide instance, since each tool converts one
+// asset. Counters are always maintained (they are just increments),
+// but timers only read the clock when stats are enabled. Both may be
+// updated from ParallelFor workers; a phase then accumulates the time
+// spent on all threads.
+class Stats {
+ public:
+  enum Phase {
+    kParse,  // Includes incremental flattening, done as faces parse.
+    kWeld,
+    kNormals,
+    kFlatten,  // Bulk flattening, and columns added once flattened.
+    kTangents,
+    kBounds,
+    kQuantize,
+    kCleanup,
+    kSimplify,
+    kOptimize,
+    kCluster,
+    kBvh,
+    kEncode,
+    kHash,
+    kWrite,
+    kNumPhases
+  };
+
+  enum Counter {
+    kLines,
+    kTriangles,
+    kDegenerateTriangles,  // Dropped by --cleanup.
+    kDuplicateTriangles,
+    kWeldedPositions,  // Values merged into a nearby one.
+    kWeldedTexcoords,
+    kWeldedNormals,
+    kGeneratedNormals,  // By --normals, for faces without any.
+    kMergedMaterials,  // Into an equivalent one, by --merge-materials.
+    kFlattenedVertices,
+    kFlattenerMapSpills,  // Table entries demoted to the map.
+    kFlattenerMapLookups,  // Lookups that had to go through the map.
+    kFindBestTriangleSlowPath,
+    kWebGLMeshes,
+    kWebGLMeshSplits,
+    kClusters,
+    kLodTriangles,  // Triangles in all coarser levels of detail.
+    kOutputBytes,
+    kNumCounters
+  };
+
+  static Stats& Get() {
+    static Stats stats;
+    return stats;
+  }
+
+  // Seconds on a monotonic clock.
+  static double Now() {
+    return std::chrono::duration<double>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  bool enabled() const { return enabled_; }
+
+  void Enable() {
+    enabled_ = true;
+    start_ = Now();
+  }
+
+  void AddTime(Phase phase, double seconds) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    seconds_[phase] += seconds;
+  }
+
+  void Increment(Counter counter, size_t by = 1) {
+    counts_[counter].fetch_add(by, std::memory_order_relaxed);
+  }
+
+  // Named, free-form measurements, such as cache miss ratios.
+  void SetMetric(const std::string& name, double value) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    metrics_.push_back(std::make_pair(name, value));
+  }
+
+  size_t count(Counter counter) const {
+    return counts_[counter].load();
+  }
+
+  double seconds(Phase phase) const {
+    return seconds_[phase];
+  }
+
+  void DumpJson(FILE* fp, const char* asset) const {
+    static const char* const kPhaseNames[kNumPhases] = {
+      "parse", "weld", "normals", "flatten", "tangents", "bounds",
+      "quantize", "cleanup", "simplify", "optimize", "cluster", "bvh",
+      "encode", "hash", "write"
+    };
+    static const char* const kCounterNames[kNumCounters] = {
+      "lines", "triangles", "degenerate_triangles", "duplicate_triangles",
+      "welded_positions", "welded_texcoords", "welded_normals",
+      "generated_normals", "merged_materials",
+      "flattened_vertices", "flattener_map_spills", "flattener_map_lookups",
+      "find_best_triangle_slow_path",
+      "webgl_meshes", "webgl_mesh_splits", "clusters", "lod_triangles",
+      "output_bytes"
+    };
+    fputs("{\n  \"asset\": ", fp);
+    PrintJsonString(fp, asset);
+    fputs(",\n", fp);
+    fprintf(fp, "  \"total_seconds\": %f,\n", Now() - start_);
+    fputs("  \"phase_seconds\": {\n", fp);
+    for (size_t i = 0; i < kNumPhases; ++i) {
+      fprintf(fp, "    \"%s\": %f%s\n", kPhaseNames[i], seconds_[i],
+              (i + 1 < kNumPhases) ? "," : "");
+    }
+    fputs("  },\n  \"counters\": {\n", fp);
+    for (size_t i = 0; i < kNumCounters; ++i) {
+      fprintf(fp, "    \"%s\": %zu%s\n", kCounterNames[i],
+              count(Counter(i)), (i + 1 < kNumCounters) ? "," : "");
+    }
+    fputs("  },\n  \"metrics\": {\n", fp);
+    for (size_t i = 0; i < metrics_.size(); ++i) {
+      fprintf(fp, "    \"%s\": %f%s\n", metrics_[i].first.c_str(),
+              metrics_[i].second, (i + 1 < metrics_.size()) ? "," : "");
+    }
+    fputs("  }\n}\n", fp);
+  }
+
+ private:
+  // Writes s quoted, with quotes, backslashes and control characters
+  // escaped.
+  static void PrintJsonString(FILE* fp, const char* s) {
+    putc('"', fp);
+    for (; *s; ++s) {
+      const unsigned char c = *s;
+      if (c == '"' || c == '\\') {
+        putc('\\', fp);
+        putc(c, fp);
+      } else if (c < 0x20) {
+        fprintf(fp, "\\u%04x", c);
+      } else {
+        putc(c, fp);
+      }
+    }
+    putc('"', fp);
+  }
+
+  Stats()
+      : enabled_(false),
+        start_(0) {
+    for (size_t i = 0; i < kNumPhases; ++i) {
+      seconds_[i] = 0;
+    }
+    for (size_t i = 0; i < kNumCounters; ++i) {
+      counts_[i].store(0);
+    }
+  }
+
+  bool enabled_;
+  double start_;
+  std::mutex mutex_;
+  double seconds_[kNumPhases];
+  std::atomic<size_t> counts_[kNumCounters];
+  std::vector<std::pair<std::string, double> > metrics_;
+};
+
+// Accumulates the lifetime of the object into a Stats phase.
+class ScopedTimer {
+ public:
+  explicit ScopedTimer(Stats::Phase phase)
+      : phase_(phase),
+        start_(Stats::Get().enabled() ? Stats::Now() : 0) {
+  }
+
+  ~ScopedTimer() {
+    Stats& stats = Stats::Get();
+    if (stats.enabled()) {
+      stats.AddTime(phase_, Stats::Now() - start_);
+    }
+  }
+
+ private:
+  Stats::Phase phase_;
+  double start_;
+};
+
+#endif  // WEBGL_LOADER_STATS_H_
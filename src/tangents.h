@@ -0,0 +1,214 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_TANGENTS_H_
+#define WEBGL_LOADER_TANGENTS_H_
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "base.h"
+#include "parallel.h"
+#include "stats.h"
+
+// Tangents for normal mapping, computed on flattened meshes the way
+// MikkTSpace does, so that they match the tangent space normal maps
+// are baked in: each face's texture space tangent is projected onto
+// the plane of each corner's normal, normalized, and summed weighted
+// by the corner's angle; the handedness is the sign of the faces'
+// texture space area. Unlike MikkTSpace, vertices are not split where
+// the handedness flips; the faces with the larger angle win.
+//
+// A tangent is perpendicular to its normal, so it is written as the
+// two columns of kTangentAttrib: its angle around the decoded normal,
+// from the first vector of TangentBasis, and its handedness, +1 or -1.
+// The bitangent is handedness * cross(normal, tangent).
+
+// An orthonormal basis b1, b2 of the plane perpendicular to the unit
+// vector n, from Duff et al., "Building an Orthonormal Basis,
+// Revisited" (JCGT 2017). Clients must do the same, with a sign that
+// is +1 for n[2] == 0.
+void TangentBasis(const float* n, float* b1, float* b2) {
+  const float sign = n[2] >= 0 ? 1.0f : -1.0f;
+  const float a = -1.0f / (sign + n[2]);
+  const float b = n[0] * n[1] * a;
+  b1[0] = 1.0f + sign * n[0] * n[0] * a;
+  b1[1] = sign * b;
+  b1[2] = -sign * n[0];
+  b2[0] = b;
+  b2[1] = sign + n[1] * n[1] * a;
+  b2[2] = -n[1];
+}
+
+// The columns of kTangentAttrib, and how clients decode them: the
+// angle in 10 bits over [-pi, pi], and the handedness as 0 or 2.
+static const size_t kTangentColumns = 2;
+static const int kTangentDecodeOffsets[kTangentColumns] = { -511, -1 };
+static const float kTangentDecodeScales[kTangentColumns] = {
+  static_cast<float>(M_PI / 511), 1
+};
+
+// The normal a client decodes (see BoundsParams), which tangent
+// angles are measured around.
+void DecodedNormal(const float* normal, float* decoded) {
+  float length_squared = 0;
+  for (size_t k = 0; k < 3; ++k) {
+    decoded[k] = (Quantize(normal[k], -1, 2, (1 << 10) - 1) - 511) / 511.0f;
+    length_squared += decoded[k] * decoded[k];
+  }
+  if (length_squared == 0) {
+    decoded[0] = decoded[1] = 0;
+    decoded[2] = 1;
+    return;
+  }
+  const float scale = 1 / sqrtf(length_squared);
+  for (size_t k = 0; k < 3; ++k) decoded[k] *= scale;
+}
+
+class TangentGenerator {
+ public:
+  explicit TangentGenerator(const DrawMesh& mesh)
+      : mesh_(mesh),
+        stride_(mesh.layout.stride()),
+        texcoord_(mesh.layout.offset(kTexcoordAttrib)),
+        normal_(mesh.layout.offset(kNormalAttrib)),
+        num_vertices_(mesh.attribs.size() / stride_) {
+  }
+
+  // Writes the angle and handedness of each vertex's tangent.
+  void Generate(AttribList* tangents) {
+    sums_.assign(3 * num_vertices_, 0);
+    orientations_.assign(num_vertices_, 0);
+    for (size_t i = 0; i + 2 < mesh_.indices.size(); i += 3) {
+      AddTriangle(&mesh_.indices[i]);
+    }
+    tangents->resize(kTangentColumns * num_vertices_);
+    for (size_t v = 0; v < num_vertices_; ++v) {
+      float normal[3], b1[3], b2[3];
+      DecodedNormal(&mesh_.attribs[stride_ * v + normal_], normal);
+      TangentBasis(normal, b1, b2);
+      const float* sum = &sums_[3 * v];
+      // The angle only depends on the part of the sum in the plane.
+      const float x = Dot(sum, b1);
+      const float y = Dot(sum, b2);
+      (*tangents)[kTangentColumns * v] =
+          (x != 0 || y != 0) ? atan2f(y, x) : 0;
+      (*tangents)[kTangentColumns * v + 1] =
+          orientations_[v] >= 0 ? 1 : -1;
+    }
+  }
+
+ private:
+  static float Dot(const float* a, const float* b) {
+    return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+  }
+
+  static float Normalize(float* v) {
+    const float length = sqrtf(Dot(v, v));
+    if (length > 0) {
+      for (size_t k = 0; k < 3; ++k) v[k] /= length;
+    }
+    return length;
+  }
+
+  void AddTriangle(const int* indices) {
+    const float* p[3];
+    const float* uv[3];
+    for (size_t i = 0; i < 3; ++i) {
+      p[i] = &mesh_.attribs[stride_ * indices[i]];
+      uv[i] = p[i] + texcoord_;
+    }
+    float e1[3], e2[3];
+    for (size_t k = 0; k < 3; ++k) {
+      e1[k] = p[1][k] - p[0][k];
+      e2[k] = p[2][k] - p[0][k];
+    }
+    const float du1 = uv[1][0] - uv[0][0], dv1 = uv[1][1] - uv[0][1];
+    const float du2 = uv[2][0] - uv[0][0], dv2 = uv[2][1] - uv[0][1];
+    const float uv_area = du1 * dv2 - du2 * dv1;
+    if (uv_area == 0) return;
+    const float orientation = uv_area > 0 ? 1 : -1;
+    // The direction of increasing u; its length doesn't matter.
+    float tangent[3];
+    for (size_t k = 0; k < 3; ++k) {
+      tangent[k] = orientation * (dv2 * e1[k] - dv1 * e2[k]);
+    }
+    for (size_t i = 0; i < 3; ++i) {
+      float u[3], v[3];
+      for (size_t k = 0; k < 3; ++k) {
+        u[k] = p[(i + 1) % 3][k] - p[i][k];
+        v[k] = p[(i + 2) % 3][k] - p[i][k];
+      }
+      if (Normalize(u) == 0 || Normalize(v) == 0) continue;
+      const float angle = acosf(std::max(-1.0f, std::min(1.0f, Dot(u, v))));
+      const float* normal = p[i] + normal_;
+      const float along_normal = Dot(tangent, normal);
+      float projected[3];
+      for (size_t k = 0; k < 3; ++k) {
+        projected[k] = tangent[k] - along_normal * normal[k];
+      }
+      if (Normalize(projected) == 0) continue;
+      float* sum = &sums_[3 * indices[i]];
+      for (size_t k = 0; k < 3; ++k) sum[k] += angle * projected[k];
+      orientations_[indices[i]] += angle * orientation;
+    }
+  }
+
+  const DrawMesh& mesh_;
+  size_t stride_;
+  size_t texcoord_;  // Column offsets.
+  size_t normal_;
+  size_t num_vertices_;
+  AttribList sums_;  // Weighted tangents, 3 per vertex.
+  AttribList orientations_;  // Weighted handedness.
+};
+
+// A copy of mesh with the tangents from TangentGenerator added to its
+// layout.
+void AddTangentColumns(const DrawMesh& mesh, const AttribList& tangents,
+                       DrawMesh* with_tangents) {
+  AddAttribColumns(mesh, kTangentAttrib, tangents, with_tangents);
+}
+
+// Adds tangents to each mesh, one mesh per task.
+class TangentBatchGenerator {
+ public:
+  TangentBatchGenerator(const std::vector<const DrawMesh*>& meshes,
+                        std::vector<DrawMesh>* with_tangents)
+      : meshes_(meshes),
+        with_tangents_(with_tangents) {
+    with_tangents_->resize(meshes_.size());
+  }
+
+  void operator()(size_t i) {
+    AttribList tangents;
+    TangentGenerator(*meshes_[i]).Generate(&tangents);
+    AddTangentColumns(*meshes_[i], tangents, &(*with_tangents_)[i]);
+  }
+
+ private:
+  const std::vector<const DrawMesh*>& meshes_;
+  std::vector<DrawMesh>* with_tangents_;
+};
+
+void GenerateTangents(const std::vector<const DrawMesh*>& meshes,
+                      std::vector<DrawMesh>* with_tangents) {
+  ScopedTimer timer(Stats::kTangents);
+  TangentBatchGenerator generator(meshes, with_tangents);
+  ParallelFor(meshes.size(), &generator);
+}
+
+#endif  // WEBGL_LOADER_TANGENTS_H_
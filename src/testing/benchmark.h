@@ -0,0 +1,130 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_TESTING_BENCHMARK_H_
+#define WEBGL_LOADER_TESTING_BENCHMARK_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../base.h"
+#include "../stats.h"
+
+// A tiny benchmark harness, loosely modeled after Google Benchmark:
+//
+//   Benchmark bench("SimpleHash/grid", utf8.size());
+//   while (bench.KeepRunning()) {
+//     bench.set_checksum(SimpleHash(&utf8[0], utf8.size()));
+//   }
+//
+// Each iteration of the loop is timed separately, and a fixed number
+// of iterations is run so that the set of rows (and their checksums)
+// is identical from run to run; only the timings move. Rows are
+// printed when the Benchmark goes out of scope. The checksum both
+// keeps the compiler from discarding the work, and lets a diff between
+// commits show when a stage starts computing something different.
+class Benchmark {
+ public:
+  Benchmark(const std::string& name, size_t items_per_iteration)
+      : name_(name),
+        items_(items_per_iteration),
+        checksum_(0),
+        enabled_(Matches(name)),
+        last_(0) {
+  }
+
+  ~Benchmark() {
+    if (!enabled_ || times_.empty()) return;
+    std::vector<double> sorted(times_);
+    std::sort(sorted.begin(), sorted.end());
+    const double median = sorted[sorted.size() / 2];
+    const double items = items_ ? static_cast<double>(items_) : 1.0;
+    printf("%-44s %12zu %4zu %12.2f %12.2f   %08x\n", name_.c_str(), items_,
+           sorted.size(), 1e9 * sorted[0] / items, 1e9 * median / items,
+           checksum_);
+    fflush(stdout);
+  }
+
+  bool KeepRunning() {
+    if (!enabled_) return false;
+    const double now = Stats::Now();
+    if (last_ != 0) {
+      times_.push_back(now - last_);
+    }
+    if (times_.size() == Repetitions()) {
+      return false;
+    }
+    last_ = Stats::Now();
+    return true;
+  }
+
+  void set_checksum(uint32 checksum) {
+    checksum_ = checksum;
+  }
+
+  // Consumes --repetitions=N and --filter=substring, and returns the
+  // remaining arguments.
+  static std::vector<const char*> ParseFlags(int argc, const char* argv[]) {
+    std::vector<const char*> args;
+    for (int i = 1; i < argc; ++i) {
+      if (0 == strncmp(argv[i], "--repetitions=", 14)) {
+        Repetitions() = atoi(argv[i] + 14);
+        CHECK(Repetitions() > 0);
+      } else if (0 == strncmp(argv[i], "--filter=", 9)) {
+        Filter() = argv[i] + 9;
+      } else {
+        args.push_back(argv[i]);
+      }
+    }
+    return args;
+  }
+
+  static void PrintHeader() {
+    printf("%-44s %12s %4s %12s %12s   %8s\n", "benchmark", "items", "reps",
+           "min ns/item", "med ns/item", "checksum");
+  }
+
+ private:
+  static size_t& Repetitions() {
+    static size_t repetitions = 5;
+    return repetitions;
+  }
+
+  static std::string& Filter() {
+    static std::string filter;
+    return filter;
+  }
+
+  static bool Matches(const std::string& name) {
+    return name.find(Filter()) != std::string::npos;
+  }
+
+  std::string name_;
+  size_t items_;
+  uint32 checksum_;
+  bool enabled_;
+  double last_;
+  std::vector<double> times_;
+};
+
+// Folds a word into a running checksum.
+static inline uint32 MixChecksum(uint32 checksum, uint32 word) {
+  return SimpleHash(reinterpret_cast<char*>(&word), sizeof(word), checksum);
+}
+
+#endif  // WEBGL_LOADER_TESTING_BENCHMARK_H_
@@ -0,0 +1,314 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "benchmark.h"
+
+#include "../base.h"
+#include "../bvh.h"
+#include "../mesh.h"
+
+// Times frustum and ray queries against the groups of a model, with
+// the BVH that objcompress --bvh writes and with a linear scan over the
+// group boxes, which is what clients do with per-group bboxes.
+
+static const float kMaxPosition = (1 << 14) - 1;
+
+// A tiny LCG, so that runs are identical across platforms.
+static inline float NextUniform(uint32* state) {
+  *state = 1664525 * *state + 1013904223;
+  return (*state >> 8) * (1.0f / (1 << 24));
+}
+
+// n boxes scattered through the quantized frame, each about as wide as
+// the space between them.
+void MakeRandomLeaves(size_t n, BvhNodeList* leaves) {
+  uint32 state = 1;
+  const float size = kMaxPosition / cbrtf(static_cast<float>(n));
+  leaves->resize(n);
+  for (size_t i = 0; i < n; ++i) {
+    BvhNode& leaf = (*leaves)[i];
+    for (size_t k = 0; k < 3; ++k) {
+      const float extent = size * NextUniform(&state);
+      const float min = (kMaxPosition - extent) * NextUniform(&state);
+      leaf.mins[k] = static_cast<uint16>(min);
+      leaf.maxes[k] = static_cast<uint16>(min + extent);
+    }
+    leaf.num_groups = 1;
+  }
+}
+
+// One box per group of the model, merged across material batches, as
+// objcompress would quantize it.
+void MakeObjLeaves(const WavefrontObjFile& obj, BvhNodeList* leaves) {
+  const MaterialBatches& batches = obj.material_batches();
+  Bounds bounds;
+  bounds.Clear();
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    const DrawMesh& mesh = iter->second.draw_mesh();
+    bounds.Enclose(mesh.attribs, mesh.layout.stride());
+  }
+  const BoundsParams bounds_params = BoundsParams::FromBounds(bounds);
+  std::map<unsigned int, size_t> groups;  // By group line.
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    const std::vector<GroupStart>& group_starts =
+        iter->second.group_starts();
+    for (size_t i = 0; i < group_starts.size(); ++i) {
+      BvhNode leaf;
+      QuantizeAABB(group_starts[i].bounds, bounds_params, leaf.mins,
+                   leaf.maxes);
+      leaf.num_groups = 1;
+      const std::pair<std::map<unsigned int, size_t>::iterator, bool>
+          inserted = groups.insert(
+              std::make_pair(group_starts[i].group_line, leaves->size()));
+      if (inserted.second) {
+        leaves->push_back(leaf);
+      } else {
+        (*leaves)[inserted.first->second].Enclose(leaf);
+      }
+    }
+  }
+}
+
+// Six planes of a frustum with a 60 degree field of view, looking from
+// a random point in a random direction.
+void MakeFrustum(uint32* state, float* planes) {
+  float eye[3], forward[3];
+  float length2 = 0;
+  for (size_t k = 0; k < 3; ++k) {
+    eye[k] = kMaxPosition * NextUniform(state);
+    forward[k] = 2 * NextUniform(state) - 1;
+    length2 += forward[k] * forward[k];
+  }
+  for (size_t k = 0; k < 3; ++k) forward[k] /= sqrtf(length2);
+  // Any two directions perpendicular to forward and to each other.
+  const float kX[3] = { 1, 0, 0 };
+  const float kY[3] = { 0, 1, 0 };
+  const float* other = fabsf(forward[0]) < 0.9f ? kX : kY;
+  float right[3] = { forward[1] * other[2] - forward[2] * other[1],
+                     forward[2] * other[0] - forward[0] * other[2],
+                     forward[0] * other[1] - forward[1] * other[0] };
+  length2 = 0;
+  for (size_t k = 0; k < 3; ++k) length2 += right[k] * right[k];
+  for (size_t k = 0; k < 3; ++k) right[k] /= sqrtf(length2);
+  const float up[3] = { forward[1] * right[2] - forward[2] * right[1],
+                        forward[2] * right[0] - forward[0] * right[2],
+                        forward[0] * right[1] - forward[1] * right[0] };
+  const float kSin = 0.5f;  // Of the 30 degree half angle.
+  const float kCos = 0.8660254f;
+  const float kNear = 1;
+  const float kFar = kMaxPosition / 2;
+  for (size_t k = 0; k < 3; ++k) {
+    planes[0 + k] = forward[k];
+    planes[4 + k] = -forward[k];
+    planes[8 + k] = kSin * forward[k] + kCos * right[k];
+    planes[12 + k] = kSin * forward[k] - kCos * right[k];
+    planes[16 + k] = kSin * forward[k] + kCos * up[k];
+    planes[20 + k] = kSin * forward[k] - kCos * up[k];
+  }
+  for (size_t p = 0; p < 6; ++p) {
+    float* plane = planes + 4 * p;
+    plane[3] = -(plane[0] * eye[0] + plane[1] * eye[1] + plane[2] * eye[2]);
+  }
+  planes[3] -= kNear;
+  planes[7] += kFar;
+}
+
+void MakeRay(uint32* state, float* origin, float* direction) {
+  for (size_t k = 0; k < 3; ++k) {
+    origin[k] = kMaxPosition * NextUniform(state);
+    direction[k] = 2 * NextUniform(state) - 1;
+  }
+}
+
+void LinearFrustumQuery(const BvhNodeList& leaves, const float* planes,
+                        size_t num_planes, std::vector<size_t>* groups) {
+  for (size_t i = 0; i < leaves.size(); ++i) {
+    bool outside = false;
+    for (size_t p = 0; p < num_planes && !outside; ++p) {
+      outside = ClassifyBox(leaves[i], planes + 4 * p) < 0;
+    }
+    if (!outside) groups->push_back(i);
+  }
+}
+
+void LinearRayQuery(const BvhNodeList& leaves, const float* origin,
+                    const float* direction, std::vector<size_t>* groups) {
+  float inv_direction[3];
+  for (size_t k = 0; k < 3; ++k) inv_direction[k] = 1.0f / direction[k];
+  for (size_t i = 0; i < leaves.size(); ++i) {
+    if (RayHitsBox(leaves[i], origin, inv_direction)) groups->push_back(i);
+  }
+}
+
+uint32 ChecksumGroups(const std::vector<size_t>& groups) {
+  uint32 checksum = groups.size();
+  for (size_t i = 0; i < groups.size(); ++i) {
+    checksum = MixChecksum(checksum, groups[i]);
+  }
+  return checksum;
+}
+
+void RunBenchmarks(const std::string& name, const BvhNodeList& input_leaves,
+                   size_t num_frusta, size_t num_rays) {
+  BvhNodeList nodes;
+  std::vector<size_t> leaf_order;
+  {
+    Benchmark bench("BvhBuilder/" + name, input_leaves.size());
+    while (bench.KeepRunning()) {
+      BvhBuilder(input_leaves).Build(&nodes, &leaf_order);
+      bench.set_checksum(nodes.size());
+    }
+  }
+  BvhBuilder(input_leaves).Build(&nodes, &leaf_order);
+  std::vector<char> utf8;
+  CompressBvhToUtf8(nodes, &utf8);
+  // As CompressAABBToUtf8 would write them, once each.
+  std::vector<char> bboxes;
+  for (size_t i = 0; i < input_leaves.size(); ++i) {
+    const BvhNode& leaf = input_leaves[i];
+    for (size_t k = 0; k < 3; ++k) Uint16ToUtf8(leaf.mins[k], &bboxes);
+    for (size_t k = 0; k < 3; ++k) {
+      Uint16ToUtf8(leaf.maxes[k] - leaf.mins[k], &bboxes);
+    }
+  }
+  printf("# %s: %zu groups, %zu nodes, %zu bytes (bboxes: %zu)\n",
+         name.c_str(), input_leaves.size(), nodes.size(), utf8.size(),
+         bboxes.size());
+  // Queries run on what a client decodes. The linear scan goes over
+  // the same leaf boxes, in the BVH's group numbering, so both find the
+  // same groups.
+  std::vector<uint32> codes;
+  Utf8ToCodes(&utf8[0], utf8.size(), &codes);
+  DecompressBvh(&codes[0], nodes.size(), &nodes);
+  BvhNodeList leaves;
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].num_groups == 1) leaves.push_back(nodes[i]);
+  }
+
+  std::vector<float> frusta(24 * num_frusta);
+  std::vector<float> rays(6 * num_rays);
+  uint32 state = 2;
+  for (size_t i = 0; i < num_frusta; ++i) MakeFrustum(&state, &frusta[24 * i]);
+  for (size_t i = 0; i < num_rays; ++i) {
+    MakeRay(&state, &rays[6 * i], &rays[6 * i + 3]);
+  }
+  std::vector<size_t> groups;
+  const size_t num_frustum_tests = num_frusta * leaves.size();
+  {
+    Benchmark bench("FrustumQuery/linear/" + name, num_frustum_tests);
+    while (bench.KeepRunning()) {
+      groups.clear();
+      for (size_t i = 0; i < num_frusta; ++i) {
+        LinearFrustumQuery(leaves, &frusta[24 * i], 6, &groups);
+      }
+      bench.set_checksum(ChecksumGroups(groups));
+    }
+  }
+  {
+    Benchmark bench("FrustumQuery/bvh/" + name, num_frustum_tests);
+    while (bench.KeepRunning()) {
+      groups.clear();
+      for (size_t i = 0; i < num_frusta; ++i) {
+        FrustumQueryBvh(nodes, &frusta[24 * i], 6, &groups);
+      }
+      bench.set_checksum(ChecksumGroups(groups));
+    }
+  }
+  const size_t num_ray_tests = num_rays * leaves.size();
+  {
+    Benchmark bench("RayQuery/linear/" + name, num_ray_tests);
+    while (bench.KeepRunning()) {
+      groups.clear();
+      for (size_t i = 0; i < num_rays; ++i) {
+        LinearRayQuery(leaves, &rays[6 * i], &rays[6 * i + 3], &groups);
+      }
+      bench.set_checksum(ChecksumGroups(groups));
+    }
+  }
+  {
+    Benchmark bench("RayQuery/bvh/" + name, num_ray_tests);
+    while (bench.KeepRunning()) {
+      groups.clear();
+      for (size_t i = 0; i < num_rays; ++i) {
+        RayQueryBvh(nodes, &rays[6 * i], &rays[6 * i + 3], &groups);
+      }
+      bench.set_checksum(ChecksumGroups(groups));
+    }
+  }
+}
+
+int main(int argc, const char* argv[]) {
+  std::vector<const char*> args = Benchmark::ParseFlags(argc, argv);
+  size_t num_groups = 10000;
+  size_t num_frusta = 100;
+  size_t num_rays = 1000;
+  std::vector<const char*> obj_fns;
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (0 == strncmp(args[i], "--groups=", 9)) {
+      num_groups = atoi(args[i] + 9);
+    } else if (0 == strncmp(args[i], "--frusta=", 9)) {
+      num_frusta = atoi(args[i] + 9);
+    } else if (0 == strncmp(args[i], "--rays=", 7)) {
+      num_rays = atoi(args[i] + 7);
+    } else if (args[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [--repetitions=N] [--filter=substring]\n"
+              "\t[--groups=N] [--frusta=N] [--rays=N] [in.obj ...]\n\n"
+              "Benchmarks BVH and linear frustum and ray queries over N\n"
+              "(default 10000) random group boxes, and over the groups of\n"
+              "each in.obj, with 100 frusta and 1000 rays by default. Run\n"
+              "from the directory containing the .obj files so that\n"
+              "mtllib can be found.\n",
+              argv[0]);
+      return -1;
+    } else {
+      obj_fns.push_back(args[i]);
+    }
+  }
+
+  Benchmark::PrintHeader();
+  if (num_groups) {
+    char name[32];
+    snprintf(name, sizeof(name), "random%zu", num_groups);
+    BvhNodeList leaves;
+    MakeRandomLeaves(num_groups, &leaves);
+    RunBenchmarks(name, leaves, num_frusta, num_rays);
+  }
+  for (size_t i = 0; i < obj_fns.size(); ++i) {
+    FILE* fp = fopen(obj_fns[i], "r");
+    if (!fp) {
+      fprintf(stderr, "ERROR: could not open %s\n", obj_fns[i]);
+      return -1;
+    }
+    WavefrontObjFile obj(fp);
+    fclose(fp);
+    BvhNodeList leaves;
+    MakeObjLeaves(obj, &leaves);
+    RunBenchmarks(StripLeadingDir(obj_fns[i]), leaves, num_frusta, num_rays);
+  }
+  return 0;
+}
@@ -0,0 +1,280 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "../base.h"
+#include "../bvh.h"
+#include "../decode.h"
+#include "../mesh.h"
+
+// Boxes on a jittered 8 x 8 x 8 grid of cells, some of them
+// degenerate, with a few exact duplicates.
+void MakeLeaves(BvhNodeList* leaves) {
+  uint32 state = 7;
+  for (size_t i = 0; i < 8 * 8 * 8; ++i) {
+    BvhNode leaf;
+    const size_t cell[3] = { i % 8, (i / 8) % 8, i / 64 };
+    for (size_t k = 0; k < 3; ++k) {
+      state = 1664525 * state + 1013904223;
+      const uint16 min = 2000 * cell[k] + (state >> 24);
+      leaf.mins[k] = min;
+      leaf.maxes[k] = min + ((state >> 16) & 0xFF) * (i % 5 != 0);
+    }
+    leaf.num_groups = 1;
+    leaves->push_back(leaf);
+    if (i % 50 == 0) leaves->push_back(leaf);
+  }
+}
+
+bool Contains(const BvhNode& outer, const BvhNode& inner) {
+  for (size_t k = 0; k < 3; ++k) {
+    if (inner.mins[k] < outer.mins[k] || inner.maxes[k] > outer.maxes[k]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Every node holds its children, and counts their groups.
+void CheckTree(const BvhNodeList& nodes) {
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].num_groups == 1) continue;
+    const size_t left = i + 1;
+    const size_t right = left + 2 * nodes[left].num_groups - 1;
+    CHECK(right < nodes.size());
+    CHECK(nodes[i].num_groups ==
+          nodes[left].num_groups + nodes[right].num_groups);
+    CHECK(Contains(nodes[i], nodes[left]));
+    CHECK(Contains(nodes[i], nodes[right]));
+  }
+}
+
+void GetLeaves(const BvhNodeList& nodes, BvhNodeList* leaves) {
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    if (nodes[i].num_groups == 1) leaves->push_back(nodes[i]);
+  }
+}
+
+void TestBuild() {
+  BvhNodeList input;
+  MakeLeaves(&input);
+  BvhNodeList nodes;
+  std::vector<size_t> leaf_order;
+  BvhBuilder(input).Build(&nodes, &leaf_order);
+  CHECK(nodes.size() == 2 * input.size() - 1);
+  CHECK(nodes[0].num_groups == input.size());
+  CheckTree(nodes);
+  BvhNodeList leaves;
+  GetLeaves(nodes, &leaves);
+  CHECK(leaf_order.size() == input.size());
+  std::vector<bool> seen(input.size(), false);
+  for (size_t i = 0; i < leaf_order.size(); ++i) {
+    CHECK(!seen[leaf_order[i]]);
+    seen[leaf_order[i]] = true;
+    CHECK(Contains(leaves[i], input[leaf_order[i]]) &&
+          Contains(input[leaf_order[i]], leaves[i]));
+  }
+}
+
+void TestDegenerate() {
+  BvhNodeList nodes;
+  std::vector<size_t> leaf_order;
+  BvhNodeList input;
+  BvhBuilder(input).Build(&nodes, &leaf_order);
+  CHECK(nodes.empty() && leaf_order.empty());
+
+  // Identical boxes all have the same Morton code.
+  BvhNode leaf = { { 5, 6, 7 }, { 9, 9, 9 }, 1 };
+  input.assign(5, leaf);
+  BvhBuilder(input).Build(&nodes, &leaf_order);
+  CHECK(nodes.size() == 9);
+  CheckTree(nodes);
+}
+
+// Decoded boxes nest, and hold the exact ones.
+void TestCompress() {
+  BvhNodeList input;
+  MakeLeaves(&input);
+  BvhNodeList nodes;
+  std::vector<size_t> leaf_order;
+  BvhBuilder(input).Build(&nodes, &leaf_order);
+  std::vector<char> utf8;
+  const size_t num_codes = CompressBvhToUtf8(nodes, &utf8);
+  std::vector<uint32> codes;
+  Utf8ToCodes(&utf8[0], utf8.size(), &codes);
+  CHECK(codes.size() == num_codes);
+  // Below the root, boxes take one byte per coordinate.
+  CHECK(utf8.size() < 9 * nodes.size());
+  BvhNodeList decoded;
+  CHECK(DecompressBvh(&codes[0], nodes.size(), &decoded) == num_codes);
+  CheckTree(decoded);
+  for (size_t i = 0; i < nodes.size(); ++i) {
+    CHECK(decoded[i].num_groups == nodes[i].num_groups);
+    CHECK(Contains(decoded[i], nodes[i]));
+  }
+  for (size_t k = 0; k < 3; ++k) {
+    CHECK(decoded[0].mins[k] == nodes[0].mins[k]);
+    CHECK(decoded[0].maxes[k] == nodes[0].maxes[k]);
+  }
+}
+
+// Queries find what testing every leaf finds.
+void TestQueries() {
+  BvhNodeList input;
+  MakeLeaves(&input);
+  BvhNodeList nodes;
+  std::vector<size_t> leaf_order;
+  BvhBuilder(input).Build(&nodes, &leaf_order);
+  BvhNodeList leaves;
+  GetLeaves(nodes, &leaves);
+
+  // x >= 3000, y <= 9000, and everything.
+  const float kPlanes[][4] = {
+    { 1, 0, 0, -3000 }, { 0, -1, 0, 9000 }, { 0, 0, 1, 0 }
+  };
+  for (size_t num_planes = 0; num_planes <= 3; ++num_planes) {
+    std::vector<size_t> groups;
+    FrustumQueryBvh(nodes, &kPlanes[0][0], num_planes, &groups);
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < leaves.size(); ++i) {
+      bool outside = false;
+      for (size_t p = 0; p < num_planes; ++p) {
+        outside |= ClassifyBox(leaves[i], kPlanes[p]) < 0;
+      }
+      if (!outside) expected.push_back(i);
+    }
+    CHECK(groups == expected);
+    CHECK(num_planes || groups.size() == leaves.size());
+  }
+
+  // From left of the grid, through the middle of a box.
+  const BvhNode& target = input[2];
+  const float kOrigin[3] = { -100, 0.5f * (target.mins[1] + target.maxes[1]),
+                             0.5f * (target.mins[2] + target.maxes[2]) };
+  const float kDirections[][3] = {
+    { 1, 0, 0 }, { 1, 0.25f, -0.5f }, { -1, 0, 0 }
+  };
+  for (size_t d = 0; d < 3; ++d) {
+    std::vector<size_t> groups;
+    RayQueryBvh(nodes, kOrigin, kDirections[d], &groups);
+    float inv_direction[3];
+    for (size_t k = 0; k < 3; ++k) {
+      inv_direction[k] = 1.0f / kDirections[d][k];
+    }
+    std::vector<size_t> expected;
+    for (size_t i = 0; i < leaves.size(); ++i) {
+      if (RayHitsBox(leaves[i], kOrigin, inv_direction)) {
+        expected.push_back(i);
+      }
+    }
+    CHECK(groups == expected);
+    CHECK(d != 0 || !groups.empty());
+    CHECK(d != 2 || groups.empty());
+  }
+}
+
+// The later groups only use vertices the first one flattened, one of
+// them far from the rest of the first group. The third group's maxes
+// are most of a step past a truncated word.
+const char kSharedObj[] =
+    "v 0 0 0\nv 0.7 0 0\nv 0 0.7 0\nv 0.7 0.7 0\nv 10 10 10\n"
+    "g first\n"
+    "f 1 2 3\n"
+    "f 2 5 4\n"
+    "g second\n"
+    "f 2 5 4\n"
+    "f 4 3 2\n"
+    "g third\n"
+    "f 1 2 4\n";
+
+// Leaves built from group bounds, as objcompress does, hold every
+// vertex their groups index, as quantized.
+void CheckGroupLeaves(FlattenMode flatten_mode, float weld_epsilon,
+                      QuantizeMode quantize_mode) {
+  FILE* fp = tmpfile();
+  fputs(kSharedObj, fp);
+  rewind(fp);
+  const WavefrontObjFile obj(fp, flatten_mode, weld_epsilon);
+  fclose(fp);
+  const DrawBatch& batch = obj.material_batches().begin()->second;
+  const DrawMesh& mesh = batch.draw_mesh();
+  const std::vector<GroupStart>& group_starts = batch.group_starts();
+  CHECK(group_starts.size() == 3);
+  const size_t stride = mesh.layout.stride();
+  Bounds bounds;
+  bounds.Clear();
+  bounds.Enclose(mesh.attribs, stride);
+  BoundsParams params = BoundsParams::FromBounds(bounds, mesh.layout);
+  params.mode = quantize_mode;
+  QuantizedAttribList quantized;
+  AttribsToQuantizedAttribs(mesh.attribs, params, &quantized);
+
+  BvhNodeList input(group_starts.size());
+  for (size_t g = 0; g < input.size(); ++g) {
+    QuantizeAABB(group_starts[g].bounds, params, input[g].mins,
+                 input[g].maxes);
+    input[g].num_groups = 1;
+  }
+  BvhNodeList nodes;
+  std::vector<size_t> leaf_order;
+  BvhBuilder(input).Build(&nodes, &leaf_order);
+  CheckTree(nodes);
+  BvhNodeList leaves;
+  GetLeaves(nodes, &leaves);
+  for (size_t k = 0; k < leaves.size(); ++k) {
+    const size_t g = leaf_order[k];
+    const size_t end = (g + 1 < group_starts.size()) ?
+        group_starts[g + 1].offset : mesh.indices.size();
+    for (size_t i = group_starts[g].offset; i < end; ++i) {
+      const uint16* position = &quantized[stride * mesh.indices[i]];
+      for (size_t j = 0; j < 3; ++j) {
+        CHECK(leaves[k].mins[j] <= position[j]);
+        CHECK(position[j] <= leaves[k].maxes[j]);
+      }
+    }
+  }
+}
+
+// However vertices were flattened, welded and quantized.
+void TestGroupLeaves() {
+  const FlattenMode kFlattenModes[] = { kFlattenIncremental, kFlattenBulk };
+  const float kWeldEpsilons[] = { -1, 1 };
+  const QuantizeMode kQuantizeModes[] = {
+    kQuantizeTruncate, kQuantizeRound, kQuantizeDither
+  };
+  for (size_t f = 0; f < 2; ++f) {
+    for (size_t w = 0; w < 2; ++w) {
+      for (size_t q = 0; q < 3; ++q) {
+        CheckGroupLeaves(kFlattenModes[f], kWeldEpsilons[w],
+                         kQuantizeModes[q]);
+      }
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  TestGroupLeaves();
+  TestBuild();
+  TestDegenerate();
+  TestCompress();
+  TestQueries();
+  return 0;
+}
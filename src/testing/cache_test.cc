@@ -0,0 +1,148 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../base.h"
+#include "../cache.h"
+
+// The straightforward simulations, for reference.
+size_t NaiveFifoMisses(const std::vector<int>& indices, size_t cache_size) {
+  std::vector<int> fifo;
+  size_t misses = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    if (std::find(fifo.begin(), fifo.end(), indices[i]) == fifo.end()) {
+      ++misses;
+      fifo.insert(fifo.begin(), indices[i]);
+      if (fifo.size() > cache_size) fifo.pop_back();
+    }
+  }
+  return misses;
+}
+
+size_t NaiveLruMisses(const std::vector<int>& indices, size_t cache_size) {
+  std::vector<int> lru;
+  size_t misses = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    std::vector<int>::iterator found =
+        std::find(lru.begin(), lru.end(), indices[i]);
+    if (found == lru.end()) {
+      ++misses;
+      if (lru.size() == cache_size) lru.pop_back();
+    } else {
+      lru.erase(found);
+    }
+    lru.insert(lru.begin(), indices[i]);
+  }
+  return misses;
+}
+
+void RandomIndices(size_t num_indices, int num_verts,
+                   std::vector<int>* indices) {
+  srand(12345);
+  indices->clear();
+  int recent = 0;
+  for (size_t i = 0; i < num_indices; ++i) {
+    // Mostly local, with occasional jumps, to exercise both hits and
+    // misses.
+    recent = (rand() % 8 == 0) ? rand() % num_verts
+                               : (recent + rand() % 5) % num_verts;
+    indices->push_back(recent);
+  }
+}
+
+void TestFifoAndLru() {
+  std::vector<int> indices;
+  RandomIndices(30000, 2000, &indices);
+  const size_t kSizes[] = { 1, 3, 6, 16, 32, 100, 5000 };
+  for (size_t i = 0; i < sizeof(kSizes) / sizeof(kSizes[0]); ++i) {
+    FifoCache fifo(kSizes[i]);
+    CHECK(NaiveFifoMisses(indices, kSizes[i]) ==
+          CountCacheMisses(indices, &fifo));
+    LruCache lru(kSizes[i]);
+    CHECK(NaiveLruMisses(indices, kSizes[i]) ==
+          CountCacheMisses(indices, &lru));
+  }
+}
+
+void TestBatch() {
+  // Two triangles sharing an edge fit in one batch: 4 transforms.
+  const int kQuad[] = { 0, 1, 2, 2, 1, 3 };
+  std::vector<int> quad(kQuad, kQuad + 6);
+  CHECK(4 == SimulateCache(CacheModel::Batch(32, 64), quad).misses);
+  // One triangle per batch: no sharing at all.
+  CHECK(6 == SimulateCache(CacheModel::Batch(32, 1), quad).misses);
+  // Room for only 3 vertices per batch.
+  CHECK(6 == SimulateCache(CacheModel::Batch(3, 64), quad).misses);
+  // A degenerate triangle only transforms its vertex once.
+  const int kDegenerate[] = { 5, 5, 5 };
+  std::vector<int> degenerate(kDegenerate, kDegenerate + 3);
+  CHECK(1 == SimulateCache(CacheModel::Batch(1, 1), degenerate).misses);
+}
+
+void TestStats() {
+  const int kQuad[] = { 0, 1, 2, 2, 1, 3 };
+  std::vector<int> quad(kQuad, kQuad + 6);
+  const CacheStats stats = SimulateCache(CacheModel::Fifo(16), quad);
+  CHECK(4 == stats.misses);
+  CHECK(4 == stats.num_vertices);
+  CHECK(2 == stats.num_triangles);
+  CHECK(2.0 == stats.acmr());
+  CHECK(1.0 == stats.atvr());
+}
+
+void TestParse() {
+  CacheModel model = CacheModel::Fifo(1);
+  CHECK(CacheModel::Parse("24", &model));
+  CHECK(CacheModel::kFifo == model.kind && 24 == model.size);
+  CHECK(CacheModel::Parse("lru:8", &model));
+  CHECK(CacheModel::kLru == model.kind && 8 == model.size);
+  CHECK(CacheModel::Parse("batch:16:32", &model));
+  CHECK(CacheModel::kBatch == model.kind && 16 == model.size);
+  CHECK(32 == model.max_triangles);
+  CHECK(CacheModel::Parse("nvidia", &model));
+  CHECK(!CacheModel::Parse("lru:", &model));
+  CHECK(!CacheModel::Parse("batch:16", &model));
+  CHECK(!CacheModel::Parse("bogus", &model));
+}
+
+void TestFetch() {
+  // 16-byte vertices, visited in order: every byte is read once.
+  std::vector<int> sequential;
+  for (int i = 0; i < 4096; ++i) sequential.push_back(i);
+  const FetchStats in_order = SimulateVertexFetch(sequential, 16);
+  CHECK(1.0 == in_order.overfetch());
+  CHECK(16.0 == in_order.bytes_per_vertex());
+  // Striding by one line never reuses a line.
+  std::vector<int> strided;
+  for (int i = 0; i < 4096; ++i) strided.push_back((4 * i) % 4096 +
+                                                   (4 * i) / 4096);
+  CHECK(1.0 < SimulateVertexFetch(strided, 16).overfetch());
+}
+
+int main(int argc, char* argv[]) {
+  TestFifoAndLru();
+  TestBatch();
+  TestStats();
+  TestParse();
+  TestFetch();
+  return 0;
+}
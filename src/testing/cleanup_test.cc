@@ -0,0 +1,94 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <vector>
+
+#include "../base.h"
+#include "../cleanup.h"
+#include "../mesh.h"
+
+// Vertices 0 to 3 are a unit square, 4 is on the diagonal from 0 to
+// 2, and 5 is a copy of 1.
+void MakeAttribs(QuantizedAttribList* attribs) {
+  const uint16 kPositions[][3] = {
+    { 0, 0, 0 }, { 100, 0, 0 }, { 100, 100, 0 }, { 0, 100, 0 },
+    { 50, 50, 0 }, { 100, 0, 0 }
+  };
+  for (size_t i = 0; i < 6; ++i) {
+    attribs->insert(attribs->end(), kPositions[i], kPositions[i] + 3);
+    attribs->insert(attribs->end(), 5, 0);
+  }
+}
+
+void TestDegenerate() {
+  QuantizedAttribList attribs;
+  MakeAttribs(&attribs);
+  CHECK(!IsDegenerateTriangle(attribs, 8, 0, 1, 2));
+  CHECK(!IsDegenerateTriangle(attribs, 8, 0, 4, 1));
+  CHECK(IsDegenerateTriangle(attribs, 8, 0, 0, 1));
+  CHECK(IsDegenerateTriangle(attribs, 8, 0, 4, 2));  // Collinear.
+  CHECK(IsDegenerateTriangle(attribs, 8, 1, 5, 2));  // Coincident.
+}
+
+void TestCleanup() {
+  QuantizedAttribList attribs;
+  MakeAttribs(&attribs);
+  DrawMesh mesh;
+  mesh.attribs.resize(attribs.size());
+  const int kIndices[] = {
+    // Group 0.
+    0, 1, 2,
+    1, 2, 0,  // Rotated duplicate.
+    0, 2, 1,  // Back face, kept.
+    0, 4, 2,  // Degenerate.
+    0, 2, 3,
+    // Group 1: only a degenerate triangle.
+    3, 3, 1,
+    // Group 2: the same triangle as in group 0, kept.
+    2, 3, 0,
+    2, 3, 0,
+  };
+  mesh.indices.assign(kIndices, kIndices + sizeof(kIndices) / sizeof(int));
+  std::vector<GroupStart> group_starts(3);
+  group_starts[0].offset = 0;
+  group_starts[1].offset = 15;
+  group_starts[2].offset = 18;
+  for (size_t g = 0; g < 3; ++g) group_starts[g].group_line = 10 * g;
+
+  DrawMesh cleaned;
+  std::vector<GroupStart> cleaned_group_starts;
+  const size_t degenerate = Stats::Get().count(Stats::kDegenerateTriangles);
+  const size_t duplicate = Stats::Get().count(Stats::kDuplicateTriangles);
+  CleanupTriangles(mesh, group_starts, attribs, &cleaned,
+                   &cleaned_group_starts);
+  CHECK(Stats::Get().count(Stats::kDegenerateTriangles) == degenerate + 2);
+  CHECK(Stats::Get().count(Stats::kDuplicateTriangles) == duplicate + 2);
+  const int kExpected[] = { 0, 1, 2, 0, 2, 1, 0, 2, 3, 2, 3, 0 };
+  CHECK(cleaned.indices == IndexList(kExpected, kExpected + 12));
+  CHECK(cleaned.attribs.size() == mesh.attribs.size());
+  CHECK(cleaned_group_starts.size() == 2);
+  CHECK(cleaned_group_starts[0].offset == 0);
+  CHECK(cleaned_group_starts[1].offset == 9);
+  CHECK(cleaned_group_starts[1].group_line == 20);
+}
+
+int main(int argc, char* argv[]) {
+  TestDegenerate();
+  TestCleanup();
+  return 0;
+}
@@ -0,0 +1,165 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../base.h"
+#include "../cluster.h"
+
+// An n x n vertex grid in the quantized frame, displaced by
+// bump * sin(x) * cos(y) along z. Triangles are in scanline order.
+void MakeGrid(int n, float bump, WebGLMesh* mesh) {
+  const float spacing = 16383.0f / (n - 1);
+  for (int y = 0; y < n; ++y) {
+    for (int x = 0; x < n; ++x) {
+      const float z = 8191.5f + bump * sinf(0.3f * x) * cosf(0.2f * y);
+      mesh->attribs.push_back(static_cast<uint16>(x * spacing));
+      mesh->attribs.push_back(static_cast<uint16>(y * spacing));
+      mesh->attribs.push_back(static_cast<uint16>(z));
+      for (int k = 3; k < 8; ++k) mesh->attribs.push_back(0);
+    }
+  }
+  for (int y = 0; y + 1 < n; ++y) {
+    for (int x = 0; x + 1 < n; ++x) {
+      const uint32 v = y * n + x;
+      mesh->indices.push_back(v);
+      mesh->indices.push_back(v + 1);
+      mesh->indices.push_back(v + n);
+      mesh->indices.push_back(v + n);
+      mesh->indices.push_back(v + 1);
+      mesh->indices.push_back(v + n + 1);
+    }
+  }
+}
+
+void CheckClusters(const WebGLMesh& mesh, const ClusterList& clusters,
+                   size_t max_vertices, size_t max_triangles) {
+  size_t next = 0;
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    const Cluster& cluster = clusters[c];
+    CHECK(cluster.index_start == next);
+    CHECK(cluster.num_triangles >= 1);
+    CHECK(cluster.num_triangles <= max_triangles);
+    CHECK(cluster.num_vertices <= max_vertices);
+    next += 3 * cluster.num_triangles;
+
+    std::vector<uint32> vertices(&mesh.indices[cluster.index_start],
+                                 &mesh.indices[next]);
+    std::sort(vertices.begin(), vertices.end());
+    CHECK(cluster.num_vertices == static_cast<size_t>(
+        std::unique(vertices.begin(), vertices.end()) - vertices.begin()));
+
+    float axis[3];
+    DecodeConeAxis(cluster, axis);
+    const float cutoff = DecodeConeValue(cluster.cone_cutoff);
+    for (size_t i = cluster.index_start; i < next; i += 3) {
+      float p[3][3];
+      for (size_t j = 0; j < 3; ++j) {
+        const uint16* position = &mesh.attribs[8 * mesh.indices[i + j]];
+        float distance2 = 0;
+        for (size_t k = 0; k < 3; ++k) {
+          p[j][k] = position[k];
+          const float d = p[j][k] - cluster.center[k];
+          distance2 += d * d;
+        }
+        CHECK(sqrtf(distance2) <= cluster.radius);
+      }
+      float e1[3], e2[3];
+      for (size_t k = 0; k < 3; ++k) {
+        e1[k] = p[1][k] - p[0][k];
+        e2[k] = p[2][k] - p[0][k];
+      }
+      const float n[3] = { e1[1] * e2[2] - e1[2] * e2[1],
+                           e1[2] * e2[0] - e1[0] * e2[2],
+                           e1[0] * e2[1] - e1[1] * e2[0] };
+      const float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+      if (length == 0) continue;
+      const float dot = (n[0] * axis[0] + n[1] * axis[1] +
+                         n[2] * axis[2]) / length;
+      CHECK(dot >= cutoff - 1e-5f);
+    }
+  }
+  CHECK(next == mesh.indices.size());
+}
+
+void TestFlat() {
+  WebGLMesh mesh;
+  MakeGrid(100, 0, &mesh);
+  ClusterList clusters;
+  ClusterBuilder(mesh, 64, 124).Build(&clusters);
+  CheckClusters(mesh, clusters, 64, 124);
+  // A plane facing +z: a tight cone that points straight up.
+  for (size_t c = 0; c < clusters.size(); ++c) {
+    float axis[3];
+    DecodeConeAxis(clusters[c], axis);
+    CHECK(axis[2] > 0.99f);
+    CHECK(DecodeConeValue(clusters[c].cone_cutoff) > 0.98f);
+  }
+}
+
+void TestBumpy() {
+  WebGLMesh mesh;
+  MakeGrid(200, 3000, &mesh);
+  const size_t kLimits[][2] = { { 64, 124 }, { 3, 1 }, { 32, 64 },
+                                { 256, 32 } };
+  for (size_t i = 0; i < sizeof(kLimits) / sizeof(kLimits[0]); ++i) {
+    ClusterList clusters;
+    ClusterBuilder(mesh, kLimits[i][0], kLimits[i][1]).Build(&clusters);
+    CheckClusters(mesh, clusters, kLimits[i][0], kLimits[i][1]);
+  }
+}
+
+void TestEncoding() {
+  WebGLMesh mesh;
+  MakeGrid(20, 500, &mesh);
+  ClusterList clusters;
+  ClusterBuilder(mesh, 64, 124).Build(&clusters);
+  std::vector<char> utf8;
+  CompressClustersToUtf8(clusters, &utf8);
+  // Every code is a single character of one to three bytes.
+  CHECK(utf8.size() >= kClusterCodes * clusters.size());
+  CHECK(utf8.size() <= 3 * kClusterCodes * clusters.size());
+}
+
+void TestParseClusters() {
+  size_t max_vertices = 0;
+  size_t max_triangles = 0;
+  CHECK(ParseClusters("64:124", &max_vertices, &max_triangles));
+  CHECK(max_vertices == 64 && max_triangles == 124);
+  CHECK(ParseClusters("63487:63487", &max_vertices, &max_triangles));
+  CHECK(max_vertices == kMaxClusterSize && max_triangles == kMaxClusterSize);
+  const char* const kBad[] = {
+    "", "64", "64:", ":124", "2:124", "64:0", "-64:124", "64:-1",
+    "63488:124", "64:63488", "64:99999999999999999999", "64:124x"
+  };
+  for (size_t i = 0; i < sizeof(kBad) / sizeof(kBad[0]); ++i) {
+    CHECK(!ParseClusters(kBad[i], &max_vertices, &max_triangles));
+  }
+  CHECK(max_vertices == kMaxClusterSize && max_triangles == kMaxClusterSize);
+}
+
+int main(int argc, char* argv[]) {
+  TestParseClusters();
+  TestFlat();
+  TestBumpy();
+  TestEncoding();
+  return 0;
+}
@@ -0,0 +1,177 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <string>
+#include <vector>
+
+#include "../base.h"
+#include "../mesh.h"
+#include "../normals.h"
+#include "../parallel.h"
+
+// A unit cube around the origin, with faces wound outwards.
+const char kCube[] =
+    "v -1 -1 -1\nv 1 -1 -1\nv 1 1 -1\nv -1 1 -1\n"
+    "v -1 -1 1\nv 1 -1 1\nv 1 1 1\nv -1 1 1\n"
+    "f 1 4 3 2\nf 5 6 7 8\nf 1 2 6 5\nf 3 4 8 7\nf 2 3 7 6\nf 1 5 8 4\n";
+
+const DrawMesh& Parse(const std::string& obj_text, float crease_angle,
+                      WavefrontObjFile** obj) {
+  FILE* fp = tmpfile();
+  fputs(obj_text.c_str(), fp);
+  rewind(fp);
+  *obj = new WavefrontObjFile(fp, kFlattenIncremental, -1, crease_angle);
+  fclose(fp);
+  return (*obj)->material_batches().find("")->second.draw_mesh();
+}
+
+// Every vertex normal is unit length and points away from the origin.
+void CheckOutwards(const DrawMesh& mesh) {
+  for (size_t i = 0; i < mesh.attribs.size(); i += 8) {
+    const float* position = &mesh.attribs[i];
+    const float* normal = &mesh.attribs[i + 5];
+    float dot = 0, length_squared = 0;
+    for (size_t k = 0; k < 3; ++k) {
+      dot += position[k] * normal[k];
+      length_squared += normal[k] * normal[k];
+    }
+    CHECK(dot > 0);
+    CHECK(fabsf(length_squared - 1) < 1e-5f);
+  }
+}
+
+void TestCube() {
+  const char* const kSmoothing[] = { "", "s off\n", "s 1\n", "s 1\n" };
+  const float kCreaseAngles[] = { 180, 180, 180, 60 };
+  // Flat faces don't share vertices; smooth ones share the corners.
+  const size_t kExpectedVertices[] = { 24, 24, 8, 24 };
+  for (size_t i = 0; i < 4; ++i) {
+    WavefrontObjFile* obj;
+    const DrawMesh& mesh =
+        Parse(std::string(kSmoothing[i]) + kCube, kCreaseAngles[i], &obj);
+    CHECK(mesh.indices.size() == 36);
+    CHECK(mesh.attribs.size() == 8 * kExpectedVertices[i]);
+    CheckOutwards(mesh);
+    if (kExpectedVertices[i] == 8) {
+      // Corner normals point along the diagonal.
+      for (size_t v = 0; v < mesh.attribs.size(); v += 8) {
+        for (size_t k = 0; k < 3; ++k) {
+          CHECK(fabsf(fabsf(mesh.attribs[v + 5 + k]) - 1 / sqrtf(3)) < 1e-5f);
+        }
+      }
+    }
+    delete obj;
+  }
+}
+
+// Faces in different smoothing groups don't share normals, and faces
+// that have normals keep them.
+void TestGroups() {
+  const std::string kObj =
+      "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 1\nv 0 -1 1\n"
+      "vn 0 0 -1\n"
+      "s 1\nf 1 2 3\nf 1 3 4\n"
+      "s 2\nf 1 5 2\n"
+      "f 2//1 3//1 1//1\n";
+  WavefrontObjFile* obj;
+  const DrawMesh& mesh = Parse(kObj, 180, &obj);
+  CHECK(mesh.indices.size() == 12);
+  // 1, 2, 3 and 4 smoothed; 1, 5 and 2 apart; and the given normal.
+  CHECK(mesh.attribs.size() == 8 * 10);
+  const float* given = &mesh.attribs[8 * mesh.indices[9] + 5];
+  CHECK(given[0] == 0 && given[1] == 0 && given[2] == -1);
+  delete obj;
+}
+
+// The apex of a cone of many faces gets one normal per smoothing
+// group, and one per face when they are flat.
+void TestApex() {
+  const size_t kFaces = 1000;
+  const char* const kSmoothing[] = { "s off\n", "s 1\n", "s 1\n" };
+  const char* const kHalfway[] = { "", "", "s 2\n" };
+  const size_t kExpectedApexes[] = { kFaces, 1, 2 };
+  for (size_t i = 0; i < 3; ++i) {
+    std::string obj_text = "v 0 0 1\n";
+    char line[64];
+    for (size_t k = 0; k < kFaces; ++k) {
+      const float angle = 2 * static_cast<float>(M_PI) * k / kFaces;
+      snprintf(line, sizeof(line), "v %f %f 0\n", cosf(angle), sinf(angle));
+      obj_text += line;
+    }
+    obj_text += kSmoothing[i];
+    for (size_t k = 0; k < kFaces; ++k) {
+      if (k == kFaces / 2) obj_text += kHalfway[i];
+      snprintf(line, sizeof(line), "f 1 %zu %zu\n", k + 2,
+               (k + 1) % kFaces + 2);
+      obj_text += line;
+    }
+    WavefrontObjFile* obj;
+    const DrawMesh& mesh = Parse(obj_text, 180, &obj);
+    CheckOutwards(mesh);
+    size_t apexes = 0;
+    for (size_t v = 0; v < mesh.attribs.size(); v += 8) {
+      if (mesh.attribs[v + 2] == 1) ++apexes;
+    }
+    CHECK(apexes == kExpectedApexes[i]);
+    delete obj;
+  }
+}
+
+// The generated normals don't depend on the number of threads.
+void TestThreads() {
+  srand(5);
+  AttribList positions;
+  for (size_t i = 0; i < 3 * 20000; ++i) {
+    positions.push_back(rand() % 1000 / 10.0f);
+  }
+  std::vector<int> corners;
+  std::vector<unsigned int> smoothing_groups;
+  for (size_t t = 0; t < 50000; ++t) {
+    for (size_t k = 0; k < 3; ++k) corners.push_back(rand() % 20000);
+    smoothing_groups.push_back(rand() % 3);
+  }
+  std::vector<int> normal_indices[2];
+  AttribList normals[2];
+  const size_t kThreads[] = { 1, 4 };
+  for (size_t i = 0; i < 2; ++i) {
+    NumThreads() = kThreads[i];
+    normal_indices[i].assign(corners.size(), -1);
+    normal_indices[i][0] = 7;
+    normals[i].assign(3 * 8, 0);
+    NormalGenerator(positions, corners, smoothing_groups, 45)
+        .Generate(&normals[i], &normal_indices[i]);
+  }
+  CHECK(normal_indices[0] == normal_indices[1]);
+  CHECK(normals[0] == normals[1]);
+  CHECK(normal_indices[0][0] == 7);
+  for (size_t c = 1; c < corners.size(); ++c) {
+    CHECK(normal_indices[0][c] >= 8);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  TestCube();
+  TestGroups();
+  TestApex();
+  TestThreads();
+  return 0;
+}
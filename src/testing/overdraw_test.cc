@@ -0,0 +1,136 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../base.h"
+#include "../overdraw.h"
+#include "../raster.h"
+
+void AddVertex(uint16 x, uint16 y, uint16 z, QuantizedAttribList* attribs) {
+  attribs->push_back(x);
+  attribs->push_back(y);
+  attribs->push_back(z);
+  for (size_t k = 3; k < 8; ++k) attribs->push_back(0);
+}
+
+// A square facing +z at height z, as two counter-clockwise triangles.
+void AddSquare(uint16 z, WebGLMesh* mesh) {
+  const uint32 base = mesh->attribs.size() / 8;
+  AddVertex(1000, 1000, z, &mesh->attribs);
+  AddVertex(15000, 1000, z, &mesh->attribs);
+  AddVertex(1000, 15000, z, &mesh->attribs);
+  AddVertex(15000, 15000, z, &mesh->attribs);
+  const uint32 kQuad[] = { 0, 1, 2, 2, 1, 3 };
+  for (size_t i = 0; i < 6; ++i) mesh->indices.push_back(base + kQuad[i]);
+}
+
+void TestRasterizer() {
+  // Seen from +z, drawing the low square first shades it all twice;
+  // drawing the high one first lets the depth test reject the other.
+  // From -z, both are back facing.
+  WebGLMesh back_to_front;
+  AddSquare(100, &back_to_front);
+  AddSquare(200, &back_to_front);
+  OverdrawRasterizer rasterizer;
+  rasterizer.Rasterize(back_to_front.attribs, back_to_front.layout.stride(),
+                       back_to_front.indices);
+  const OverdrawStats worst = rasterizer.stats();
+  CHECK(2.0 == worst.overdraw());
+
+  WebGLMesh front_to_back;
+  AddSquare(200, &front_to_back);
+  AddSquare(100, &front_to_back);
+  OverdrawRasterizer other;
+  other.Rasterize(front_to_back.attribs, front_to_back.layout.stride(),
+                  front_to_back.indices);
+  const OverdrawStats best = other.stats();
+  CHECK(1.0 == best.overdraw());
+  CHECK(worst.pixels_covered == best.pixels_covered);
+}
+
+void TestRenumber() {
+  WebGLMesh mesh;
+  for (uint16 i = 0; i < 4; ++i) AddVertex(i, i, i, &mesh.attribs);
+  const uint32 kIndices[] = { 3, 1, 2, 2, 1, 0 };
+  mesh.indices.assign(kIndices, kIndices + 6);
+  RenumberVerticesByFirstUse(&mesh);
+  const uint32 kExpected[] = { 0, 1, 2, 2, 1, 3 };
+  CHECK(std::equal(kExpected, kExpected + 6, mesh.indices.begin()));
+  CHECK(3 == mesh.attribs[0] && 0 == mesh.attribs[8 * 3]);
+}
+
+// A soup of random triangles keeps its triangles within each group
+// run, and comes out with vertices in first-use order.
+void TestOptimizeOverdraw() {
+  WebGLMesh mesh;
+  srand(1234);
+  for (size_t i = 0; i < 3000; ++i) {
+    AddVertex(rand() % 16384, rand() % 16384, rand() % 16384, &mesh.attribs);
+  }
+  for (size_t i = 0; i < 3000; ++i) {
+    mesh.indices.push_back(i);
+    mesh.indices.push_back(i < 2 ? i + 1 : rand() % i);
+    mesh.indices.push_back(i < 2 ? i : rand() % i);
+  }
+  GroupRunList runs(2);
+  runs[0].group_index = 0;
+  runs[0].length = 3 * 1200;
+  runs[1].group_index = 1;
+  runs[1].length = 3 * 1800;
+
+  std::vector<std::vector<uint16> > before;
+  for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+    std::vector<uint16> triangle;
+    for (size_t j = 0; j < 3; ++j) {
+      const uint16* p = &mesh.attribs[8 * mesh.indices[i + j]];
+      triangle.insert(triangle.end(), p, p + 3);
+    }
+    before.push_back(triangle);
+  }
+  OptimizeOverdraw(runs, 1.05f, &mesh);
+  std::vector<std::vector<uint16> > after;
+  uint32 high_water_mark = 0;
+  for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+    std::vector<uint16> triangle;
+    for (size_t j = 0; j < 3; ++j) {
+      const uint32 index = mesh.indices[i + j];
+      CHECK(index <= high_water_mark);
+      if (index == high_water_mark) ++high_water_mark;
+      const uint16* p = &mesh.attribs[8 * index];
+      triangle.insert(triangle.end(), p, p + 3);
+    }
+    after.push_back(triangle);
+  }
+  // Same triangles within each run.
+  std::sort(before.begin(), before.begin() + 1200);
+  std::sort(after.begin(), after.begin() + 1200);
+  std::sort(before.begin() + 1200, before.end());
+  std::sort(after.begin() + 1200, after.end());
+  CHECK(before == after);
+}
+
+int main(int argc, char* argv[]) {
+  TestRasterizer();
+  TestRenumber();
+  TestOptimizeOverdraw();
+  return 0;
+}
@@ -0,0 +1,401 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdio.h>
+#include <string.h>
+
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "benchmark.h"
+
+#define private public
+
+#include "../base.h"
+#include "../mesh.h"
+#include "../optimize.h"
+#include "../parallel.h"
+
+// Writes an n x n grid of quads. Every seam_period columns the
+// texcoords switch sets, which forces IndexFlattener to split the
+// vertices along that column.
+void WriteGridObj(size_t n, size_t seam_period, FILE* fp) {
+  const size_t row = n + 1;
+  for (size_t i = 0; i <= n; ++i) {
+    for (size_t j = 0; j <= n; ++j) {
+      const float x = static_cast<float>(j) / n;
+      const float y = static_cast<float>(i) / n;
+      fprintf(fp, "v %f %f %f\n", x, y, 0.05f * (x - y) * (x + y));
+    }
+  }
+  for (size_t set = 0; set < 2; ++set) {
+    for (size_t i = 0; i <= n; ++i) {
+      for (size_t j = 0; j <= n; ++j) {
+        fprintf(fp, "vt %f %f\n", 0.5f * set + 0.5f * j / n,
+                static_cast<float>(i) / n);
+      }
+    }
+  }
+  for (size_t i = 0; i <= n; ++i) {
+    for (size_t j = 0; j <= n; ++j) {
+      fprintf(fp, "vn %f %f %f\n", 0.f, 0.f, 1.f);
+    }
+  }
+  for (size_t i = 0; i < n; ++i) {
+    for (size_t j = 0; j < n; ++j) {
+      // OBJ indices are 1-based.
+      const size_t a = i * row + j + 1;
+      const size_t corners[4] = { a, a + 1, a + row + 1, a + row };
+      const size_t tex_offset = ((j / seam_period) & 1) ? row * row : 0;
+      fputs("f", fp);
+      for (size_t k = 0; k < 4; ++k) {
+        fprintf(fp, " %zu/%zu/%zu", corners[k], corners[k] + tex_offset,
+                corners[k]);
+      }
+      fputs("\n", fp);
+    }
+  }
+}
+
+// Everything the stage benchmarks need, computed once up front.
+struct MeshInput {
+  std::string name;
+  std::vector<std::string> attrib_lines;  // Payloads of v, vt and vn.
+  std::vector<std::string> face_lines;  // Payloads of f.
+  size_t num_face_corners;
+  std::vector<int> corners;  // Fan-triangulated (position, tex, normal).
+  MaterialBatches batches;
+  BoundsParams bounds_params;
+  std::vector<QuantizedAttribList> quantized;
+  std::vector<WebGLMeshList> webgl_meshes;
+  std::vector<char> utf8;
+};
+
+void ReadLines(FILE* fp, MeshInput* input) {
+  const size_t kLineBufferSize = 256;
+  char buffer[kLineBufferSize] = { 0 };
+  while (fgets(buffer, kLineBufferSize, fp) != NULL) {
+    char* stripped = StripLeadingWhitespace(buffer);
+    TerminateAtNewlineOrComment(stripped);
+    if (stripped[0] == 'v' && stripped[1] == ' ') {
+      input->attrib_lines.push_back(stripped + 2);
+    } else if (stripped[0] == 'v' && stripped[1] != '\0') {
+      input->attrib_lines.push_back(stripped + 3);
+    } else if (stripped[0] == 'f' && isspace(stripped[1])) {
+      input->face_lines.push_back(stripped + 1);
+    }
+  }
+  rewind(fp);
+}
+
+void OptimizeBatch(const DrawBatch& draw_batch,
+                   const QuantizedAttribList& quantized_attribs,
+                   WebGLMeshList* webgl_meshes) {
+  const DrawMesh& draw_mesh = draw_batch.draw_mesh();
+  const std::vector<GroupStart>& group_starts = draw_batch.group_starts();
+  VertexOptimizer vertex_optimizer(quantized_attribs);
+  for (size_t i = 0; i < group_starts.size(); ++i) {
+    const size_t here = group_starts[i].offset;
+    const size_t end = (i + 1 < group_starts.size()) ?
+        group_starts[i + 1].offset : draw_mesh.indices.size();
+    vertex_optimizer.AddTriangles(&draw_mesh.indices[here], end - here,
+                                  webgl_meshes);
+  }
+}
+
+void PrepareInput(FILE* fp, MeshInput* input) {
+  ReadLines(fp, input);
+  input->num_face_corners = 0;
+  WavefrontObjFile obj;
+  int indices[3] = { 0 };
+  for (size_t i = 0; i < input->face_lines.size(); ++i) {
+    std::vector<int> face;
+    const char* line = input->face_lines[i].c_str();
+    while ((line = obj.ParseIndices(line, 0, indices + 0, indices + 1,
+                                    indices + 2))) {
+      face.insert(face.end(), indices, indices + 3);
+    }
+    input->num_face_corners += face.size() / 3;
+    for (size_t j = 6; j + 3 <= face.size(); j += 3) {
+      input->corners.insert(input->corners.end(),
+                            face.begin(), face.begin() + 3);
+      input->corners.insert(input->corners.end(),
+                            face.begin() + j - 3, face.begin() + j + 3);
+    }
+  }
+  // Parse "for real," which also flattens.
+  input->batches = WavefrontObjFile(fp).material_batches();
+  Bounds bounds;
+  bounds.Clear();
+  for (MaterialBatches::const_iterator iter = input->batches.begin();
+       iter != input->batches.end(); ++iter) {
+    const DrawMesh& mesh = iter->second.draw_mesh();
+    bounds.Enclose(mesh.attribs, mesh.layout.stride());
+  }
+  input->bounds_params = BoundsParams::FromBounds(bounds);
+  for (MaterialBatches::const_iterator iter = input->batches.begin();
+       iter != input->batches.end(); ++iter) {
+    if (iter->second.draw_mesh().indices.empty()) continue;
+    input->quantized.push_back(QuantizedAttribList());
+    AttribsToQuantizedAttribs(iter->second.draw_mesh().attribs,
+                              input->bounds_params, &input->quantized.back());
+    input->webgl_meshes.push_back(WebGLMeshList());
+    OptimizeBatch(iter->second, input->quantized.back(),
+                  &input->webgl_meshes.back());
+    const WebGLMeshList& meshes = input->webgl_meshes.back();
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      CompressQuantizedAttribsToUtf8(meshes[i].attribs,
+                                     meshes[i].layout.stride(), &input->utf8);
+      CompressIndicesToUtf8(meshes[i].indices, &input->utf8);
+    }
+  }
+}
+
+void BenchParseLine(const MeshInput& input) {
+  const std::vector<std::string>& lines = input.attrib_lines;
+  Benchmark bench("ShortFloatList::ParseLine/" + input.name, lines.size());
+  while (bench.KeepRunning()) {
+    uint32 checksum = 0;
+    ShortFloatList floats;
+    for (size_t i = 0; i < lines.size(); ++i) {
+      checksum = 31 * checksum + floats.ParseLine(lines[i].c_str());
+      checksum += static_cast<uint32>(1024 * floats[0]);
+    }
+    bench.set_checksum(checksum);
+  }
+}
+
+void BenchParseIndices(const MeshInput& input) {
+  const std::vector<std::string>& lines = input.face_lines;
+  WavefrontObjFile obj;
+  Benchmark bench("ParseIndices/" + input.name, input.num_face_corners);
+  while (bench.KeepRunning()) {
+    uint32 checksum = 0;
+    int indices[3] = { 0 };
+    for (size_t i = 0; i < lines.size(); ++i) {
+      const char* line = lines[i].c_str();
+      while ((line = obj.ParseIndices(line, 0, indices + 0, indices + 1,
+                                      indices + 2))) {
+        checksum = 31 * checksum + indices[0] + indices[1] + indices[2];
+      }
+    }
+    bench.set_checksum(checksum);
+  }
+}
+
+void BenchGetFlattenedIndex(const MeshInput& input) {
+  const std::vector<int>& corners = input.corners;
+  Benchmark bench("IndexFlattener::GetFlattenedIndex/" + input.name,
+                  corners.size() / 3);
+  while (bench.KeepRunning()) {
+    IndexFlattener flattener(0);
+    flattener.reserve(1024);
+    uint32 checksum = 0;
+    for (size_t i = 0; i < corners.size(); i += 3) {
+      const std::pair<int, bool> flattened = flattener.GetFlattenedIndex(
+          corners[i + 0] - 1, corners[i + 1] - 1, corners[i + 2] - 1);
+      checksum = 31 * checksum + flattened.first;
+    }
+    bench.set_checksum(MixChecksum(checksum, flattener.count()));
+  }
+}
+
+// Checksums match BenchGetFlattenedIndex's, since the numbering is the
+// same.
+void BenchFlattenIndicesBulk(const MeshInput& input) {
+  std::vector<int> corners(input.corners);
+  for (size_t i = 0; i < corners.size(); ++i) {
+    corners[i] -= 1;
+  }
+  Benchmark bench("FlattenIndicesBulk/" + input.name, corners.size() / 3);
+  std::vector<int> flat_indices;
+  std::vector<uint32> first_corners;
+  while (bench.KeepRunning()) {
+    const size_t count = FlattenIndicesBulk(corners, &flat_indices,
+                                            &first_corners);
+    uint32 checksum = 0;
+    for (size_t i = 0; i < flat_indices.size(); ++i) {
+      checksum = 31 * checksum + flat_indices[i];
+    }
+    bench.set_checksum(MixChecksum(checksum, count));
+  }
+}
+
+void BenchAttribsToQuantizedAttribs(const MeshInput& input) {
+  size_t items = 0;
+  for (MaterialBatches::const_iterator iter = input.batches.begin();
+       iter != input.batches.end(); ++iter) {
+    const DrawMesh& mesh = iter->second.draw_mesh();
+    items += mesh.attribs.size() / mesh.layout.stride();
+  }
+  Benchmark bench("AttribsToQuantizedAttribs/" + input.name, items);
+  while (bench.KeepRunning()) {
+    uint32 checksum = 0;
+    QuantizedAttribList quantized;
+    for (MaterialBatches::const_iterator iter = input.batches.begin();
+         iter != input.batches.end(); ++iter) {
+      AttribsToQuantizedAttribs(iter->second.draw_mesh().attribs,
+                                input.bounds_params, &quantized);
+      for (size_t i = 0; i < quantized.size(); ++i) {
+        checksum = 31 * checksum + quantized[i];
+      }
+    }
+    bench.set_checksum(checksum);
+  }
+}
+
+void BenchAddTriangles(const MeshInput& input) {
+  size_t items = 0;
+  for (MaterialBatches::const_iterator iter = input.batches.begin();
+       iter != input.batches.end(); ++iter) {
+    items += iter->second.draw_mesh().indices.size() / 3;
+  }
+  Benchmark bench("VertexOptimizer::AddTriangles/" + input.name, items);
+  while (bench.KeepRunning()) {
+    uint32 checksum = 0;
+    size_t batch = 0;
+    for (MaterialBatches::const_iterator iter = input.batches.begin();
+         iter != input.batches.end(); ++iter) {
+      if (iter->second.draw_mesh().indices.empty()) continue;
+      WebGLMeshList meshes;
+      OptimizeBatch(iter->second, input.quantized[batch++], &meshes);
+      for (size_t i = 0; i < meshes.size(); ++i) {
+        const OptimizedIndexList& indices = meshes[i].indices;
+        for (size_t j = 0; j < indices.size(); ++j) {
+          checksum = 31 * checksum + indices[j];
+        }
+      }
+    }
+    bench.set_checksum(checksum);
+  }
+}
+
+void BenchUint16ToUtf8(const MeshInput& input) {
+  size_t items = 0;
+  for (size_t i = 0; i < input.quantized.size(); ++i) {
+    items += input.quantized[i].size();
+  }
+  Benchmark bench("Uint16ToUtf8/" + input.name, items);
+  std::vector<char> utf8;
+  while (bench.KeepRunning()) {
+    utf8.clear();
+    for (size_t i = 0; i < input.quantized.size(); ++i) {
+      const QuantizedAttribList& words = input.quantized[i];
+      for (size_t j = 0; j < words.size(); ++j) {
+        Uint16ToUtf8(ZigZag(static_cast<int16>(words[j])), &utf8);
+      }
+    }
+    bench.set_checksum(utf8.size());
+  }
+}
+
+void BenchCompressIndicesToUtf8(const MeshInput& input) {
+  size_t items = 0;
+  for (size_t i = 0; i < input.webgl_meshes.size(); ++i) {
+    for (size_t j = 0; j < input.webgl_meshes[i].size(); ++j) {
+      items += input.webgl_meshes[i][j].indices.size();
+    }
+  }
+  Benchmark bench("CompressIndicesToUtf8/" + input.name, items);
+  std::vector<char> utf8;
+  while (bench.KeepRunning()) {
+    utf8.clear();
+    for (size_t i = 0; i < input.webgl_meshes.size(); ++i) {
+      for (size_t j = 0; j < input.webgl_meshes[i].size(); ++j) {
+        CompressIndicesToUtf8(input.webgl_meshes[i][j].indices, &utf8);
+      }
+    }
+    bench.set_checksum(utf8.size());
+  }
+}
+
+void BenchSimpleHash(const MeshInput& input) {
+  std::vector<char> utf8(input.utf8);
+  Benchmark bench("SimpleHash/" + input.name, utf8.size());
+  while (bench.KeepRunning()) {
+    bench.set_checksum(SimpleHash(&utf8[0], utf8.size()));
+  }
+}
+
+void RunBenchmarks(const MeshInput& input) {
+  BenchParseLine(input);
+  BenchParseIndices(input);
+  BenchGetFlattenedIndex(input);
+  BenchFlattenIndicesBulk(input);
+  BenchAttribsToQuantizedAttribs(input);
+  BenchAddTriangles(input);
+  BenchUint16ToUtf8(input);
+  BenchCompressIndicesToUtf8(input);
+  BenchSimpleHash(input);
+}
+
+int main(int argc, const char* argv[]) {
+  std::vector<const char*> args = Benchmark::ParseFlags(argc, argv);
+  size_t grid_size = 256;
+  std::vector<const char*> obj_fns;
+  for (size_t i = 0; i < args.size(); ++i) {
+    if (0 == strncmp(args[i], "--grid=", 7)) {
+      grid_size = atoi(args[i] + 7);
+    } else if (0 == strncmp(args[i], "--threads=", 10)) {
+      if (!ParseThreads(args[i] + 10, &NumThreads())) {
+        fprintf(stderr, "ERROR: bad thread count: %s\n", args[i]);
+        return -1;
+      }
+    } else if (args[i][0] == '-') {
+      fprintf(stderr, "Usage: %s [--repetitions=N] [--filter=substring]\n"
+              "\t[--grid=N] [--threads=N] [in.obj ...]\n\n"
+              "Benchmarks each pipeline stage on a synthetic N x N grid\n"
+              "(default 256), and on each in.obj. Run from the directory\n"
+              "containing the .obj files so that mtllib can be found.\n",
+              argv[0]);
+      return -1;
+    } else {
+      obj_fns.push_back(args[i]);
+    }
+  }
+
+  Benchmark::PrintHeader();
+  {
+    char name[32];
+    snprintf(name, sizeof(name), "grid%zu", grid_size);
+    MeshInput input;
+    input.name = name;
+    FILE* fp = tmpfile();
+    CHECK(fp != NULL);
+    WriteGridObj(grid_size, 16, fp);
+    rewind(fp);
+    PrepareInput(fp, &input);
+    fclose(fp);
+    RunBenchmarks(input);
+  }
+  for (size_t i = 0; i < obj_fns.size(); ++i) {
+    MeshInput input;
+    input.name = StripLeadingDir(obj_fns[i]);
+    FILE* fp = fopen(obj_fns[i], "r");
+    if (!fp) {
+      fprintf(stderr, "ERROR: could not open %s\n", obj_fns[i]);
+      return -1;
+    }
+    PrepareInput(fp, &input);
+    fclose(fp);
+    RunBenchmarks(input);
+  }
+  return 0;
+}
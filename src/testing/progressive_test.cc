@@ -0,0 +1,150 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <vector>
+
+#include "../base.h"
+#include "../decode.h"
+#include "../mesh.h"
+#include "../progressive.h"
+
+static const int kGridSize = 24;
+
+// A quantized kGridSize x kGridSize grid with a bumpy height, so that
+// simplification has something to keep.
+void MakeGrid(int seed, WebGLMesh* mesh) {
+  const int n = kGridSize + 1;
+  for (int y = 0; y < n; ++y) {
+    for (int x = 0; x < n; ++x) {
+      const uint16 z = static_cast<uint16>((x * x * 7 + y * 13 + seed) % 37);
+      const uint16 attribs[8] = { static_cast<uint16>(x * 100),
+                                  static_cast<uint16>(y * 100), z,
+                                  static_cast<uint16>(x),
+                                  static_cast<uint16>(y), 0, 0, 511 };
+      mesh->attribs.insert(mesh->attribs.end(), attribs, attribs + 8);
+    }
+  }
+  for (int y = 0; y < kGridSize; ++y) {
+    for (int x = 0; x < kGridSize; ++x) {
+      const uint32 v[4] = { static_cast<uint32>(y * n + x),
+                            static_cast<uint32>(y * n + x + 1),
+                            static_cast<uint32>((y + 1) * n + x),
+                            static_cast<uint32>((y + 1) * n + x + 1) };
+      const int kQuad[] = { 0, 1, 2, 2, 1, 3 };
+      for (size_t i = 0; i < 6; ++i) mesh->indices.push_back(v[kQuad[i]]);
+    }
+  }
+}
+
+void TestMakeProgressiveMesh() {
+  WebGLMesh mesh;
+  MakeGrid(0, &mesh);
+  const size_t num_vertices = mesh.attribs.size() / 8;
+  const size_t num_triangles = mesh.indices.size() / 3;
+  // Two groups, of a third and two thirds of the rows.
+  GroupRunList runs(2);
+  runs[0].group_index = 0;
+  runs[0].length = mesh.indices.size() / 3;
+  runs[1].group_index = 1;
+  runs[1].length = mesh.indices.size() - runs[0].length;
+  ProgressiveLevelList levels;
+  MakeProgressiveMesh(2, 0.5f, &mesh, &levels, &runs);
+  CHECK(levels.size() == 3);
+  CHECK(mesh.attribs.size() == 8 * num_vertices);
+  CHECK(levels.back().indices == mesh.indices);
+  size_t num_known = 0;
+  for (size_t l = 0; l < levels.size(); ++l) {
+    num_known += levels[l].num_new_vertices;
+    for (size_t i = 0; i < levels[l].indices.size(); ++i) {
+      CHECK(levels[l].indices[i] < num_known);
+    }
+    if (l) {
+      CHECK(levels[l].indices.size() > levels[l - 1].indices.size());
+    }
+    CHECK(levels[l].run_lengths.size() == 2);
+    CHECK(levels[l].run_lengths[0] + levels[l].run_lengths[1] ==
+          levels[l].indices.size());
+  }
+  CHECK(levels.back().run_lengths[0] == runs[0].length);
+  CHECK(levels.back().run_lengths[1] == runs[1].length);
+  CHECK(num_known == num_vertices);
+  CHECK(levels[0].indices.size() / 3 <= num_triangles / 4);
+}
+
+void TestLevelIndices() {
+  OptimizedIndexList indices;
+  const uint32 kIndices[] = { 3, 0, 5, 5, 0, 1, 6, 7, 3, 2, 6, 8 };
+  indices.assign(kIndices, kIndices + sizeof(kIndices) / sizeof(uint32));
+  std::vector<char> utf8;
+  const size_t num_codes = CompressLevelIndicesToUtf8(indices, 5, &utf8);
+  std::vector<uint32> codes;
+  CHECK(Utf8ToCodes(&utf8[0], utf8.size(), &codes) == utf8.size());
+  CHECK(codes.size() == num_codes);
+  std::vector<uint32> decoded(indices.size());
+  CHECK(DecompressLevelIndices(&codes[0], indices.size(), 5, &decoded[0]) ==
+        num_codes);
+  for (size_t i = 0; i < indices.size(); ++i) {
+    CHECK(decoded[i] == indices[i]);
+  }
+}
+
+// Two meshes, fed to the decoder a few bytes at a time, draw something
+// well before the end and come out whole.
+void TestStream() {
+  WebGLMeshList meshes(2);
+  MakeGrid(0, &meshes[0]);
+  MakeGrid(5, &meshes[1]);
+  std::vector<ProgressiveLevelList> levels;
+  MakeProgressiveMeshes(2, 0.5f, &meshes, &levels);
+  std::vector<LevelRangeList> ranges;
+  std::vector<char> utf8;
+  const size_t num_codes =
+      CompressProgressiveMeshesToUtf8(meshes, levels, 0, &ranges, &utf8);
+  CHECK(ranges.size() == 2);
+  CHECK(ranges[0].size() == 3);
+  CHECK(ranges[1].back().index_start + ranges[1].back().index_codes ==
+        num_codes);
+
+  ProgressiveDecoder decoder(ranges);
+  std::vector<uint32> codes;
+  size_t received = 0;
+  size_t decoded = 0;
+  size_t first_triangle = 0;
+  while (received < utf8.size()) {
+    received = std::min(utf8.size(), received + 1 + received % 7);
+    decoded += Utf8ToCodes(&utf8[decoded], received - decoded, &codes);
+    decoder.Update(codes);
+    if (!first_triangle && decoder.num_triangles()) first_triangle = received;
+    CHECK(decoder.done() == (received == utf8.size()));
+  }
+  CHECK(codes.size() == num_codes);
+  CHECK(first_triangle && first_triangle < utf8.size() / 4);
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    const WebGLMesh& mesh = decoder.mesh(i);
+    CHECK(mesh.attribs == meshes[i].attribs);
+    CHECK(mesh.indices == meshes[i].indices);
+  }
+  CHECK(decoder.num_triangles() == 2 * 2 * kGridSize * kGridSize);
+}
+
+int main(int argc, char* argv[]) {
+  TestMakeProgressiveMesh();
+  TestLevelIndices();
+  TestStream();
+  return 0;
+}
@@ -0,0 +1,140 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "../base.h"
+#include "../mesh.h"
+#include "../quantize.h"
+
+void TestParse() {
+  QuantizeMode mode = kQuantizeTruncate;
+  CHECK(ParseQuantizeMode("round", &mode));
+  CHECK(mode == kQuantizeRound);
+  CHECK(ParseQuantizeMode("dither", &mode));
+  CHECK(mode == kQuantizeDither);
+  CHECK(ParseQuantizeMode("truncate", &mode));
+  CHECK(mode == kQuantizeTruncate);
+  CHECK(!ParseQuantizeMode("nearest", &mode));
+  CHECK(!ParseQuantizeMode("", &mode));
+}
+
+void TestBias() {
+  CHECK(Quantize(0.25f, 0, 1, 2) == 0);
+  CHECK(Quantize(0.25f, 0, 1, 2, 0.5f) == 1);
+  CHECK(Quantize(0.2f, 0, 1, 2, 0.5f) == 0);
+  // Rounding up past out_max is clamped.
+  CHECK(Quantize(1, 0, 1, 2, 0.5f) == 2);
+  float sum = 0;
+  for (uint32 i = 0; i < 10000; ++i) {
+    const float threshold = DitherThreshold(i);
+    CHECK(threshold >= 0 && threshold < 1);
+    sum += threshold;
+  }
+  CHECK(fabsf(sum / 10000 - 0.5f) < 0.01f);
+}
+
+// A grid of 2 groups with random texcoords, in [0, 1].
+void MakeGrid(FILE* fp) {
+  const int kSize = 40;
+  srand(3);
+  for (int y = 0; y < kSize; ++y) {
+    for (int x = 0; x < kSize; ++x) {
+      fprintf(fp, "v %d %d 0\nvt %f %f\n", x, y,
+              rand() / (RAND_MAX + 1.0), rand() / (RAND_MAX + 1.0));
+    }
+  }
+  for (int y = 0; y + 1 < kSize; ++y) {
+    if (y == 0) fputs("g bottom\n", fp);
+    if (y == kSize / 2) fputs("g top\n", fp);
+    for (int x = 0; x + 1 < kSize; ++x) {
+      const int a = 1 + y * kSize + x;
+      const int b = a + 1;
+      const int c = a + kSize + 1;
+      const int d = a + kSize;
+      fprintf(fp, "f %d/%d %d/%d %d/%d %d/%d\n", a, a, b, b, c, c, d, d);
+    }
+  }
+}
+
+void TestModes() {
+  FILE* fp = tmpfile();
+  MakeGrid(fp);
+  rewind(fp);
+  const WavefrontObjFile obj(fp);
+  fclose(fp);
+  const DrawBatch& batch = obj.material_batches().find("")->second;
+  const DrawMesh& mesh = batch.draw_mesh();
+  CHECK(batch.group_starts().size() == 2);
+  Bounds bounds;
+  bounds.Clear();
+  bounds.Enclose(mesh.attribs, mesh.layout.stride());
+  const QuantizeMode kModes[] = {
+    kQuantizeTruncate, kQuantizeRound, kQuantizeDither
+  };
+  for (size_t m = 0; m < 3; ++m) {
+    BoundsParams params = BoundsParams::FromBounds(bounds, mesh.layout);
+    params.mode = kModes[m];
+    QuantizedAttribList quantized;
+    AttribsToQuantizedAttribs(mesh.attribs, params, &quantized);
+    QuantizedAttribList again;
+    AttribsToQuantizedAttribs(mesh.attribs, params, &again);
+    CHECK(quantized == again);
+    QuantizeErrorReport report(mesh.layout);
+    report.Add("", mesh, params, quantized, batch.group_starts(), obj);
+    report.Print();
+    // Every column is within half a step of the decoded grid.
+    for (size_t i = 0; i < mesh.layout.stride(); ++i) {
+      if (kModes[m] == kQuantizeRound) {
+        CHECK(report.column(i).max_steps < 0.501);
+      }
+    }
+    const size_t texcoord = mesh.layout.offset(kTexcoordAttrib);
+    for (size_t i = texcoord; i < texcoord + 2; ++i) {
+      const ColumnError& column = report.column(i);
+      CHECK(column.count == 40 * 40);
+      // No texcoord is clamped.
+      CHECK(column.bins[0] == 0);
+      CHECK(column.bins[ColumnError::kNumBins - 1] == 0);
+      switch (kModes[m]) {
+        case kQuantizeTruncate:
+          CHECK(column.max_steps < 1.001);
+          CHECK(column.bias() < -0.4 && column.bias() > -0.6);
+          break;
+        case kQuantizeRound:
+          CHECK(column.max_steps < 0.501);
+          CHECK(fabs(column.bias()) < 0.05);
+          break;
+        case kQuantizeDither:
+          CHECK(column.max_steps < 1.001);
+          CHECK(fabs(column.bias()) < 0.05);
+          CHECK(column.mean() > 0.25);
+          break;
+      }
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  TestParse();
+  TestBias();
+  TestModes();
+  return 0;
+}
@@ -0,0 +1,196 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../base.h"
+#include "../mesh.h"
+#include "../morton.h"
+#include "../parallel.h"
+#include "../reorder.h"
+
+// A random mesh whose vertices are in first-use order.
+void MakeMesh(size_t num_vertices, WebGLMesh* mesh) {
+  srand(4321);
+  for (size_t i = 0; i < 8 * num_vertices; ++i) {
+    mesh->attribs.push_back(rand() % 16384);
+  }
+  uint32 next = 0;
+  while (next < num_vertices) {
+    for (size_t j = 0; j < 3; ++j) {
+      const bool reuse = next > 0 && (next == num_vertices || rand() % 2);
+      mesh->indices.push_back(reuse ? next - 1 - rand() % std::min(next, 20u)
+                                    : next++);
+    }
+  }
+}
+
+// Corner attributes, in triangle order.
+void Corners(const WebGLMesh& mesh, std::vector<uint16>* corners) {
+  for (size_t i = 0; i < mesh.indices.size(); ++i) {
+    const uint16* attribs = &mesh.attribs[8 * mesh.indices[i]];
+    corners->insert(corners->end(), attribs, attribs + 8);
+  }
+}
+
+void TestReorderInWindows() {
+  const size_t kWindows[] = { 1, 7, 32, 1000 };
+  for (size_t w = 0; w < sizeof(kWindows) / sizeof(kWindows[0]); ++w) {
+    WebGLMesh mesh;
+    MakeMesh(500, &mesh);
+    std::vector<uint16> before;
+    Corners(mesh, &before);
+    const OptimizedIndexList first_use = mesh.indices;
+    ReorderVerticesInWindows(kWindows[w], &mesh);
+    std::vector<uint16> after;
+    Corners(mesh, &after);
+    CHECK(before == after);
+    // Vertices only move within their window.
+    for (size_t i = 0; i < first_use.size(); ++i) {
+      CHECK(first_use[i] / kWindows[w] == mesh.indices[i] / kWindows[w]);
+    }
+  }
+}
+
+void TestMortonCode() {
+  srand(99);
+  for (size_t i = 0; i < 1000; ++i) {
+    const uint32 x = rand() % (1 << 21);
+    const uint32 y = rand() % (1 << 21);
+    const uint32 z = rand() % (1 << 21);
+    uint64 expected = 0;
+    for (size_t b = 0; b < 21; ++b) {
+      expected |= static_cast<uint64>((x >> b) & 1) << (3 * b + 2);
+      expected |= static_cast<uint64>((y >> b) & 1) << (3 * b + 1);
+      expected |= static_cast<uint64>((z >> b) & 1) << (3 * b);
+    }
+    CHECK(MortonCode3(x, y, z) == expected);
+  }
+}
+
+bool LessKey(const std::pair<uint64, uint32>& a,
+             const std::pair<uint64, uint32>& b) {
+  return a.first < b.first;
+}
+
+// Stable, on any number of threads and chunks.
+void TestRadixSort() {
+  const size_t kSizes[] = { 0, 1, 1000, 200000 };
+  const size_t kThreads[] = { 1, 3 };
+  srand(5);
+  for (size_t s = 0; s < sizeof(kSizes) / sizeof(kSizes[0]); ++s) {
+    for (size_t t = 0; t < sizeof(kThreads) / sizeof(kThreads[0]); ++t) {
+      NumThreads() = kThreads[t];
+      std::vector<uint64> keys;
+      std::vector<uint32> values;
+      std::vector<std::pair<uint64, uint32> > expected;
+      for (size_t i = 0; i < kSizes[s]; ++i) {
+        // Few distinct keys, so there are plenty of ties.
+        const uint64 key = static_cast<uint64>(rand() % 1000) << 30;
+        keys.push_back(key);
+        values.push_back(i);
+        expected.push_back(std::make_pair(key, i));
+      }
+      std::stable_sort(expected.begin(), expected.end(), LessKey);
+      RadixSort(kPositionMortonBits, &keys, &values);
+      for (size_t i = 0; i < expected.size(); ++i) {
+        CHECK(keys[i] == expected[i].first);
+        CHECK(values[i] == expected[i].second);
+      }
+    }
+  }
+}
+
+void TestReorderMorton() {
+  const size_t kWindows[] = { 0, 1, 32, 1000 };
+  for (size_t w = 0; w < sizeof(kWindows) / sizeof(kWindows[0]); ++w) {
+    WebGLMesh mesh;
+    MakeMesh(500, &mesh);
+    std::vector<uint16> before;
+    Corners(mesh, &before);
+    const OptimizedIndexList first_use = mesh.indices;
+    ReorderVerticesMorton(kWindows[w], &mesh);
+    std::vector<uint16> after;
+    Corners(mesh, &after);
+    CHECK(before == after);
+    const size_t window = kWindows[w] ? kWindows[w] : 500;
+    for (size_t i = 0; i < first_use.size(); ++i) {
+      CHECK(first_use[i] / window == mesh.indices[i] / window);
+    }
+    // Within a window, vertices are in Morton order.
+    for (size_t v = 1; v < 500; ++v) {
+      if (v % window == 0) continue;
+      const uint16* a = &mesh.attribs[8 * (v - 1)];
+      const uint16* b = &mesh.attribs[8 * v];
+      CHECK(MortonCode3(a[0], a[1], a[2]) <= MortonCode3(b[0], b[1], b[2]));
+    }
+  }
+}
+
+void TestParseAttribOrder() {
+  AttribOrder order;
+  size_t window;
+  CHECK(ParseAttribOrder("first-use", &order, &window));
+  CHECK(order == kAttribOrderFirstUse);
+  CHECK(ParseAttribOrder("spatial", &order, &window));
+  CHECK(order == kAttribOrderSpatial && window == kDefaultVertexWindow);
+  CHECK(ParseAttribOrder("morton:64", &order, &window));
+  CHECK(order == kAttribOrderMorton && window == 64);
+  CHECK(ParseAttribOrder("morton", &order, &window));
+  CHECK(order == kAttribOrderMorton && window == 0);
+  CHECK(!ParseAttribOrder("morton:0", &order, &window));
+  CHECK(!ParseAttribOrder("morton:-8", &order, &window));
+  CHECK(!ParseAttribOrder("spatial:", &order, &window));
+  CHECK(!ParseAttribOrder("spatial:32x", &order, &window));
+  CHECK(!ParseAttribOrder("mortonx", &order, &window));
+  CHECK(!ParseAttribOrder("hilbert", &order, &window));
+}
+
+// Mirrors decompressZigZagIndices_ in samples/loader.js, for codes
+// that all fit in one character.
+void TestZigZagIndices() {
+  WebGLMesh mesh;
+  MakeMesh(500, &mesh);
+  ReorderVerticesInWindows(16, &mesh);
+  std::vector<char> utf8;
+  const size_t num_codes = CompressIndicesToUtf8ZigZag(mesh.indices, &utf8);
+  CHECK(num_codes == mesh.indices.size());
+  CHECK(utf8.size() == num_codes);  // Small codes are single bytes.
+  uint32 next = 0;
+  for (size_t i = 0; i < utf8.size(); ++i) {
+    const uint32 code = utf8[i];
+    const int32 delta = (code & 1) ? -static_cast<int32>((code + 1) / 2)
+                                   : static_cast<int32>(code / 2);
+    const uint32 index = next - delta;
+    CHECK(index == mesh.indices[i]);
+    if (index >= next) next = index + 1;
+  }
+}
+
+int main(int argc, char* argv[]) {
+  TestReorderInWindows();
+  TestZigZagIndices();
+  TestMortonCode();
+  TestRadixSort();
+  TestReorderMorton();
+  TestParseAttribOrder();
+  return 0;
+}
@@ -0,0 +1,179 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+
+#include <set>
+#include <vector>
+
+#include "../base.h"
+#include "../mesh.h"
+#include "../simplify.h"
+
+static const int kGridSize = 32;
+static const int kSeam = kGridSize / 2;
+
+// A flat kGridSize x kGridSize grid facing +z. Positions in column
+// kSeam have a second vertex, with other texcoords, for the triangles
+// right of it, as the flattener would make for a texture seam. The
+// left and right halves are separate groups.
+void MakeGrid(DrawMesh* mesh, std::vector<int>* position_indices,
+              std::vector<GroupStart>* group_starts) {
+  const int n = kGridSize + 1;
+  std::vector<int> right(n * n);
+  for (int y = 0; y < n; ++y) {
+    for (int x = 0; x < n; ++x) {
+      const int copies = (x == kSeam) ? 2 : 1;
+      for (int c = 0; c < copies; ++c) {
+        right[y * n + x] = mesh->attribs.size() / 8;
+        const float attribs[8] = { static_cast<float>(x),
+                                   static_cast<float>(y), 0,
+                                   static_cast<float>(c), 0, 0, 0, 1 };
+        mesh->attribs.insert(mesh->attribs.end(), attribs, attribs + 8);
+        position_indices->push_back(y * n + x);
+      }
+    }
+  }
+  for (int half = 0; half < 2; ++half) {
+    GroupStart group_start;
+    group_start.offset = mesh->indices.size();
+    group_start.group_line = half;
+    group_starts->push_back(group_start);
+    for (int y = 0; y < kGridSize; ++y) {
+      for (int x = half * kSeam; x < (half + 1) * kSeam; ++x) {
+        // The right vertex at the seam is the second one, which
+        // right[] holds; the left one comes just before it.
+        int v[4] = { right[y * n + x], right[y * n + x + 1],
+                     right[(y + 1) * n + x], right[(y + 1) * n + x + 1] };
+        if (x + 1 == kSeam) {
+          --v[1];
+          --v[3];
+        }
+        const int kQuad[] = { 0, 1, 2, 2, 1, 3 };
+        for (size_t i = 0; i < 6; ++i) mesh->indices.push_back(v[kQuad[i]]);
+      }
+    }
+  }
+}
+
+// Signed area, in z, of triangle t.
+float Area(const DrawMesh& mesh, size_t t) {
+  const float* p[3];
+  for (size_t j = 0; j < 3; ++j) {
+    p[j] = &mesh.attribs[8 * mesh.indices[3 * t + j]];
+  }
+  return 0.5f * ((p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) -
+                 (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]));
+}
+
+void TestSimplifyGrid() {
+  DrawMesh mesh;
+  std::vector<int> position_indices;
+  std::vector<GroupStart> group_starts;
+  MakeGrid(&mesh, &position_indices, &group_starts);
+  MeshSimplifier simplifier(mesh, position_indices);
+  CHECK(simplifier.num_triangles() == 2 * kGridSize * kGridSize);
+  simplifier.Simplify(200);
+  CHECK(simplifier.num_triangles() <= 200);
+  DrawMesh level;
+  std::vector<GroupStart> level_group_starts;
+  simplifier.GetLevel(group_starts, &level, &level_group_starts);
+  CHECK(level.indices.size() == 3 * simplifier.num_triangles());
+
+  // No triangle flips, and none of the area goes missing: the corners,
+  // borders and seam stay put.
+  float area = 0;
+  for (size_t t = 0; t < level.indices.size() / 3; ++t) {
+    CHECK(Area(level, t) > 0);
+    area += Area(level, t);
+  }
+  CHECK(fabs(area - kGridSize * kGridSize) < 1e-3);
+
+  // Every seam vertex survives, with its own texcoords on each side.
+  std::set<std::pair<float, float> > seam;
+  for (size_t i = 0; i < level.attribs.size(); i += 8) {
+    if (level.attribs[i] == kSeam) {
+      seam.insert(std::make_pair(level.attribs[i + 1], level.attribs[i + 3]));
+    }
+  }
+  CHECK(seam.size() == 2 * (kGridSize + 1));
+
+  // Triangles stay in their groups, and group bounds hold them.
+  CHECK(level_group_starts.size() == 2);
+  CHECK(level_group_starts[0].offset == 0);
+  for (size_t g = 0; g < 2; ++g) {
+    const GroupStart& group_start = level_group_starts[g];
+    CHECK(group_start.group_line == g);
+    const size_t end = g ? level.indices.size() : level_group_starts[1].offset;
+    for (size_t i = group_start.offset; i < end; ++i) {
+      const int index = level.indices[i];
+      CHECK(group_start.min_index <= index && index <= group_start.max_index);
+      const float x = level.attribs[8 * index];
+      CHECK(group_start.bounds.mins[0] <= x &&
+            x <= group_start.bounds.maxes[0]);
+      CHECK(g ? x >= kSeam : x <= kSeam);
+    }
+  }
+}
+
+// Further levels continue from the last, down to where only the seam
+// holds triangles up: one on each side of each of its edges.
+void TestSimplifyAgain() {
+  DrawMesh mesh;
+  std::vector<int> position_indices;
+  std::vector<GroupStart> group_starts;
+  MakeGrid(&mesh, &position_indices, &group_starts);
+  MeshSimplifier simplifier(mesh, position_indices);
+  size_t last = simplifier.num_triangles();
+  for (size_t target = 1024; target > 0; target /= 4) {
+    simplifier.Simplify(target);
+    CHECK(simplifier.num_triangles() <= last);
+    last = simplifier.num_triangles();
+  }
+  CHECK(last == 2 * kGridSize);
+  DrawMesh level;
+  std::vector<GroupStart> level_group_starts;
+  simplifier.GetLevel(group_starts, &level, &level_group_starts);
+  for (size_t t = 0; t < level.indices.size() / 3; ++t) {
+    CHECK(Area(level, t) > 0);
+  }
+}
+
+void TestParseLods() {
+  size_t num_lods = 0;
+  float ratio = 0.5f;
+  CHECK(ParseLods("3", &num_lods, &ratio));
+  CHECK(num_lods == 3 && ratio == 0.5f);
+  CHECK(ParseLods("8:0.25", &num_lods, &ratio));
+  CHECK(num_lods == 8 && ratio == 0.25f);
+  const char* const kBad[] = {
+    "", "0", "-1", "9", "99999999999999999999", "3x", "3:", "3:0", "3:1",
+    "3:x", "3:0.5x"
+  };
+  for (size_t i = 0; i < sizeof(kBad) / sizeof(kBad[0]); ++i) {
+    CHECK(!ParseLods(kBad[i], &num_lods, &ratio));
+  }
+  CHECK(num_lods == 8 && ratio == 0.25f);
+}
+
+int main(int argc, char* argv[]) {
+  TestParseLods();
+  TestSimplifyGrid();
+  TestSimplifyAgain();
+  return 0;
+}
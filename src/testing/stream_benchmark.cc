@@ -0,0 +1,237 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+#include "../base.h"
+#include "../decode.h"
+#include "../mesh.h"
+#include "../optimize.h"
+#include "../partition.h"
+#include "../progressive.h"
+#include "../stats.h"
+
+// Streams a model through the C++ decoder as if it were arriving over
+// the network, in the plain layout and the progressive one, and
+// reports how soon something can be drawn.
+
+// Every batch of a model, one after another in a single stream, with
+// the ranges of each mesh. Plain meshes have a single range.
+struct Layout {
+  bool progressive;
+  std::vector<char> utf8;
+  std::vector<LevelRangeList> ranges;
+  size_t num_triangles;
+};
+
+void MakeLayouts(const WavefrontObjFile& obj, size_t num_lods, float ratio,
+                 Layout* plain, Layout* progressive) {
+  const MaterialBatches& batches = obj.material_batches();
+  Bounds bounds;
+  bounds.Clear();
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    const DrawMesh& mesh = iter->second.draw_mesh();
+    bounds.Enclose(mesh.attribs, mesh.layout.stride());
+  }
+  const BoundsParams bounds_params = BoundsParams::FromBounds(bounds);
+  plain->progressive = false;
+  plain->num_triangles = 0;
+  progressive->progressive = true;
+  progressive->num_triangles = 0;
+  size_t plain_offset = 0;
+  size_t progressive_offset = 0;
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    if (iter->second.draw_mesh().indices.empty()) continue;
+    QuantizedAttribList quantized_attribs;
+    AttribsToQuantizedAttribs(iter->second.draw_mesh().attribs, bounds_params,
+                              &quantized_attribs);
+    WebGLMeshList meshes;
+    std::vector<GroupRunList> group_runs;
+    OptimizeBatch(iter->second, quantized_attribs, kSplitSequential,
+                  VertexOptimizer::kMaxOutputIndex, &meshes, &group_runs);
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      LevelRange range;
+      range.attrib_start = plain_offset;
+      const size_t stride = meshes[i].layout.stride();
+      range.num_new_vertices = meshes[i].attribs.size() / stride;
+      CompressQuantizedAttribsToUtf8(meshes[i].attribs, stride, &plain->utf8);
+      range.index_start = plain_offset + meshes[i].attribs.size();
+      range.num_triangles = meshes[i].indices.size() / 3;
+      range.index_codes = meshes[i].indices.size();
+      CompressIndicesToUtf8(meshes[i].indices, &plain->utf8);
+      plain_offset = range.index_start + range.index_codes;
+      plain->ranges.push_back(LevelRangeList(1, range));
+      plain->num_triangles += range.num_triangles;
+    }
+    std::vector<ProgressiveLevelList> levels;
+    MakeProgressiveMeshes(num_lods, ratio, &meshes, &levels);
+    std::vector<LevelRangeList> ranges;
+    progressive_offset = CompressProgressiveMeshesToUtf8(
+        meshes, levels, progressive_offset, &ranges, &progressive->utf8);
+    progressive->ranges.insert(progressive->ranges.end(), ranges.begin(),
+                               ranges.end());
+    for (size_t i = 0; i < meshes.size(); ++i) {
+      progressive->num_triangles += meshes[i].indices.size() / 3;
+    }
+  }
+}
+
+// Decodes the plain meshes that have arrived, in order.
+class PlainDecoder {
+ public:
+  explicit PlainDecoder(const std::vector<LevelRangeList>& ranges)
+      : ranges_(ranges),
+        next_(0),
+        num_triangles_(0) {
+  }
+
+  void Update(const std::vector<uint32>& codes) {
+    while (next_ < ranges_.size()) {
+      const LevelRange& range = ranges_[next_][0];
+      if (codes.size() < range.index_start + range.index_codes) return;
+      WebGLMesh mesh;
+      const size_t stride = mesh.layout.stride();
+      mesh.attribs.resize(stride * range.num_new_vertices);
+      mesh.indices.resize(3 * range.num_triangles);
+      DecompressAttribs(&codes[range.attrib_start], range.num_new_vertices,
+                        stride, &mesh.attribs[0]);
+      DecompressIndices(&codes[range.index_start], mesh.indices.size(),
+                        &mesh.indices[0]);
+      num_triangles_ += range.num_triangles;
+      ++next_;
+    }
+  }
+
+  size_t num_triangles() const { return num_triangles_; }
+
+ private:
+  const std::vector<LevelRangeList>& ranges_;
+  size_t next_;
+  size_t num_triangles_;
+};
+
+// Feeds the stream in chunks, and prints when the first triangle could
+// be drawn, in bytes and in milliseconds of network plus decoding, and
+// what fraction of the full triangle count is drawable after each
+// fraction of the bytes.
+template <typename DecoderT>
+void StreamLayout(const char* name, const Layout& layout, size_t chunk_size,
+                  double bytes_per_second) {
+  static const double kFractions[] = { 0.1, 0.25, 0.5, 0.75, 1.0 };
+  static const size_t kNumFractions = sizeof(kFractions) / sizeof(double);
+  DecoderT decoder(layout.ranges);
+  std::vector<uint32> codes;
+  const size_t total = layout.utf8.size();
+  size_t received = 0;
+  size_t decoded = 0;
+  double decode_seconds = 0;
+  size_t first_bytes = 0;
+  double first_ms = 0;
+  size_t fraction = 0;
+  double drawable[kNumFractions];
+  while (received < total) {
+    received = std::min(total, received + chunk_size);
+    const double start = Stats::Now();
+    decoded += Utf8ToCodes(&layout.utf8[decoded], received - decoded, &codes);
+    decoder.Update(codes);
+    decode_seconds += Stats::Now() - start;
+    if (!first_bytes && decoder.num_triangles()) {
+      first_bytes = received;
+      first_ms = 1e3 * (received / bytes_per_second + decode_seconds);
+    }
+    while (fraction < kNumFractions &&
+           received >= kFractions[fraction] * total) {
+      drawable[fraction++] =
+          100.0 * decoder.num_triangles() / layout.num_triangles;
+    }
+  }
+  CHECK(decoder.num_triangles() == layout.num_triangles);
+  printf("%-32s %10zu %10zu %10.1f %10.1f", name, total, first_bytes,
+         first_ms, 1e3 * decode_seconds);
+  for (size_t i = 0; i < kNumFractions; ++i) {
+    printf(" %6.1f", drawable[i]);
+  }
+  printf("\n");
+}
+
+int main(int argc, const char* argv[]) {
+  size_t num_lods = 3;
+  float lod_ratio = 0.5f;
+  size_t chunk_size = 16384;
+  double bytes_per_second = 1e6;
+  std::vector<const char*> obj_fns;
+  for (int i = 1; i < argc; ++i) {
+    if (0 == strncmp(argv[i], "--lods=", 7)) {
+      if (!ParseLods(argv[i] + 7, &num_lods, &lod_ratio)) {
+        obj_fns.clear();
+        break;
+      }
+    } else if (0 == strncmp(argv[i], "--chunk=", 8)) {
+      chunk_size = atoi(argv[i] + 8);
+    } else if (0 == strncmp(argv[i], "--bandwidth=", 12)) {
+      bytes_per_second = atof(argv[i] + 12);
+    } else if (argv[i][0] == '-' || !num_lods || !chunk_size ||
+               bytes_per_second <= 0) {
+      obj_fns.clear();
+      break;
+    } else {
+      obj_fns.push_back(argv[i]);
+    }
+  }
+  if (obj_fns.empty()) {
+    fprintf(stderr, "Usage: %s [--lods=N[:R]] [--chunk=BYTES]\n"
+            "\t[--bandwidth=BYTES_PER_SECOND] in.obj ...\n\n"
+            "Streams each in.obj through the decoder in chunks (default\n"
+            "16384 bytes) at a simulated bandwidth (default 1e6), in the\n"
+            "plain layout and the progressive one with N levels of detail\n"
+            "(default 3:0.5). Reports bytes and milliseconds to the first\n"
+            "triangle, total decode time, and the percentage of triangles\n"
+            "drawable after 10%%, 25%%, 50%%, 75%% and 100%% of the bytes.\n"
+            "Run from the directory containing the .obj files so that\n"
+            "mtllib can be found.\n",
+            argv[0]);
+    return -1;
+  }
+  printf("%-32s %10s %10s %10s %10s %6s %6s %6s %6s %6s\n", "layout",
+         "bytes", "first_tri", "first_ms", "decode_ms", "@10%", "@25%",
+         "@50%", "@75%", "@100%");
+  for (size_t i = 0; i < obj_fns.size(); ++i) {
+    FILE* fp = fopen(obj_fns[i], "r");
+    if (!fp) {
+      fprintf(stderr, "ERROR: could not open %s\n", obj_fns[i]);
+      return -1;
+    }
+    WavefrontObjFile obj(fp);
+    fclose(fp);
+    Layout plain, progressive;
+    MakeLayouts(obj, num_lods, lod_ratio, &plain, &progressive);
+    const std::string name = StripLeadingDir(obj_fns[i]);
+    StreamLayout<PlainDecoder>((name + "/plain").c_str(), plain, chunk_size,
+                               bytes_per_second);
+    StreamLayout<ProgressiveDecoder>((name + "/progressive").c_str(),
+                                     progressive, chunk_size,
+                                     bytes_per_second);
+  }
+  return 0;
+}
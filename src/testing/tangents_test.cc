@@ -0,0 +1,220 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../base.h"
+#include "../decode.h"
+#include "../mesh.h"
+#include "../parallel.h"
+#include "../partition.h"
+#include "../tangents.h"
+
+float Dot(const float* a, const float* b) {
+  return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+void TestLayout() {
+  const VertexLayout standard;
+  CHECK(standard.stride() == 8);
+  CHECK(standard.offset(kTexcoordAttrib) == 3);
+  CHECK(standard.offset(kNormalAttrib) == 5);
+  CHECK(!standard.has(kTangentAttrib));
+  const VertexLayout with_tangents = standard.With(kTangentAttrib);
+  CHECK(with_tangents.stride() == 8 + kTangentColumns);
+  CHECK(with_tangents.offset(kNormalAttrib) == 5);
+  CHECK(with_tangents.offset(kTangentAttrib) == 8);
+  CHECK(with_tangents.With(kTangentAttrib) == with_tangents);
+  const VertexLayout positions(1 << kPositionAttrib);
+  CHECK(positions.stride() == 3);
+  CHECK(!positions.has(kNormalAttrib));
+  CHECK(positions.With(kTexcoordAttrib).With(kNormalAttrib) == standard);
+}
+
+void TestBasis() {
+  srand(7);
+  for (size_t i = 0; i < 1000; ++i) {
+    float n[3];
+    for (size_t k = 0; k < 3; ++k) {
+      // Some normals on the axes and in the z = 0 plane.
+      n[k] = (i % 5 == 0 && k == i % 3) ? 1.0f :
+          (i % 7 == 0 && k == 2) ? 0.0f : rand() % 2001 - 1000.0f;
+    }
+    const float length = sqrtf(Dot(n, n));
+    if (length == 0) continue;
+    for (size_t k = 0; k < 3; ++k) n[k] /= length;
+    float b1[3], b2[3];
+    TangentBasis(n, b1, b2);
+    CHECK(fabsf(Dot(b1, b1) - 1) < 1e-5f);
+    CHECK(fabsf(Dot(b2, b2) - 1) < 1e-5f);
+    CHECK(fabsf(Dot(b1, b2)) < 1e-5f);
+    CHECK(fabsf(Dot(b1, n)) < 1e-5f);
+    CHECK(fabsf(Dot(b2, n)) < 1e-5f);
+    // Right handed: b1 x b2 = n.
+    CHECK(fabsf(b1[1] * b2[2] - b1[2] * b2[1] - n[0]) < 1e-5f);
+    CHECK(fabsf(b1[2] * b2[0] - b1[0] * b2[2] - n[1]) < 1e-5f);
+  }
+}
+
+// A grid of quads in a tilted plane, with texcoords along two of its
+// directions, u mirrored if flip.
+void MakeGrid(bool flip, DrawMesh* mesh, float* du, float* normal) {
+  const float kDu[3] = { 0.6f, 0.0f, 0.8f };
+  const float kDv[3] = { 0.0f, 1.0f, 0.0f };
+  // kDu x kDv, for counterclockwise faces.
+  const float kNormal[3] = { -0.8f, 0.0f, 0.6f };
+  const size_t kSize = 4;
+  for (size_t y = 0; y <= kSize; ++y) {
+    for (size_t x = 0; x <= kSize; ++x) {
+      for (size_t k = 0; k < 3; ++k) {
+        mesh->attribs.push_back(x * kDu[k] + y * kDv[k]);
+      }
+      mesh->attribs.push_back((flip ? kSize - x : x) / float(kSize));
+      mesh->attribs.push_back(y / float(kSize));
+      mesh->attribs.insert(mesh->attribs.end(), kNormal, kNormal + 3);
+    }
+  }
+  for (size_t y = 0; y < kSize; ++y) {
+    for (size_t x = 0; x < kSize; ++x) {
+      const int v = y * (kSize + 1) + x;
+      const int kQuad[] = { v, v + 1, v + int(kSize) + 2,
+                            v, v + int(kSize) + 2, v + int(kSize) + 1 };
+      mesh->indices.insert(mesh->indices.end(), kQuad, kQuad + 6);
+    }
+  }
+  for (size_t k = 0; k < 3; ++k) {
+    du[k] = flip ? -kDu[k] : kDu[k];
+    normal[k] = kNormal[k];
+  }
+}
+
+// The tangents come out along increasing u, with the handedness of
+// the texture mapping, after quantization as a client decodes them.
+void TestGrid() {
+  for (size_t flip = 0; flip < 2; ++flip) {
+    DrawMesh mesh;
+    float du[3], normal[3];
+    MakeGrid(flip, &mesh, du, normal);
+    AttribList tangents;
+    TangentGenerator(mesh).Generate(&tangents);
+    DrawMesh with_tangents;
+    AddTangentColumns(mesh, tangents, &with_tangents);
+    const VertexLayout& layout = with_tangents.layout;
+    CHECK(layout.stride() == 8 + kTangentColumns);
+    CHECK(with_tangents.indices == mesh.indices);
+    Bounds bounds;
+    bounds.Clear();
+    bounds.Enclose(with_tangents.attribs, layout.stride());
+    QuantizedAttribList quantized;
+    AttribsToQuantizedAttribs(with_tangents.attribs,
+                              BoundsParams::FromBounds(bounds, layout),
+                              &quantized);
+    for (size_t v = 0; v < mesh.attribs.size() / 8; ++v) {
+      // The other columns are untouched.
+      CHECK(std::equal(&mesh.attribs[8 * v], &mesh.attribs[8 * v] + 8,
+                       &with_tangents.attribs[layout.stride() * v]));
+      const uint16* columns =
+          &quantized[layout.stride() * v + layout.offset(kTangentAttrib)];
+      const float angle = kTangentDecodeScales[0] *
+          (columns[0] + kTangentDecodeOffsets[0]);
+      const float handedness = kTangentDecodeScales[1] *
+          (columns[1] + kTangentDecodeOffsets[1]);
+      CHECK(handedness == (flip ? -1 : 1));
+      float decoded_normal[3], b1[3], b2[3], tangent[3];
+      DecodedNormal(normal, decoded_normal);
+      TangentBasis(decoded_normal, b1, b2);
+      for (size_t k = 0; k < 3; ++k) {
+        tangent[k] = cosf(angle) * b1[k] + sinf(angle) * b2[k];
+      }
+      // Within half a degree, and a bit for the quantized normal.
+      CHECK(Dot(tangent, du) > cosf(1.0f * M_PI / 180));
+    }
+  }
+}
+
+// Batches come out the same however many threads make them, and
+// tangent columns round trip through the compressed stream.
+void TestBatches() {
+  std::vector<DrawMesh> meshes(5);
+  std::vector<const DrawMesh*> mesh_pointers;
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    float du[3], normal[3];
+    MakeGrid(i % 2, &meshes[i], du, normal);
+    mesh_pointers.push_back(&meshes[i]);
+  }
+  std::vector<DrawMesh> with_tangents[2];
+  NumThreads() = 1;
+  GenerateTangents(mesh_pointers, &with_tangents[0]);
+  NumThreads() = 3;
+  GenerateTangents(mesh_pointers, &with_tangents[1]);
+  for (size_t i = 0; i < meshes.size(); ++i) {
+    CHECK(with_tangents[0][i].attribs == with_tangents[1][i].attribs);
+  }
+
+  // Through the stages that move whole vertices.
+  const DrawMesh& mesh = with_tangents[0][1];
+  const size_t stride = mesh.layout.stride();
+  Bounds bounds;
+  bounds.Clear();
+  bounds.Enclose(mesh.attribs, stride);
+  QuantizedAttribList quantized;
+  AttribsToQuantizedAttribs(mesh.attribs,
+                            BoundsParams::FromBounds(bounds, mesh.layout),
+                            &quantized);
+  std::vector<GroupStart> group_starts(1);
+  group_starts[0].offset = 0;
+  WebGLMeshList webgl_meshes;
+  std::vector<GroupRunList> group_runs;
+  OptimizeBatch(mesh, group_starts, quantized, kSplitSequential,
+                VertexOptimizer::kMaxOutputIndex, &webgl_meshes, &group_runs);
+  CHECK(webgl_meshes.size() == 1);
+  const WebGLMesh& webgl_mesh = webgl_meshes[0];
+  CHECK(webgl_mesh.layout == mesh.layout);
+  // The same vertices, in another order.
+  std::vector<std::vector<uint16> > vertices[2];
+  for (size_t v = 0; v < quantized.size(); v += stride) {
+    vertices[0].push_back(std::vector<uint16>(&quantized[v],
+                                              &quantized[v] + stride));
+  }
+  for (size_t v = 0; v < webgl_mesh.attribs.size(); v += stride) {
+    vertices[1].push_back(std::vector<uint16>(&webgl_mesh.attribs[v],
+                                              &webgl_mesh.attribs[v] + stride));
+  }
+  std::sort(vertices[0].begin(), vertices[0].end());
+  std::sort(vertices[1].begin(), vertices[1].end());
+  CHECK(vertices[0] == vertices[1]);
+  std::vector<char> utf8;
+  CompressQuantizedAttribsToUtf8(webgl_mesh.attribs, stride, &utf8);
+  std::vector<uint32> codes;
+  CHECK(Utf8ToCodes(&utf8[0], utf8.size(), &codes) == utf8.size());
+  QuantizedAttribList decoded(webgl_mesh.attribs.size());
+  DecompressAttribs(&codes[0], decoded.size() / stride, stride, &decoded[0]);
+  CHECK(decoded == webgl_mesh.attribs);
+}
+
+int main(int argc, char* argv[]) {
+  TestLayout();
+  TestBasis();
+  TestGrid();
+  TestBatches();
+  return 0;
+}
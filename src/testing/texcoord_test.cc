@@ -0,0 +1,209 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+// Checks texcoord quantization, over [0, 1] and with --uv-bounds. With
+// models as arguments, also prints the largest texcoord error of each,
+// both ways.
+
+#include <math.h>
+#include <stdio.h>
+
+#include "../base.h"
+#include "../decode.h"
+#include "../mesh.h"
+
+// How far value decodes from itself, in column, up to whole tiles, which
+// REPEAT wrapping ignores.
+float TileError(const BoundsParams& params, size_t column,
+                float value) {
+  const uint16 q = Quantize(value, params.mins[column], params.scales[column],
+                            params.outputMaxes[column]);
+  const float decoded =
+      params.decodeScales[column] * (q + params.decodeOffsets[column]);
+  const float error = decoded - value;
+  return fabsf(error - floorf(error + 0.5f));
+}
+
+// The largest TileError of the texcoords of mesh.
+float MaxTexcoordError(const BoundsParams& params, const DrawMesh& mesh) {
+  const size_t stride = mesh.layout.stride();
+  const size_t texcoord = mesh.layout.offset(kTexcoordAttrib);
+  float max_error = 0;
+  for (size_t i = 0; i < mesh.attribs.size(); i += stride) {
+    for (size_t j = texcoord; j < texcoord + 2; ++j) {
+      max_error = std::max(max_error,
+                           TileError(params, j, mesh.attribs[i + j]));
+    }
+  }
+  return max_error;
+}
+
+void TestQuantizeClamps() {
+  CHECK(Quantize(0.5f, 0, 1, 1023) == 511);
+  CHECK(Quantize(1, 0, 1, 1023) == 1023);
+  CHECK(Quantize(-0.25f, 0, 1, 1023) == 0);
+  CHECK(Quantize(-1e30f, 0, 1, 1023) == 0);
+  CHECK(Quantize(1.25f, 0, 1, 1023) == 1023);
+  CHECK(Quantize(70000, 0, 1, 0xFFFF) == 0xFFFF);
+  CHECK(Quantize(nanf(""), 0, 1, 1023) == 0);
+}
+
+// A batch tiled over [5.25, 7.5] x [-3, -2.5].
+void TestTiled() {
+  DrawMesh mesh;
+  const size_t kVertices = 1000;
+  for (size_t v = 0; v < kVertices; ++v) {
+    const float t = static_cast<float>(v) / (kVertices - 1);
+    const float vertex[8] = { t, 0, 0, 5.25f + 2.25f * t, -3 + 0.5f * t,
+                              0, 0, 1 };
+    mesh.attribs.insert(mesh.attribs.end(), vertex, vertex + 8);
+  }
+  Bounds bounds;
+  bounds.Clear();
+  bounds.Enclose(mesh.attribs, 8);
+  const BoundsParams unit = BoundsParams::FromBounds(bounds);
+  const BoundsParams tiled = unit.WithTexcoordBounds(bounds);
+  // Positions and normals are unchanged.
+  for (size_t j = 0; j < 8; ++j) {
+    if (j == 3 || j == 4) continue;
+    CHECK(tiled.mins[j] == unit.mins[j]);
+    CHECK(tiled.decodeOffsets[j] == unit.decodeOffsets[j]);
+  }
+  // U spans 3 tiles, so it gets more steps; V's steps are finer.
+  CHECK(tiled.outputMaxes[3] > unit.outputMaxes[3]);
+  CHECK(tiled.decodeScales[3] <= 1.0f / 1023);
+  CHECK(tiled.decodeScales[4] < 1.0f / 1023);
+  // Decoded values start in the first tile, [0, 1).
+  CHECK(tiled.decodeOffsets[3] * tiled.decodeScales[3] >= 0);
+  CHECK(tiled.decodeOffsets[3] * tiled.decodeScales[3] < 1);
+  const float step = std::max(tiled.decodeScales[3], tiled.decodeScales[4]);
+  const float tiled_error = MaxTexcoordError(tiled, mesh);
+  const float unit_error = MaxTexcoordError(unit, mesh);
+  CHECK(tiled_error <= step * 1.01f);
+  CHECK(unit_error > 0.1f);
+}
+
+// Texcoords already in [0, 1] are no worse off, and a batch without
+// texcoords (empty bounds) keeps the unit params.
+void TestUnit() {
+  const float vertices[2][8] = {
+    { 0, 0, 0, 0, 0.125f, 0, 0, 1 },
+    { 1, 1, 1, 1, 0.25f, 0, 0, 1 },
+  };
+  Bounds empty_bounds;
+  empty_bounds.Clear();
+  Bounds bounds = empty_bounds;
+  bounds.EncloseAttrib(vertices[0], 8);
+  bounds.EncloseAttrib(vertices[1], 8);
+  const BoundsParams unit = BoundsParams::FromBounds(bounds);
+  const BoundsParams empty = unit.WithTexcoordBounds(empty_bounds);
+  CHECK(empty.outputMaxes[3] == unit.outputMaxes[3]);
+  CHECK(empty.decodeScales[4] == unit.decodeScales[4]);
+  const BoundsParams params = unit.WithTexcoordBounds(bounds);
+  CHECK(params.decodeScales[3] <= unit.decodeScales[3]);
+  CHECK(params.decodeScales[4] < unit.decodeScales[4]);
+  for (size_t k = 0; k <= 100; ++k) {
+    const float u = k / 100.0f;
+    const float v = 0.125f + 0.125f * u;
+    CHECK(TileError(params, 3, u) <= params.decodeScales[3] * 1.01f);
+    CHECK(TileError(params, 4, v) <= params.decodeScales[4] * 1.01f);
+  }
+}
+
+// A batch 60 tiles wide, jumping end to end, encodes to UTF-8 and
+// decodes the way loader.js does, summing deltas without wrapping.
+void TestWide() {
+  DrawMesh mesh;
+  const size_t kVertices = 1000;
+  for (size_t v = 0; v < kVertices; ++v) {
+    const float t = static_cast<float>(v) / (kVertices - 1);
+    const float u = v % 2 ? 60.5f - t : 0.5f + t;
+    const float vertex[8] = { t, 0, 0, u, 31.0f * t, 0, 0, 1 };
+    mesh.attribs.insert(mesh.attribs.end(), vertex, vertex + 8);
+  }
+  Bounds bounds;
+  bounds.Clear();
+  bounds.Enclose(mesh.attribs, 8);
+  const BoundsParams params =
+      BoundsParams::FromBounds(bounds).WithTexcoordBounds(bounds);
+  CHECK(params.outputMaxes[3] < (1 << 14));
+  CHECK(params.outputMaxes[4] < (1 << 14));
+  QuantizedAttribList quantized;
+  AttribsToQuantizedAttribs(mesh.attribs, params, &quantized);
+  std::vector<char> utf8;
+  CompressQuantizedAttribsToUtf8(quantized, 8, &utf8);
+  std::vector<uint32> codes;
+  CHECK(Utf8ToCodes(&utf8[0], utf8.size(), &codes) == utf8.size());
+  CHECK(codes.size() == quantized.size());
+  for (size_t j = 3; j < 5; ++j) {
+    int prev = 0;
+    for (size_t v = 0; v < kVertices; ++v) {
+      const uint32 code = codes[j * kVertices + v];
+      prev += (code >> 1) ^ -static_cast<int>(code & 1);
+      CHECK(prev == quantized[8 * v + j]);
+      const float decoded = params.tiles[j] +
+          params.decodeScales[j] * (prev + params.decodeOffsets[j]);
+      CHECK(fabsf(decoded - mesh.attribs[8 * v + j]) <=
+            params.decodeScales[j] * 1.01f);
+    }
+  }
+}
+
+void ReportModel(const char* filename) {
+  FILE* fp = fopen(filename, "r");
+  CHECK(fp != NULL);
+  const WavefrontObjFile obj(fp);
+  fclose(fp);
+  const MaterialBatches& batches = obj.material_batches();
+  Bounds bounds;
+  bounds.Clear();
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    const DrawMesh& mesh = iter->second.draw_mesh();
+    bounds.Enclose(mesh.attribs, mesh.layout.stride());
+  }
+  const BoundsParams unit = BoundsParams::FromBounds(bounds, obj.layout());
+  float unit_error = 0;
+  float batch_error = 0;
+  for (MaterialBatches::const_iterator iter = batches.begin();
+       iter != batches.end(); ++iter) {
+    const DrawMesh& mesh = iter->second.draw_mesh();
+    Bounds batch_bounds;
+    batch_bounds.Clear();
+    batch_bounds.Enclose(mesh.attribs, mesh.layout.stride());
+    unit_error = std::max(unit_error, MaxTexcoordError(unit, mesh));
+    batch_error = std::max(
+        batch_error,
+        MaxTexcoordError(unit.WithTexcoordBounds(batch_bounds), mesh));
+  }
+  printf("%s: u, v in [%g, %g] x [%g, %g]; max error %g over [0, 1], "
+         "%g with --uv-bounds\n", StripLeadingDir(filename),
+         bounds.mins[3], bounds.maxes[3], bounds.mins[4], bounds.maxes[4],
+         unit_error, batch_error);
+}
+
+int main(int argc, char* argv[]) {
+  TestQuantizeClamps();
+  TestTiled();
+  TestUnit();
+  TestWide();
+  for (int i = 1; i < argc; ++i) {
+    ReportModel(argv[i]);
+  }
+  return 0;
+}
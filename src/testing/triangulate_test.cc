@@ -0,0 +1,142 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <math.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "../base.h"
+#include "../mesh.h"
+#include "../triangulate.h"
+
+// Twice the signed area of a polygon of 2-D points.
+double Area(const double* points, const int* indices, size_t num_indices) {
+  double area = 0;
+  for (size_t i = 0; i < num_indices; ++i) {
+    const double* a = &points[2 * indices[i]];
+    const double* b = &points[2 * indices[(i + 1) % num_indices]];
+    area += a[0] * b[1] - a[1] * b[0];
+  }
+  return area;
+}
+
+// Triangulates a counterclockwise polygon of 2-D points, after
+// placing it in a tilted plane (and reversing it, if clockwise), and
+// checks that the triangles keep its winding and tile its area, which
+// they can't if any of them is outside it.
+void CheckTriangulation(const double* points, size_t num_points,
+                        bool clockwise) {
+  std::vector<float> points3;
+  std::vector<int> order;
+  for (size_t i = 0; i < num_points; ++i) {
+    const size_t j = clockwise ? num_points - 1 - i : i;
+    const double x = points[2 * j], y = points[2 * j + 1];
+    points3.push_back(x + 0.5 * y);
+    points3.push_back(-0.25 * x + y);
+    points3.push_back(0.75 * x - 0.5 * y);
+    order.push_back(j);
+  }
+  static PolygonTriangulator triangulator;
+  const std::vector<int>& triangles =
+      triangulator.Triangulate(&points3[0], num_points);
+  CHECK(triangles.size() == 3 * (num_points - 2));
+  std::vector<int> all(num_points);
+  for (size_t i = 0; i < num_points; ++i) all[i] = i;
+  const double area = Area(points, &all[0], num_points);
+  double sum = 0;
+  for (size_t i = 0; i < triangles.size(); i += 3) {
+    int triangle[3];
+    for (size_t k = 0; k < 3; ++k) {
+      CHECK(triangles[i + k] >= 0 &&
+            triangles[i + k] < static_cast<int>(num_points));
+      triangle[k] = order[triangles[i + k]];
+    }
+    const double triangle_area = Area(points, triangle, 3);
+    CHECK(clockwise ? triangle_area <= 0 : triangle_area >= 0);
+    sum += fabs(triangle_area);
+  }
+  CHECK(fabs(sum - area) < 1e-9 * area);
+}
+
+void TestConcave() {
+  // An L.
+  const double kL[] = { 0, 0, 2, 0, 2, 1, 1, 1, 1, 2, 0, 2 };
+  // A five pointed star, starting at a reflex vertex.
+  double star[20];
+  for (size_t i = 0; i < 10; ++i) {
+    const double radius = (i % 2) ? 1 : 0.4;
+    const double angle = (i + 1) * M_PI / 5;
+    star[2 * i] = radius * cos(angle);
+    star[2 * i + 1] = radius * sin(angle);
+  }
+  // A comb with four teeth, with collinear points along its back.
+  const double kComb[] = {
+    0, 0, 1, 0, 2, 0, 3, 0, 4, 0, 5, 0, 6, 0, 7, 0,
+    7, 3, 6, 3, 6, 1, 5, 1, 5, 3, 4, 3, 4, 1, 3, 1,
+    3, 3, 2, 3, 2, 1, 1, 1, 1, 3, 0, 3
+  };
+  for (size_t clockwise = 0; clockwise < 2; ++clockwise) {
+    CheckTriangulation(kL, 6, clockwise);
+    CheckTriangulation(star, 10, clockwise);
+    CheckTriangulation(kComb, sizeof(kComb) / sizeof(kComb[0]) / 2,
+                       clockwise);
+  }
+}
+
+// A polygon with all its points in one place still gets n - 2
+// triangles.
+void TestDegenerate() {
+  const float kPoints[15] = { 0 };
+  PolygonTriangulator triangulator;
+  CHECK(triangulator.Triangulate(kPoints, 5).size() == 9);
+}
+
+// A concave hexagon, the same as a comb with one tooth, whose fan from
+// the first corner would cover the notch.
+const char kObj[] =
+    "v 0 0 0\nv 3 0 0\nv 3 2 0\nv 2 2 0\nv 2 1 0\nv 1 1 0\nv 1 2 0\n"
+    "v 0 2 0\n"
+    "f 5 6 7 8 1 2 3 4\n"
+    "f 1 2 3\n";
+
+void TestObj() {
+  FILE* fp = tmpfile();
+  fputs(kObj, fp);
+  rewind(fp);
+  const WavefrontObjFile obj(fp);
+  fclose(fp);
+  const DrawMesh& mesh = obj.material_batches().find("")->second.draw_mesh();
+  CHECK(mesh.indices.size() == 3 * 7);
+  for (size_t i = 0; i < mesh.indices.size(); i += 3) {
+    float area = 0;
+    for (size_t k = 0; k < 3; ++k) {
+      const float* a = &mesh.attribs[8 * mesh.indices[i + k]];
+      const float* b = &mesh.attribs[8 * mesh.indices[i + (k + 1) % 3]];
+      area += a[0] * b[1] - a[1] * b[0];
+    }
+    CHECK(area > 0);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  TestConcave();
+  TestDegenerate();
+  TestObj();
+  return 0;
+}
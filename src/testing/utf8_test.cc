@@ -0,0 +1,140 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <vector>
+
+#include "../base.h"
+#include "../mesh.h"
+#include "../utf8.h"
+
+// What String.charCodeAt sees, for the characters Uint16ToUtf8 writes.
+void Utf8ToCodes(const std::vector<char>& utf8, std::vector<uint32>* codes) {
+  codes->clear();
+  for (size_t i = 0; i < utf8.size(); ) {
+    const unsigned char lead = utf8[i];
+    uint32 code;
+    size_t length;
+    if (lead < 0x80) {
+      code = lead;
+      length = 1;
+    } else if (lead < 0xE0) {
+      code = lead & 0x1F;
+      length = 2;
+    } else {
+      code = lead & 0x0F;
+      length = 3;
+    }
+    for (size_t j = 1; j < length; ++j) {
+      code = (code << 6) | (utf8[i + j] & kUtf8MoreBytesMask);
+    }
+    codes->push_back(code);
+    i += length;
+  }
+}
+
+// Mirrors decompressVarint_ in samples/loader.js.
+uint32 DecodeVarint(const std::vector<uint32>& codes, size_t* pos) {
+  uint32 value = 0;
+  uint32 shift = 0;
+  for (;;) {
+    const uint32 code = codes[(*pos)++];
+    if (code < kVarintMoreCodes) {
+      return value | (code << shift);
+    }
+    value |= (code - kVarintMoreCodes) << shift;
+    shift += kVarintGroupBits;
+  }
+}
+
+void TestUint16ToUtf8() {
+  const uint16 kWords[] = { 0, 0x7F, 0x80, 0x7FF, 0x800, 0xD7FF };
+  std::vector<char> utf8;
+  for (size_t i = 0; i < sizeof(kWords) / sizeof(kWords[0]); ++i) {
+    CHECK(Uint16ToUtf8(kWords[i], &utf8));
+  }
+  std::vector<uint32> codes;
+  Utf8ToCodes(utf8, &codes);
+  CHECK(codes.size() == sizeof(kWords) / sizeof(kWords[0]));
+  for (size_t i = 0; i < codes.size(); ++i) {
+    CHECK(kWords[i] == codes[i]);
+  }
+  CHECK(!Uint16ToUtf8(0xF800, &utf8));
+}
+
+void TestVarint() {
+  const uint32 kValues[] = {
+    0, 1, 0x7FFF, 0x8000, 0x3FFF, 0x4000, 0xD800, 0xFFFF, 0x10000,
+    0x1FFFFFF, 0x7FFFFFFF, 0xFFFFFFFF
+  };
+  const size_t kNumValues = sizeof(kValues) / sizeof(kValues[0]);
+  std::vector<char> utf8;
+  size_t num_codes = 0;
+  for (size_t i = 0; i < kNumValues; ++i) {
+    num_codes += Uint32ToUtf8Varint(kValues[i], &utf8);
+  }
+  std::vector<uint32> codes;
+  Utf8ToCodes(utf8, &codes);
+  CHECK(num_codes == codes.size());
+  size_t pos = 0;
+  for (size_t i = 0; i < kNumValues; ++i) {
+    // Codes never reach the surrogate range, so need no unshifting.
+    CHECK(codes[pos] < 0xD800);
+    CHECK(kValues[i] == DecodeVarint(codes, &pos));
+  }
+  CHECK(pos == codes.size());
+  // Small values cost what they did before.
+  utf8.clear();
+  CHECK(1 == Uint32ToUtf8Varint(0x7FFF, &utf8));
+  CHECK(2 == Uint32ToUtf8Varint(0x8000, &utf8));
+}
+
+void TestWideIndices() {
+  // A strip over more vertices than fit in 16 bits, with some
+  // references far behind the high water mark.
+  OptimizedIndexList indices;
+  const uint32 kNumVertices = 100000;
+  for (uint32 i = 0; i + 2 < kNumVertices; ++i) {
+    indices.push_back(i);
+    indices.push_back(i + 1);
+    indices.push_back(i + 2);
+  }
+  indices.push_back(0);
+  indices.push_back(kNumVertices / 2);
+  indices.push_back(kNumVertices - 1);
+  std::vector<char> utf8;
+  const size_t num_codes = CompressIndicesToUtf8Varint(indices, &utf8);
+  std::vector<uint32> codes;
+  Utf8ToCodes(utf8, &codes);
+  CHECK(num_codes == codes.size());
+  size_t pos = 0;
+  uint32 highest = 0;
+  for (size_t i = 0; i < indices.size(); ++i) {
+    const uint32 delta = DecodeVarint(codes, &pos);
+    CHECK(indices[i] == highest - delta);
+    if (delta == 0) ++highest;
+  }
+  CHECK(pos == codes.size());
+  CHECK(highest == kNumVertices);
+}
+
+int main(int argc, char* argv[]) {
+  TestUint16ToUtf8();
+  TestVarint();
+  TestWideIndices();
+  return 0;
+}
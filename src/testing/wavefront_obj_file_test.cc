@@ -1,5 +1,5 @@
 #if 0  // A cute trick to making this .cc self-building from shell.
-g++ $0 -Wall -Werror -o `basename $0 .cc`;
+g++ $0 -Wall -Werror -pthread -o `basename $0 .cc`;
 exit;
 #endif
 // Copyright 2011 Google Inc. All Rights Reserved.
@@ -16,12 +16,19 @@ exit;
 // implied. See the License for the specific language governing
 // permissions and limitations under the License.
 
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 #define private public
 
 #include "../base.h"
 #include "../mesh.h"
+#include "../parallel.h"
 
 #define CHECK_INDICES(POSITION_INDEX, TEXCOORD_INDEX, NORMAL_INDEX) \
   CHECK(POSITION_INDEX == position_index_);                         \
@@ -75,8 +82,197 @@ class ParseIndicesTester {
   WavefrontObjFile obj_;
 };
 
+// Random triples, some with absent texcoords or normals, many
+// repeated, numbered as IndexFlattener numbers them.
+void TestFlattenIndicesBulk() {
+  const size_t kThreads[] = { 1, 4 };
+  for (size_t t = 0; t < sizeof(kThreads) / sizeof(kThreads[0]); ++t) {
+    NumThreads() = kThreads[t];
+    srand(17);
+    std::vector<int> corners;
+    for (size_t i = 0; i < 100000; ++i) {
+      corners.push_back(rand() % 5000);
+      corners.push_back(rand() % 4 - 1);
+      corners.push_back(rand() % 3 ? rand() % 2 : -1);
+    }
+    std::vector<int> flat_indices;
+    std::vector<uint32> first_corners;
+    const size_t count = FlattenIndicesBulk(corners, &flat_indices,
+                                            &first_corners);
+    IndexFlattener flattener(0);
+    std::vector<uint32> expected_first_corners;
+    for (size_t c = 0; c < corners.size() / 3; ++c) {
+      const std::pair<int, bool> flattened = flattener.GetFlattenedIndex(
+          corners[3 * c + 0], corners[3 * c + 1], corners[3 * c + 2]);
+      CHECK(flat_indices[c] == flattened.first);
+      if (flattened.second) expected_first_corners.push_back(c);
+    }
+    CHECK(count == static_cast<size_t>(flattener.count()));
+    CHECK(first_corners == expected_first_corners);
+  }
+}
+
+// Two groups, a texture seam, and faces without texcoords or normals.
+const char kObj[] =
+    "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\nv 2 0 1\n"
+    "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\nvt 0.5 0.5\n"
+    "vn 0 0 1\nvn 0 1 0\n"
+    "g first\n"
+    "f 1/1/1 2/2/1 3/3/1 4/4/1\n"
+    "f 2/5/1 5/1/1 3/3/1\n"
+    "g second\n"
+    "f 5//2 3//2 2//2\n"
+    "f 1 2 4\n"
+    "f 3/3/1 2/2/1 5/1/1\n";
+
+void CheckSameBatch(const DrawBatch& expected, const DrawBatch& actual) {
+  CHECK(actual.draw_mesh().indices == expected.draw_mesh().indices);
+  CHECK(actual.draw_mesh().attribs == expected.draw_mesh().attribs);
+  CHECK(actual.position_indices() == expected.position_indices());
+  CHECK(actual.group_starts().size() == expected.group_starts().size());
+  for (size_t i = 0; i < expected.group_starts().size(); ++i) {
+    const GroupStart& a = actual.group_starts()[i];
+    const GroupStart& e = expected.group_starts()[i];
+    CHECK(a.offset == e.offset && a.group_line == e.group_line);
+    CHECK(a.min_index == e.min_index && a.max_index == e.max_index);
+    CHECK(0 == memcmp(&a.bounds, &e.bounds, sizeof(Bounds)));
+  }
+}
+
+// Bulk flattening, and incremental flattening deferred for welding,
+// match flattening while parsing.
+void TestFlattenModes() {
+  FILE* fp = tmpfile();
+  fputs(kObj, fp);
+  rewind(fp);
+  const WavefrontObjFile incremental(fp, kFlattenIncremental);
+  rewind(fp);
+  const WavefrontObjFile bulk(fp, kFlattenBulk);
+  rewind(fp);
+  const WavefrontObjFile welded(fp, kFlattenIncremental, 0);
+  rewind(fp);
+  const WavefrontObjFile bulk_welded(fp, kFlattenBulk, 0);
+  fclose(fp);
+  const DrawBatch& expected = incremental.material_batches().find("")->second;
+  CHECK(expected.draw_mesh().indices.size() == 18);
+  CHECK(expected.draw_mesh().attribs.size() == 8 * 12);
+  CHECK(expected.group_starts().size() == 2);
+  CheckSameBatch(expected, bulk.material_batches().find("")->second);
+  CheckSameBatch(expected, welded.material_batches().find("")->second);
+  CheckSameBatch(expected, bulk_welded.material_batches().find("")->second);
+}
+
+// Colors follow their positions through flattening and welding; 8-bit
+// ones are scaled to [0, 1], and positions without one are white.
+void TestColors() {
+  const char kColorObj[] =
+    "v 0 0 0\n"
+    "v 1 0 0 255 0 0\n"
+    "v 1 1 0 0 255 0\n"
+    "v 1 0 0 0 0 255\n"
+    "vt 0 0\nvt 1 0\n"
+    "f 1 2 3\n"
+    "f 1/1 2/1 3/2\n"
+    "f 1 4 3\n";
+  for (int weld = 0; weld < 2; ++weld) {
+    FILE* fp = tmpfile();
+    fputs(kColorObj, fp);
+    rewind(fp);
+    const WavefrontObjFile obj(fp, kFlattenIncremental, weld ? 1 : -1);
+    fclose(fp);
+    const VertexLayout layout = obj.layout();
+    CHECK(layout.has(kColorAttrib));
+    CHECK(layout.stride() == 11);
+    const DrawMesh& mesh = obj.material_batches().find("")->second.draw_mesh();
+    CHECK(mesh.layout == layout);
+    // Positions 2 and 4 only differ by color, so they don't weld.
+    CHECK(mesh.attribs.size() == layout.stride() * 7);
+    const float kColors[][3] = {
+      { 1, 1, 1 }, { 1, 0, 0 }, { 0, 1, 0 }, { 0, 0, 1 }
+    };
+    const int kPositions[] = { 0, 1, 2, 0, 1, 2, 0, 3, 2 };
+    CHECK(mesh.indices.size() == 9);
+    for (size_t i = 0; i < mesh.indices.size(); ++i) {
+      const float* vertex = &mesh.attribs[layout.stride() * mesh.indices[i]];
+      const int position = kPositions[i];
+      CHECK(std::equal(kColors[position], kColors[position] + 3,
+                       vertex + layout.offset(kColorAttrib)));
+    }
+  }
+
+  // Without colors, the layout is the usual one.
+  FILE* fp = tmpfile();
+  fputs(kObj, fp);
+  rewind(fp);
+  const WavefrontObjFile obj(fp);
+  fclose(fp);
+  CHECK(obj.layout() == VertexLayout());
+  CHECK(obj.material_batches().find("")->second.draw_mesh().layout ==
+        VertexLayout());
+}
+
+void TestCanonicalPath() {
+  CHECK(CanonicalPath("a.ppm") == "a.ppm");
+  CHECK(CanonicalPath("./tex//a.ppm") == "tex/a.ppm");
+  CHECK(CanonicalPath("tex\\b\\..\\a.ppm") == "tex/a.ppm");
+  CHECK(CanonicalPath("../../tex/a.ppm") == "../../tex/a.ppm");
+  CHECK(CanonicalPath("tex/../../a.ppm") == "../a.ppm");
+  CHECK(CanonicalPath("/tex/./a.ppm") == "/tex/a.ppm");
+}
+
+// Materials b and d look like a and c, whose batches they join; e
+// looks like nothing else.
+void TestMergeMaterials() {
+  char mtl_fn[] = "/tmp/wavefront_obj_file_testXXXXXX";
+  const int fd = mkstemp(mtl_fn);
+  CHECK(fd >= 0);
+  FILE* mtl = fdopen(fd, "w");
+  fputs("newmtl A\nKd 1 0 0\n"
+        "newmtl B\nKd 1 0.001 0\n"
+        "newmtl C\nKd 1 0 0\nmap_Kd tex/./a.ppm\n"
+        "newmtl D\nKd 0 0 1\nmap_Kd tex\\b\\..\\a.ppm\n"
+        "newmtl E\nKd 0 1 0\n", mtl);
+  fclose(mtl);
+  const std::string obj_text = "mtllib " + std::string(mtl_fn) + "\n"
+      "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+      "usemtl A\nf 1 2 3\nusemtl B\nf 1 3 4\n"
+      "usemtl C\nf 1 2 3\nusemtl D\nf 1 2 4\n"
+      "usemtl E\nf 1 2 3\n";
+  for (int merge = 0; merge < 2; ++merge) {
+    FILE* fp = tmpfile();
+    fputs(obj_text.c_str(), fp);
+    rewind(fp);
+    const WavefrontObjFile obj(fp, kFlattenIncremental, -1, -1, merge);
+    fclose(fp);
+    const MaterialBatches& batches = obj.material_batches();
+    if (!merge) {
+      CHECK(obj.materials().size() == 5);
+      CHECK(batches.size() == 6);
+      CHECK(batches.find("b")->second.draw_mesh().indices.size() == 3);
+      continue;
+    }
+    CHECK(obj.materials().size() == 3);
+    CHECK(obj.materials()[1].map_Kd == "tex/a.ppm");
+    CHECK(batches.size() == 4);
+    CHECK(batches.find("b") == batches.end());
+    CHECK(batches.find("d") == batches.end());
+    // The triangles of a and b share 2 vertices.
+    const DrawMesh& a = batches.find("a")->second.draw_mesh();
+    CHECK(a.indices.size() == 6);
+    CHECK(a.attribs.size() == 4 * a.layout.stride());
+    CHECK(batches.find("c")->second.draw_mesh().indices.size() == 6);
+    CHECK(batches.find("e")->second.draw_mesh().indices.size() == 3);
+  }
+  unlink(mtl_fn);
+}
+
 int main(int argc, char* argv[]) {
   ParseIndicesTester tester;
   tester.Test();
+  TestFlattenIndicesBulk();
+  TestFlattenModes();
+  TestColors();
+  TestCanonicalPath();
+  TestMergeMaterials();
   return 0;
 }
@@ -0,0 +1,109 @@
+#if 0  // A cute trick to making this .cc self-building from shell.
+g++ $0 -O2 -Wall -Werror -pthread -o `basename $0 .cc`;
+exit;
+#endif
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "../base.h"
+#include "../mesh.h"
+#include "../weld.h"
+
+float DistanceSquared(const AttribList& points, size_t a, size_t b) {
+  float distance_squared = 0;
+  for (size_t k = 0; k < 3; ++k) {
+    const float d = points[3 * a + k] - points[3 * b + k];
+    distance_squared += d * d;
+  }
+  return distance_squared;
+}
+
+// Clumps of points, some exactly repeated, checked against a brute
+// force search for the lowest unwelded point within epsilon.
+void TestWelder() {
+  srand(3);
+  AttribList points;
+  for (size_t i = 0; i < 2000; ++i) {
+    const size_t base = 3 * (rand() % (i + 1));
+    for (size_t k = 0; k < 3; ++k) {
+      if (i % 3 == 0 || points.empty()) {
+        points.push_back(rand() % 1000 + 0.5f);
+      } else if (i % 3 == 1) {
+        points.push_back(points[base + k]);
+      } else {
+        points.push_back(points[base + k] + (rand() % 100) / 25.0f - 2);
+      }
+    }
+  }
+  const float kEpsilons[] = { 0, 0.5f, 1, 3 };
+  for (size_t e = 0; e < sizeof(kEpsilons) / sizeof(kEpsilons[0]); ++e) {
+    const float epsilon = kEpsilons[e];
+    std::vector<int> remap;
+    const size_t num_welded = AttribWelder(points, 3, 1, epsilon).Weld(&remap);
+    CHECK(remap.size() == points.size() / 3);
+    size_t expected_welded = 0;
+    for (size_t i = 0; i < remap.size(); ++i) {
+      int expected = i;
+      for (size_t j = 0; j < i; ++j) {
+        if (remap[j] == static_cast<int>(j) &&
+            DistanceSquared(points, i, j) <= epsilon * epsilon) {
+          expected = j;
+          break;
+        }
+      }
+      CHECK(remap[i] == expected);
+      expected_welded += expected != static_cast<int>(i);
+    }
+    CHECK(num_welded == expected_welded);
+    CHECK(epsilon == 0 || num_welded > 600);
+  }
+}
+
+// Two quads that each have their own copy of the shared edge and the
+// normal, and a triangle with a position a fraction of a quantization
+// step away from one of them, which only welds at an epsilon of 1.
+const char kObj[] =
+    "v 0 0 0\nv 1 0 0\nv 1 1 0\nv 0 1 0\n"
+    "v 1 0 0\nv 1 1 0\nv 2 0 0\nv 2 1 0\n"
+    "v 1.00001 1 0\n"
+    "vn 0 0 1\nvn 0 0 1\n"
+    "f 1//1 2//1 3//1 4//1\n"
+    "f 5//2 7//2 8//2 6//2\n"
+    "f 9//2 4//2 3//2\n";
+
+void TestWeldObj() {
+  const float kEpsilons[] = { -1, 0, 1 };
+  const size_t kExpectedVertices[] = { 11, 7, 6 };
+  for (size_t e = 0; e < 3; ++e) {
+    FILE* fp = tmpfile();
+    fputs(kObj, fp);
+    rewind(fp);
+    const WavefrontObjFile obj(fp, kFlattenIncremental, kEpsilons[e]);
+    fclose(fp);
+    const DrawMesh& mesh = obj.material_batches().find("")->second.draw_mesh();
+    CHECK(mesh.indices.size() == 15);
+    CHECK(mesh.attribs.size() == 8 * kExpectedVertices[e]);
+  }
+}
+
+int main(int argc, char* argv[]) {
+  TestWelder();
+  TestWeldObj();
+  return 0;
+}
@@ -0,0 +1,135 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_TRIANGULATE_H_
+#define WEBGL_LOADER_TRIANGULATE_H_
+
+#include <math.h>
+
+#include <vector>
+
+#include "base.h"
+
+// Triangulates polygons by ear clipping, in the plane of their Newell
+// normal, so that concave faces don't get triangles outside them and
+// long faces don't turn into fans of slivers. Triangles keep the
+// polygon's winding. Buffers are kept from one polygon to the next,
+// so a triangulator per parser means faces don't allocate.
+class PolygonTriangulator {
+ public:
+  // Triangulates the polygon through num_points points (x, y, z
+  // each), and returns num_points - 2 triangles as 3 indices each
+  // into the points. Self-intersecting or degenerate polygons still
+  // get that many triangles, if not good ones.
+  const std::vector<int>& Triangulate(const float* points,
+                                      size_t num_points) {
+    triangles_.clear();
+    if (num_points < 3) return triangles_;
+    Project(points, num_points);
+    prev_.resize(num_points);
+    next_.resize(num_points);
+    for (size_t i = 0; i < num_points; ++i) {
+      prev_[i] = (i + num_points - 1) % num_points;
+      next_[i] = (i + 1) % num_points;
+    }
+    int v = 0;
+    // Vertices tried since the last ear was clipped.
+    size_t num_tried = 0;
+    for (size_t remaining = num_points; remaining > 3; ) {
+      if (num_tried == remaining || IsEar(v)) {
+        // When no ear is left, the polygon was not simple; clip anyway.
+        Clip(v);
+        v = next_[v];
+        --remaining;
+        num_tried = 0;
+      } else {
+        v = next_[v];
+        ++num_tried;
+      }
+    }
+    Clip(v);
+    return triangles_;
+  }
+
+ private:
+  // Drops the axis the normal is closest to, and mirrors the other
+  // two if needed, so the polygon is counterclockwise in 2-D.
+  void Project(const float* points, size_t num_points) {
+    double normal[3] = { 0, 0, 0 };
+    for (size_t i = 0; i < num_points; ++i) {
+      const float* a = &points[3 * i];
+      const float* b = &points[3 * ((i + 1) % num_points)];
+      normal[0] += (a[1] - b[1]) * (a[2] + b[2]);
+      normal[1] += (a[2] - b[2]) * (a[0] + b[0]);
+      normal[2] += (a[0] - b[0]) * (a[1] + b[1]);
+    }
+    size_t axis = 0;
+    for (size_t k = 1; k < 3; ++k) {
+      if (fabs(normal[k]) > fabs(normal[axis])) axis = k;
+    }
+    const size_t u = (axis + 1) % 3;
+    const size_t v = (axis + 2) % 3;
+    const double sign = normal[axis] < 0 ? -1 : 1;
+    projected_.resize(2 * num_points);
+    for (size_t i = 0; i < num_points; ++i) {
+      projected_[2 * i] = points[3 * i + u];
+      projected_[2 * i + 1] = sign * points[3 * i + v];
+    }
+  }
+
+  // Twice the signed area of triangle abc; positive if it turns left.
+  double Cross(int a, int b, int c) const {
+    const double* pa = &projected_[2 * a];
+    const double* pb = &projected_[2 * b];
+    const double* pc = &projected_[2 * c];
+    return (pb[0] - pa[0]) * (pc[1] - pa[1]) -
+        (pb[1] - pa[1]) * (pc[0] - pa[0]);
+  }
+
+  bool SamePoint(int a, int b) const {
+    return projected_[2 * a] == projected_[2 * b] &&
+        projected_[2 * a + 1] == projected_[2 * b + 1];
+  }
+
+  // v is an ear if it is convex and no other vertex is in the
+  // triangle it makes with its neighbors.
+  bool IsEar(int v) const {
+    const int a = prev_[v];
+    const int c = next_[v];
+    if (Cross(a, v, c) <= 0) return false;
+    for (int p = next_[c]; p != a; p = next_[p]) {
+      if (SamePoint(p, a) || SamePoint(p, v) || SamePoint(p, c)) continue;
+      if (Cross(a, v, p) >= 0 && Cross(v, c, p) >= 0 &&
+          Cross(c, a, p) >= 0) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  void Clip(int v) {
+    triangles_.push_back(prev_[v]);
+    triangles_.push_back(v);
+    triangles_.push_back(next_[v]);
+    next_[prev_[v]] = next_[v];
+    prev_[next_[v]] = prev_[v];
+  }
+
+  std::vector<double> projected_;  // 2-D points.
+  std::vector<int> prev_;  // The remaining polygon, as a linked list.
+  std::vector<int> next_;
+  std::vector<int> triangles_;
+};
+
+#endif  // WEBGL_LOADER_TRIANGULATE_H_
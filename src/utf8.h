@@ -49,4 +49,25 @@ bool Uint16ToUtf8(uint16 word, std::vector<char>* utf8) {
   return true;
 }
 
+// Variable-length codes for values that may not fit in a single
+// character. A value is split into 14-bit groups, least significant
+// first; every group but the last is written as a character in
+// [0x8000, 0xC000), and the last group (up to 15 bits) as a character
+// below 0x8000. Values below 0x8000 take a single character, as with
+// Uint16ToUtf8. Returns the number of characters written.
+const uint32 kVarintMoreCodes = 0x8000;
+const uint32 kVarintGroupBits = 14;
+const uint32 kVarintGroupMask = (1 << kVarintGroupBits) - 1;
+
+size_t Uint32ToUtf8Varint(uint32 value, std::vector<char>* utf8) {
+  size_t num_codes = 1;
+  while (value >= kVarintMoreCodes) {
+    Uint16ToUtf8(kVarintMoreCodes | (value & kVarintGroupMask), utf8);
+    value >>= kVarintGroupBits;
+    ++num_codes;
+  }
+  Uint16ToUtf8(value, utf8);
+  return num_codes;
+}
+
 #endif  // WEBGL_LOADER_UTF8_H_
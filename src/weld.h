@@ -0,0 +1,206 @@
+// Copyright 2011 Google Inc. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License"); you
+// may not use this file except in compliance with the License. You
+// may obtain a copy of the License at
+//
+// http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or
+// implied. See the License for the specific language governing
+// permissions and limitations under the License.
+
+#ifndef WEBGL_LOADER_WELD_H_
+#define WEBGL_LOADER_WELD_H_
+
+#include <float.h>
+#include <math.h>
+
+#include <vector>
+
+#include "base.h"
+#include "stats.h"
+
+// Welding merges attribute values that are closer than epsilon, so
+// that corners which only differ by duplicated positions, texcoords or
+// normals flatten to the same vertex. Distances are measured in the
+// quantized space each attribute is written in (see BoundsParams):
+// 14 bits over the model's extent for positions, and 10 bits over
+// [0, 1] for texcoords and [-1, 1] for normals. So an epsilon of 1 is
+// one quantization step, at any model scale.
+
+// Quantization steps per unit for positions, which are scaled
+// uniformly by their largest extent.
+float PositionWeldScale(const AttribList& positions) {
+  float mins[3] = { FLT_MAX, FLT_MAX, FLT_MAX };
+  float maxes[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+  for (size_t i = 0; i < positions.size(); ++i) {
+    if (positions[i] < mins[i % 3]) mins[i % 3] = positions[i];
+    if (positions[i] > maxes[i % 3]) maxes[i % 3] = positions[i];
+  }
+  float extent = 0;
+  for (size_t k = 0; k < 3; ++k) {
+    if (maxes[k] - mins[k] > extent) extent = maxes[k] - mins[k];
+  }
+  return extent > 0 ? ((1 << 14) - 1) / extent : 0;
+}
+
+static const float kTexcoordWeldScale = (1 << 10) - 1;
+static const float kNormalWeldScale = 0.5f * ((1 << 10) - 1);
+
+// A hash grid over welded values, with cells at least epsilon wide,
+// so that any value within epsilon of a point is in one of the 27
+// cells around it.
+class AttribWelder {
+ public:
+  // attribs holds dim (at most 3) floats per value. Values with colors
+  // (3 per value, see ParsePosition) only weld if their 8-bit colors
+  // match.
+  AttribWelder(const AttribList& attribs, size_t dim, float scale,
+               float epsilon, const AttribList* colors = NULL)
+      : attribs_(attribs),
+        colors_(colors),
+        dim_(dim),
+        num_values_(attribs.size() / dim),
+        scale_(scale),
+        epsilon_squared_(epsilon * epsilon),
+        cell_size_(epsilon > 1 ? epsilon : 1),
+        next_(num_values_, static_cast<int>(kNone)) {
+    size_t table_size = 1;
+    while (table_size < 2 * num_values_) table_size *= 2;
+    cells_.assign(table_size, static_cast<uint64>(kEmptyCell));
+    heads_.assign(table_size, static_cast<int>(kNone));
+  }
+
+  // Maps every value index to the lowest one within epsilon of it,
+  // among those that were not welded themselves, and returns the
+  // number of values welded.
+  size_t Weld(std::vector<int>* remap) {
+    remap->resize(num_values_);
+    size_t num_welded = 0;
+    for (size_t i = 0; i < num_values_; ++i) {
+      float point[3];
+      Quantize(i, point);
+      int cell[3];
+      for (size_t k = 0; k < 3; ++k) {
+        cell[k] = static_cast<int>(floorf(point[k] / cell_size_));
+      }
+      int best = kNone;
+      for (int dx = -1; dx <= 1; ++dx) {
+        for (int dy = -1; dy <= 1; ++dy) {
+          for (int dz = -1; dz <= 1; ++dz) {
+            const size_t slot = Find(CellKey(cell[0] + dx, cell[1] + dy,
+                                             cell[2] + dz));
+            for (int j = heads_[slot]; j != kNone; j = next_[j]) {
+              if ((best == kNone || j < best) && Near(point, j) &&
+                  SameColor(i, j)) {
+                best = j;
+              }
+            }
+          }
+        }
+      }
+      if (best != kNone) {
+        (*remap)[i] = best;
+        ++num_welded;
+        continue;
+      }
+      (*remap)[i] = i;
+      const uint64 key = CellKey(cell[0], cell[1], cell[2]);
+      const size_t slot = Find(key);
+      cells_[slot] = key;
+      next_[i] = heads_[slot];
+      heads_[slot] = i;
+    }
+    return num_welded;
+  }
+
+ private:
+  static const int kNone = -1;
+  static const uint64 kEmptyCell = ~0ULL;
+
+  void Quantize(size_t index, float* point) const {
+    for (size_t k = 0; k < 3; ++k) {
+      point[k] = (k < dim_) ? attribs_[dim_ * index + k] * scale_ : 0;
+    }
+  }
+
+  bool Near(const float* point, size_t index) const {
+    float other[3];
+    Quantize(index, other);
+    float distance_squared = 0;
+    for (size_t k = 0; k < 3; ++k) {
+      distance_squared += (point[k] - other[k]) * (point[k] - other[k]);
+    }
+    return distance_squared <= epsilon_squared_;
+  }
+
+  bool SameColor(size_t a, size_t b) const {
+    if (!colors_) return true;
+    for (size_t k = 0; k < 3; ++k) {
+      if (::Quantize((*colors_)[3 * a + k], 0, 1, 255) !=
+          ::Quantize((*colors_)[3 * b + k], 0, 1, 255)) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // Far apart cells may share a key, which only costs distance tests.
+  static uint64 CellKey(int x, int y, int z) {
+    static const uint64 kMask = (1 << 21) - 1;
+    return ((static_cast<uint64>(x) & kMask) << 42) |
+        ((static_cast<uint64>(y) & kMask) << 21) |
+        (static_cast<uint64>(z) & kMask);
+  }
+
+  // The slot holding key, or the empty slot where it would go.
+  size_t Find(uint64 key) const {
+    const size_t mask = cells_.size() - 1;
+    size_t slot = ((key * 0x9E3779B97F4A7C15ULL) >> 32) & mask;
+    while (cells_[slot] != key && cells_[slot] != kEmptyCell) {
+      slot = (slot + 1) & mask;
+    }
+    return slot;
+  }
+
+  const AttribList& attribs_;
+  const AttribList* colors_;  // Or NULL.
+  size_t dim_;
+  size_t num_values_;
+  float scale_;
+  float epsilon_squared_;
+  float cell_size_;
+  std::vector<uint64> cells_;  // Open addressing, by CellKey.
+  std::vector<int> heads_;  // First unwelded value in each cell.
+  std::vector<int> next_;  // Next unwelded value in the same cell.
+};
+
+// The remapping of each attribute's indices, from AttribWelder.
+struct WeldMaps {
+  std::vector<int> positions;
+  std::vector<int> texcoords;
+  std::vector<int> normals;
+};
+
+// colors are per position, or empty.
+void WeldAttribs(const AttribList& positions, const AttribList& colors,
+                 const AttribList& texcoords, const AttribList& normals,
+                 float epsilon, WeldMaps* maps) {
+  ScopedTimer timer(Stats::kWeld);
+  Stats& stats = Stats::Get();
+  stats.Increment(Stats::kWeldedPositions,
+      AttribWelder(positions, 3, PositionWeldScale(positions), epsilon,
+                   colors.empty() ? NULL : &colors)
+          .Weld(&maps->positions));
+  stats.Increment(Stats::kWeldedTexcoords,
+      AttribWelder(texcoords, 2, kTexcoordWeldScale, epsilon)
+          .Weld(&maps->texcoords));
+  stats.Increment(Stats::kWeldedNormals,
+      AttribWelder(normals, 3, kNormalWeldScale, epsilon)
+          .Weld(&maps->normals));
+}
+
+#endif  // WEBGL_LOADER_WELD_H_